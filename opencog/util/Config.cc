@@ -32,6 +32,7 @@
 #include <cstdlib>
 
 #include <errno.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 // For backward compatibility as from boost 1.46 filesystem 3 is the default
@@ -45,6 +46,7 @@
 #include <boost/filesystem/operations.hpp>
 
 #include <boost/lexical_cast.hpp>
+#include <boost/lexical_cast/try_lexical_convert.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <opencog/util/platform.h>
@@ -64,6 +66,97 @@ static string strip(string const& str, char const *strip_chars = blank_chars)
 }
 
 
+config_value::config_value(const string& s)
+    : str(s), is_int(false), is_long(false), is_double(false),
+      is_bool(false), as_int(0), as_long(0), as_double(0.0), as_bool(false)
+{
+    is_int = boost::conversion::try_lexical_convert(s, as_int);
+    is_long = boost::conversion::try_lexical_convert(s, as_long);
+    is_double = boost::conversion::try_lexical_convert(s, as_double);
+    if (boost::iequals(s, "true")) is_bool = as_bool = true;
+    else if (boost::iequals(s, "false")) is_bool = true;
+}
+
+Config::cell::cell(const string& name)
+    : _name(name), _flags(0), _int(0), _long(0), _double(0.0), _bool(false)
+{
+}
+
+void Config::cell::store(const config_value* v)
+{
+    if (nullptr == v)
+    {
+        _flags.store(0, memory_order_release);
+        std::atomic_store(&_str, shared_ptr<const string>());
+        return;
+    }
+    unsigned f = PRESENT;
+    if (v->is_int) { _int.store(v->as_int, memory_order_relaxed); f |= INT; }
+    if (v->is_long) { _long.store(v->as_long, memory_order_relaxed); f |= LONG; }
+    if (v->is_double) { _double.store(v->as_double, memory_order_relaxed); f |= DOUBLE; }
+    if (v->is_bool) { _bool.store(v->as_bool, memory_order_relaxed); f |= BOOL; }
+    std::atomic_store(&_str, make_shared<const string>(v->str));
+    _flags.store(f, memory_order_release);
+}
+
+bool Config::cell::is_set() const
+{
+    return _flags.load(memory_order_acquire) & PRESENT;
+}
+
+// Return the flags for a read of the type, or 0 if the parameter is
+// not set.
+unsigned Config::cell::flags(unsigned type) const
+{
+    unsigned f = _flags.load(memory_order_acquire);
+    if (not (f & PRESENT)) return 0;
+    if (not (f & type))
+    {
+        const char* tname =
+            INT == type ? "integer" : LONG == type ? "long integer" :
+            DOUBLE == type ? "double" : "bool";
+        throw InvalidParamException(TRACE_INFO,
+               "[ERROR] invalid %s parameter (%s)", tname, _name.c_str());
+    }
+    return f;
+}
+
+bool Config::cell::read(int& v) const
+{
+    if (not flags(INT)) return false;
+    v = _int.load(memory_order_relaxed);
+    return true;
+}
+
+bool Config::cell::read(long& v) const
+{
+    if (not flags(LONG)) return false;
+    v = _long.load(memory_order_relaxed);
+    return true;
+}
+
+bool Config::cell::read(double& v) const
+{
+    if (not flags(DOUBLE)) return false;
+    v = _double.load(memory_order_relaxed);
+    return true;
+}
+
+bool Config::cell::read(bool& v) const
+{
+    if (not flags(BOOL)) return false;
+    v = _bool.load(memory_order_relaxed);
+    return true;
+}
+
+bool Config::cell::read(string& v) const
+{
+    shared_ptr<const string> s = std::atomic_load(&_str);
+    if (not s) return false;
+    v = *s;
+    return true;
+}
+
 Config* Config::createInstance()
 {
     return new Config();
@@ -71,20 +164,82 @@ Config* Config::createInstance()
 
 Config::~Config()
 {
+    unwatch();
 }
 
-Config::Config()
+Config::Config() : _defer_publish(false), _watching(false)
 {
     reset();
 }
 
 void Config::reset()
 {
+    lock_guard<recursive_mutex> lock(_write_mtx);
     _table.clear();
     _no_config_loaded = true;
     _had_to_search = true;
     _abs_path = "";
     _cfg_filename = "";
+    publish();
+}
+
+void Config::publish()
+{
+    if (_defer_publish) return;
+
+    auto snap = make_shared<snapshot_map>();
+    for (const auto& kv : _table)
+        snap->emplace(kv.first, config_value(kv.second));
+
+    shared_ptr<const snapshot_map> old;
+    {
+        lock_guard<mutex> lock(_publish_mtx);
+        old = std::atomic_exchange(&_snapshot,
+                                   shared_ptr<const snapshot_map>(snap));
+        for (const auto& kc : _cells)
+        {
+            auto it = snap->find(kc.first);
+            kc.second->store(it == snap->end() ? nullptr : &it->second);
+        }
+    }
+
+    // Both maps are sorted, so walk them side by side.
+    static const snapshot_map none;
+    const snapshot_map& before = old ? *old : none;
+    vector<string> diff;
+    auto o = before.cbegin(), n = snap->cbegin();
+    while (o != before.end() or n != snap->end())
+    {
+        if (n == snap->end() or (o != before.end() and o->first < n->first))
+            diff.push_back((o++)->first);
+        else if (o == before.end() or n->first < o->first)
+            diff.push_back((n++)->first);
+        else
+        {
+            if (o->second.str != n->second.str) diff.push_back(n->first);
+            ++o, ++n;
+        }
+    }
+    for (const string& key : diff) changed.emit(key);
+}
+
+shared_ptr<const Config::snapshot_map> Config::snapshot() const
+{
+    return std::atomic_load(&_snapshot);
+}
+
+const Config::cell& Config::resolve(const string& name)
+{
+    lock_guard<mutex> lock(_publish_mtx);
+    unique_ptr<cell>& c = _cells[name];
+    if (not c)
+    {
+        c.reset(new cell(name));
+        shared_ptr<const snapshot_map> snap = std::atomic_load(&_snapshot);
+        auto it = snap->find(name);
+        if (it != snap->end()) c->store(&it->second);
+    }
+    return *c;
 }
 
 static const char* DEFAULT_CONFIG_FILENAME = "opencog.conf";
@@ -159,13 +314,22 @@ void Config::check_for_file(std::ifstream& fin,
 // constructor
 void Config::load(const char* filename, bool resetFirst)
 {
+    lock_guard<recursive_mutex> lock(_write_mtx);
     if (NULL == filename or 0 == filename[0])
         filename = DEFAULT_CONFIG_FILENAME;
 
-    // Reset to default values
-    if (resetFirst) reset();
+    // Reset to default values. The snapshot is published once, when
+    // the file is read, so that readers never see the config empty.
+    if (resetFirst)
+    {
+        bool defer = _defer_publish;
+        _defer_publish = true;
+        reset();
+        _defer_publish = defer;
+    }
 
     _cfg_filename = filename;
+    _path_where_found.clear();
 
     ifstream fin;
 
@@ -201,6 +365,7 @@ void Config::load(const char* filename, bool resetFirst)
         for (auto& path : search_paths())
         logger().warn("Searched at %s\n", path.c_str());
 
+        publish();
         throw IOException(TRACE_INFO,
              "unable to open file \"%s\"", filename);
     }
@@ -267,6 +432,7 @@ void Config::load(const char* filename, bool resetFirst)
             logger().warn("Invalid config file entry at line %d in %s\n",
                   line_number, path_where_found().c_str());
 
+            publish();
             throw InvalidParamException(TRACE_INFO,
                   "[ERROR] invalid configuration entry (line %d)",
                   line_number);
@@ -282,6 +448,7 @@ void Config::load(const char* filename, bool resetFirst)
         }
     }
     fin.close();
+    publish();
 
     // Finish configuring the logger... The config file itself
     // contains the location of the log file. This is working around
@@ -295,6 +462,86 @@ void Config::load(const char* filename, bool resetFirst)
                   path_where_found().c_str());
 }
 
+bool Config::reload()
+{
+    lock_guard<recursive_mutex> lock(_write_mtx);
+    const string path = _path_where_found;
+    if (path.empty()) return false;
+
+    // Publish only once done, whether it worked or not, so that the
+    // readers and the slots of changed never see a half-loaded config.
+    map<string, string> table = _table;
+    bool no_config_loaded = _no_config_loaded;
+    bool ok = true;
+    _defer_publish = true;
+    try {
+        load(path.c_str(), true);
+    } catch (const StandardException& ex) {
+        logger().warn("Could not reload %s, keeping the current config: %s",
+                      path.c_str(), ex.get_message());
+        _table.swap(table);
+        _no_config_loaded = no_config_loaded;
+        _path_where_found = path;
+        ok = false;
+    }
+    _defer_publish = false;
+    publish();
+    return ok;
+}
+
+// What tells that a file changed: a different inode, for editors that
+// write a new file and rename it over the old one, or a different size
+// or modification time.
+static vector<long> file_stamp(const string& path)
+{
+    struct stat st;
+    if (0 != stat(path.c_str(), &st)) return {};
+    return {long(st.st_ino), long(st.st_size), long(st.st_mtim.tv_sec),
+            long(st.st_mtim.tv_nsec)};
+}
+
+void Config::watch(unsigned period_ms)
+{
+    unwatch();
+
+    // The file as it is now, so that any later change is caught, even
+    // before the thread starts.
+    string path;
+    {
+        lock_guard<recursive_mutex> lock(_write_mtx);
+        path = _path_where_found;
+    }
+    lock_guard<mutex> lock(_watch_mtx);
+    _watching = true;
+    _watcher = thread(&Config::watch_loop, this, path, file_stamp(path),
+                      period_ms);
+}
+
+void Config::unwatch()
+{
+    {
+        lock_guard<mutex> lock(_watch_mtx);
+        _watching = false;
+    }
+    _watch_cv.notify_all();
+    if (_watcher.joinable()) _watcher.join();
+}
+
+void Config::watch_loop(string path, vector<long> stamp, unsigned period_ms)
+{
+    unique_lock<mutex> lock(_watch_mtx);
+    while (not _watch_cv.wait_for(lock, chrono::milliseconds(period_ms),
+                                  [this]() { return not _watching; }))
+    {
+        vector<long> now = file_stamp(path);
+        if (now.empty() or now == stamp) continue;
+        stamp = now;
+        lock.unlock();
+        reload();
+        lock.lock();
+    }
+}
+
 void Config::setup_logger()
 {
     if (has("LOG_FILE"))
@@ -320,8 +567,10 @@ const bool Config::has(const string &name) const
 void Config::set(const std::string &parameter_name,
                  const std::string &parameter_value)
 {
+    lock_guard<recursive_mutex> lock(_write_mtx);
     _no_config_loaded = false;
     _table[parameter_name] = parameter_value;
+    publish();
 }
 
 const string& Config::get(const string& name, const string& dfl) const
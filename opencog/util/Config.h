@@ -25,22 +25,103 @@
 #ifndef _OPENCOG_CONFIG_H
 #define _OPENCOG_CONFIG_H
 
+#include <atomic>
+#include <condition_variable>
 #include <fstream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include <opencog/util/sigslot.h>
+
 namespace opencog
 {
 /** \addtogroup grp_cogutil
  *  @{
  */
 
+//! A parameter value, with its conversions to the other types done
+//! once, when it is set.
+struct config_value
+{
+    explicit config_value(const std::string&);
+
+    std::string str;
+    bool is_int, is_long, is_double, is_bool;
+    int as_int;
+    long as_long;
+    double as_double;
+    bool as_bool;
+};
+
 //! library-wide configuration; keys and values are strings
+/**
+ * The get methods look the key up, and convert the value, on every
+ * call, and are not safe against a concurrent set, load or reload,
+ * such as those of watch(). Code that
+ * reads a parameter often, or from many threads, should rather use a
+ * config_param (see below), or a snapshot().
+ */
 class Config
 {
+public:
+    typedef std::map<std::string, config_value> snapshot_map;
+
+    //! The published state of one parameter, read by config_param
+    /**
+     * Every change to the configuration stores the new value in the
+     * atomics below, the flags last, so that a reader that sees the
+     * flags sees a value at least as recent.
+     */
+    class cell
+    {
+        friend class Config;
+        enum { PRESENT = 1, INT = 2, LONG = 4, DOUBLE = 8, BOOL = 16 };
+
+        const std::string _name;
+        std::atomic<unsigned> _flags;
+        std::atomic<int> _int;
+        std::atomic<long> _long;
+        std::atomic<double> _double;
+        std::atomic<bool> _bool;
+        std::shared_ptr<const std::string> _str;
+
+        void store(const config_value*);
+        unsigned flags(unsigned type) const;
+
+    public:
+        explicit cell(const std::string& name);
+        const std::string& name() const { return _name; }
+        bool is_set() const;
+
+        //! Set v and return true if the parameter is set; throw
+        //! InvalidParamException if its value is not of that type.
+        bool read(int& v) const;
+        bool read(long& v) const;
+        bool read(double& v) const;
+        bool read(bool& v) const;
+        //! Unlike the others, takes a (short) lock, that of
+        //! std::atomic_load on a shared_ptr.
+        bool read(std::string& v) const;
+    };
+
 protected:
     std::map<std::string, std::string> _table;
+    std::shared_ptr<const snapshot_map> _snapshot;
+    std::map<std::string, std::unique_ptr<cell>> _cells;
+    std::mutex _publish_mtx;
+    std::recursive_mutex _write_mtx;
+    bool _defer_publish;
+
+    std::thread _watcher;
+    std::mutex _watch_mtx;
+    std::condition_variable _watch_cv;
+    bool _watching;
+    void watch_loop(std::string path, std::vector<long> stamp,
+                    unsigned period_ms);
     bool _no_config_loaded;
     bool _had_to_search;
     std::string _path_where_found;
@@ -50,6 +131,11 @@ protected:
     void check_for_file(std::ifstream&, const char *, const char *);
     void setup_logger();
 
+    //! Publish _table, as a new snapshot and in the cells, and emit
+    //! changed for the keys that differ from the last snapshot. To be
+    //! called after every change to it, with _write_mtx held.
+    void publish();
+
 public:
     //! constructor
     ~Config();
@@ -65,6 +151,26 @@ public:
     //! Parse the indicated file for parameter values.
     void load(const char* config_file, bool resetFirst = true);
 
+    //! Load the file that was last loaded again, in place of the
+    //! current parameters. If it cannot be read or parsed, the
+    //! parameters are left as they were, and false is returned.
+    bool reload();
+
+    //! Check the last loaded file every period_ms milliseconds, on a
+    //! thread of its own, and reload() it when it is modified or
+    //! replaced. Calling it again changes the period.
+    void watch(unsigned period_ms = 1000);
+
+    //! Stop watching the file
+    void unwatch();
+
+    //! Emitted with the name of each parameter that a set, load,
+    //! reload or reset adds, removes or changes the value of, once
+    //! the new value is published; the slots may read it with
+    //! config_param or snapshot(). The slot is called on the thread
+    //! that made the change: for watch(), the watching thread.
+    SigSlot<const std::string&> changed;
+
     //! Location at which the config file was found.
     const std::string& path_where_found() const { return _path_where_found; }
 
@@ -99,6 +205,15 @@ public:
 
     //! Dump all configuration parameters to a string.
     std::string to_string() const;
+
+    //! The current parameters, immutable. A set, load or reset does
+    //! not change it, but publishes a new one; the old one lives on
+    //! until its last reader lets go of it.
+    std::shared_ptr<const snapshot_map> snapshot() const;
+
+    //! The cell of a parameter, set or not, created on first call.
+    //! It lives as long as the Config.
+    const cell& resolve(const std::string& parameter_name);
 };
 
 //! singleton instance (following meyer's design pattern)
@@ -111,6 +226,41 @@ typedef Config* ConfigFactory(void);
 Config& config(ConfigFactory* = Config::createInstance,
                bool overwrite = false);
 
+//! A typed handle on a parameter: the key is resolved once, at
+//! construction, and each read is a few atomic loads, without lock
+//! nor parsing, always up to date with the last set, load or reset.
+/**
+ * T is int, long, double, bool or std::string. A read throws
+ * InvalidParamException if the value is not of type T, as the get_
+ * methods of Config do. The handle must not outlive its Config (with
+ * config(), beware of overwrite).
+ *
+ * Example:
+ *
+ *     static config_param<int> max_steps("MAX_STEPS", 1000);
+ *     for (int i = 0; i < max_steps(); i++) ...
+ */
+template<typename T>
+class config_param
+{
+    const Config::cell* _cell;
+    T _dfl;
+
+public:
+    config_param(const std::string& name, T dfl = T(),
+                 Config& cfg = config())
+        : _cell(&cfg.resolve(name)), _dfl(dfl) {}
+
+    const std::string& name() const { return _cell->name(); }
+
+    //! Whether the parameter is set
+    bool is_set() const { return _cell->is_set(); }
+
+    //! The value of the parameter, or the default if it is not set
+    T get() const { T v; return _cell->read(v) ? v : _dfl; }
+    T operator()() const { return get(); }
+};
+
 /** @}*/
 } // namespace opencog
 
@@ -26,17 +26,89 @@
 #include <float.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <set>
 #include <utility>
 #include <vector>
 
+#include <opencog/util/oc_omp.h>
+
 /** \addtogroup grp_cogutil
  *  @{
  */
 
+template<class Point> class FrozenCoverTree;
+
+#ifdef COVER_TREE_STATS
+#define COVER_TREE_STAT(statement) statement
+#else
+#define COVER_TREE_STAT(statement)
+#endif
+
+//! Counters of the work of a cover tree, to tune base and the metric
+/**
+ * They are only kept if COVER_TREE_STATS is defined before this file
+ * is included (enabled is then true); otherwise they stay at 0, at
+ * no cost. Concurrent queries may count at once.
+ *
+ * The number of distances a query makes compares with size(), that of
+ * a brute force search.
+ */
+struct CoverTreeStats
+{
+    typedef std::atomic<unsigned long long> counter;
+    static constexpr int max_levels = 64;
+
+#ifdef COVER_TREE_STATS
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    counter queries, query_distances;   //!< kNN and range queries
+    counter inserts, insert_distances;  //!< including bulk inserts
+    counter removes, remove_distances;
+    //! Nodes whose children a search looked at, by level from the
+    //! top (by depth in a FrozenCoverTree); the deepest are summed
+    //! in the last. Inserts count, as they search for the point first.
+    counter visited[max_levels];
+    //! Nodes a search dropped without looking at their children
+    counter pruned;
+
+    CoverTreeStats() { reset(); }
+    CoverTreeStats(const CoverTreeStats& other) { *this = other; }
+    CoverTreeStats& operator=(const CoverTreeStats& other)
+    {
+        queries = other.queries.load();
+        query_distances = other.query_distances.load();
+        inserts = other.inserts.load();
+        insert_distances = other.insert_distances.load();
+        removes = other.removes.load();
+        remove_distances = other.remove_distances.load();
+        for(int i=0; i<max_levels; i++) visited[i] = other.visited[i].load();
+        pruned = other.pruned.load();
+        return *this;
+    }
+
+    void reset()
+    {
+        queries = query_distances = 0;
+        inserts = insert_distances = 0;
+        removes = remove_distances = 0;
+        for(int i=0; i<max_levels; i++) visited[i] = 0;
+        pruned = 0;
+    }
+
+    void visit(int level, unsigned long long n = 1)
+    {
+        visited[std::min(std::max(level, 0), max_levels-1)] += n;
+    }
+};
+
 //! Cover Tree. Allows for insertion, removal, and k-nearest-neighbor queries.
 /**
  * https://github.com/DNCrane/Cover-Tree
@@ -92,6 +164,8 @@
 template<class Point>
 class CoverTree
 {
+    friend class FrozenCoverTree<Point>;
+
     /**
      * Cover tree node. Consists of arbitrarily many points P, as long as
      * they have distance 0 to each other. Keeps track of its children.
@@ -112,7 +186,7 @@ class CoverTree
          * Does not include the node itself, though technically every node
          * has itself as a child in a cover tree.
          */
-        std::vector<CoverTreeNode*> get_children(int level) const;
+        const std::vector<CoverTreeNode*>& get_children(int level) const;
         void add_child(int level, CoverTreeNode* p);
         void remove_child(int level, CoverTreeNode* p);
         void add_point(const Point& p);
@@ -140,9 +214,19 @@ class CoverTree
     int _maxLevel;//base^_maxLevel should be the max distance
                   //between any 2 points
     int _minLevel;//A level beneath which there are no more new nodes.
+    mutable CoverTreeStats _stats;
+
+    //! p.distance(q), counted in c
+    double measure(const Point& p, const Point& q,
+                   CoverTreeStats::counter& c) const
+    {
+        COVER_TREE_STAT(c++;)
+        return p.distance(q);
+    }
 
     std::vector<CoverTreeNode*>
-        k_nearest_nodes(const Point& p, const unsigned int& k) const;
+        k_nearest_nodes(const Point& p, const unsigned int& k,
+                        CoverTreeStats::counter& distances) const;
     /**
      * Recursive implementation of the insert algorithm (see paper).
      */
@@ -163,6 +247,12 @@ class CoverTree
                     int level,
                     bool& multi);
 
+    /**
+     * Build the tree from all points at once, level by level, into an
+     * empty tree.
+     */
+    void batch_insert(const std::vector<Point>& points);
+
  public:
     const double base;
 
@@ -173,6 +263,10 @@ class CoverTree
      * can have between each other. IE p.distance(q) < maxDist for all
      * p,q that you will ever try to insert. The cover tree may be invalid
      * if an inaccurate maxDist is given.
+     *
+     * The points are inserted all at once, level by level, rather than
+     * one by one; the distances are computed in parallel, with the
+     * threads set by setting_omp().
      */
 
     CoverTree(const double& maxDist,
@@ -208,9 +302,32 @@ class CoverTree
      * Returns the k nearest points to p in order (the 0th element of the vector
      * is closest to p, 1th is next, etc). It may return greater than k points
      * if there is a tie for the kth place.
+     *
+     * Queries may run concurrently, as long as the tree is not modified
+     * meanwhile.
      */
     std::vector<Point> k_nearest_neighbors(const Point& p, const unsigned int& k) const;
 
+    /**
+     * k_nearest_neighbors of each query, in parallel with the threads
+     * set by setting_omp().
+     */
+    std::vector<std::vector<Point> >
+    k_nearest_neighbors_batch(const std::vector<Point>& queries,
+                              unsigned int k) const;
+
+    /**
+     * Returns all points q with p.distance(q) <= radius, nearest first.
+     */
+    std::vector<Point> points_within(const Point& p, double radius) const;
+
+    //! The counters of the work done so far, see CoverTreeStats
+    const CoverTreeStats& stats() const { return _stats; }
+    void reset_stats() const { _stats.reset(); }
+
+    //! Number of nodes, that is, of distinct points up to distance 0
+    unsigned int size() const { return _numNodes; }
+
     CoverTreeNode* get_root() const;
 
     /**
@@ -227,9 +344,110 @@ CoverTree<Point>::CoverTree(const double& maxDist,
     _numNodes=0;
     _maxLevel=ceilf(log(maxDist)/log(base));
     _minLevel=_maxLevel-1;
-    typename std::vector<Point>::const_iterator it;
-    for(it=points.begin(); it!=points.end(); ++it) {
-        this->insert(*it);
+    batch_insert(points);
+}
+
+template<class Point>
+void CoverTree<Point>::batch_insert(const std::vector<Point>& points)
+{
+    if(points.empty()) return;
+    _root = new CoverTreeNode(points[0]);
+    _numNodes = 1;
+    COVER_TREE_STAT(_stats.inserts += points.size();)
+
+    // Going down the levels, the nodes at level i (the cover set C_i,
+    // made of the nodes at levels above and of the children at level
+    // i+1) are a base^i-net of the points. Each point not yet in
+    // keeps Q, the nodes of C_i within base^(i+1) of it. Q holds its
+    // nearest node if it is within base^i, so its parent at level i,
+    // and the parent of any point joining C_(i-1) within base^(i-1)
+    // of it; and the parents at level i of the nodes of Q at the next
+    // level are in Q.
+    struct pending
+    {
+        const Point* p;
+        std::vector<distNodePair> Q;
+        distNodePair nearest;
+    };
+    std::vector<pending> todo(points.size() - 1);
+    for(size_t u=1; u<points.size(); u++) {
+        todo[u-1].p = &points[u];
+        todo[u-1].Q.push_back(std::make_pair(measure(points[u], points[0],
+                                                     _stats.insert_distances),
+                                             _root));
+    }
+
+    for(int level=_maxLevel; !todo.empty(); level--) {
+        const double radius = pow(base, level+1);
+        const double sep = pow(base, level-1);
+
+        // Add the children at level+1 of the nodes of Q, then drop
+        // the nodes out of radius (but the root, so that Q is never
+        // empty even if maxDist was too small).
+        long n = todo.size();
+#ifdef OC_OMP
+        #pragma omp parallel for schedule(dynamic, 64) num_threads(opencog::num_threads())
+#endif
+        for(long u=0; u<n; u++) {
+            pending& pd = todo[u];
+            size_t size = pd.Q.size();
+            for(size_t i=0; i<size; i++) {
+                const std::vector<CoverTreeNode*>& children =
+                    pd.Q[i].second->get_children(level+1);
+                for(CoverTreeNode* c : children)
+                    pd.Q.push_back(std::make_pair(measure(*pd.p, c->get_point(),
+                                                          _stats.insert_distances),
+                                                  c));
+            }
+            pd.nearest = std::make_pair(DBL_MAX, (CoverTreeNode*)NULL);
+            size_t j = 0;
+            for(size_t i=0; i<pd.Q.size(); i++) {
+                if(pd.Q[i].first > radius && pd.Q[i].second != _root)
+                    continue;
+                if(pd.Q[i].first < pd.nearest.first) pd.nearest = pd.Q[i];
+                pd.Q[j++] = pd.Q[i];
+            }
+            pd.Q.resize(j);
+        }
+
+        // The points farther than sep from C_i and from each other
+        // (greedily, in order) join C_(i-1), as children at level i of
+        // their nearest node, within base^i; those at distance 0 from
+        // a node join it. New nodes are listed by parent, to find them
+        // again through Q.
+        std::map<CoverTreeNode*, std::vector<CoverTreeNode*> > added;
+        size_t j = 0;
+        for(size_t u=0; u<todo.size(); u++) {
+            pending& pd = todo[u];
+            if(pd.nearest.first == 0.0) {
+                pd.nearest.second->add_point(*pd.p);
+                continue;
+            }
+            bool separated = pd.nearest.first > sep;
+            for(size_t i=0; separated && i<pd.Q.size(); i++) {
+                typename std::map<CoverTreeNode*,
+                                  std::vector<CoverTreeNode*> >::const_iterator
+                    it = added.find(pd.Q[i].second);
+                if(it == added.end()) continue;
+                for(CoverTreeNode* c : it->second)
+                    if(measure(*pd.p, c->get_point(),
+                               _stats.insert_distances) <= sep) {
+                        separated = false;
+                        break;
+                    }
+            }
+            if(separated) {
+                CoverTreeNode* node = new CoverTreeNode(*pd.p);
+                pd.nearest.second->add_child(level, node);
+                added[pd.nearest.second].push_back(node);
+                _numNodes++;
+                if(level-1<_minLevel) _minLevel=level-1;
+                continue;
+            }
+            if(j != u) todo[j] = std::move(pd);
+            j++;
+        }
+        todo.resize(j);
     }
 }
 
@@ -254,12 +472,13 @@ CoverTree<Point>::~CoverTree()
 
 template<class Point>
 std::vector<typename CoverTree<Point>::CoverTreeNode*>
-CoverTree<Point>::k_nearest_nodes(const Point& p, const unsigned int& k) const
+CoverTree<Point>::k_nearest_nodes(const Point& p, const unsigned int& k,
+                                  CoverTreeStats::counter& distances) const
 {
     if(_root==NULL) return std::vector<CoverTreeNode*>();
     //maxDist is the kth nearest known point to p, and also the farthest
     //point from p in the set minNodes defined below.
-    double maxDist = p.distance(_root->get_point());
+    double maxDist = measure(p, _root->get_point(), distances);
     //minNodes stores the k nearest known points to p.
     std::set<distNodePair> minNodes;
 
@@ -268,12 +487,13 @@ CoverTree<Point>::k_nearest_nodes(const Point& p, const unsigned int& k) const
     for(int level = _maxLevel; level>=_minLevel;level--) {
         typename std::vector<distNodePair>::const_iterator it;
         int size = Qj.size();
+        COVER_TREE_STAT(_stats.visit(_maxLevel-level, size);)
         for(int i=0; i<size; i++) {
-            std::vector<CoverTreeNode*> children =
+            const std::vector<CoverTreeNode*>& children =
                 Qj[i].second->get_children(level);
             typename std::vector<CoverTreeNode*>::const_iterator it2;
             for(it2=children.begin(); it2!=children.end(); ++it2) {
-                double d = p.distance((*it2)->get_point());
+                double d = measure(p, (*it2)->get_point(), distances);
                 if(d < maxDist || minNodes.size() < k) {
                     minNodes.insert(std::make_pair(d,*it2));
                     //--minNodes.end() gives us an iterator to the greatest
@@ -288,6 +508,7 @@ CoverTree<Point>::k_nearest_nodes(const Point& p, const unsigned int& k) const
         size = Qj.size();
         for(int i=0; i<size; i++) {
             if(Qj[i].first > sep) {
+                COVER_TREE_STAT(_stats.pruned++;)
                 //quickly removes an element from a vector w/o preserving order.
                 Qj[i]=Qj.back();
                 Qj.pop_back();
@@ -316,10 +537,11 @@ bool CoverTree<Point>::insert_rec(const Point& p,
         if(it->first<minQiDist.first) minQiDist = *it;
         if(it->first<minDist) minDist=it->first;
         if(it->first<=sep) Qj.push_back(*it);
-        std::vector<CoverTreeNode*> children = it->second->get_children(level);
+        const std::vector<CoverTreeNode*>& children =
+            it->second->get_children(level);
         typename std::vector<CoverTreeNode*>::const_iterator it2;
         for(it2=children.begin();it2!=children.end();++it2) {
-            double d = p.distance((*it2)->get_point());
+            double d = measure(p, (*it2)->get_point(), _stats.insert_distances);
             if(d<minDist) minDist = d;
             if(d<=sep) {
                 Qj.push_back(std::make_pair(d,*it2));
@@ -374,7 +596,7 @@ void CoverTree<Point>::remove_rec(const Point& p,
         }
         typename std::vector<CoverTreeNode*>::const_iterator it2;
         for(it2=children.begin();it2!=children.end();++it2) {
-            dist = p.distance((*it2)->get_point());
+            dist = measure(p, (*it2)->get_point(), _stats.remove_distances);
             if(dist<minDist) {
                 minDist = dist;
                 minNode = *it2;
@@ -424,7 +646,8 @@ void CoverTree<Point>::remove_rec(const Point& p,
                 typename std::vector<distNodePair>::const_iterator it2;
                 minDQ = DBL_MAX;
                 for(it2=Q.begin();it2!=Q.end();++it2) {
-                    double d = q.distance(it2->second->get_point());
+                    double d = measure(q, it2->second->get_point(),
+                                       _stats.remove_distances);
                     if(d<minDQ) {
                         minDQ = d;
                         minDQNode = it2->second;
@@ -436,7 +659,9 @@ void CoverTree<Point>::remove_rec(const Point& p,
                 }
                 minDQ=DBL_MAX;
                 if(br) break;
-                Q.push_back(std::make_pair((*it)->distance(p),*it));
+                Q.push_back(std::make_pair(measure((*it)->get_point(), p,
+                                                   _stats.remove_distances),
+                                           *it));
                 i++;
                 sep = pow(base,i);
             }
@@ -478,17 +703,20 @@ void CoverTree<Point>::insert(const Point& newPoint)
         _numNodes=1;
         return;
     }
+    COVER_TREE_STAT(_stats.inserts++;)
     //TODO: this is pretty inefficient, there may be a better way
     //to check if the node already exists...
-    CoverTreeNode* n = k_nearest_nodes(newPoint,1)[0];
-    if(newPoint.distance(n->get_point())==0.0) {
+    CoverTreeNode* n = k_nearest_nodes(newPoint,1,_stats.insert_distances)[0];
+    if(measure(newPoint, n->get_point(), _stats.insert_distances)==0.0) {
         n->add_point(newPoint);
     } else {
         //insert_rec acts under the assumption that there are no nodes with
         //distance 0 to newPoint in the cover tree (the previous lines check it)
         insert_rec(newPoint,
                    std::vector<distNodePair>
-                   (1,std::make_pair(_root->distance(newPoint),_root)),
+                   (1,std::make_pair(measure(_root->get_point(), newPoint,
+                                             _stats.insert_distances),
+                                     _root)),
                    _maxLevel);
     }
 }
@@ -498,6 +726,7 @@ void CoverTree<Point>::remove(const Point& p)
 {
     //Most of this function's code is for the special case of removing the root
     if(_root==NULL) return;
+    COVER_TREE_STAT(_stats.removes++;)
     bool removingRoot=_root->has_point(p);
     if(removingRoot && !_root->is_single()) {
         _root->remove_point(p);
@@ -522,9 +751,14 @@ void CoverTree<Point>::remove(const Point& p)
         }
     }
     std::map<int, std::vector<distNodePair> > coverSets;
-    coverSets[_maxLevel].push_back(std::make_pair(_root->distance(p),_root));
+    coverSets[_maxLevel].push_back(
+        std::make_pair(measure(_root->get_point(), p, _stats.remove_distances),
+                       _root));
     if(removingRoot)
-        coverSets[_maxLevel].push_back(std::make_pair(newRoot->distance(p),newRoot));
+        coverSets[_maxLevel].push_back(
+            std::make_pair(measure(newRoot->get_point(), p,
+                                   _stats.remove_distances),
+                           newRoot));
     bool multi = false;
     remove_rec(p,coverSets,_maxLevel,multi);
     if(removingRoot) {
@@ -539,7 +773,8 @@ std::vector<Point> CoverTree<Point>::k_nearest_neighbors(const Point& p,
                                                          const unsigned int& k) const
 {
     if(_root==NULL) return std::vector<Point>();
-    std::vector<CoverTreeNode*> v = k_nearest_nodes(p, k);
+    COVER_TREE_STAT(_stats.queries++;)
+    std::vector<CoverTreeNode*> v = k_nearest_nodes(p, k, _stats.query_distances);
     std::vector<Point> kNN;
     typename std::vector<CoverTreeNode*>::const_iterator it;
     for(it=v.begin();it!=v.end();++it) {
@@ -550,6 +785,63 @@ std::vector<Point> CoverTree<Point>::k_nearest_neighbors(const Point& p,
     return kNN;
 }
 
+template<class Point>
+std::vector<std::vector<Point> >
+CoverTree<Point>::k_nearest_neighbors_batch(const std::vector<Point>& queries,
+                                            unsigned int k) const
+{
+    std::vector<std::vector<Point> > res(queries.size());
+    long n = queries.size();
+#ifdef OC_OMP
+    #pragma omp parallel for schedule(dynamic, 16) num_threads(opencog::num_threads())
+#endif
+    for(long i=0; i<n; i++)
+        res[i] = k_nearest_neighbors(queries[i], k);
+    return res;
+}
+
+template<class Point>
+std::vector<Point> CoverTree<Point>::points_within(const Point& p,
+                                                   double radius) const
+{
+    std::vector<Point> res;
+    if(_root==NULL) return res;
+    // Every node of Q is in the current cover set and may have points
+    // within radius under it: the descendants of a node of C_(i-1)
+    // are within base^i of it.
+    COVER_TREE_STAT(_stats.queries++;)
+    std::vector<distNodePair> Q(1, std::make_pair(measure(p, _root->get_point(),
+                                                          _stats.query_distances),
+                                                  _root));
+    std::vector<distNodePair> found;
+    if(Q[0].first <= radius) found.push_back(Q[0]);
+    for(int level = _maxLevel; level>=_minLevel && !Q.empty(); level--) {
+        size_t size = Q.size();
+        COVER_TREE_STAT(_stats.visit(_maxLevel-level, size);)
+        for(size_t i=0; i<size; i++) {
+            const std::vector<CoverTreeNode*>& children =
+                Q[i].second->get_children(level);
+            for(CoverTreeNode* c : children) {
+                double d = measure(p, c->get_point(), _stats.query_distances);
+                if(d <= radius) found.push_back(std::make_pair(d, c));
+                Q.push_back(std::make_pair(d, c));
+            }
+        }
+        double reach = radius + pow(base, level);
+        size_t j = 0;
+        for(size_t i=0; i<Q.size(); i++)
+            if(Q[i].first <= reach) Q[j++] = Q[i];
+        COVER_TREE_STAT(_stats.pruned += Q.size() - j;)
+        Q.resize(j);
+    }
+    std::sort(found.begin(), found.end());
+    for(const distNodePair& dn : found) {
+        const std::vector<Point>& ps = dn.second->get_points();
+        res.insert(res.end(), ps.begin(), ps.end());
+    }
+    return res;
+}
+
 template<class Point>
 void CoverTree<Point>::print() const
 {
@@ -592,15 +884,16 @@ CoverTree<Point>::CoverTreeNode::CoverTreeNode(const Point& p) {
 }
 
 template<class Point>
-std::vector<typename CoverTree<Point>::CoverTreeNode*>
+const std::vector<typename CoverTree<Point>::CoverTreeNode*>&
 CoverTree<Point>::CoverTreeNode::get_children(int level) const
 {
+    static const std::vector<CoverTreeNode*> none;
     typename std::map<int,std::vector<CoverTreeNode*> >::const_iterator
         it = _childMap.find(level);
     if(it!=_childMap.end()) {
         return it->second;
     }
-    return std::vector<CoverTreeNode*>();
+    return none;
 }
 
 template<class Point>
@@ -712,6 +1005,272 @@ bool CoverTree<Point>::is_valid_tree() const {
     return true;
 }
 
+//! A built CoverTree, frozen in contiguous arrays for fast queries
+/**
+ * The nodes of the tree are laid out breadth first in one array, the
+ * children of each node being a range of it, and their points in
+ * another; each node also holds the largest distance from its point to
+ * any point under it. A k-nearest-neighbor search then walks the tree
+ * depth first, nearest children first, pruning every subtree that
+ * cannot hold a closer point than the k found so far, with no
+ * allocation other than the result (once its thread-local work space
+ * has grown to fit).
+ *
+ * A frozen tree is a snapshot: it does not follow later insertions or
+ * removals in the CoverTree it was built from. It gives the same
+ * neighbors as CoverTree::k_nearest_neighbors, up to the order of
+ * ties.
+ */
+template<class Point>
+class FrozenCoverTree
+{
+    struct Node
+    {
+        unsigned point_begin, point_end; // range in _points
+        unsigned child_begin, child_end; // range in _nodes
+        unsigned depth;
+        double max_dist; // from the node point to all points under it
+    };
+
+    std::vector<Node> _nodes;
+    std::vector<Point> _points;
+    mutable CoverTreeStats _stats;
+
+    double measure(const Point& p, const Point& q) const
+    {
+        COVER_TREE_STAT(_stats.query_distances++;)
+        return p.distance(q);
+    }
+
+    typedef std::pair<double, unsigned> distIndexPair;
+
+    /**
+     * The k nearest nodes to p, nearest first, in a thread-local work
+     * space valid until the next search of the thread.
+     */
+    const std::vector<distIndexPair>& search(const Point& p,
+                                             unsigned int k) const;
+
+public:
+    explicit FrozenCoverTree(const CoverTree<Point>& tree);
+
+    //! Number of nodes, that is, of distinct points up to distance 0
+    size_t size() const { return _nodes.size(); }
+
+    //! The counters of the queries so far, see CoverTreeStats
+    const CoverTreeStats& stats() const { return _stats; }
+    void reset_stats() const { _stats.reset(); }
+
+    //! Same as CoverTree::k_nearest_neighbors. Queries may run
+    //! concurrently.
+    std::vector<Point> k_nearest_neighbors(const Point& p,
+                                           unsigned int k) const;
+
+    //! k_nearest_neighbors of each query, in parallel with the threads
+    //! set by setting_omp()
+    std::vector<std::vector<Point>>
+    k_nearest_neighbors_batch(const std::vector<Point>& queries,
+                              unsigned int k) const;
+
+    //! Same as CoverTree::points_within
+    std::vector<Point> points_within(const Point& p, double radius) const;
+
+    /**
+     * The k nearest points to each of the n queries, in parallel, into
+     * caller-supplied arrays of n*k entries: out[i*k + j] points to the
+     * j-th nearest point to queries[i], stored in this tree, and
+     * dists[i*k + j], unless dists is NULL, is its distance. Unlike
+     * k_nearest_neighbors, exactly k points are given, ties for the
+     * k-th place being cut; if the tree holds fewer than k points, the
+     * remaining entries are NULL, at an infinite distance. Nothing is
+     * allocated once the thread-local work space of each thread has
+     * grown to fit.
+     */
+    void k_nearest_neighbors_batch(const Point* queries, size_t n,
+                                   unsigned int k, const Point** out,
+                                   double* dists = NULL) const;
+};
+
+template<class Point>
+FrozenCoverTree<Point>::FrozenCoverTree(const CoverTree<Point>& tree)
+{
+    typedef typename CoverTree<Point>::CoverTreeNode CoverTreeNode;
+    if(tree._root==NULL) return;
+
+    // Breadth first, so that the children of a node are consecutive.
+    std::vector<CoverTreeNode*> order(1, tree._root);
+    std::vector<unsigned> parent(1, 0);
+    _nodes.reserve(tree._numNodes);
+    for(unsigned i=0; i<order.size(); i++) {
+        CoverTreeNode* n = order[i];
+        Node fn;
+        const std::vector<Point>& points = n->get_points();
+        fn.point_begin = _points.size();
+        _points.insert(_points.end(), points.begin(), points.end());
+        fn.point_end = _points.size();
+        std::vector<CoverTreeNode*> children = n->get_all_children();
+        fn.child_begin = order.size();
+        order.insert(order.end(), children.begin(), children.end());
+        parent.insert(parent.end(), children.size(), i);
+        fn.child_end = order.size();
+        fn.depth = i==0 ? 0 : _nodes[parent[i]].depth + 1;
+        fn.max_dist = 0.0;
+        _nodes.push_back(fn);
+    }
+
+    // The exact max_dist of each node, walking up from every node to
+    // the root: the depth of the tree times its size in distances.
+    for(unsigned i=1; i<_nodes.size(); i++) {
+        const Point& q = _points[_nodes[i].point_begin];
+        unsigned a = i;
+        do {
+            a = parent[a];
+            double d = _points[_nodes[a].point_begin].distance(q);
+            if(d > _nodes[a].max_dist) _nodes[a].max_dist = d;
+        } while(a != 0);
+    }
+}
+
+template<class Point>
+const std::vector<typename FrozenCoverTree<Point>::distIndexPair>&
+FrozenCoverTree<Point>::search(const Point& p, unsigned int k) const
+{
+    // best is a max-heap of the k nearest nodes found so far, stack
+    // the nodes still to visit, with their distance to p.
+    static thread_local std::vector<distIndexPair> best, stack;
+    best.clear();
+    if(_nodes.empty() || k==0) return best;
+    COVER_TREE_STAT(_stats.queries++;)
+    stack.clear();
+    stack.push_back(std::make_pair(measure(p, _points[0]), 0u));
+    while(!stack.empty()) {
+        distIndexPair dn = stack.back();
+        stack.pop_back();
+        const Node& n = _nodes[dn.second];
+        if(best.size()==k && dn.first - n.max_dist >= best.front().first) {
+            COVER_TREE_STAT(_stats.pruned++;)
+            continue;
+        }
+        COVER_TREE_STAT(_stats.visit(n.depth);)
+
+        if(best.size() < k) {
+            best.push_back(dn);
+            std::push_heap(best.begin(), best.end());
+        } else if(dn.first < best.front().first) {
+            std::pop_heap(best.begin(), best.end());
+            best.back() = dn;
+            std::push_heap(best.begin(), best.end());
+        }
+
+        // Push the children farthest first, so the nearest come out
+        // first and shrink the bound early.
+        size_t top = stack.size();
+        for(unsigned c=n.child_begin; c<n.child_end; c++) {
+            double d = measure(p, _points[_nodes[c].point_begin]);
+            if(best.size() < k || d - _nodes[c].max_dist < best.front().first)
+                stack.push_back(std::make_pair(d, c));
+            else {
+                COVER_TREE_STAT(_stats.pruned++;)
+            }
+        }
+        std::sort(stack.begin() + top, stack.end(),
+                  std::greater<distIndexPair>());
+    }
+    std::sort_heap(best.begin(), best.end());
+    return best;
+}
+
+template<class Point>
+std::vector<Point>
+FrozenCoverTree<Point>::k_nearest_neighbors(const Point& p,
+                                            unsigned int k) const
+{
+    std::vector<Point> kNN;
+    for(const distIndexPair& dn : search(p, k)) {
+        const Node& n = _nodes[dn.second];
+        kNN.insert(kNN.end(), _points.begin() + n.point_begin,
+                   _points.begin() + n.point_end);
+        if(kNN.size() >= k) break;
+    }
+    return kNN;
+}
+
+template<class Point>
+std::vector<std::vector<Point>>
+FrozenCoverTree<Point>::k_nearest_neighbors_batch(
+    const std::vector<Point>& queries, unsigned int k) const
+{
+    std::vector<std::vector<Point>> res(queries.size());
+    long n = queries.size();
+#ifdef OC_OMP
+    #pragma omp parallel for schedule(dynamic, 16) num_threads(opencog::num_threads())
+#endif
+    for(long i=0; i<n; i++)
+        res[i] = k_nearest_neighbors(queries[i], k);
+    return res;
+}
+
+template<class Point>
+void FrozenCoverTree<Point>::k_nearest_neighbors_batch(const Point* queries,
+                                                       size_t n,
+                                                       unsigned int k,
+                                                       const Point** out,
+                                                       double* dists) const
+{
+    long nq = n;
+#ifdef OC_OMP
+    #pragma omp parallel for schedule(dynamic, 16) num_threads(opencog::num_threads())
+#endif
+    for(long i=0; i<nq; i++) {
+        size_t j = i * size_t(k), end = j + k;
+        for(const distIndexPair& dn : search(queries[i], k)) {
+            const Node& nd = _nodes[dn.second];
+            for(unsigned q=nd.point_begin; q<nd.point_end && j<end; q++, j++) {
+                out[j] = &_points[q];
+                if(dists) dists[j] = dn.first;
+            }
+            if(j == end) break;
+        }
+        for(; j<end; j++) {
+            out[j] = NULL;
+            if(dists) dists[j] = HUGE_VAL;
+        }
+    }
+}
+
+template<class Point>
+std::vector<Point>
+FrozenCoverTree<Point>::points_within(const Point& p, double radius) const
+{
+    std::vector<Point> res;
+    if(_nodes.empty()) return res;
+    static thread_local std::vector<distIndexPair> found, stack;
+    found.clear();
+    stack.clear();
+    COVER_TREE_STAT(_stats.queries++;)
+    stack.push_back(std::make_pair(measure(p, _points[0]), 0u));
+    while(!stack.empty()) {
+        distIndexPair dn = stack.back();
+        stack.pop_back();
+        const Node& n = _nodes[dn.second];
+        COVER_TREE_STAT(_stats.visit(n.depth);)
+        if(dn.first <= radius) found.push_back(dn);
+        for(unsigned c=n.child_begin; c<n.child_end; c++) {
+            double d = measure(p, _points[_nodes[c].point_begin]);
+            if(d - _nodes[c].max_dist <= radius)
+                stack.push_back(std::make_pair(d, c));
+            else {
+                COVER_TREE_STAT(_stats.pruned++;)
+            }
+        }
+    }
+    std::sort(found.begin(), found.end());
+    for(const distIndexPair& dn : found)
+        res.insert(res.end(), _points.begin() + _nodes[dn.second].point_begin,
+                   _points.begin() + _nodes[dn.second].point_end);
+    return res;
+}
+
 /** @}*/
 #endif // _COVER_TREE_H
 
@@ -24,6 +24,11 @@
 #ifndef _OPENCOG_KLD_H
 #define _OPENCOG_KLD_H
 
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <vector>
+
 #include <boost/range/adaptor/map.hpp>
 #include <boost/range/numeric.hpp>
 
@@ -197,6 +202,161 @@ private:
     FloatT x_very_first, x_very_last;
 };
 
+/**
+ * Same estimate of KL(P||Q) as KLDS, for a fixed P and a Q that
+ * changes one sample at a time, such as a sliding window: add_q() and
+ * remove_q() update the estimate in O(log n), and operator() returns
+ * it in O(1).
+ *
+ * The sum of KLDS groups the points of P by the interval (q_lo, q_hi]
+ * of consecutive points of Q they fall in, each point giving
+ *
+ *     log(delta_p) - log(p_s) + log(q_s) + log(q_hi - q_lo) - log(n_hi)
+ *
+ * where n_hi is the number of occurences of q_hi. Only the last two
+ * terms depend on the interval, so the sum over an interval is just
+ * the number of points of P in it times those two. Adding or removing
+ * a sample of Q changes at most two intervals, whose sums are updated.
+ *
+ * The estimate is kept as a running sum, so rounding errors add up
+ * over the updates; set_q_pdf() recomputes it from scratch.
+ */
+template<typename FloatT>
+struct incremental_KLDS {
+    typedef typename KLDS<FloatT>::pdf_t pdf_t;
+
+    //! same arguments as KLDS' set_p_pdf, Q is set empty
+    void set_p_pdf(const pdf_t& p_counter, FloatT p_s_ = -1) {
+        OC_ASSERT(not p_counter.empty());
+        p_s = p_s_ < 0 ? boost::accumulate(p_counter | map_values, 0) : p_s_;
+        x_very_first = p_counter.cbegin()->first - margin;
+        x_very_last = p_counter.crbegin()->first + margin;
+        p_keys.clear();
+        sum_log_delta_p = 0;
+        FloatT p_x_pre(x_very_first);
+        for (const typename pdf_t::value_type& v : p_counter) {
+            p_keys.push_back(v.first);
+            sum_log_delta_p += std::log(v.second / (v.first - p_x_pre));
+            p_x_pre = v.first;
+        }
+        clear_q();
+    }
+    //! like above but takes a sorted sequence of FloatT
+    template<typename SortedSeq>
+    void set_p(const SortedSeq& p) {
+        set_p_pdf(Counter<FloatT, FloatT>(p), p.size());
+    }
+
+    template<typename SortedSeq>
+    incremental_KLDS(const SortedSeq& p) : margin(1.0) {
+        set_p(p);
+    }
+
+    incremental_KLDS(const pdf_t& p_pdf_, FloatT p_s_ = -1) : margin(1.0) {
+        set_p_pdf(p_pdf_, p_s_);
+    }
+
+    //! empty Q
+    void clear_q() {
+        q_counter.clear();
+        q_s = 0;
+        sum_intervals = interval(x_very_first, x_very_last, 1);
+    }
+
+    //! replace Q by q_counter, recomputing the estimate from scratch
+    void set_q_pdf(const pdf_t& q_counter_) {
+        clear_q();
+        for (const typename pdf_t::value_type& v : q_counter_)
+            add_q(v.first, v.second);
+    }
+
+    //! add n occurences of x to Q, in O(log n)
+    void add_q(FloatT x, FloatT n = 1) {
+        pdf_it it = q_counter.find(x);
+        if (it != q_counter.end()) {
+            FloatT lo = lower(it);
+            sum_intervals += interval(lo, x, it->second + n)
+                - interval(lo, x, it->second);
+            it->second += n;
+        } else {
+            it = q_counter.emplace(x, n).first;
+            FloatT lo = lower(it), hi, n_hi;
+            upper(it, hi, n_hi);
+            // (lo, hi] is split at x
+            sum_intervals += interval(lo, x, n) + interval(x, hi, n_hi)
+                - interval(lo, hi, n_hi);
+        }
+        q_s += n;
+    }
+
+    //! remove n of the occurences of x in Q, in O(log n)
+    void remove_q(FloatT x, FloatT n = 1) {
+        pdf_it it = q_counter.find(x);
+        OC_ASSERT(it != q_counter.end() and n <= it->second,
+                  "incremental_KLDS::remove_q - not that many %g in Q.", x);
+        FloatT lo = lower(it);
+        if (n < it->second) {
+            sum_intervals += interval(lo, x, it->second - n)
+                - interval(lo, x, it->second);
+            it->second -= n;
+        } else {
+            FloatT hi, n_hi;
+            upper(it, hi, n_hi);
+            // (lo, x] and (x, hi] are joined
+            sum_intervals += interval(lo, hi, n_hi)
+                - interval(lo, x, it->second) - interval(x, hi, n_hi);
+            q_counter.erase(it);
+        }
+        q_s -= n;
+    }
+
+    //! size of q (duplicated values are not ignored)
+    FloatT q_size() const {
+        return q_s;
+    }
+
+    //! Q, as a map from values to numbers of occurences
+    const pdf_t& q_pdf() const {
+        return q_counter;
+    }
+
+    //! @return estimate of KL(P||Q), same as KLDS' operator()(q_pdf())
+    FloatT operator()() const {
+        FloatT m = p_keys.size();
+        return (sum_log_delta_p + m * (std::log(q_s) - std::log(p_s))
+                + sum_intervals) / p_s - 1;
+    }
+
+private:
+    typedef typename pdf_t::iterator pdf_it;
+
+    //! sum of the components of the points of P in (lo, hi]
+    FloatT interval(FloatT lo, FloatT hi, FloatT n_hi) const {
+        auto c = std::upper_bound(p_keys.begin(), p_keys.end(), hi)
+            - std::upper_bound(p_keys.begin(), p_keys.end(), lo);
+        return c <= 0 ? 0 : c * (std::log(hi - lo) - std::log(n_hi));
+    }
+
+    //! point of Q before it, or x_very_first
+    FloatT lower(pdf_it it) const {
+        return it == q_counter.begin() ? x_very_first : std::prev(it)->first;
+    }
+
+    //! point of Q after it and its number of occurences, or
+    //! x_very_last and 1
+    void upper(pdf_it it, FloatT& hi, FloatT& n_hi) const {
+        ++it;
+        hi = it == q_counter.end() ? x_very_last : it->first;
+        n_hi = it == q_counter.end() ? 1 : it->second;
+    }
+
+    FloatT p_s, q_s, margin;
+    FloatT x_very_first, x_very_last;
+    FloatT sum_log_delta_p, sum_intervals;
+    std::vector<FloatT> p_keys;
+    pdf_t q_counter;
+};
+
 //! function helper
 template<typename SortedSeq>
 typename SortedSeq::value_type KLD(const SortedSeq& p, const SortedSeq& q) {
@@ -32,9 +32,14 @@
 #include <execinfo.h>
 #endif
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <sstream>
+#include <vector>
 
+#include <ctype.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <strings.h>
@@ -46,7 +51,11 @@
 #undef ERROR
 #undef DEBUG
 #else
+#include <dirent.h>
+#include <spawn.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
 #endif
 
 #ifdef HAVE_VALGRIND
@@ -54,7 +63,10 @@
 #endif
 
 #include <opencog/util/backtrace-symbols.h>
+#include <opencog/util/binary_log.h>
+#include <opencog/util/memory_accounting.h>
 #include <opencog/util/platform.h>
+#include <opencog/util/trace_event.h>
 
 #include "Logger.h"
 
@@ -66,25 +78,54 @@ using namespace opencog;
 
 // messages greater than this will be truncated
 #define MAX_PRINTF_STYLE_MESSAGE_SIZE (1<<15)
+// Maximum number of ring slots written out by one writev().
+#define RING_BATCH_SIZE 64
+// Storage pre-reserved in each ring slot.
+#define RING_SLOT_RESERVE 256
+// Longest time that the thread-buffer harvester sleeps, in millisecs.
+#define TBUF_MAX_POLL 100
+
 const char* levelStrings[] = {"NONE", "ERROR", "WARN", "INFO", "DEBUG", "FINE"};
 
+// The bytes of the messages queued, for all writers, not yet written.
+// Never destroyed, as the writer threads may outlive the statics.
+static memory_account& queued_bytes()
+{
+    static memory_account* acct = new memory_account("Logger queue");
+    return *acct;
+}
+
+// Whether a message (or a buffer of messages, of the given most
+// important level) is to be discarded, with that many pending.
+static bool over_drop_mark(Logger::Backpressure bp, size_t high_water_mark,
+                           Logger::Level level, size_t pending)
+{
+    if (pending <= high_water_mark) return false;
+    return Logger::DROP_NEWEST == bp or
+        (Logger::DROP_LOWEST_LEVEL == bp and Logger::INFO <= level and
+         pending > high_water_mark * (Logger::FINE - level + 1));
+}
+
+// Whether a full ring may drop the message, rather than wait.
+static bool may_drop(Logger::Backpressure bp, Logger::Level level)
+{
+    return Logger::DROP_NEWEST == bp or
+        (Logger::DROP_LOWEST_LEVEL == bp and Logger::INFO <= level);
+}
+
 #if defined(HAVE_GNU_BACKTRACE) /// @todo backtrace and backtrace_symbols
                                 /// is LINUX, we may need a WIN32 version
-static void prt_backtrace(std::ostringstream& oss)
+// Print the stack of return addresses bt_buf[first, stack_depth)
+static void prt_backtrace(std::ostringstream& oss, void* const* bt_buf,
+                          int stack_depth, int first)
 {
-#define BT_BUFSZ 50
-	void *bt_buf[BT_BUFSZ];
-
-	int stack_depth = backtrace(bt_buf, BT_BUFSZ);
 	char **syms = oc_backtrace_symbols(bt_buf, stack_depth);
 
     // Depending on how the dependencies are met, syms could be NULL
     if (syms == NULL) return;
 
-	// Start printing at a bit into the stack, so as to avoid recording
-	// the logger functions in the stack trace.
 	oss << "\tStack Trace:\n";
-	for (int i=2; i < stack_depth; i++)
+	for (int i=first; i < stack_depth; i++)
 	{
 		// Most things we'll print are mangled C++ names,
 		// So demangle them, get them to pretty-print.
@@ -139,6 +180,17 @@ static void prt_backtrace(std::ostringstream& oss)
 	oss << std::endl;
 	free(syms);
 }
+
+static void prt_backtrace(std::ostringstream& oss)
+{
+#define BT_BUFSZ 50
+	void *bt_buf[BT_BUFSZ];
+
+	// Start printing at a bit into the stack, so as to avoid recording
+	// the logger functions in the stack trace.
+	int stack_depth = backtrace(bt_buf, BT_BUFSZ);
+	prt_backtrace(oss, bt_buf, stack_depth, 2);
+}
 #endif
 
 std::mutex Logger::_loggers_mtx;
@@ -159,10 +211,28 @@ Logger::LogWriter::LogWriter(void)
 #endif
     logfile = NULL;
     pending_write = false;
+    msg_ring = nullptr;
+    ring_sleeping = false;
+    dropped_count = 0;
+    stalled_count = 0;
+    rotate_bytes = 0;
+    rotate_secs = 0;
+    rotate_keep = 0;
+    rotate_compress = NO_COMPRESSION;
+    file_bytes = 0;
+    file_opened = 0;
+    tbuf_active = false;
 }
 
 Logger::LogWriter::~LogWriter()
 {
+    {
+        std::lock_guard<std::mutex> lock(tbuf_mutex);
+        tbuf_active = false;
+        tbuf_cond.notify_one();
+    }
+    if (tbuf_thread.joinable()) tbuf_thread.join();
+
     if (logfile == NULL) return;
 
     // Remove the logfile from the list.
@@ -175,6 +245,8 @@ Logger::LogWriter::~LogWriter()
     fflush(logfile);
     fclose(logfile);
     logfile = nullptr;
+
+    delete msg_ring.load();
 }
 
 void Logger::LogWriter::start_write_loop()
@@ -186,9 +258,13 @@ void Logger::LogWriter::start_write_loop()
 
 void Logger::LogWriter::stop_write_loop()
 {
-    std::unique_lock<std::mutex> lock(the_mutex);
-    msg_queue.close();
-    // rejoin thread
+    {
+        std::unique_lock<std::mutex> lock(the_mutex);
+        msg_queue.close();
+        wake_ring_loop();
+    }
+    // Rejoin the thread, without the lock: it takes the lock to write
+    // what is left in the ring.
     writer_thread.join();
 }
 
@@ -216,9 +292,18 @@ void Logger::LogWriter::writing_loop()
                 while (not that->msg_queue.is_closed())
                 {
                     std::string* msg = that->msg_queue.value_pop();
+                    if (msg == nullptr) break;
                     that->write_msg(*msg);
+                    queued_bytes().sub(msg->size());
                     delete msg;
                 }
+                mpsc_ring<std::string>* ring = that->msg_ring.load();
+                while (ring and not ring->is_empty())
+                {
+                    size_t n = ring->peek(RING_BATCH_SIZE);
+                    that->write_ring_batch(ring, n);
+                    ring->release(n);
+                }
                 that->pending_write = false;
                 that->writingLoopActive = false;
                 fflush(that->logfile);
@@ -228,6 +313,7 @@ void Logger::LogWriter::writing_loop()
     };
     thread_local OnExit exiter;
     exiter.that = this;
+    trace_thread_name("Logger writer");
 
     writingLoopActive = true;
     try
@@ -237,9 +323,17 @@ void Logger::LogWriter::writing_loop()
             // The pending_write flag prevents Logger::flush()
             // from returning prematurely.
             std::string* msg = msg_queue.value_pop();
+
+            // A null message is the signal to switch over to the ring.
+            if (nullptr == msg)
+            {
+                ring_loop();
+                break;
+            }
             pending_write = true;
             write_msg(*msg);
             pending_write = false;
+            queued_bytes().sub(msg->size());
             delete msg;
         }
     }
@@ -250,6 +344,240 @@ void Logger::LogWriter::writing_loop()
     writingLoopActive = false;
 }
 
+/// Writer-thread loop used after useRing() has been called.  Drains
+/// the ring in batches; sleeps on a condition variable when there is
+/// nothing to do.  Returns when the message queue is closed.
+void Logger::LogWriter::ring_loop()
+{
+    mpsc_ring<std::string>* ring = msg_ring.load();
+    while (true)
+    {
+        size_t n = ring->peek(RING_BATCH_SIZE);
+        if (0 < n)
+        {
+            pending_write = true;
+            write_ring_batch(ring, n);
+            ring->release(n);
+            pending_write = false;
+            continue;
+        }
+
+        if (msg_queue.is_closed()) return;
+
+        // A producer may have pushed onto the queue just before the
+        // ring was switched on. Don't lose those.
+        std::string* msg = nullptr;
+        if (msg_queue.try_get(msg))
+        {
+            if (msg)
+            {
+                write_msg(*msg);
+                queued_bytes().sub(msg->size());
+                delete msg;
+            }
+            continue;
+        }
+
+        // Nothing to do. Sleep, until some producer wakes us. The
+        // timeout covers the (unlikely) case of a missed wakeup.
+        std::unique_lock<std::mutex> lock(ring_mutex);
+        ring_sleeping = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (0 == ring->peek(1) and not msg_queue.is_closed())
+            ring_cond.wait_for(lock, std::chrono::milliseconds(100));
+        ring_sleeping = false;
+    }
+}
+
+void Logger::LogWriter::wake_ring_loop()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (not ring_sleeping) return;
+    std::lock_guard<std::mutex> lock(ring_mutex);
+    ring_cond.notify_one();
+}
+
+void Logger::LogWriter::useRing(size_t nslots)
+{
+    std::unique_lock<std::mutex> lock(the_mutex);
+    if (msg_ring.load()) return;
+
+    // Pre-reserve storage in each slot, so that typical messages
+    // can be copied in without allocating.
+    std::string proto;
+    proto.reserve(RING_SLOT_RESERVE);
+    msg_ring = new mpsc_ring<std::string>(nslots, proto);
+
+    // Everything queued so far is written first; then the writer
+    // thread sees the null and switches over to the ring.
+    msg_queue.push(nullptr);
+}
+
+bool Logger::LogWriter::qmsg(const std::string& str, bool wait)
+{
+    mpsc_ring<std::string>* ring = msg_ring.load(std::memory_order_acquire);
+    if (nullptr == ring)
+    {
+        queued_bytes().add(str.size());
+        msg_queue.push(new std::string(str));
+        return true;
+    }
+
+    while (not ring->try_push(str))
+    {
+        wake_ring_loop();
+        if (not wait) return false;
+        std::this_thread::yield();
+    }
+    queued_bytes().add(str.size());
+    wake_ring_loop();
+    return true;
+}
+
+size_t Logger::LogWriter::size(void)
+{
+    size_t sz = msg_queue.size();
+    mpsc_ring<std::string>* ring = msg_ring.load(std::memory_order_acquire);
+    if (ring) sz += ring->size();
+    return sz;
+}
+
+uint32_t Logger::LogWriter::binlog_id(const char* str)
+{
+    // Most lookups are satisfied from a per-thread cache, without
+    // taking any locks.
+    thread_local std::map<const LogWriter*,
+                          std::map<std::string, uint32_t, std::less<>>> cache;
+    auto& local = cache[this];
+    auto it = local.find(str);
+    if (local.end() != it) return it->second;
+
+    std::lock_guard<std::mutex> lock(binlog_mutex);
+    auto git = binlog_ids.find(str);
+    if (binlog_ids.end() != git)
+    {
+        local.emplace(git->first, git->second);
+        return git->second;
+    }
+
+    // Queue the definition while holding the lock, so that it is
+    // written before any message that uses the id.  Definitions
+    // must never be dropped.  Record it in the header first, so that
+    // a rotation can never miss it.
+    std::string rec;
+    if (binlog_ids.empty()) binlog_append_clock(rec);
+    uint32_t id = binlog_ids.size() + 1;
+    binlog_append_format(rec, id, str);
+    {
+        std::lock_guard<std::mutex> hlock(binlog_header_mutex);
+        binlog_header += rec;
+    }
+    qmsg(rec, true);
+
+    binlog_ids.emplace(str, id);
+    local.emplace(str, id);
+    return id;
+}
+
+/// A per-thread, per-writer message buffer; see set_thread_buffer().
+/// Normally, only the owning thread touches it, so that its lock is
+/// not contended. flush() and the harvester thread take the lock only
+/// when they are looking for buffers to hand off.
+struct Logger::LogWriter::ThreadBuffer
+{
+    std::mutex mtx;
+    std::string data;
+    unsigned long nmsgs = 0;
+    Level level = BAD_LEVEL;   // The most important level in data.
+    // As set on the logger that last wrote to the buffer.
+    Backpressure backpressure = GROW;
+    size_t high_water_mark = 0;
+    std::chrono::steady_clock::time_point oldest;
+    std::chrono::milliseconds max_delay{TBUF_MAX_POLL};
+};
+
+Logger::LogWriter::ThreadBuffer* Logger::LogWriter::thread_buffer()
+{
+    // When the thread exits, whatever it left in its buffers is
+    // handed off, and the buffers are unregistered.
+    struct Buffers
+    {
+        std::map<LogWriter*, ThreadBuffer*> bufs;
+        ~Buffers()
+        {
+            for (auto& wb : bufs)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(wb.first->tbuf_mutex);
+                    wb.first->tbufs.erase(wb.second);
+                }
+                wb.first->hand_off(*wb.second);
+                delete wb.second;
+            }
+        }
+    };
+    thread_local Buffers buffers;
+
+    ThreadBuffer*& tb = buffers.bufs[this];
+    if (tb) return tb;
+
+    tb = new ThreadBuffer();
+    std::lock_guard<std::mutex> lock(tbuf_mutex);
+    tbufs.insert(tb);
+    if (not tbuf_active)
+    {
+        tbuf_active = true;
+        tbuf_thread = std::thread(&Logger::LogWriter::tbuf_loop, this);
+    }
+    return tb;
+}
+
+/// Queue the contents of a thread buffer, or drop them, as the
+/// backpressure policy of the buffer says.  The caller must hold the
+/// buffer's lock, unless no other thread can see the buffer.
+///
+/// This is for the buffers handed off by flush(), by the harvester
+/// thread, and on thread exit; as these may hold the buffer locks,
+/// BLOCK only waits for room in the ring, rather than for a flush().
+void Logger::LogWriter::hand_off(ThreadBuffer& tb)
+{
+    if (tb.data.empty()) return;
+    if (GROW != tb.backpressure and
+        over_drop_mark(tb.backpressure, tb.high_water_mark, tb.level, size()))
+        dropped_count += tb.nmsgs;
+    else if (not qmsg(tb.data, not may_drop(tb.backpressure, tb.level)))
+        dropped_count += tb.nmsgs;
+    tb.data.clear();
+    tb.nmsgs = 0;
+    tb.level = BAD_LEVEL;
+}
+
+/// Hand off the buffers of threads that have gone quiet, so that
+/// their messages don't sit in the buffer indefinitely.
+void Logger::LogWriter::tbuf_loop()
+{
+    using namespace std::chrono;
+    milliseconds poll(TBUF_MAX_POLL);
+
+    std::unique_lock<std::mutex> lock(tbuf_mutex);
+    while (tbuf_active)
+    {
+        tbuf_cond.wait_for(lock, poll);
+
+        poll = milliseconds(TBUF_MAX_POLL);
+        steady_clock::time_point now = steady_clock::now();
+        for (ThreadBuffer* tb : tbufs)
+        {
+            // A buffer that is locked is being handed off anyway.
+            std::unique_lock<std::mutex> tlock(tb->mtx, std::try_to_lock);
+            if (not tlock.owns_lock()) continue;
+            poll = std::max(milliseconds(1), std::min(poll, tb->max_delay));
+            if (not tb->data.empty() and tb->oldest + tb->max_delay <= now)
+                hand_off(*tb);
+        }
+    }
+}
+
 void Logger::flush()
 {
     if (_log_writer) _log_writer->flush();
@@ -257,6 +585,15 @@ void Logger::flush()
 
 void Logger::LogWriter::flush()
 {
+    {
+        std::lock_guard<std::mutex> lock(tbuf_mutex);
+        for (ThreadBuffer* tb : tbufs)
+        {
+            std::lock_guard<std::mutex> tlock(tb->mtx);
+            hand_off(*tb);
+        }
+    }
+
     // There is a timing window between when pending_write is set,
     // and the msg_queue being empty. We could fall through that
     // window. Yes, its stupid, but too low-importance to fix.
@@ -265,7 +602,9 @@ void Logger::LogWriter::flush()
 
     // Perhaps we could do this with semaphores, but this is not
     // really critical code, so a busy-wait is good enough.
-    while (pending_write or not msg_queue.is_empty())
+    mpsc_ring<std::string>* ring = msg_ring.load();
+    while (pending_write or not msg_queue.is_empty() or
+           (ring and not ring->is_empty()))
     {
         usleep(100);
     }
@@ -274,27 +613,45 @@ void Logger::LogWriter::flush()
     if (logfile) fdatasync(fileno(logfile));
 }
 
+/// Delay opening the file until the first logging statement is issued;
+/// this allows us to set the main logger's filename without creating
+/// a useless log file with the default filename.
+/// Must be called with the_mutex held.
+bool Logger::LogWriter::open_logfile()
+{
+    if (logfile != NULL) return true;
+    if ((logfile = fopen(fileName.c_str(), "a")) != NULL)
+    {
+        // The size limit for rotation includes whatever was already
+        // in the file.
+        fseek(logfile, 0, SEEK_END);
+        long pos = ftell(logfile);
+        file_bytes = (0 < pos) ? pos : 0;
+        file_opened = time(NULL);
+        return true;
+    }
+
+    fprintf(stderr, "[ERROR] Unable to open log file \"%s\"\n",
+            fileName.c_str());
+    return false;
+}
+
 void Logger::LogWriter::write_msg(const std::string &msg)
 {
+    OC_TRACE_SCOPE("Logger::write_msg");
     std::unique_lock<std::mutex> lock(the_mutex);
 
-    // Delay opening the file until the first logging statement is issued;
-    // this allows us to set the main logger's filename without creating
-    // a useless log file with the default filename.
-    if (logfile == NULL)
+    if (logfile) maybe_rotate();
+    if (not open_logfile())
     {
-        if ((logfile = fopen(fileName.c_str(), "a")) == NULL)
-        {
-            fprintf(stderr, "[ERROR] Unable to open log file \"%s\"\n",
-                    fileName.c_str());
-            lock.unlock();
-            stop_write_loop();
-            return;
-        }
+        lock.unlock();
+        stop_write_loop();
+        return;
     }
 
     // Write to file.
-    int rc = fprintf(logfile, "%s", msg.c_str());
+    // Use fwrite, not fprintf: binary-mode messages contain nulls.
+    int rc = fwrite(msg.data(), 1, msg.size(), logfile);
     if ((int) msg.size() != rc)
     {
         fprintf(stderr,
@@ -302,6 +659,7 @@ void Logger::LogWriter::write_msg(const std::string &msg)
             rc, msg.size());
         exit(1);
     }
+    file_bytes += msg.size();
 
     // Flush, because log messages are important, especially if we
     // are about to crash. So we don't want to have these buffered up.
@@ -316,6 +674,236 @@ void Logger::LogWriter::write_msg(const std::string &msg)
     }
 }
 
+/// Write the first n messages in the ring with a single writev().
+void Logger::LogWriter::write_ring_batch(mpsc_ring<std::string>* ring,
+                                         size_t n)
+{
+    OC_TRACE_SCOPE("Logger::write_ring_batch");
+    trace_counter("Logger ring batch", n);
+    std::unique_lock<std::mutex> lock(the_mutex);
+
+    struct iovec iov[RING_BATCH_SIZE];
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const std::string& msg = ring->at(i);
+        iov[i].iov_base = (void*) msg.data();
+        iov[i].iov_len = msg.size();
+        total += msg.size();
+    }
+    queued_bytes().sub(total);
+
+    // If the file can't be opened, there is nowhere to write to;
+    // the messages are dropped.
+    if (logfile) maybe_rotate();
+    if (not open_logfile()) return;
+
+    ssize_t rc = writev(fileno(logfile), iov, n);
+    if (rc < 0)
+    {
+        int norr = errno;
+        fprintf(stderr,
+            "[ERROR] failed write to logfile, errno=%d %s\n",
+            norr, strerror(norr));
+        exit(1);
+    }
+
+    // Short write; finish up the remainder the slow way.
+    size_t done = rc;
+    if (done < total)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            if (done >= iov[i].iov_len)
+            {
+                done -= iov[i].iov_len;
+                continue;
+            }
+            const char* p = (const char*) iov[i].iov_base + done;
+            size_t len = iov[i].iov_len - done;
+            if (len != fwrite(p, 1, len, logfile))
+            {
+                fprintf(stderr,
+                    "[ERROR] failed write to logfile, sz=%lu\n", len);
+                exit(1);
+            }
+            done = 0;
+        }
+    }
+    fflush(logfile);
+    file_bytes += total;
+}
+
+// Rotated files are named <filename>.YYYYmmdd-HHMMSS.uuuuuu, possibly
+// followed by the extension of the compressor.
+#define ROTATION_STAMP_SIZE 22
+
+static bool is_rotation_stamp(const std::string& s)
+{
+    if (ROTATION_STAMP_SIZE != s.size()) return false;
+    for (size_t i = 0; i < ROTATION_STAMP_SIZE; i++)
+    {
+        if (8 == i) { if ('-' != s[i]) return false; }
+        else if (15 == i) { if ('.' != s[i]) return false; }
+        else if (not isdigit(s[i])) return false;
+    }
+    return true;
+}
+
+/// Remove all but the newest keep rotated copies of the log file.
+/// A rotation that is still being compressed may exist both with and
+/// without the compressor's extension; it counts only once.
+static void prune_rotated(const std::string& fileName, unsigned keep)
+{
+    if (0 == keep) return;
+
+    size_t slash = fileName.rfind('/');
+    std::string dir = (std::string::npos == slash) ?
+        "." : fileName.substr(0, slash);
+    std::string prefix = (std::string::npos == slash) ?
+        fileName : fileName.substr(slash + 1);
+    prefix += '.';
+
+    DIR* d = opendir(dir.c_str());
+    if (nullptr == d) return;
+
+    // Ordered by time stamp, oldest first.
+    std::map<std::string, std::vector<std::string>> rotated;
+    while (struct dirent* ent = readdir(d))
+    {
+        std::string name(ent->d_name);
+        if (name.size() < prefix.size() + ROTATION_STAMP_SIZE or
+            0 != name.compare(0, prefix.size(), prefix))
+            continue;
+        std::string stamp = name.substr(prefix.size(), ROTATION_STAMP_SIZE);
+        std::string ext = name.substr(prefix.size() + ROTATION_STAMP_SIZE);
+        if (not is_rotation_stamp(stamp) or
+            (not ext.empty() and ext != ".gz" and ext != ".zst"))
+            continue;
+        rotated[stamp].push_back(dir + "/" + name);
+    }
+    closedir(d);
+
+    size_t excess = (keep < rotated.size()) ? rotated.size() - keep : 0;
+    for (auto it = rotated.begin(); 0 < excess; ++it, --excess)
+        for (const std::string& f : it->second)
+            unlink(f.c_str());
+}
+
+/// Compress a rotated log file by running an external gzip or zstd,
+/// and then prune old rotations.  Runs on its own detached thread, so
+/// that the writer thread does not have to wait for it.  Compressions
+/// are done one at a time, so that pruning never removes a file that
+/// is being compressed.
+static void compress_rotated(std::string path, Logger::Compression how,
+                             std::string fileName, unsigned keep)
+{
+    static std::mutex compress_mutex;
+    std::lock_guard<std::mutex> lock(compress_mutex);
+
+    // Already pruned, while waiting for the previous compression.
+    if (0 != access(path.c_str(), F_OK)) return;
+
+    const char* gzip[] = {"gzip", "-q", "-f", path.c_str(), nullptr};
+    const char* zstd[] = {"zstd", "-q", "-f", "--rm", path.c_str(), nullptr};
+    char* const* argv = (char* const*) (Logger::GZIP == how ? gzip : zstd);
+
+    pid_t pid;
+    if (0 == posix_spawnp(&pid, argv[0], nullptr, nullptr, argv, environ))
+    {
+        int status;
+        while (waitpid(pid, &status, 0) < 0 and EINTR == errno) {}
+    }
+    else
+    {
+        fprintf(stderr, "[WARN] Unable to run %s to compress \"%s\"\n",
+                argv[0], path.c_str());
+    }
+    prune_rotated(fileName, keep);
+}
+
+/// Rotate the log file, if it is past its size or age limit.
+/// Must be called with the_mutex held, with the file open.
+void Logger::LogWriter::maybe_rotate()
+{
+    if ((0 < rotate_bytes and rotate_bytes <= file_bytes) or
+        (0 < rotate_secs and file_opened + (time_t) rotate_secs <= time(NULL)))
+        rotate();
+}
+
+/// Rename the current log file out of the way, and start a new one.
+/// Must be called with the_mutex held, with the file open.
+void Logger::LogWriter::rotate()
+{
+    fflush(logfile);
+    fclose(logfile);
+    logfile = NULL;
+
+    // Pick a name that is not in use, not even by a compressed file.
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    std::string rotated;
+    while (true)
+    {
+        struct tm tm;
+        char stamp[64];
+        localtime_r(&tv.tv_sec, &tm);
+        size_t len = strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+        snprintf(stamp + len, sizeof(stamp) - len, ".%06ld",
+                 (long) tv.tv_usec);
+        rotated = fileName + "." + stamp;
+        if (0 != access(rotated.c_str(), F_OK) and
+            0 != access((rotated + ".gz").c_str(), F_OK) and
+            0 != access((rotated + ".zst").c_str(), F_OK))
+            break;
+        if (1000000 <= ++tv.tv_usec) { tv.tv_usec = 0; tv.tv_sec++; }
+    }
+
+    bool renamed = (0 == rename(fileName.c_str(), rotated.c_str()));
+    if (not renamed)
+    {
+        int norr = errno;
+        fprintf(stderr, "[WARN] Unable to rotate log file \"%s\": %s\n",
+                fileName.c_str(), strerror(norr));
+    }
+
+    if (not open_logfile()) return;
+
+    // Don't retry on every single write, if the rename failed.
+    if (not renamed)
+    {
+        file_bytes = 0;
+        return;
+    }
+
+    // A binary log can't be decoded without its definitions.
+    {
+        std::lock_guard<std::mutex> hlock(binlog_header_mutex);
+        if (not binlog_header.empty())
+        {
+            fwrite(binlog_header.data(), 1, binlog_header.size(), logfile);
+            fflush(logfile);
+            file_bytes += binlog_header.size();
+        }
+    }
+
+    if (NO_COMPRESSION != rotate_compress)
+        std::thread(compress_rotated, rotated, rotate_compress,
+                    fileName, rotate_keep).detach();
+    else
+        prune_rotated(fileName, rotate_keep);
+}
+
+void Logger::LogWriter::setRotation(size_t max_bytes, unsigned max_seconds,
+                                    unsigned keep, Compression how)
+{
+    std::lock_guard<std::mutex> lock(the_mutex);
+    rotate_bytes = max_bytes;
+    rotate_secs = max_seconds;
+    rotate_keep = keep;
+    rotate_compress = how;
+}
+
 Logger::Logger(const std::string &fname, Logger::Level level, bool tsEnabled)
     : error(*this), warn(*this), info(*this), debug(*this), fine(*this)
 {
@@ -329,6 +917,11 @@ Logger::Logger(const std::string &fname, Logger::Level level, bool tsEnabled)
     this->printLevel = true;
     this->printToStdout = false;
     this->syncEnabled = false;
+    this->binaryEnabled = false;
+    this->backpressure = BLOCK;
+    this->highWaterMark = 1024;
+    this->threadBufferSize = 0;
+    this->threadBufferDelay = 100;
 
     this->logEnabled = true;
 #ifdef HAVE_VALGRIND
@@ -358,6 +951,11 @@ void Logger::set(const Logger& log)
     this->timestampEnabled = log.timestampEnabled;
     this->threadIdEnabled = log.threadIdEnabled;
     this->syncEnabled = log.syncEnabled;
+    this->binaryEnabled = log.binaryEnabled;
+    this->backpressure = log.backpressure;
+    this->highWaterMark = log.highWaterMark;
+    this->threadBufferSize = log.threadBufferSize;
+    this->threadBufferDelay = log.threadBufferDelay;
     this->logEnabled = log.logEnabled;
 }
 
@@ -469,6 +1067,67 @@ void Logger::set_sync_flag(bool flag)
     syncEnabled = flag;
 }
 
+void Logger::set_ring_buffer(size_t nslots)
+{
+    if (_log_writer) _log_writer->useRing(nslots);
+}
+
+void Logger::set_thread_buffer(size_t nbytes, unsigned max_delay_ms)
+{
+    threadBufferSize = nbytes;
+    threadBufferDelay = max_delay_ms;
+}
+
+size_t Logger::get_thread_buffer() const
+{
+    return threadBufferSize;
+}
+
+void Logger::set_binary_flag(bool flag)
+{
+    binaryEnabled = flag;
+}
+
+bool Logger::get_binary_flag() const
+{
+    return binaryEnabled;
+}
+
+void Logger::set_backpressure(Logger::Backpressure bp, size_t hwm)
+{
+    backpressure = bp;
+    highWaterMark = hwm;
+}
+
+Logger::Backpressure Logger::get_backpressure() const
+{
+    return backpressure;
+}
+
+size_t Logger::get_high_water_mark() const
+{
+    return highWaterMark;
+}
+
+unsigned long Logger::get_dropped_count() const
+{
+    if (nullptr == _log_writer) return 0;
+    return _log_writer->dropped_count;
+}
+
+unsigned long Logger::get_stalled_count() const
+{
+    if (nullptr == _log_writer) return 0;
+    return _log_writer->stalled_count;
+}
+
+void Logger::set_rotation(size_t max_bytes, unsigned max_seconds,
+                          unsigned keep, Logger::Compression how)
+{
+    if (_log_writer)
+        _log_writer->setRotation(max_bytes, max_seconds, keep, how);
+}
+
 void Logger::set_print_error_level_stdout()
 {
     set_print_to_stdout_flag(true);
@@ -485,56 +1144,183 @@ void Logger::disable()
     logEnabled = false;
 }
 
-void Logger::log(Logger::Level level, const std::string &txt)
+// Per-thread scratch space used to format log messages. The buffer
+// is re-used from one message to the next, so that, at steady state,
+// formatting a message does not allocate. The timestamp prefix is
+// cached, and only regenerated when the wall-clock second changes.
+namespace {
+struct LogScratch
 {
-    static const unsigned int max_queue_size_allowed = 1024;
-    // Don't log if not enabled, or level is too low.
-    if (!logEnabled) return;
-    if (level > currentLevel) return;
-    if (nullptr == _log_writer) return;
+    std::string buf;
+    time_t stamp_sec = -1;
+    char stamp[64];
+    std::string thread_id;
 
-    std::ostringstream oss;
+    LogScratch() { buf.reserve(512); }
+};
+
+LogScratch& log_scratch()
+{
+    thread_local LogScratch scratch;
+    return scratch;
+}
+
+// Don't let a single giant message pin down memory forever.
+#define MAX_RETAINED_SCRATCH_SIZE (1<<16)
+}
+
+void Logger::format_header(Logger::Level level, std::string& buf) const
+{
+    LogScratch& scr = log_scratch();
     if (timestampEnabled)
     {
         struct timeval stv;
-        struct tm stm;
-        char timestamp[64];
-        char timestampStr[256];
-
-
         ::gettimeofday(&stv, NULL);
-        time_t t = stv.tv_sec;
-        gmtime_r(&t, &stm);
-        strftime(timestamp, sizeof(timestamp), "%F %T", &stm);
-        snprintf(timestampStr, sizeof(timestampStr),
-                "[%s:%03ld] ",timestamp, (long)stv.tv_usec / 1000);
-        oss << timestampStr;
+        if (stv.tv_sec != scr.stamp_sec)
+        {
+            struct tm stm;
+            time_t t = stv.tv_sec;
+            gmtime_r(&t, &stm);
+            strftime(scr.stamp, sizeof(scr.stamp), "%F %T", &stm);
+            scr.stamp_sec = stv.tv_sec;
+        }
+        char msec[24];
+        snprintf(msec, sizeof(msec), ":%03ld] ", (long)stv.tv_usec / 1000);
+        buf += '[';
+        buf += scr.stamp;
+        buf += msec;
     }
 
     if (printLevel)
-        oss << "[" << get_level_string(level) << "] ";
+    {
+        buf += '[';
+        buf += get_level_string(level);
+        buf += "] ";
+    }
 
     if (!component.empty())
-        oss << "[" << component << "] ";
+    {
+        buf += '[';
+        buf += component;
+        buf += "] ";
+    }
 
     if (threadIdEnabled)
-        oss << "[thread-" << std::this_thread::get_id() << "] ";
+    {
+        if (scr.thread_id.empty())
+        {
+            std::ostringstream oss;
+            oss << "[thread-" << std::this_thread::get_id() << "] ";
+            scr.thread_id = oss.str();
+        }
+        buf += scr.thread_id;
+    }
+}
+
+bool Logger::admit(Logger::Level level, unsigned long nmsgs)
+{
+    if (GROW == backpressure) return true;
 
-    oss << txt << std::endl;
+    size_t pending = _log_writer->size();
+    if (pending <= highWaterMark) return true;
 
-#if defined(HAVE_GNU_BACKTRACE)
-    if (level <= backTraceLevel)
+    if (over_drop_mark(backpressure, highWaterMark, level, pending))
     {
-        prt_backtrace(oss);
+        _log_writer->dropped_count += nmsgs;
+        return false;
     }
-#endif
 
-    _log_writer->qmsg(oss.str());
+    // WARN and ERROR get to use up to four times the high-water mark,
+    // before they too have to wait.
+    if (DROP_LOWEST_LEVEL == backpressure and pending <= 4 * highWaterMark)
+        return true;
 
     // If the queue gets too full, block until it's flushed to
     // file. This can sometimes happen, if some component is spewing
     // lots of debugging messages in a tight loop.
-    if (_log_writer->size() > max_queue_size_allowed) flush();
+    _log_writer->stalled_count++;
+    flush();
+    return true;
+}
+
+bool Logger::buffer_message(Logger::Level level, std::string& buf,
+                            Logger::Level& batch_level,
+                            unsigned long& nmsgs)
+{
+    using namespace std::chrono;
+    LogWriter::ThreadBuffer* tb = _log_writer->thread_buffer();
+    std::lock_guard<std::mutex> lock(tb->mtx);
+
+    steady_clock::time_point now = steady_clock::now();
+    if (tb->data.empty()) tb->oldest = now;
+    tb->data += buf;
+    tb->nmsgs++;
+    tb->level = std::min(tb->level, level);
+    tb->max_delay = milliseconds(threadBufferDelay);
+    tb->backpressure = backpressure;
+    tb->high_water_mark = highWaterMark;
+
+    if (tb->data.size() < threadBufferSize and
+        now < tb->oldest + tb->max_delay and
+        ERROR < level and backTraceLevel < level and not syncEnabled)
+    {
+        buf.clear();
+        return false;
+    }
+
+    // Swap, rather than copy, so that both strings keep their storage.
+    buf.swap(tb->data);
+    batch_level = tb->level;
+    nmsgs = tb->nmsgs;
+    tb->data.clear();
+    tb->nmsgs = 0;
+    tb->level = BAD_LEVEL;
+    return true;
+}
+
+void Logger::write_formatted(Logger::Level level, std::string& buf,
+                             bool with_backtrace)
+{
+    // Buffered messages are subjected to backpressure only when the
+    // buffer is handed off.
+    bool buffered = (0 < threadBufferSize);
+    if (not buffered and not admit(level))
+    {
+        buf.clear();
+        return;
+    }
+
+#if defined(HAVE_GNU_BACKTRACE)
+    if (with_backtrace and level <= backTraceLevel and not binaryEnabled)
+    {
+        std::ostringstream oss;
+        prt_backtrace(oss);
+        buf += oss.str();
+    }
+#endif
+
+    // Write to stdout.
+    if (printToStdout and not binaryEnabled)
+    {
+        std::cout.write(buf.data(), buf.size());
+        std::cout.flush();
+    }
+
+    Level batch_level = level;
+    unsigned long nmsgs = 1;
+    if (buffered)
+    {
+        if (not buffer_message(level, buf, batch_level, nmsgs)) return;
+        if (not admit(batch_level, nmsgs))
+        {
+            buf.clear();
+            return;
+        }
+    }
+
+    // A full ring is just another form of backpressure.
+    if (not _log_writer->qmsg(buf, not may_drop(backpressure, batch_level)))
+        _log_writer->dropped_count += nmsgs;
 
     // Errors are associated with imminent crashes. Make sure that the
     // stack trace is written to disk *before* the crash happens! Yes,
@@ -543,43 +1329,125 @@ void Logger::log(Logger::Level level, const std::string &txt)
 
     if (syncEnabled) flush();
 
-    // Write to stdout.
-    if (printToStdout)
+    buf.clear();
+    if (MAX_RETAINED_SCRATCH_SIZE < buf.capacity())
+        buf.shrink_to_fit();
+}
+
+void Logger::log(Logger::Level level, const std::string &txt)
+{
+    // Don't log if not enabled, or level is too low.
+    if (!logEnabled) return;
+    if (level > currentLevel) return;
+    if (nullptr == _log_writer) return;
+
+    std::string& buf = log_scratch().buf;
+    buf.clear();
+    if (binaryEnabled)
     {
-        std::cout << oss.str();
-        std::cout.flush();
+        uint32_t comp_id = component.empty() ? 0 :
+            _log_writer->binlog_id(component.c_str());
+        binlog_append_text(buf, comp_id, level, txt);
+        write_formatted(level, buf);
+        return;
+    }
+    format_header(level, buf);
+    buf += txt;
+    buf += '\n';
+
+    write_formatted(level, buf);
+}
+
+void Logger::log_backtrace(Logger::Level level, const std::string& txt,
+                           void* const* frames, int depth)
+{
+    if (!logEnabled) return;
+    if (level > currentLevel) return;
+    if (nullptr == _log_writer) return;
+
+    std::string& buf = log_scratch().buf;
+    buf.clear();
+    if (binaryEnabled)
+    {
+        uint32_t comp_id = component.empty() ? 0 :
+            _log_writer->binlog_id(component.c_str());
+        binlog_append_text(buf, comp_id, level, txt);
+        write_formatted(level, buf, false);
+        return;
     }
+    format_header(level, buf);
+    buf += txt;
+    buf += '\n';
+
+#if defined(HAVE_GNU_BACKTRACE)
+    if (level <= backTraceLevel and 0 < depth)
+    {
+        std::ostringstream oss;
+        prt_backtrace(oss, frames, depth, 0);
+        buf += oss.str();
+    }
+#endif
+
+    write_formatted(level, buf, false);
 }
 
 void Logger::backtrace()
 {
     if (nullptr == _log_writer) return;
 
-    static const unsigned int max_queue_size_allowed = 1024;
     std::ostringstream oss;
 
     #if defined(HAVE_GNU_BACKTRACE)
     prt_backtrace(oss);
     #endif
 
+    if (not admit(ERROR)) return;
     _log_writer->qmsg(oss.str());
-
-    // If the queue gets too full, block until it's flushed to file or
-    // stdout. This can sometimes happen, if some component is spewing
-    // lots of debugging messages in a tight loop.
-    if (_log_writer->size() > max_queue_size_allowed) {
-        flush();
-    }
 }
 
+/// Format printf-style directly into the per-thread buffer, right
+/// after the header; no intermediate std::string is created.
 void Logger::logva(Logger::Level level, const char *fmt, va_list args)
 {
-    if (level <= currentLevel) {
-        char buffer[MAX_PRINTF_STYLE_MESSAGE_SIZE];
-        vsnprintf(buffer, sizeof(buffer), fmt, args);
-        std::string msg = buffer;
-        log(level, msg);
+    if (!logEnabled) return;
+    if (level > currentLevel) return;
+    if (nullptr == _log_writer) return;
+
+    std::string& buf = log_scratch().buf;
+    buf.clear();
+    if (binaryEnabled)
+    {
+        uint32_t fmt_id = _log_writer->binlog_id(fmt);
+        uint32_t comp_id = component.empty() ? 0 :
+            _log_writer->binlog_id(component.c_str());
+        binlog_append_message(buf, fmt_id, comp_id, level, fmt, args);
+        write_formatted(level, buf);
+        return;
     }
+    format_header(level, buf);
+
+    size_t off = buf.size();
+    size_t avail = buf.capacity() - off;
+    if (avail < 256) avail = 256;
+    buf.resize(off + avail);
+
+    va_list cpy;
+    va_copy(cpy, args);
+    int n = vsnprintf(&buf[off], avail, fmt, cpy);
+    va_end(cpy);
+    if (n < 0) n = 0;
+
+    // Messages greater than MAX_PRINTF_STYLE_MESSAGE_SIZE are truncated.
+    size_t len = std::min((size_t) n, (size_t) MAX_PRINTF_STYLE_MESSAGE_SIZE - 1);
+    if (avail <= len)
+    {
+        buf.resize(off + len + 1);
+        vsnprintf(&buf[off], len + 1, fmt, args);
+    }
+    buf.resize(off + len);
+    buf += '\n';
+
+    write_formatted(level, buf);
 }
 
 void Logger::log(Logger::Level level, const char *fmt, ...)
@@ -27,14 +27,20 @@
 #ifndef _OPENCOG_LOGGER_H
 #define _OPENCOG_LOGGER_H
 
+#include <atomic>
+#include <condition_variable>
 #include <cstdarg>
+#include <cstdint>
+#include <ctime>
 #include <map>
 #include <mutex>
+#include <set>
 #include <sstream>
 #include <string>
 #include <thread>
 
 #include <opencog/util/concurrent_queue.h>
+#include <opencog/util/mpsc_ring.h>
 
 namespace opencog
 {
@@ -50,6 +56,27 @@ public:
 
     enum Level { NONE, ERROR, WARN, INFO, DEBUG, FINE, BAD_LEVEL=255 };
 
+    /**
+     * What to do when messages are produced faster than the writer
+     * thread can write them, i.e. when the number of pending messages
+     * exceeds the high-water mark.
+     *
+     * BLOCK: the logging thread waits until the backlog is written.
+     * DROP_NEWEST: the message being logged is discarded.
+     * DROP_LOWEST_LEVEL: the least important messages are discarded
+     *     first: FINE messages above the high-water mark, DEBUG above
+     *     twice the mark, INFO above three times the mark.  WARN and
+     *     ERROR messages are never discarded; they BLOCK above four
+     *     times the mark.
+     * GROW: the backlog is allowed to grow without bound.
+     */
+    enum Backpressure { BLOCK, DROP_NEWEST, DROP_LOWEST_LEVEL, GROW };
+
+    /**
+     * How rotated log files are compressed.
+     */
+    enum Compression { NO_COMPRESSION, GZIP, ZSTD };
+
     /**
      * Convert from string to enum (ignoring case), and vice-versa.
      */
@@ -169,6 +196,90 @@ public:
      */
     void set_sync_flag(bool);
 
+    /**
+     * Pass messages to the writer thread through a bounded, lock-free
+     * ring of nslots pre-allocated message slots, instead of through
+     * the default (unbounded, mutex-protected) queue.  Producers only
+     * need an atomic slot reservation; the writer thread drains the
+     * ring in batches, with one writev() per batch.  If the ring is
+     * full, the logging thread waits until a slot frees up.
+     *
+     * The setting applies to every logger writing to the same file,
+     * and cannot be undone.
+     */
+    void set_ring_buffer(size_t nslots);
+
+    /**
+     * Collect the messages logged by each thread into a thread-local
+     * buffer of (about) nbytes, and hand that buffer to the writer
+     * thread as a whole: when it is full, when its oldest message is
+     * max_delay_ms old, on flush(), and whenever an ERROR (or a
+     * message with a back trace) is logged. This saves a queue
+     * operation, and often a wakeup of the writer thread, for every
+     * message; it pays off for components that log in tight loops.
+     *
+     * Messages from different threads are then no longer written in
+     * the order in which they were logged; use the timestamps to
+     * recover that order. Backpressure applies to whole buffers,
+     * whether they are handed off when full, by flush(), after the
+     * delay, or when their thread exits; in the last three cases,
+     * BLOCK waits only for room in the ring (see set_ring_buffer()).
+     * Zero (the default) turns buffering off.
+     */
+    void set_thread_buffer(size_t nbytes, unsigned max_delay_ms = 100);
+    size_t get_thread_buffer() const;
+
+    /**
+     * If set, messages are written as binary records (see
+     * binary_log.h) instead of text. printf-style messages are not
+     * formatted at all: the format string is written once, and each
+     * message only carries the raw argument bytes, the level, a
+     * monotonic timestamp and the thread id. Use the cogutil-logdecode
+     * tool to render the log file as text.
+     *
+     * All loggers writing to the same file must agree on this flag.
+     * Binary messages are not printed to stdout, and do not carry
+     * back traces.
+     */
+    void set_binary_flag(bool);
+    bool get_binary_flag() const;
+
+    /**
+     * Set the backpressure policy, and the high-water mark, in number
+     * of pending messages, at which it kicks in. The default is to
+     * BLOCK above 1024 pending messages.
+     */
+    void set_backpressure(Backpressure, size_t high_water_mark = 1024);
+    Backpressure get_backpressure() const;
+    size_t get_high_water_mark() const;
+
+    /**
+     * Number of messages discarded, and number of times a logging
+     * thread had to wait, because of backpressure. These are counted
+     * per log file, across all loggers writing to that file.
+     */
+    unsigned long get_dropped_count() const;
+    unsigned long get_stalled_count() const;
+
+    /**
+     * Rotate the log file once it grows past max_bytes, or once it has
+     * been open for more than max_seconds; a value of zero disables
+     * the corresponding limit. The full file is renamed to
+     *
+     *     <filename>.YYYYmmdd-HHMMSS.uuuuuu
+     *
+     * (local time, in microseconds) and a fresh file is started. Only
+     * the newest keep rotated files are retained; zero retains all of
+     * them. Rotated files may be compressed by running the gzip or
+     * zstd command in the background.
+     *
+     * Rotation is done by the writer thread, and compression by a
+     * child process; logging threads never wait for either. The
+     * setting applies to every logger writing to the same file.
+     */
+    void set_rotation(size_t max_bytes, unsigned max_seconds = 0,
+                      unsigned keep = 0, Compression = NO_COMPRESSION);
+
     /**
      * Set the main logger to print only
      * error level log on stdout (useful when one is only interested
@@ -191,6 +302,15 @@ public:
     // Log the backtrace, and only it
     void backtrace();
 
+    /**
+     * Log a message, like log(), but if the level calls for a stack
+     * trace, print that of the return addresses frames[0, depth), as
+     * captured earlier by backtrace(3), rather than the current one.
+     * Only then are the addresses resolved to symbol names.
+     */
+    void log_backtrace(Level level, const std::string&,
+                       void* const* frames, int depth);
+
     /**
      * Log a message (printf style) into log file (passed in constructor)
      * if and only if passed level is lower than or equals to the current
@@ -320,6 +440,11 @@ private:
     bool printToStdout;
     bool printLevel;
     bool syncEnabled;
+    bool binaryEnabled;
+    Backpressure backpressure;
+    size_t highWaterMark;
+    size_t threadBufferSize;
+    unsigned threadBufferDelay;
 
     /**
      * Enable logging messages.
@@ -331,6 +456,27 @@ private:
      */
     void disable();
 
+    /**
+     * Append the message header (timestamp, level, component, thread
+     * id) to the buffer, and hand the completed message to the writer.
+     */
+    void format_header(Level, std::string&) const;
+    void write_formatted(Level, std::string&, bool with_backtrace = true);
+
+    /**
+     * Apply the backpressure policy to nmsgs messages, the most
+     * important of which has the given level. Return false if they
+     * should be dropped.
+     */
+    bool admit(Level, unsigned long nmsgs = 1);
+
+    /**
+     * Append the message to this thread's buffer. Return false if it
+     * is to stay there. Otherwise, return true, with the contents of
+     * the buffer moved into the string, ready to be queued.
+     */
+    bool buffer_message(Level, std::string&, Level&, unsigned long&);
+
     class LogWriter
     {
         /* One writer per file */
@@ -346,10 +492,51 @@ private:
         concurrent_queue< std::string* > msg_queue;
         bool pending_write;
 
+        /** Optional lock-free ring, used instead of the queue. */
+        std::atomic<mpsc_ring<std::string>*> msg_ring;
+        std::atomic<bool> ring_sleeping;
+        std::mutex ring_mutex;
+        std::condition_variable ring_cond;
+
+        /** String ids for binary-mode logging */
+        std::mutex binlog_mutex;
+        std::map<std::string, uint32_t, std::less<>> binlog_ids;
+
+        /** All binary-mode definitions so far; repeated at the start
+         * of each rotated file. */
+        std::mutex binlog_header_mutex;
+        std::string binlog_header;
+
+    public:
+        struct ThreadBuffer;
+    private:
+        /** Per-thread buffers, see set_thread_buffer(). */
+        std::mutex tbuf_mutex;
+        std::set<ThreadBuffer*> tbufs;
+        std::thread tbuf_thread;
+        bool tbuf_active;
+        std::condition_variable tbuf_cond;
+        void tbuf_loop();
+        void hand_off(ThreadBuffer&);
+
+        /** Log rotation; all protected by the_mutex. */
+        size_t rotate_bytes;
+        unsigned rotate_secs;
+        unsigned rotate_keep;
+        Compression rotate_compress;
+        size_t file_bytes;
+        time_t file_opened;
+
         void start_write_loop();
         void stop_write_loop();
         void writing_loop();
+        void ring_loop();
+        void wake_ring_loop();
+        bool open_logfile();
         void write_msg(const std::string&);
+        void write_ring_batch(mpsc_ring<std::string>*, size_t);
+        void maybe_rotate();
+        void rotate();
 
     public:
         LogWriter(void);
@@ -360,11 +547,31 @@ private:
         const std::string& getFileName(void) const
             { return fileName; }
 
-        void qmsg(const std::string& str)
-            { msg_queue.push(new std::string(str)); }
+        void useRing(size_t nslots);
 
-        size_t size(void)
-            { return msg_queue.size(); }
+        void setRotation(size_t max_bytes, unsigned max_seconds,
+                         unsigned keep, Compression);
+
+        /**
+         * Queue the message for writing. If wait is false, and the
+         * ring is in use and is full, the message is not queued, and
+         * false is returned.
+         */
+        bool qmsg(const std::string& str, bool wait = true);
+
+        /** This thread's buffer for this writer. */
+        ThreadBuffer* thread_buffer();
+
+        std::atomic<unsigned long> dropped_count;
+        std::atomic<unsigned long> stalled_count;
+
+        /**
+         * Return the binary-log id for the string, writing out its
+         * definition record if it has not been seen before.
+         */
+        uint32_t binlog_id(const char*);
+
+        size_t size(void);
 
         void flush();
     };
@@ -386,6 +593,13 @@ Logger& logger();
 #define LAZY_LOG_DEBUG if(logger().is_debug_enabled()) logger().debug()
 #define LAZY_LOG_FINE if(logger().is_fine_enabled()) logger().fine()
 
+// printf-style variant of the above; the arguments are not evaluated
+// unless the level is enabled. For example:
+// LAZY_LOGF(DEBUG, "Count = %d", expensive_count());
+#define LAZY_LOGF(LVL, ...) \
+    do { if (logger().is_enabled(opencog::Logger::LVL)) \
+        logger().log(opencog::Logger::LVL, __VA_ARGS__); } while(0)
+
 /** @}*/
 }  // namespace opencog
 
@@ -23,10 +23,16 @@
 #ifndef _OPENCOG_MANNWHITNEYU_H
 #define _OPENCOG_MANNWHITNEYU_H
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
 #include <boost/range/numeric.hpp>
 #include <boost/range/adaptor/map.hpp>
 
 #include <opencog/util/Counter.h>
+#include <opencog/util/oc_omp.h>
 #include <opencog/util/ranking.h>
 
 namespace opencog {
@@ -50,7 +56,7 @@ FloatT MannWhitneyU(const Counter<Key, FloatT>& c1,
     counter_t r = ranking(c);
     FloatT sum2 = 0;
     for (const auto& v : c2)
-        sum2 += r[v.first];
+        sum2 += r[v.first] * v.second;
     if (n2 < 0)
         n2 = boost::accumulate(c2 | map_values, 0);
     return sum2 - n2*(n2+1)/2;
@@ -74,6 +80,74 @@ FloatT standardizedMannWhitneyU(const Counter<Key, FloatT>& c1,
     return (U - mU) / sU;
 }
 
+/**
+ * Same as MannWhitneyU above, given the 2 samples as sorted arrays
+ * (with their duplicates) instead of Counters. Rather than ranking the
+ * union of both, U_2 is worked out directly as the number of pairs
+ * (x1, x2) with x1 < x2, plus half of those with x1 == x2, in one
+ * merge of the arrays, with no allocation. When sorted2 is much
+ * shorter than sorted1, the elements of sorted2 are located in
+ * sorted1 by binary search instead, in O(n2 log n1).
+ */
+template<typename T>
+double MannWhitneyU(const T* sorted1, size_t n1,
+                    const T* sorted2, size_t n2) {
+    const T* end1 = sorted1 + n1;
+    const T* end2 = sorted2 + n2;
+    bool search = 32 * n2 < n1;
+    const T* it1 = sorted1;
+    double U = 0;
+    for (const T* it2 = sorted2; it2 != end2;) {
+        const T& x = *it2;
+        const T* next2 = it2 + 1;
+        while (next2 != end2 and not (x < *next2)) ++next2;
+        const T *lo, *hi;
+        if (search) {
+            lo = std::lower_bound(it1, end1, x);
+            hi = std::upper_bound(lo, end1, x);
+        } else {
+            for (lo = it1; lo != end1 and *lo < x; ++lo);
+            for (hi = lo; hi != end1 and not (x < *hi); ++hi);
+        }
+        U += (next2 - it2) * ((lo - sorted1) + 0.5 * (hi - lo));
+        it1 = hi;
+        it2 = next2;
+    }
+    return U;
+}
+
+//! Same as standardizedMannWhitneyU above, given sorted arrays
+template<typename T>
+double standardizedMannWhitneyU(const T* sorted1, size_t n1,
+                                const T* sorted2, size_t n2) {
+    double U = MannWhitneyU(sorted1, n1, sorted2, n2),
+        mU = double(n1)*n2/2,
+        sU = sqrt(mU*(n1+n2+1)/6);
+    return (U - mU) / sU;
+}
+
+/**
+ * Standardized Mann-Whitney U of each of many samples against one
+ * reference, given as sorted contiguous containers (std::vector,
+ * std::array...). The i-th result compares samples[i], as the second
+ * sample, to ref. The samples are spread over the threads set by
+ * setting_omp().
+ */
+template<typename Container, typename Samples>
+std::vector<double>
+standardizedMannWhitneyUs(const Container& ref, const Samples& samples) {
+    std::vector<double> res(samples.size());
+    long n = samples.size();
+#ifdef OC_OMP
+    #pragma omp parallel for num_threads(num_threads()) schedule(dynamic)
+#endif
+    for (long i = 0; i < n; i++)
+        res[i] = standardizedMannWhitneyU(ref.data(), ref.size(),
+                                          samples[i].data(),
+                                          samples[i].size());
+    return res;
+}
+
 /** @}*/
 } // ~namespace opencog
 
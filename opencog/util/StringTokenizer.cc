@@ -26,6 +26,10 @@
 
 #include <cstring>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <opencog/util/exceptions.h>
 #include <opencog/util/oc_assert.h>
 
@@ -140,3 +144,72 @@ std::vector<std::string> AltStringTokenizer::without_empty() const
     return ret;
 }
 
+
+string_view_tokenizer::string_view_tokenizer(std::string_view str,
+                                             std::string_view delimiters)
+    : _first(str.data()), _last(str.data() + str.size()),
+      _delimiters(delimiters), _is_delimiter{}
+{
+    for (unsigned char c : _delimiters)
+        _is_delimiter[c >> 6] |= uint64_t(1) << (c & 63);
+}
+
+string_view_tokenizer::iterator string_view_tokenizer::begin() const
+{
+    iterator it(this, skip_delimiters(_first));
+    it._end = find_delimiter(it._begin);
+    return it;
+}
+
+std::vector<std::string_view> string_view_tokenizer::to_vector() const
+{
+    return std::vector<std::string_view>(begin(), end());
+}
+
+#ifdef __SSE2__
+// A bit per character of the 16 at p, set if it is one of the
+// delimiters. Beyond a handful of delimiters, the table lookup of the
+// scalar loop is as fast.
+static inline unsigned delimiter_mask(const char* p, const std::string& delims)
+{
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i eq = _mm_setzero_si128();
+    for (char d : delims)
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(d)));
+    return _mm_movemask_epi8(eq);
+}
+static const size_t max_simd_delimiters = 8;
+#endif
+
+const char* string_view_tokenizer::find_delimiter(const char* p) const
+{
+    if (1 == _delimiters.size())
+    {
+        const void* d = std::memchr(p, _delimiters[0], _last - p);
+        return d ? static_cast<const char*>(d) : _last;
+    }
+#ifdef __SSE2__
+    if (_delimiters.size() <= max_simd_delimiters)
+        for (; p + 16 <= _last; p += 16)
+            if (unsigned m = delimiter_mask(p, _delimiters))
+                return p + __builtin_ctz(m);
+#endif
+    while (p < _last and not is_delimiter(*p)) p++;
+    return p;
+}
+
+const char* string_view_tokenizer::skip_delimiters(const char* p) const
+{
+    // Tokens are mostly separated by a single delimiter, so look at
+    // the first character before setting up a vector search.
+    if (p == _last or not is_delimiter(*p)) return p;
+    p++;
+#ifdef __SSE2__
+    if (_delimiters.size() <= max_simd_delimiters)
+        for (; p + 16 <= _last; p += 16)
+            if (unsigned m = ~delimiter_mask(p, _delimiters) & 0xffff)
+                return p + __builtin_ctz(m);
+#endif
+    while (p < _last and is_delimiter(*p)) p++;
+    return p;
+}
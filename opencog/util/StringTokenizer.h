@@ -25,7 +25,11 @@
 #ifndef _OPENCOG_STRING_TOKENIZER_H
 #define _OPENCOG_STRING_TOKENIZER_H
 
+#include <array>
+#include <cstdint>
+#include <iterator>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace opencog
@@ -100,6 +104,81 @@ private:
 
 }; // class
 
+//! Tokenize a string lazily, into views of it
+/**
+ * The tokens are the maximal runs of characters that are not any of
+ * the delimiters, as for AltStringTokenizer and tokenize() in misc.h,
+ * but nothing is copied nor allocated: iterating yields
+ * std::string_views into the string, which must outlive them.
+ *
+ *     for (std::string_view tok : string_view_tokenizer(line, " \t"))
+ *         ...
+ *
+ * The delimiters are searched 16 characters at a time, with SSE2 when
+ * available, or with memchr for a single delimiter.
+ */
+class string_view_tokenizer
+{
+public:
+    string_view_tokenizer(std::string_view str,
+                          std::string_view delimiters = " ,\n");
+
+    class iterator
+    {
+        friend class string_view_tokenizer;
+        const string_view_tokenizer* _tk;
+        const char* _begin;     //!< of the token
+        const char* _end;       //!< of the token
+
+        iterator(const string_view_tokenizer* tk, const char* p)
+            : _tk(tk), _begin(p), _end(p) {}
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::string_view value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::string_view* pointer;
+        typedef std::string_view reference;
+
+        iterator() : _tk(nullptr), _begin(nullptr), _end(nullptr) {}
+
+        std::string_view operator*() const
+        { return std::string_view(_begin, _end - _begin); }
+
+        iterator& operator++()
+        {
+            _begin = _tk->skip_delimiters(_end);
+            _end = _tk->find_delimiter(_begin);
+            return *this;
+        }
+        iterator operator++(int) { iterator it = *this; ++*this; return it; }
+
+        bool operator==(const iterator& it) const { return _begin == it._begin; }
+        bool operator!=(const iterator& it) const { return _begin != it._begin; }
+    };
+
+    iterator begin() const;
+    iterator end() const { return iterator(this, _last); }
+
+    //! The tokens, as a vector
+    std::vector<std::string_view> to_vector() const;
+
+private:
+    const char* _first;
+    const char* _last;
+    std::string _delimiters;
+    //! _is_delimiter[c / 64] >> (c % 64) & 1 for unsigned char c
+    std::array<uint64_t, 4> _is_delimiter;
+
+    bool is_delimiter(unsigned char c) const
+    { return (_is_delimiter[c >> 6] >> (c & 63)) & 1; }
+
+    //! The first delimiter in [p, _last), or _last if none
+    const char* find_delimiter(const char* p) const;
+    //! The first non-delimiter in [p, _last), or _last if none
+    const char* skip_delimiters(const char* p) const;
+};
+
 /** @}*/
 }  // namespace
 
@@ -0,0 +1,188 @@
+/*
+ * opencog/util/affinity.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <opencog/util/affinity.h>
+
+using namespace opencog;
+
+#ifdef __linux__
+
+// Parse a list of CPUs such as "0-3,8,10-11"
+static std::vector<unsigned> parse_cpulist(const std::string& list)
+{
+    std::vector<unsigned> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ','))
+    {
+        unsigned lo, hi;
+        char dash;
+        std::stringstream rs(range);
+        if (not (rs >> lo)) continue;
+        if (rs >> dash >> hi and '-' == dash)
+            for (unsigned c = lo; c <= hi; c++) cpus.push_back(c);
+        else
+            cpus.push_back(lo);
+    }
+    return cpus;
+}
+
+static cpu_topology read_topology()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (0 != sched_getaffinity(0, sizeof(allowed), &allowed))
+        for (unsigned c = 0; c < std::thread::hardware_concurrency(); c++)
+            CPU_SET(c, &allowed);
+
+    cpu_topology topo;
+    const char* sysnode = "/sys/devices/system/node";
+    if (DIR* dir = opendir(sysnode))
+    {
+        while (struct dirent* ent = readdir(dir))
+        {
+            unsigned id;
+            char rest;
+            if (1 != sscanf(ent->d_name, "node%u%c", &id, &rest)) continue;
+            std::ifstream in(std::string(sysnode) + "/" + ent->d_name + "/cpulist");
+            std::string list;
+            std::getline(in, list);
+            cpu_topology::node node{id, {}};
+            for (unsigned c : parse_cpulist(list))
+                if (c < CPU_SETSIZE and CPU_ISSET(c, &allowed))
+                    node.cpus.push_back(c);
+            if (not node.cpus.empty()) topo.nodes.push_back(node);
+        }
+        closedir(dir);
+    }
+    std::sort(topo.nodes.begin(), topo.nodes.end(),
+              [](const cpu_topology::node& a, const cpu_topology::node& b)
+              { return a.id < b.id; });
+
+    if (topo.nodes.empty())
+    {
+        cpu_topology::node node{0, {}};
+        for (unsigned c = 0; c < CPU_SETSIZE; c++)
+            if (CPU_ISSET(c, &allowed)) node.cpus.push_back(c);
+        topo.nodes.push_back(node);
+    }
+    return topo;
+}
+
+static bool pin(pthread_t th, const std::vector<unsigned>& cpus)
+{
+    if (cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned c : cpus)
+    {
+        if (CPU_SETSIZE <= c) return false;
+        CPU_SET(c, &set);
+    }
+    return 0 == pthread_setaffinity_np(th, sizeof(set), &set);
+}
+
+static bool pin_node(pthread_t th, unsigned node)
+{
+    const cpu_topology& topo = get_cpu_topology();
+    if (topo.n_nodes() <= node) return false;
+    return pin(th, topo.nodes[node].cpus);
+}
+
+bool opencog::pin_thread_to_cpu(std::thread& t, unsigned cpu)
+{
+    return pin(t.native_handle(), {cpu});
+}
+
+bool opencog::pin_thread_to_node(std::thread& t, unsigned node)
+{
+    return pin_node(t.native_handle(), node);
+}
+
+bool opencog::pin_this_thread_to_cpu(unsigned cpu)
+{
+    return pin(pthread_self(), {cpu});
+}
+
+bool opencog::pin_this_thread_to_node(unsigned node)
+{
+    return pin_node(pthread_self(), node);
+}
+
+int opencog::current_cpu()
+{
+    return sched_getcpu();
+}
+
+#else // __linux__
+
+static cpu_topology read_topology()
+{
+    cpu_topology topo;
+    cpu_topology::node node{0, {}};
+    unsigned n = std::max(1U, std::thread::hardware_concurrency());
+    for (unsigned c = 0; c < n; c++) node.cpus.push_back(c);
+    topo.nodes.push_back(node);
+    return topo;
+}
+
+bool opencog::pin_thread_to_cpu(std::thread&, unsigned) { return false; }
+bool opencog::pin_thread_to_node(std::thread&, unsigned) { return false; }
+bool opencog::pin_this_thread_to_cpu(unsigned) { return false; }
+bool opencog::pin_this_thread_to_node(unsigned) { return false; }
+int opencog::current_cpu() { return -1; }
+
+#endif // __linux__
+
+size_t cpu_topology::n_cpus() const
+{
+    size_t n = 0;
+    for (const node& nd : nodes) n += nd.cpus.size();
+    return n;
+}
+
+const cpu_topology& opencog::get_cpu_topology()
+{
+    static const cpu_topology topo = read_topology();
+    return topo;
+}
+
+int opencog::current_numa_node()
+{
+    int cpu = current_cpu();
+    if (cpu < 0) return -1;
+    const cpu_topology& topo = get_cpu_topology();
+    for (size_t i = 0; i < topo.n_nodes(); i++)
+        if (std::binary_search(topo.nodes[i].cpus.begin(),
+                               topo.nodes[i].cpus.end(), unsigned(cpu)))
+            return i;
+    return -1;
+}
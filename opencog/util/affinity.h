@@ -0,0 +1,109 @@
+/*
+ * opencog/util/affinity.h
+ *
+ * Placement of threads on CPUs and NUMA nodes.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_AFFINITY_H
+#define _OPENCOG_AFFINITY_H
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include <opencog/util/oc_omp.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! The NUMA nodes of the machine, and the CPUs of each.
+///
+/// Read once, from /sys/devices/system/node, and restricted to the
+/// CPUs that the process may run on (as set by taskset, cgroups and
+/// the like); nodes left with no CPU, such as memory-only nodes, are
+/// dropped. Without NUMA information, or off Linux, there is a single
+/// node, of all allowed CPUs.
+///
+/// Nodes are designated by their index in nodes, which is their
+/// system id only if no node was dropped.
+struct cpu_topology
+{
+    struct node
+    {
+        unsigned id;                //!< the system id of the node
+        std::vector<unsigned> cpus; //!< sorted
+    };
+    std::vector<node> nodes;
+
+    size_t n_nodes() const { return nodes.size(); }
+    size_t n_cpus() const;
+
+    //! The node that the n-th of a set of threads should run on, so
+    //! as to spread them evenly across nodes: n modulo the number
+    //! of nodes.
+    unsigned node_for(unsigned n) const { return n % nodes.size(); }
+};
+
+//! The topology of the machine
+const cpu_topology& get_cpu_topology();
+
+//! Restrict the thread to the CPU, or to the CPUs of the node (an
+//! index in get_cpu_topology().nodes). Return false if it cannot be
+//! done: no such CPU or node, or no support on this platform.
+bool pin_thread_to_cpu(std::thread&, unsigned cpu);
+bool pin_thread_to_node(std::thread&, unsigned node);
+
+//! Same as above, for the calling thread
+bool pin_this_thread_to_cpu(unsigned cpu);
+bool pin_this_thread_to_node(unsigned node);
+
+//! The CPU the calling thread is running on, or -1 if unknown
+int current_cpu();
+
+//! The node of the CPU the calling thread is running on, or -1 if
+//! unknown
+int current_numa_node();
+
+//! Initialize data[0, n) to T(), in parallel, each thread writing
+//! the part that it would get in an OpenMP loop of static schedule.
+/**
+ * The kernel places a page on the node of the thread that first
+ * writes it, so that the threads of later static loops over data
+ * find their part in local memory. For that, data must not have been
+ * written yet, as after new T[n] for a trivial T, or std::malloc, and
+ * the threads must not move between nodes (see pin_this_thread_to_node).
+ * Without OpenMP, it is a serial loop.
+ */
+template<typename T>
+void first_touch(T* data, size_t n)
+{
+    long ln = n;
+#ifdef OC_OMP
+    #pragma omp parallel for schedule(static) num_threads(num_threads())
+#endif
+    for (long i = 0; i < ln; i++)
+        data[i] = T();
+}
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_AFFINITY_H
@@ -2,14 +2,16 @@
 #define _OPENCOG_ALGORITHM_H
 
 #include <algorithm>
+#include <functional>
 #include <set>
+#include <type_traits>
+#include <vector>
 #include <boost/lexical_cast.hpp>
 #include <boost/bind/bind.hpp>
 
-#include <algorithm>
-
 #include <opencog/util/numeric.h>
 #include <opencog/util/exceptions.h>
+#include <opencog/util/oc_omp.h>
 
 namespace opencog
 {
@@ -269,6 +271,174 @@ Set set_symmetric_difference(const Set& s1, const Set& s2) {
 	return res;
 }
 
+/** @name Set algorithms over sorted vectors
+ *
+ * Overloads of the above for sets held in sorted vectors of unique
+ * elements (per std::less), which keep the elements contiguous and
+ * allocate the result once. Inputs of more than
+ * sorted_vector_parallel_min elements in all are split in
+ * num_threads() parts of equal size by merge path (Green et al.,
+ * "GPU merge path", 2012), processed in parallel. The intersection of
+ * integers compares blocks of elements at once, branch-free, in loops
+ * that the compiler vectorizes.
+ */
+///@{
+
+//! Total size of the inputs above which the set operations on sorted
+//! vectors run in parallel
+const size_t sorted_vector_parallel_min = 1 << 16;
+
+namespace detail {
+
+// Split the merge of a[0, n) and b[0, m) after d elements: return in
+// i and j the numbers of elements from a and from b (i + j == d, but
+// for one more in j where a[i-1] == b[j], so that equal elements stay
+// in the same part).
+template<typename T>
+void merge_path_split(const T* a, size_t n, const T* b, size_t m, size_t d,
+                      size_t& i, size_t& j)
+{
+	size_t lo = d > m ? d - m : 0, hi = std::min(d, n);
+	// The largest i such that a[i-1] <= b[d-i]
+	while (lo < hi) {
+		size_t mid = (lo + hi + 1) / 2;
+		if (not (b[d - mid] < a[mid - 1])) lo = mid;
+		else hi = mid - 1;
+	}
+	i = lo;
+	j = d - lo;
+	if (0 < i and j < m and not (a[i - 1] < b[j])) j++;
+}
+
+// The intersection of sorted unique integers, 8 by 8: each block of a
+// is compared to all of a block of b, then the block of smaller last
+// element is passed (or both). Return the end of out, which must have
+// room for n elements.
+template<typename T>
+T* intersect_blocks(const T* a, size_t n, const T* b, size_t m, T* out)
+{
+	const size_t B = 8;
+	size_t i = 0, j = 0;
+	while (i + B <= n and j + B <= m) {
+		unsigned char match[B] = {0};
+		for (size_t q = 0; q < B; q++) {
+			const T bq = b[j + q];
+#ifdef OC_OMP
+			#pragma omp simd
+#endif
+			for (size_t p = 0; p < B; p++)
+				match[p] |= a[i + p] == bq;
+		}
+		// Branch-free: write every element, keep the matched ones.
+		for (size_t p = 0; p < B; p++) {
+			*out = a[i + p];
+			out += match[p];
+		}
+		const T amax = a[i + B - 1], bmax = b[j + B - 1];
+		if (not (bmax < amax)) i += B;
+		if (not (amax < bmax)) j += B;
+	}
+	return std::set_intersection(a + i, a + n, b + j, b + m, out);
+}
+
+// The parts of the result of op(a, b), computed in parallel, and
+// concatenated. op(a, n, b, m, out) writes its result to out and
+// returns its end; it writes at most n + m elements.
+template<typename T, typename Op>
+std::vector<T> sorted_vector_op(const std::vector<T>& a,
+                                const std::vector<T>& b, Op op)
+{
+	OC_ASSERT(std::is_sorted(a.begin(), a.end()) and
+	          std::is_sorted(b.begin(), b.end()),
+	          "algorithm - vectors aren't sorted (sorted_vector_op).");
+	size_t n = a.size(), m = b.size();
+	unsigned nparts = std::min<size_t>(num_threads(),
+	                                   (n + m) / (sorted_vector_parallel_min / 4) + 1);
+	std::vector<T> res(n + m);
+	if (n + m < sorted_vector_parallel_min or nparts < 2) {
+		res.resize(op(a.data(), n, b.data(), m, res.data()) - res.data());
+		return res;
+	}
+
+	// Part k is a[ai[k], ai[k+1]) and b[bi[k], bi[k+1]); its result
+	// goes to res at ai[k] + bi[k], then moves down to offset[k].
+	std::vector<size_t> ai(nparts + 1), bi(nparts + 1), len(nparts);
+	for (unsigned k = 0; k <= nparts; k++)
+		merge_path_split(a.data(), n, b.data(), m, (n + m) * k / nparts,
+		                 ai[k], bi[k]);
+#ifdef OC_OMP
+	#pragma omp parallel for schedule(static, 1) num_threads(nparts)
+#endif
+	for (long k = 0; k < long(nparts); k++) {
+		T* out = res.data() + ai[k] + bi[k];
+		len[k] = op(a.data() + ai[k], ai[k + 1] - ai[k],
+		            b.data() + bi[k], bi[k + 1] - bi[k], out) - out;
+	}
+	size_t end = 0;
+	for (unsigned k = 0; k < nparts; k++) {
+		std::move(res.begin() + ai[k] + bi[k],
+		          res.begin() + ai[k] + bi[k] + len[k], res.begin() + end);
+		end += len[k];
+	}
+	res.resize(end);
+	return res;
+}
+
+} // ~namespace detail
+
+/**
+ * \return s1 union s2
+ * s1 and s2 must be sorted, with no duplicates
+ */
+template<typename T, typename A>
+std::vector<T, A> set_union(const std::vector<T, A>& s1,
+                            const std::vector<T, A>& s2) {
+	return detail::sorted_vector_op(s1, s2,
+		[](const T* a, size_t n, const T* b, size_t m, T* out) {
+			return std::set_union(a, a + n, b, b + m, out); });
+}
+
+/**
+ * \return s1 inter s2
+ * s1 and s2 must be sorted, with no duplicates
+ */
+template<typename T, typename A>
+std::vector<T, A> set_intersection(const std::vector<T, A>& s1,
+                                   const std::vector<T, A>& s2) {
+	return detail::sorted_vector_op(s1, s2,
+		[](const T* a, size_t n, const T* b, size_t m, T* out) {
+			if constexpr (std::is_integral<T>::value)
+				return detail::intersect_blocks(a, n, b, m, out);
+			else
+				return std::set_intersection(a, a + n, b, b + m, out);
+		});
+}
+
+/**
+ * \return s1 - s2
+ * s1 and s2 must be sorted, with no duplicates
+ */
+template<typename T, typename A>
+std::vector<T, A> set_difference(const std::vector<T, A>& s1,
+                                 const std::vector<T, A>& s2) {
+	return detail::sorted_vector_op(s1, s2,
+		[](const T* a, size_t n, const T* b, size_t m, T* out) {
+			return std::set_difference(a, a + n, b, b + m, out); });
+}
+
+/**
+ * determine if the intersection of two sets is the empty set
+ * s1 and s2 must be sorted
+ */
+template<typename T, typename A>
+bool has_empty_intersection(const std::vector<T, A>& s1,
+                            const std::vector<T, A>& s2) {
+	return has_empty_intersection(s1.begin(), s1.end(),
+	                              s2.begin(), s2.end(), std::less<T>());
+}
+
+///@}
+
 //! Predicate maps to the range [0, n)
 //! n-1 values (the pivots) are copied to out
 template<typename It, typename Pred, typename Out>
@@ -356,6 +526,114 @@ std::set<std::vector<typename C::value_type>> cartesian_product(const C& c,
 	return {{}};
 }
 
+/**
+ * The subsets of s, as powerset(s, n, exact) gives, but one at a
+ * time, and without holding them all:
+ *
+ *     lazy_powerset<std::set<int>> ps(s, 2);
+ *     while (not ps.empty()) {
+ *         std::set<int> subset = ps();
+ *         ...
+ *     }
+ *
+ * The subsets come by increasing size, and for each size, in
+ * lexicographic order of their elements (the order of s).
+ */
+template<typename Set>
+class lazy_powerset
+{
+public:
+	lazy_powerset(const Set& s, size_t n, bool exact=false)
+		: _elements(s.begin(), s.end()),
+		  _max(std::min(n, _elements.size()))
+	{
+		size_t k = exact ? n : 0;
+		if (k <= _max) start(k);
+		else _done = true;
+	}
+	explicit lazy_powerset(const Set& s) : lazy_powerset(s, s.size()) {}
+
+	//! true once all subsets have been returned
+	bool empty() const { return _done; }
+
+	//! return the next subset
+	Set operator()()
+	{
+		OC_ASSERT(not _done, "lazy_powerset - no more subsets.");
+		Set res;
+		for (size_t i : _idx) res.insert(res.end(), _elements[i]);
+		advance();
+		return res;
+	}
+
+private:
+	std::vector<typename Set::value_type> _elements;
+	size_t _max;
+	std::vector<size_t> _idx;   // of the next subset, increasing
+	bool _done = false;
+
+	void start(size_t k)
+	{
+		_idx.resize(k);
+		for (size_t i = 0; i < k; i++) _idx[i] = i;
+	}
+	void advance()
+	{
+		size_t k = _idx.size(), n = _elements.size();
+		// Increment the last index that can be, and reset the
+		// following ones right after it.
+		for (size_t i = k; i-- > 0;)
+			if (_idx[i] < n - k + i) {
+				_idx[i]++;
+				for (size_t j = i + 1; j < k; j++) _idx[j] = _idx[j - 1] + 1;
+				return;
+			}
+		if (k < _max) start(k + 1);
+		else _done = true;
+	}
+};
+
+/**
+ * The tuples of cartesian_product(c, nfold), one at a time, and
+ * without holding them all; in lexicographic order of the positions
+ * in c, which is the order of cartesian_product if c is a sorted set.
+ * Unlike cartesian_product, the tuples are not deduplicated if c has
+ * duplicates.
+ */
+template<typename C>
+class lazy_cartesian_product
+{
+public:
+	typedef std::vector<typename C::value_type> tuple_type;
+
+	lazy_cartesian_product(const C& c, size_t nfold=2)
+		: _elements(c.begin(), c.end()), _idx(nfold, 0),
+		  _done(_elements.empty() and 0 < nfold) {}
+
+	//! true once all tuples have been returned
+	bool empty() const { return _done; }
+
+	//! return the next tuple
+	tuple_type operator()()
+	{
+		OC_ASSERT(not _done, "lazy_cartesian_product - no more tuples.");
+		tuple_type res;
+		res.reserve(_idx.size());
+		for (size_t i : _idx) res.push_back(_elements[i]);
+		// Odometer increment
+		size_t i = _idx.size();
+		while (0 < i and ++_idx[i - 1] == _elements.size())
+			_idx[--i] = 0;
+		_done = 0 == i;
+		return res;
+	}
+
+private:
+	std::vector<typename C::value_type> _elements;
+	std::vector<size_t> _idx;   // of the next tuple
+	bool _done;
+};
+
 /**
  * Given a sequence of indexes, and a sequence of elements, return a
  * sequence of all elements corresponding to the indexes (in the order
@@ -0,0 +1,144 @@
+/*
+ * opencog/util/alias_sampler.h
+ *
+ * Constant time sampling from a fixed discrete distribution.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_ALIAS_SAMPLER_H
+#define _OPENCOG_ALIAS_SAMPLER_H
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#include <opencog/util/mt19937ar.h>
+#include <opencog/util/oc_assert.h>
+#include <opencog/util/RandGen.h>
+#include <opencog/util/rng_engines.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+/**
+ * Draws indices in [0, n) with probabilities proportional to n fixed,
+ * non-negative weights, using Walker's alias method (as built by
+ * Vose).
+ *
+ * Building the table takes O(n); after that each draw takes O(1): pick
+ * a column uniformly, then either keep it or take its alias, on a
+ * biased coin flip. Compare with RandGen::rand_discrete() and
+ * roulette_select(), which are O(n) per draw. Worth it as soon as
+ * more than a handful of draws are made from the same weights.
+ *
+ * Example:
+ *
+ *     alias_sampler pick(fitnesses.begin(), fitnesses.end());
+ *     for (auto& slot : next_generation)
+ *         slot = population[pick()];
+ */
+class alias_sampler
+{
+public:
+    alias_sampler() {}
+
+    template<typename It>
+    alias_sampler(It from, It to) { assign(from, to); }
+
+    alias_sampler(const std::vector<double>& weights)
+    { assign(weights.begin(), weights.end()); }
+
+    /// Rebuild the table for new weights. At least one weight must be
+    /// positive, and none negative.
+    template<typename It>
+    void assign(It from, It to)
+    {
+        size_t n = std::distance(from, to);
+        OC_ASSERT(0 < n, "alias_sampler - no weights.");
+        _prob.assign(n, 0.0);
+        _alias.assign(n, 0);
+
+        double sum = 0;
+        for (It it = from; it != to; ++it)
+        {
+            OC_ASSERT(0 <= double(*it), "alias_sampler - negative weight.");
+            sum += double(*it);
+        }
+        OC_ASSERT(0 < sum, "alias_sampler - all weights are zero.");
+
+        // Weights scaled so that their mean is 1; columns under 1 are
+        // topped up from columns over 1.
+        std::vector<double> scaled(n);
+        std::vector<unsigned> small, large;
+        small.reserve(n);
+        large.reserve(n);
+        size_t i = 0;
+        for (It it = from; it != to; ++it, ++i)
+        {
+            scaled[i] = double(*it) * n / sum;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+        while (not small.empty() and not large.empty())
+        {
+            unsigned s = small.back(), l = large.back();
+            small.pop_back();
+            _prob[s] = scaled[s];
+            _alias[s] = l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0)
+            {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // Whatever is left is 1, up to rounding.
+        for (unsigned l : large) { _prob[l] = 1.0; _alias[l] = l; }
+        for (unsigned s : small) { _prob[s] = 1.0; _alias[s] = s; }
+    }
+
+    /// Draw an index.
+    size_t operator()(RandGen& rng = randGen()) const
+    {
+        size_t i = rng.randint(_prob.size());
+        return rng.randdouble_one_excluded() < _prob[i] ? i : _alias[i];
+    }
+
+    /// Same as above, with one of the engines of rng_engines.h.
+    template<typename Engine,
+             typename std::enable_if<is_fast_engine<Engine>::value, int>::type = 0>
+    size_t operator()(Engine& eng) const
+    {
+        size_t i = rand_below(eng, _prob.size());
+        return rand_unit(eng) < _prob[i] ? i : _alias[i];
+    }
+
+    size_t size() const { return _prob.size(); }
+    bool empty() const { return _prob.empty(); }
+
+private:
+    std::vector<double> _prob;      // chance of keeping each column
+    std::vector<unsigned> _alias;   // what to take otherwise
+};
+
+/** @}*/
+} // ~namespace opencog
+
+#endif // _OPENCOG_ALIAS_SAMPLER_H
@@ -0,0 +1,41 @@
+/*
+ * opencog/util/async_batch.h
+ *
+ * Defaults shared by the batching writers of async_buffer and
+ * async_caller.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_ASYNC_BATCH_H
+#define _OPENCOG_ASYNC_BATCH_H
+
+#include <cstddef>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+/// The largest number of elements handed to one call of a batch
+/// writer, unless the constructor is given another.
+constexpr size_t DEFAULT_BATCH_SIZE = 1000;
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_ASYNC_BATCH_H
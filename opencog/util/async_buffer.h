@@ -31,10 +31,15 @@
 #include <thread>
 #include <vector>
 
-#include <opencog/util/concurrent_set.h>
+#include <boost/functional/hash.hpp>
+
+#include <opencog/util/async_batch.h>
+#include <opencog/util/concurrent_sharded_set.h>
 #include <opencog/util/exceptions.h>
+#include <opencog/util/latency_histogram.h>
 #include <opencog/util/Logger.h>
 #include <opencog/util/macros.h>
+#include <opencog/util/trace_event.h>
 
 namespace opencog
 {
@@ -84,9 +89,16 @@ namespace opencog
  *
  * What actually happens is this: The given elements are placed in a
  * set (in a thread-safe manner -- the enqueue function can be safely
- * called from multiple threads.) This set is then serviced and
+ * called from multiple threads.) The set is sharded by the hash of the
+ * element, with one lock per shard, so that threads inserting at the
+ * same time rarely contend; the Element must therefore be hashable
+ * (by the Hash template argument, boost::hash by default), as well as
+ * having a std::less. This set is then serviced and
  * drained by a pool of active threads, which remove the elements, and
  * call the method on each one.
+ * Alternately, the method can take a vector of elements; it is then
+ * called with batches of elements, which helps if a whole batch can
+ * be written out about as cheaply as a single element.
  *
  * The implementation is very simple: it uses a fixed-size thread pool.
  * It uses hi/lo watermarks to stall and drain the set, if it gets too
@@ -120,14 +132,31 @@ namespace opencog
  * impure, and should be replaced by CV's. Doing so becomes much easier
  * once C++20 is widely available, as it has CV's on std::atomic ints.
  */
-template<typename Writer, typename Element>
+template<typename Writer, typename Element,
+         typename Hash = boost::hash<Element>>
 class async_buffer
 {
 	private:
-		concurrent_set<Element> _store_set;
+		// Each element carries the time at which it was first
+		// inserted; duplicates do not change it.
+		struct Timed
+		{
+			Element elt;
+			async_stats::clock::time_point stamp;
+			bool operator<(const Timed& other) const
+			{ return elt < other.elt; }
+		};
+		struct TimedHash
+		{
+			size_t operator()(const Timed& t) const
+			{ return Hash()(t.elt); }
+		};
+		concurrent_sharded_set<Timed, TimedHash> _store_set;
 		std::vector<std::thread> _write_threads;
 		std::mutex _write_mutex;
 		std::mutex _enqueue_mutex;
+		std::atomic<bool> _in_barrier;
+		std::atomic<unsigned long> _inserting;
 		std::atomic<unsigned long> _busy_writers;
 		std::atomic<unsigned long> _pending;
 		size_t _high_watermark;
@@ -135,6 +164,9 @@ class async_buffer
 
 		Writer* _writer;
 		void (Writer::*_do_write)(const Element&);
+		void (Writer::*_do_write_batch)(const std::vector<Element>&);
+		size_t _batch_size;
+		std::chrono::milliseconds _linger;
 
 		unsigned int _thread_count;
 		bool _stopping_writers;
@@ -144,12 +176,23 @@ class async_buffer
 		void start_writer_thread();
 		void stop_writer_threads();
 		void write_loop();
+		void write_one(const Element&);
+		void write_timed(const Timed&);
+		void write_timed(std::vector<Timed>&, std::vector<Element>&);
+		void init(Writer*, int);
+
+		async_stats _telemetry;
 
 		void do_insert(const Element&);
 		void drain();
+		bool in_writer_thread() const;
 
 	public:
 		async_buffer(Writer*, void (Writer::*)(const Element&), int nthreads=4);
+		async_buffer(Writer*, void (Writer::*)(const std::vector<Element>&),
+		             int nthreads=4,
+		             size_t batch_size=DEFAULT_BATCH_SIZE,
+		             unsigned linger_msec=0);
 		~async_buffer();
 		void insert(const Element&);
 		void flush();
@@ -180,6 +223,11 @@ class async_buffer
 		bool stalling() const { return _stall_writers; }
 
 		void clear_stats();
+
+		// Latency percentiles, writer busy ratio, and set size,
+		// since the last clear_stats(). Cheap enough to poll often.
+		async_telemetry get_telemetry() const
+		{ return _telemetry.snapshot(_pending, _thread_count); }
 };
 
 
@@ -194,13 +242,44 @@ class async_buffer
 /// cb: the method that will be called.
 /// nthreads: the number of threads in the writer pool to use. Defaults
 /// to 4 if not specified.
-template<typename Writer, typename Element>
-async_buffer<Writer, Element>::async_buffer(Writer* wr,
+template<typename Writer, typename Element, typename Hash>
+async_buffer<Writer, Element, Hash>::async_buffer(Writer* wr,
                                             void (Writer::*cb)(const Element&),
                                             int nthreads)
 {
-	_writer = wr;
 	_do_write = cb;
+	_do_write_batch = nullptr;
+	_batch_size = 1;
+	_linger = std::chrono::milliseconds(0);
+	init(wr, nthreads);
+}
+
+/// As above, but the method is called with batches of elements,
+/// instead of one element at a time. Each writer thread takes whatever
+/// is pending, up to batch_size elements. If fewer than that are
+/// pending, it waits up to linger_msec millisecs for more to arrive,
+/// before making the call. This is useful when writing a thousand
+/// elements costs about as much as writing just one.
+template<typename Writer, typename Element, typename Hash>
+async_buffer<Writer, Element, Hash>::async_buffer(Writer* wr,
+                                            void (Writer::*cb)(const std::vector<Element>&),
+                                            int nthreads,
+                                            size_t batch_size,
+                                            unsigned linger_msec)
+{
+	_do_write = nullptr;
+	_do_write_batch = cb;
+	_batch_size = (0 < batch_size) ? batch_size : 1;
+	_linger = std::chrono::milliseconds(linger_msec);
+	init(wr, nthreads);
+}
+
+template<typename Writer, typename Element, typename Hash>
+void async_buffer<Writer, Element, Hash>::init(Writer* wr, int nthreads)
+{
+	_writer = wr;
+	_in_barrier = false;
+	_inserting = 0;
 	_stopping_writers = false;
 	_thread_count = 0;
 	_busy_writers = 0;
@@ -219,8 +298,8 @@ async_buffer<Writer, Element>::async_buffer(Writer* wr,
 	}
 }
 
-template<typename Writer, typename Element>
-async_buffer<Writer, Element>::~async_buffer()
+template<typename Writer, typename Element, typename Hash>
+async_buffer<Writer, Element, Hash>::~async_buffer()
 {
 	stop_writer_threads();
 }
@@ -237,8 +316,8 @@ async_buffer<Writer, Element>::~async_buffer()
 /// If write-stalling is enabled, then no writing will be done until
 /// at least the low_watermark number of elements have accumulated.
 ///
-template<typename Writer, typename Element>
-void async_buffer<Writer, Element>::set_watermarks(size_t hi, size_t lo)
+template<typename Writer, typename Element, typename Hash>
+void async_buffer<Writer, Element, Hash>::set_watermarks(size_t hi, size_t lo)
 {
 	_high_watermark = hi;
 	_low_watermark = lo;
@@ -251,14 +330,14 @@ void async_buffer<Writer, Element>::set_watermarks(size_t hi, size_t lo)
 /// leaving eleemnts in the set forever, never quite getting them
 /// written out. Caveat emptor! You may want to flush periodically,
 /// to avoid this situation.
-template<typename Writer, typename Element>
-void async_buffer<Writer, Element>::stall(bool st)
+template<typename Writer, typename Element, typename Hash>
+void async_buffer<Writer, Element, Hash>::stall(bool st)
 {
 	_stall_writers = st;
 }
 
-template<typename Writer, typename Element>
-void async_buffer<Writer, Element>::clear_stats()
+template<typename Writer, typename Element, typename Hash>
+void async_buffer<Writer, Element, Hash>::clear_stats()
 {
 	_item_count = 0;
 	_duplicate_count = 0;
@@ -267,14 +346,15 @@ void async_buffer<Writer, Element>::clear_stats()
 	_drain_msec = 0;
 	_drain_slowest_msec = 0;
 	_drain_concurrent = 0;
+	_telemetry.clear();
 }
 
 /* ================================================================ */
 
 /// Start a single writer thread.
 /// May be called multiple times.
-template<typename Writer, typename Element>
-void async_buffer<Writer, Element>::start_writer_thread()
+template<typename Writer, typename Element, typename Hash>
+void async_buffer<Writer, Element, Hash>::start_writer_thread()
 {
 	// logger().info("async_buffer: starting a writer thread");
 	std::unique_lock<std::mutex> lock(_write_mutex);
@@ -287,8 +367,8 @@ void async_buffer<Writer, Element>::start_writer_thread()
 }
 
 /// Stop all writer threads, but only after they are done writing.
-template<typename Writer, typename Element>
-void async_buffer<Writer, Element>::stop_writer_threads()
+template<typename Writer, typename Element, typename Hash>
+void async_buffer<Writer, Element, Hash>::stop_writer_threads()
 {
 	_stall_writers = false;
 
@@ -299,8 +379,7 @@ void async_buffer<Writer, Element>::stop_writer_threads()
 	// Spin a while, until the writer threads are (mostly) done.
 	while (0 < _pending)
 	{
-		// std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		usleep(1000);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
 	}
 
 	// Now tell all the threads that they are done.
@@ -319,8 +398,15 @@ void async_buffer<Writer, Element>::stop_writer_threads()
 	_store_set.cancel_reset();
 	while (not _store_set.is_empty())
 	{
-		Element elt = _store_set.value_get();
-		(_writer->*_do_write)(elt);
+		if (_do_write_batch)
+		{
+			std::vector<Timed> batch;
+			std::vector<Element> elts;
+			_store_set.get_batch(batch, _batch_size, std::chrono::milliseconds(0));
+			write_timed(batch, elts);
+			continue;
+		}
+		write_timed(_store_set.value_get());
 	}
 	
 	// Its now OK to start new threads, if desired ...(!)
@@ -332,8 +418,8 @@ void async_buffer<Writer, Element>::stop_writer_threads()
 ///
 /// This will deadlock, if called from a writer thread.
 /// Thus, not for public use.
-template<typename Writer, typename Element>
-void async_buffer<Writer, Element>::drain()
+template<typename Writer, typename Element, typename Hash>
+void async_buffer<Writer, Element, Hash>::drain()
 {
 	bool save_stall = _stall_writers;
 	_stall_writers = false;
@@ -344,7 +430,6 @@ void async_buffer<Writer, Element>::drain()
 	while (0 < _pending)
 	{
 		std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		// usleep(1000);
 	}
 
 	_stall_writers = save_stall;
@@ -357,8 +442,8 @@ void async_buffer<Writer, Element>::drain()
 /// adding at a high rate, this call might not return for a long time;
 /// it might never return! There is no guarantee of forward progress!
 ///
-template<typename Writer, typename Element>
-void async_buffer<Writer, Element>::flush()
+template<typename Writer, typename Element, typename Hash>
+void async_buffer<Writer, Element, Hash>::flush()
 {
 	bool save_stall = _stall_writers;
 	_stall_writers = false;
@@ -367,7 +452,6 @@ void async_buffer<Writer, Element>::flush()
 	while (0 < _store_set.size())
 	{
 		std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		// usleep(1000);
 	}
 
 	_stall_writers = save_stall;
@@ -380,33 +464,107 @@ void async_buffer<Writer, Element>::flush()
 /// It will wait not only for the pending work-queue to empty, but also
 /// for all writers to have completed.
 ///
-template<typename Writer, typename Element>
-void async_buffer<Writer, Element>::barrier()
+template<typename Writer, typename Element, typename Hash>
+void async_buffer<Writer, Element, Hash>::barrier()
 {
 	std::unique_lock<std::mutex> lock(_enqueue_mutex);
 
 	// We cannot poll _pending in a writer thread, as it will never
 	// drop to zero, resulting in a deadlock.
-	std::thread::id tid = std::this_thread::get_id();
-	for (const auto& th : _write_threads)
+	if (in_writer_thread())
 	{
-		if (th.get_id() == tid)
-		{
-			flush();
-			return;
-		}
+		flush();
+		return;
 	}
 
+	// Inserts that see this flag wait for the enqueue mutex, and thus,
+	// for the barrier to finish. Those that looked before it was set
+	// are waited for, so that their elements are counted in _pending,
+	// and drained, too; see insert().
+	_in_barrier = true;
+	while (0 < _inserting)
+		std::this_thread::yield();
 	drain();
+	_in_barrier = false;
+}
+
+template<typename Writer, typename Element, typename Hash>
+bool async_buffer<Writer, Element, Hash>::in_writer_thread() const
+{
+	std::thread::id tid = std::this_thread::get_id();
+	for (const auto& th : _write_threads)
+		if (th.get_id() == tid) return true;
+	return false;
+}
+
+/// Invoke the method on a single element, in the calling thread.
+template<typename Writer, typename Element, typename Hash>
+void async_buffer<Writer, Element, Hash>::write_one(const Element& elt)
+{
+	if (_do_write_batch)
+		(_writer->*_do_write_batch)(std::vector<Element>(1, elt));
+	else
+		(_writer->*_do_write)(elt);
+}
+
+/// Invoke the method on a buffered element, and record the timing.
+template<typename Writer, typename Element, typename Hash>
+void async_buffer<Writer, Element, Hash>::write_timed(const Timed& t)
+{
+	auto start = async_stats::clock::now();
+	(_writer->*_do_write)(t.elt);
+	auto end = async_stats::clock::now();
+	_telemetry.note_busy(start, end);
+	_telemetry.note_written(t.stamp, end);
+}
+
+/// Invoke the method on a batch of buffered elements, and record the
+/// timing. The elements are moved out of the batch, into elts.
+template<typename Writer, typename Element, typename Hash>
+void async_buffer<Writer, Element, Hash>::write_timed(std::vector<Timed>& batch,
+                                                std::vector<Element>& elts)
+{
+	auto start = async_stats::clock::now();
+	for (Timed& t : batch)
+		elts.push_back(std::move(t.elt));
+	(_writer->*_do_write_batch)(elts);
+	elts.clear();
+	auto end = async_stats::clock::now();
+	_telemetry.note_busy(start, end);
+	for (const Timed& t : batch)
+		_telemetry.note_written(t.stamp, end);
 }
 
 /// A single write thread. Reads elements from set, and invokes the
 /// method on them.
-template<typename Writer, typename Element>
-void async_buffer<Writer, Element>::write_loop()
+template<typename Writer, typename Element, typename Hash>
+void async_buffer<Writer, Element, Hash>::write_loop()
 {
+	trace_thread_name("async_buffer writer");
 	try
 	{
+		std::vector<Timed> batch;
+		std::vector<Element> elts;
+		while (_do_write_batch)
+		{
+			// Do nothing, if asked to stall.
+			while (_stall_writers and _store_set.size() < _low_watermark)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(3));
+			}
+
+			batch.clear();
+			_store_set.get_batch(batch, _batch_size, _linger);
+			trace_counter("async_buffer pending", _pending);
+			{
+				OC_TRACE_SCOPE("async_buffer::write");
+				_busy_writers ++;
+				write_timed(batch, elts);
+				_busy_writers --;
+			}
+			_pending -= batch.size();
+		}
+
 		while (true)
 		{
 			// Do nothing, if asked to stall.
@@ -415,14 +573,17 @@ void async_buffer<Writer, Element>::write_loop()
 				std::this_thread::sleep_for(std::chrono::milliseconds(3));
 			}
 
-			Element elt = _store_set.value_get();
-			_busy_writers ++;
-			(_writer->*_do_write)(elt);
-			_busy_writers --;
+			Timed t = _store_set.value_get();
+			{
+				OC_TRACE_SCOPE("async_buffer::write");
+				_busy_writers ++;
+				write_timed(t);
+				_busy_writers --;
+			}
 			_pending --;
 		}
 	}
-	catch (typename concurrent_set<Element>::Canceled& e)
+	catch (typename concurrent_sharded_set<Timed, TimedHash>::Canceled& e)
 	{
 		// We are so out of here. Nothing to do, just exit this thread.
 		return;
@@ -433,17 +594,18 @@ void async_buffer<Writer, Element>::write_loop()
 /* ================================================================ */
 
 /// Insert, no matter what. Private, unsafe for external use.
-template<typename Writer, typename Element>
-void async_buffer<Writer, Element>::do_insert(const Element& elt)
+template<typename Writer, typename Element, typename Hash>
+void async_buffer<Writer, Element, Hash>::do_insert(const Element& elt)
 {
 	_pending ++;
-	bool inserted = _store_set.insert(elt);
+	bool inserted = _store_set.insert({elt, async_stats::clock::now()});
 	_item_count++;
 	if (not inserted)
 	{
 		_duplicate_count++;
 		_pending --;
 	}
+	else _telemetry.note_depth(_pending);
 }
 
 /**
@@ -452,8 +614,8 @@ void async_buffer<Writer, Element>::do_insert(const Element& elt)
  * If the set is over-full, then this will block until the set is
  * mostly drained...
  */
-template<typename Writer, typename Element>
-void async_buffer<Writer, Element>::insert(const Element& elt)
+template<typename Writer, typename Element, typename Hash>
+void async_buffer<Writer, Element, Hash>::insert(const Element& elt)
 {
 	// Sanity checks.
 	if (_stopping_writers)
@@ -469,33 +631,31 @@ void async_buffer<Writer, Element>::insert(const Element& elt)
 		// transient object, and the user wants to avoid the overhead
 		// of creating threads.
 		_item_count++;
-		(_writer->*_do_write)(elt);
+		write_one(elt);
 		return;
 	}
 
-	// Must not honor the enqueue mutex when in a writer thread,
-	// as otherwise a deadlock will result.
-	bool need_insert = true;
-	std::thread::id tid = std::this_thread::get_id();
-	for (const auto& th : _write_threads)
-	{
-		if (th.get_id() == tid)
-		{
-			do_insert(elt);
-			need_insert = false;
-			break;
-		}
-	}
-
 	// The _store_set.insert(elt) does not need a lock, itself; its
 	// perfectly thread-safe. However, the flush barrier does need to
-	// be able to halt everyone else from enqueing more stuff, so we
-	// do need to use a lock for that.
-	if (need_insert)
+	// be able to halt everyone else from enqueing more stuff. So, if
+	// a barrier is in progress, wait for it to finish. The barrier
+	// holds the enqueue mutex for as long as it runs.  Must not wait
+	// when in a writer thread, as otherwise a deadlock will result.
+	//
+	// The insert is announced in _inserting before the flag is read,
+	// and the barrier sets the flag before it waits for _inserting to
+	// drop to zero. Both are sequentially consistent, so either this
+	// sees the flag, or the barrier sees this insert, and waits for it.
+	while (true)
 	{
-		std::unique_lock<std::mutex> lock(_enqueue_mutex);
-		do_insert(elt);
+		_inserting++;
+		if (not _in_barrier or in_writer_thread()) break;
+		_inserting--;
+		// Nothing to do, other than wait.
+		std::lock_guard<std::mutex> lock(_enqueue_mutex);
 	}
+	do_insert(elt);
+	_inserting--;
 
 	// If the writer threads are falling behind, mitigate.
 	// Right now, this will be real simple: just spin and wait
@@ -517,7 +677,6 @@ void async_buffer<Writer, Element>::insert(const Element& elt)
 		do
 		{
 			std::this_thread::sleep_for(std::chrono::milliseconds(1));
-			// usleep(1000);
 			// cnt++;
 		}
 		while (_low_watermark < _store_set.size());
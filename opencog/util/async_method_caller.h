@@ -31,11 +31,15 @@
 #include <thread>
 #include <vector>
 
+#include <opencog/util/affinity.h>
+#include <opencog/util/async_batch.h>
 #include <opencog/util/concurrent_queue.h>
 #include <opencog/util/concurrent_stack.h>
 #include <opencog/util/exceptions.h>
+#include <opencog/util/latency_histogram.h>
 #include <opencog/util/Logger.h>
 #include <opencog/util/macros.h>
+#include <opencog/util/trace_event.h>
 
 namespace opencog
 {
@@ -67,6 +71,9 @@ namespace opencog
  * called from multiple threads.) This queue is then serviced and
  * drained by a pool of active threads, which dequeue the elements, and
  * call the method on each one.
+ * Alternately, the method can take a vector of elements; it is then
+ * called with batches of elements, which helps if a whole batch can
+ * be written out about as cheaply as a single element.
  *
  * The implementation is very simple: it uses a fixed-size thread pool.
  * It uses hi/lo watermarks to stall and drain the queue, if it gets too
@@ -104,7 +111,13 @@ template<typename Writer, typename Element>
 class async_caller
 {
 	private:
-		concurrent_queue<Element> _store_queue;
+		// Each element carries the time at which it was queued.
+		struct Timed
+		{
+			Element elt;
+			async_stats::clock::time_point stamp;
+		};
+		concurrent_queue<Timed> _store_queue;
 		std::vector<std::thread> _write_threads;
 		std::mutex _write_mutex;
 		std::mutex _enqueue_mutex;
@@ -115,32 +128,71 @@ class async_caller
 
 		Writer* _writer;
 		void (Writer::*_do_write)(const Element&);
+		void (Writer::*_do_write_batch)(const std::vector<Element>&);
+		size_t _batch_size;
+		std::chrono::milliseconds _linger;
 
-		unsigned int _thread_count;
+		std::atomic<unsigned int> _thread_count;
 		bool _stopping_writers;
 
+		// Adaptive thread pool. Retired threads have exited, or are
+		// about to; they are joined at the next opportunity.
+		std::atomic<unsigned int> _min_threads;
+		std::atomic<unsigned int> _max_threads;
+		std::atomic<unsigned int> _idle_msec;
+		std::vector<std::thread> _retired_threads;
+		static thread_local const async_caller* _current_writer;
+
+		// NUMA placement of the writer threads; see set_numa_node().
+		std::atomic<int> _numa_node;
+		std::atomic<unsigned int> _placed_count;
+		void place_this_thread();
+
 		void start_writer_thread();
 		void stop_writer_threads();
+		bool grow_writer_threads();
+		bool retire_writer_thread();
+		bool is_writer_thread() const { return this == _current_writer; }
 		void write_loop();
+		void write_one(const Element&);
+		void write_timed(const Timed&);
+		void write_timed(std::vector<Timed>&, std::vector<Element>&);
+		void init(Writer*, int);
+
+		async_stats _telemetry;
 
 		void drain();
 
 	public:
 		async_caller(Writer*, void (Writer::*)(const Element&), int nthreads=4);
+		async_caller(Writer*, void (Writer::*)(const std::vector<Element>&),
+		             int nthreads=4,
+		             size_t batch_size=DEFAULT_BATCH_SIZE,
+		             unsigned linger_msec=0);
 		~async_caller();
 		void enqueue(const Element&);
 		void flush_queue();
 		void barrier();
 
 		void set_watermarks(size_t, size_t);
+		void set_adaptive(unsigned int min_threads, unsigned int max_threads,
+		                  unsigned int idle_msec = 1000);
+
+		static const int NUMA_NONE = -1;
+		static const int NUMA_SPREAD = -2;
+		void set_numa_node(int node);
 
 		// Utilities for monitoring performance.
 		// _item_count == number of items queued;
+		// _grow_count == number of writer threads added by adaptation.
+		// _retire_count == number of idle writer threads retired.
 		// _drain_count == number of times the high watermark was hit.
 		// _drain_msec == accumulated number of millisecs to drain.
 		// _drain_concurrent == number of threads that hit queue-full.
 		bool _in_drain;
 		std::atomic<unsigned long> _item_count;
+		std::atomic<unsigned long> _grow_count;
+		std::atomic<unsigned long> _retire_count;
 		std::atomic<unsigned long> _flush_count;
 		std::atomic<unsigned long> _drain_count;
 		std::atomic<unsigned long> _drain_msec;
@@ -148,10 +200,16 @@ class async_caller
 		std::atomic<unsigned long> _drain_concurrent;
 
 		unsigned long get_busy_writers() const { return _busy_writers; }
+		unsigned long get_thread_count() const { return _thread_count; }
 		unsigned long get_queue_size() const { return _pending; }
 		unsigned long get_high_watermark() const { return _high_watermark; }
 		unsigned long get_low_watermark() const { return _low_watermark; }
 		void clear_stats();
+
+		// Latency percentiles, writer busy ratio, and queue depth,
+		// since the last clear_stats(). Cheap enough to poll often.
+		async_telemetry get_telemetry() const
+		{ return _telemetry.snapshot(_pending, _thread_count); }
 };
 
 
@@ -171,13 +229,47 @@ async_caller<Writer, Element>::async_caller(Writer* wr,
                                             void (Writer::*cb)(const Element&),
                                             int nthreads)
 {
-	_writer = wr;
 	_do_write = cb;
+	_do_write_batch = nullptr;
+	_batch_size = 1;
+	_linger = std::chrono::milliseconds(0);
+	init(wr, nthreads);
+}
+
+/// As above, but the method is called with batches of elements,
+/// instead of one element at a time. Each writer thread takes whatever
+/// is pending, up to batch_size elements. If fewer than that are
+/// pending, it waits up to linger_msec millisecs for more to arrive,
+/// before making the call. This is useful when writing a thousand
+/// elements costs about as much as writing just one.
+template<typename Writer, typename Element>
+async_caller<Writer, Element>::async_caller(Writer* wr,
+                                            void (Writer::*cb)(const std::vector<Element>&),
+                                            int nthreads,
+                                            size_t batch_size,
+                                            unsigned linger_msec)
+{
+	_do_write = nullptr;
+	_do_write_batch = cb;
+	_batch_size = (0 < batch_size) ? batch_size : 1;
+	_linger = std::chrono::milliseconds(linger_msec);
+	init(wr, nthreads);
+}
+
+template<typename Writer, typename Element>
+void async_caller<Writer, Element>::init(Writer* wr, int nthreads)
+{
+	_writer = wr;
 	_stopping_writers = false;
 	_thread_count = 0;
+	_min_threads = 0;
+	_max_threads = 0;
+	_idle_msec = 0;
 	_busy_writers = 0;
 	_pending = 0;
 	_in_drain = false;
+	_numa_node = NUMA_NONE;
+	_placed_count = 0;
 
 	_high_watermark = DEFAULT_HIGH_WATER_MARK;
 	_low_watermark = DEFAULT_LOW_WATER_MARK;
@@ -212,15 +304,75 @@ void async_caller<Writer, Element>::set_watermarks(size_t hi, size_t lo)
 	_low_watermark = lo;
 }
 
+/// Let the number of writer threads adapt to the load. Whenever an
+/// enqueue finds the queue above the high watermark, another writer
+/// thread is started, up to max_threads; only when there are already
+/// max_threads does the enqueue block, waiting for the drain. Writer
+/// threads that have had nothing to do for idle_msec millisecs exit,
+/// down to min_threads (at least one). If there are fewer than
+/// min_threads already, more are started right away.
+template<typename Writer, typename Element>
+void async_caller<Writer, Element>::set_adaptive(unsigned int min_threads,
+                                                 unsigned int max_threads,
+                                                 unsigned int idle_msec)
+{
+	if (0 == min_threads) min_threads = 1;
+	if (max_threads < min_threads) max_threads = min_threads;
+	if (0 == idle_msec) idle_msec = 1;
+	_min_threads = min_threads;
+	_max_threads = max_threads;
+	_idle_msec = idle_msec;
+
+	while (_thread_count < min_threads)
+		start_writer_thread();
+}
+
+/// Place the writer threads: all of them on the given NUMA node (an
+/// index in get_cpu_topology().nodes), say the node of the device
+/// written to; or, with NUMA_SPREAD, each on the next node in turn;
+/// or, with NUMA_NONE, no placement (the default). This applies to
+/// the threads running now, and to those started later. Threads
+/// already placed stay where they are if placement is then turned
+/// off.
+template<typename Writer, typename Element>
+void async_caller<Writer, Element>::set_numa_node(int node)
+{
+	std::unique_lock<std::mutex> lock(_write_mutex);
+	_numa_node = node;
+	_placed_count = 0;
+	const cpu_topology& topo = get_cpu_topology();
+	for (auto& th : _write_threads)
+	{
+		if (NUMA_SPREAD == node)
+			pin_thread_to_node(th, topo.node_for(_placed_count++));
+		else if (0 <= node)
+			pin_thread_to_node(th, node);
+	}
+}
+
+template<typename Writer, typename Element>
+void async_caller<Writer, Element>::place_this_thread()
+{
+	int node = _numa_node;
+	if (NUMA_SPREAD == node)
+		pin_this_thread_to_node(
+			get_cpu_topology().node_for(_placed_count++));
+	else if (0 <= node)
+		pin_this_thread_to_node(node);
+}
+
 template<typename Writer, typename Element>
 void async_caller<Writer, Element>::clear_stats()
 {
 	_item_count = 0;
+	_grow_count = 0;
+	_retire_count = 0;
 	_flush_count = 0;
 	_drain_count = 0;
 	_drain_msec = 0;
 	_drain_slowest_msec = 0;
 	_drain_concurrent = 0;
+	_telemetry.clear();
 }
 
 /* ================================================================ */
@@ -240,6 +392,51 @@ void async_caller<Writer, Element>::start_writer_thread()
 	_thread_count ++;
 }
 
+/// Start one more writer thread, unless there are max_threads already.
+/// Return true if a thread was started.
+template<typename Writer, typename Element>
+bool async_caller<Writer, Element>::grow_writer_threads()
+{
+	// Writer threads may enqueue, too; they must not wait on a
+	// stop_writer_threads() that is waiting to join them.
+	std::unique_lock<std::mutex> lock(_write_mutex, std::try_to_lock);
+	if (not lock.owns_lock()) return false;
+	if (_stopping_writers or _max_threads <= _thread_count) return false;
+
+	for (auto& th : _retired_threads) th.join();
+	_retired_threads.clear();
+
+	_write_threads.push_back(std::thread(&async_caller::write_loop, this));
+	_thread_count ++;
+	_grow_count ++;
+	return true;
+}
+
+/// Called by an idle writer thread. Return true if the thread should
+/// exit, because there are more than min_threads writers.
+template<typename Writer, typename Element>
+bool async_caller<Writer, Element>::retire_writer_thread()
+{
+	// If the lock is taken, the pool is probably being stopped, and
+	// stop_writer_threads() is waiting to join this thread. So don't
+	// wait for the lock.
+	std::unique_lock<std::mutex> lock(_write_mutex, std::try_to_lock);
+	if (not lock.owns_lock()) return false;
+	if (_stopping_writers or _thread_count <= _min_threads) return false;
+
+	std::thread::id tid = std::this_thread::get_id();
+	for (auto it = _write_threads.begin(); it != _write_threads.end(); it++)
+	{
+		if (it->get_id() != tid) continue;
+		_retired_threads.push_back(std::move(*it));
+		_write_threads.erase(it);
+		_thread_count --;
+		_retire_count ++;
+		return true;
+	}
+	return false;
+}
+
 /// Stop all writer threads, but only after they are done writing.
 template<typename Writer, typename Element>
 void async_caller<Writer, Element>::stop_writer_threads()
@@ -252,7 +449,6 @@ void async_caller<Writer, Element>::stop_writer_threads()
 	while (0 < _pending)
 	{
 		std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		// usleep(1000);
 	}
 
 	// Now tell all the threads that they are done.
@@ -264,6 +460,8 @@ void async_caller<Writer, Element>::stop_writer_threads()
 		_write_threads.pop_back();
 		_thread_count --;
 	}
+	for (auto& th : _retired_threads) th.join();
+	_retired_threads.clear();
 
 	// OK, so we've joined all the threads, but the queue
 	// might not be totally empty; some dregs might remain.
@@ -271,8 +469,15 @@ void async_caller<Writer, Element>::stop_writer_threads()
 	_store_queue.cancel_reset();
 	while (not _store_queue.is_empty())
 	{
-		Element elt = _store_queue.value_pop();
-		(_writer->*_do_write)(elt);
+		if (_do_write_batch)
+		{
+			std::vector<Timed> batch;
+			std::vector<Element> elts;
+			_store_queue.pop_batch(batch, _batch_size, std::chrono::milliseconds(0));
+			write_timed(batch, elts);
+			continue;
+		}
+		write_timed(_store_queue.value_pop());
 	}
 	
 	// Its now OK to start new threads, if desired ...(!)
@@ -294,7 +499,6 @@ void async_caller<Writer, Element>::drain()
 	while (0 < _pending)
 	{
 		std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		// usleep(1000);
 	}
 }
 
@@ -313,7 +517,6 @@ void async_caller<Writer, Element>::flush_queue()
 	while (0 < _store_queue.size())
 	{
 		std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		// usleep(1000);
 	}
 }
 
@@ -334,39 +537,110 @@ void async_caller<Writer, Element>::barrier()
 
 	// We cannot poll _pending in a writer thread, as it will never
 	// drop to zero, resulting in a deadlock.
-	std::thread::id tid = std::this_thread::get_id();
-	for (const auto& th : _write_threads)
+	if (is_writer_thread())
 	{
-		if (th.get_id() == tid)
-		{
-			flush_queue();
-			return;
-		}
+		flush_queue();
+		return;
 	}
 	drain();
 }
 
+/// Invoke the method on a single element, in the calling thread.
+template<typename Writer, typename Element>
+void async_caller<Writer, Element>::write_one(const Element& elt)
+{
+	if (_do_write_batch)
+		(_writer->*_do_write_batch)(std::vector<Element>(1, elt));
+	else
+		(_writer->*_do_write)(elt);
+}
+
+/// Invoke the method on a queued element, and record the timing.
+template<typename Writer, typename Element>
+void async_caller<Writer, Element>::write_timed(const Timed& t)
+{
+	auto start = async_stats::clock::now();
+	(_writer->*_do_write)(t.elt);
+	auto end = async_stats::clock::now();
+	_telemetry.note_busy(start, end);
+	_telemetry.note_written(t.stamp, end);
+}
+
+/// Invoke the method on a batch of queued elements, and record the
+/// timing. The elements are moved out of the batch, into elts.
+template<typename Writer, typename Element>
+void async_caller<Writer, Element>::write_timed(std::vector<Timed>& batch,
+                                                std::vector<Element>& elts)
+{
+	auto start = async_stats::clock::now();
+	for (Timed& t : batch)
+		elts.push_back(std::move(t.elt));
+	(_writer->*_do_write_batch)(elts);
+	elts.clear();
+	auto end = async_stats::clock::now();
+	_telemetry.note_busy(start, end);
+	for (const Timed& t : batch)
+		_telemetry.note_written(t.stamp, end);
+}
+
 /// A single write thread. Reads elements from queue, and invokes the
 /// method on them.
 template<typename Writer, typename Element>
 void async_caller<Writer, Element>::write_loop()
 {
+	_current_writer = this;
+	place_this_thread();
+	trace_thread_name("async_caller writer");
 	try
 	{
-		while (true)
+		std::vector<Timed> batch;
+		std::vector<Element> elts;
+		while (_do_write_batch)
 		{
-			Element elt = _store_queue.value_pop();
-			_busy_writers ++;
-			(_writer->*_do_write)(elt);
-			_busy_writers --;
+			batch.clear();
+			if (0 == _idle_msec)
+				_store_queue.pop_batch(batch, _batch_size, _linger);
+			else if (not _store_queue.pop_batch_for(batch, _batch_size,
+			             _linger, std::chrono::milliseconds(_idle_msec)))
+			{
+				if (retire_writer_thread()) break;
+				continue;
+			}
+			trace_counter("async_caller pending", _pending);
+			{
+				OC_TRACE_SCOPE("async_caller::write");
+				_busy_writers ++;
+				write_timed(batch, elts);
+				_busy_writers --;
+			}
+			_pending -= batch.size();
+		}
+
+		while (not _do_write_batch)
+		{
+			Timed t;
+			if (0 == _idle_msec)
+				t = _store_queue.value_pop();
+			else if (not _store_queue.try_pop_for(t,
+			             std::chrono::milliseconds(_idle_msec)))
+			{
+				if (retire_writer_thread()) break;
+				continue;
+			}
+			{
+				OC_TRACE_SCOPE("async_caller::write");
+				_busy_writers ++;
+				write_timed(t);
+				_busy_writers --;
+			}
 			_pending --;
 		}
 	}
-	catch (typename concurrent_queue<Element>::Canceled& e)
+	catch (typename concurrent_queue<Timed>::Canceled& e)
 	{
 		// We are so out of here. Nothing to do, just exit this thread.
-		return;
 	}
+	_current_writer = nullptr;
 }
 
 
@@ -394,42 +668,35 @@ void async_caller<Writer, Element>::enqueue(const Element& elt)
 		// transient object, and the user wants to avoid the overhead
 		// of creating threads.
 		_item_count++;
-		(_writer->*_do_write)(elt);
+		write_one(elt);
 		return;
 	}
 
 	// Must not honor the enqueue mutex when in a writer thread,
 	// as otherwise a deadlock will result.
-	bool need_insert = true;
-	std::thread::id tid = std::this_thread::get_id();
-	for (const auto& th : _write_threads)
+	if (is_writer_thread())
 	{
-		if (th.get_id() == tid)
-		{
-			_pending ++;
-			_store_queue.push(elt);
-			_item_count++;
-			need_insert = false;
-			break;
-		}
+		_pending ++;
+		_store_queue.push({elt, async_stats::clock::now()});
+		_item_count++;
 	}
-
-	// The _store_queue.push(elt) does not need a lock, itself; its
-	// perfectly thread-safe. However, the flush barrier does need to
-	// be able to halt everyone else from enqueing more stuff, so we
-	// do need to use a lock for that.
-	if (need_insert)
+	else
 	{
+		// The _store_queue.push(elt) does not need a lock, itself; its
+		// perfectly thread-safe. However, the flush barrier does need to
+		// be able to halt everyone else from enqueing more stuff, so we
+		// do need to use a lock for that.
 		std::unique_lock<std::mutex> lock(_enqueue_mutex);
 		_pending ++;
-		_store_queue.push(elt);
+		_store_queue.push({elt, async_stats::clock::now()});
 		_item_count++;
 	}
+	_telemetry.note_depth(_pending);
 
 	// If the writer threads are falling behind, mitigate.
-	// Right now, this will be real simple: just spin and wait
-	// for things to catch up.  Maybe we should launch more threads!?
-	// Note also: even as we block this thread, waiting for the drain
+	// If the pool is adaptive, and not yet at full size, just launch
+	// another writer thread. Otherwise, spin and wait for things to
+	// catch up.  Note also: even as we block this thread, waiting for the drain
 	// to complete, other threads might be filling the queue back up.
 	// If it does over-fill, then those threads will also block, one
 	// by one, until we hit a metastable state, where the active
@@ -437,6 +704,8 @@ void async_caller<Writer, Element>::enqueue(const Element& elt)
 
 	if (_high_watermark < _store_queue.size())
 	{
+		if (0 < _idle_msec and grow_writer_threads()) return;
+
 		if (_in_drain) _drain_concurrent ++;
 		else _drain_count++;
 
@@ -446,7 +715,6 @@ void async_caller<Writer, Element>::enqueue(const Element& elt)
 		do
 		{
 			std::this_thread::sleep_for(std::chrono::milliseconds(1));
-			// usleep(1000);
 			// cnt++;
 		}
 		while (_low_watermark < _store_queue.size());
@@ -463,6 +731,10 @@ void async_caller<Writer, Element>::enqueue(const Element& elt)
 	}
 }
 
+template<typename Writer, typename Element>
+thread_local const async_caller<Writer, Element>*
+	async_caller<Writer, Element>::_current_writer = nullptr;
+
 /** @}*/
 } // namespace opencog
 
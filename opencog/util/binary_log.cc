@@ -0,0 +1,466 @@
+/*
+ * opencog/util/binary_log.cc
+ *
+ * Binary log record encoding and decoding.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/util/Logger.h>
+#include <opencog/util/macros.h>
+
+#include "binary_log.h"
+
+using namespace opencog;
+
+namespace {
+
+// ----------------------------------------------------------------
+// printf conversion specification parsing, shared by the encoder
+// and the decoder, so that both agree on the argument layout.
+
+enum ArgKind { ARG_LITERAL, ARG_INT, ARG_UINT, ARG_DOUBLE,
+               ARG_STRING, ARG_PTR, ARG_COUNT, ARG_UNKNOWN };
+
+struct ConvSpec
+{
+    const char* begin;   // The '%'
+    const char* end;     // One past the conversion character
+    const char* lenmod;  // Start of the length modifier
+    char length;         // 0, 'H' (hh), 'h', 'l', 'Q' (ll), 'j', 'z', 't', 'L'
+    char conv;
+    int nstar;           // Number of '*' width/precision arguments
+    ArgKind kind;
+};
+
+/// Find the next conversion specification at or after p. Return false
+/// if there are no more.
+bool next_spec(const char* p, ConvSpec& sp)
+{
+    p = strchr(p, '%');
+    if (nullptr == p) return false;
+
+    sp.begin = p++;
+    sp.nstar = 0;
+    sp.length = 0;
+
+    while (*p and strchr("-+ #0'", *p)) p++;
+    if ('*' == *p) { sp.nstar++; p++; }
+    else while ('0' <= *p and *p <= '9') p++;
+    if ('.' == *p)
+    {
+        p++;
+        if ('*' == *p) { sp.nstar++; p++; }
+        else while ('0' <= *p and *p <= '9') p++;
+    }
+
+    sp.lenmod = p;
+    switch (*p)
+    {
+        case 'h': p++; sp.length = 'h'; if ('h' == *p) { p++; sp.length = 'H'; } break;
+        case 'l': p++; sp.length = 'l'; if ('l' == *p) { p++; sp.length = 'Q'; } break;
+        case 'q': p++; sp.length = 'Q'; break;
+        case 'j': case 'z': case 't': case 'L': sp.length = *p++; break;
+        default: break;
+    }
+
+    sp.conv = *p;
+    sp.end = *p ? p + 1 : p;
+    switch (sp.conv)
+    {
+        case '%': sp.kind = ARG_LITERAL; break;
+        case 'd': case 'i': sp.kind = ARG_INT; break;
+        case 'u': case 'o': case 'x': case 'X': case 'c': sp.kind = ARG_UINT; break;
+        case 'f': case 'F': case 'e': case 'E':
+        case 'g': case 'G': case 'a': case 'A': sp.kind = ARG_DOUBLE; break;
+        case 's': sp.kind = ARG_STRING; break;
+        case 'p': sp.kind = ARG_PTR; break;
+        case 'n': sp.kind = ARG_COUNT; break;
+        default: sp.kind = ARG_UNKNOWN; break;
+    }
+    return true;
+}
+
+template<typename T>
+void put(std::string& out, T v)
+{
+    out.append((const char*) &v, sizeof(T));
+}
+
+void put_str(std::string& out, const char* s, size_t len)
+{
+    put<uint32_t>(out, len);
+    out.append(s, len);
+}
+
+int64_t get_int_arg(char length, va_list& args)
+{
+    switch (length)
+    {
+        case 'H': return (signed char) va_arg(args, int);
+        case 'h': return (short) va_arg(args, int);
+        case 'l': return va_arg(args, long);
+        case 'Q': return va_arg(args, long long);
+        case 'j': return va_arg(args, intmax_t);
+        case 'z': return va_arg(args, ssize_t);
+        case 't': return va_arg(args, ptrdiff_t);
+        default: return va_arg(args, int);
+    }
+}
+
+uint64_t get_uint_arg(char length, va_list& args)
+{
+    switch (length)
+    {
+        case 'H': return (unsigned char) va_arg(args, unsigned int);
+        case 'h': return (unsigned short) va_arg(args, unsigned int);
+        case 'l': return va_arg(args, unsigned long);
+        case 'Q': return va_arg(args, unsigned long long);
+        case 'j': return va_arg(args, uintmax_t);
+        case 'z': return va_arg(args, size_t);
+        case 't': return va_arg(args, ptrdiff_t);
+        default: return va_arg(args, unsigned int);
+    }
+}
+
+// ----------------------------------------------------------------
+// Decoding helpers
+
+template<typename T>
+T get(std::istream& in)
+{
+    T v;
+    in.read((char*) &v, sizeof(T));
+    if (not in)
+        throw IOException(TRACE_INFO, "Truncated binary log record");
+    return v;
+}
+
+// The length is untrusted; read in chunks, so that a corrupt one
+// fails on the end of the input, rather than allocating up to 4GB.
+std::string get_str(std::istream& in)
+{
+    const size_t chunk = 1 << 16;
+    uint32_t len = get<uint32_t>(in);
+    std::string s;
+    while (s.size() < len)
+    {
+        size_t off = s.size();
+        s.resize(off + std::min<size_t>(chunk, len - off));
+        in.read(&s[off], s.size() - off);
+        if (not in)
+            throw IOException(TRACE_INFO, "Truncated binary log string");
+    }
+    return s;
+}
+
+template<typename T>
+T take(const std::string& args, size_t& off)
+{
+    T v;
+    if (args.size() < off + sizeof(T))
+        throw IOException(TRACE_INFO, "Truncated binary log arguments");
+    memcpy(&v, args.data() + off, sizeof(T));
+    off += sizeof(T);
+    return v;
+}
+
+template<typename... Args>
+void append_printf(std::string& out, const std::string& spec, Args... args)
+{
+    int n = snprintf(nullptr, 0, spec.c_str(), args...);
+    if (n <= 0) return;
+    size_t off = out.size();
+    out.resize(off + n + 1);
+    snprintf(&out[off], n + 1, spec.c_str(), args...);
+    out.resize(off + n);
+}
+
+/// Re-render a message from its format string and raw argument bytes.
+std::string render(const std::string& fmt, const std::string& args)
+{
+    std::string out;
+    size_t off = 0;
+    const char* p = fmt.c_str();
+    ConvSpec sp;
+    while (next_spec(p, sp))
+    {
+        out.append(p, sp.begin - p);
+        p = sp.end;
+
+        if (ARG_LITERAL == sp.kind) { out += '%'; continue; }
+        if (ARG_UNKNOWN == sp.kind)
+        {
+            // The encoder stopped here; so do we.
+            out.append(sp.begin);
+            return out;
+        }
+
+        // Rebuild the specification, with the '*' arguments filled in,
+        // and a length modifier that matches the stored width.
+        std::string spec;
+        for (const char* q = sp.begin; q < sp.lenmod; q++)
+        {
+            if ('*' == *q) spec += std::to_string(take<int64_t>(args, off));
+            else spec += *q;
+        }
+
+        switch (sp.kind)
+        {
+            case ARG_INT:
+                spec += "ll"; spec += sp.conv;
+                append_printf(out, spec, (long long) take<int64_t>(args, off));
+                break;
+            case ARG_UINT:
+                if ('c' == sp.conv)
+                {
+                    spec += 'c';
+                    append_printf(out, spec, (int) take<uint64_t>(args, off));
+                    break;
+                }
+                spec += "ll"; spec += sp.conv;
+                append_printf(out, spec,
+                    (unsigned long long) take<uint64_t>(args, off));
+                break;
+            case ARG_DOUBLE:
+                spec += sp.conv;
+                append_printf(out, spec, take<double>(args, off));
+                break;
+            case ARG_STRING:
+            {
+                uint32_t len = take<uint32_t>(args, off);
+                if (args.size() < off + len)
+                    throw IOException(TRACE_INFO, "Truncated binary log string");
+                std::string s(args, off, len);
+                off += len;
+                spec += 's';
+                append_printf(out, spec, s.c_str());
+                break;
+            }
+            case ARG_PTR:
+                spec += 'p';
+                append_printf(out, spec,
+                    (void*) (uintptr_t) take<uint64_t>(args, off));
+                break;
+            default:
+                break;
+        }
+    }
+    out.append(p);
+    return out;
+}
+
+} // anonymous namespace
+
+// ----------------------------------------------------------------
+
+uint64_t opencog::binlog_monotonic_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Same value as printed for std::this_thread::get_id() by the text
+/// mode logger, on POSIX systems.
+uint64_t opencog::binlog_thread_tag()
+{
+    thread_local uint64_t tag = (uint64_t) pthread_self();
+    return tag;
+}
+
+void opencog::binlog_append_clock(std::string& out)
+{
+    uint64_t wall = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    out += BINLOG_CLOCK;
+    put<uint64_t>(out, wall);
+    put<uint64_t>(out, binlog_monotonic_ns());
+}
+
+void opencog::binlog_append_format(std::string& out, uint32_t id,
+                                   const char* fmt)
+{
+    out += BINLOG_FORMAT;
+    put<uint32_t>(out, id);
+    put_str(out, fmt, strlen(fmt));
+}
+
+void opencog::binlog_append_message(std::string& out, uint32_t fmt_id,
+                                    uint32_t comp_id, int level,
+                                    const char* fmt, va_list args)
+{
+    out += BINLOG_MESSAGE;
+    put<uint32_t>(out, fmt_id);
+    put<uint32_t>(out, comp_id);
+    put<uint8_t>(out, level);
+    put<uint64_t>(out, binlog_monotonic_ns());
+    put<uint64_t>(out, binlog_thread_tag());
+
+    // Reserve the length; fill it in when done.
+    size_t lenpos = out.size();
+    put<uint32_t>(out, 0);
+
+    va_list ap;
+    va_copy(ap, args);
+    ConvSpec sp;
+    const char* p = fmt;
+    while (next_spec(p, sp))
+    {
+        p = sp.end;
+        if (ARG_UNKNOWN == sp.kind) break;
+        for (int i = 0; i < sp.nstar; i++)
+            put<int64_t>(out, va_arg(ap, int));
+
+        switch (sp.kind)
+        {
+            case ARG_INT: put<int64_t>(out, get_int_arg(sp.length, ap)); break;
+            case ARG_UINT: put<uint64_t>(out, get_uint_arg(sp.length, ap)); break;
+            case ARG_DOUBLE:
+                if ('L' == sp.length)
+                    put<double>(out, (double) va_arg(ap, long double));
+                else
+                    put<double>(out, va_arg(ap, double));
+                break;
+            case ARG_STRING:
+            {
+                const char* s = va_arg(ap, const char*);
+                if (nullptr == s) s = "(null)";
+                put_str(out, s, strlen(s));
+                break;
+            }
+            case ARG_PTR: put<uint64_t>(out, (uintptr_t) va_arg(ap, void*)); break;
+            case ARG_COUNT: (void) va_arg(ap, void*); break;
+            default: break;
+        }
+    }
+    va_end(ap);
+
+    uint32_t len = out.size() - lenpos - sizeof(uint32_t);
+    memcpy(&out[lenpos], &len, sizeof(uint32_t));
+}
+
+void opencog::binlog_append_text(std::string& out, uint32_t comp_id,
+                                 int level, const std::string& txt)
+{
+    out += BINLOG_TEXT;
+    put<uint32_t>(out, comp_id);
+    put<uint8_t>(out, level);
+    put<uint64_t>(out, binlog_monotonic_ns());
+    put<uint64_t>(out, binlog_thread_tag());
+    put_str(out, txt.data(), txt.size());
+}
+
+// ----------------------------------------------------------------
+
+size_t opencog::binlog_decode(std::istream& in, std::ostream& out)
+{
+    std::map<uint32_t, std::string> formats;
+    bool have_clock = false;
+    int64_t wall_minus_mono = 0;
+    size_t nmsgs = 0;
+
+    while (EOF != in.peek())
+    {
+        char type = get<char>(in);
+        if (BINLOG_CLOCK == type)
+        {
+            uint64_t wall = get<uint64_t>(in);
+            uint64_t mono = get<uint64_t>(in);
+            wall_minus_mono = (int64_t) (wall - mono);
+            have_clock = true;
+            continue;
+        }
+        if (BINLOG_FORMAT == type)
+        {
+            uint32_t id = get<uint32_t>(in);
+            formats[id] = get_str(in);
+            continue;
+        }
+        if (BINLOG_MESSAGE != type and BINLOG_TEXT != type)
+            throw IOException(TRACE_INFO,
+                "Unknown binary log record type 0x%x", (unsigned char) type);
+
+        uint32_t fmt_id = 0;
+        if (BINLOG_MESSAGE == type) fmt_id = get<uint32_t>(in);
+        uint32_t comp_id = get<uint32_t>(in);
+        uint8_t level = get<uint8_t>(in);
+        uint64_t mono = get<uint64_t>(in);
+        uint64_t thread = get<uint64_t>(in);
+        std::string payload = get_str(in);
+
+        std::string line;
+        char stamp[64];
+        if (have_clock)
+        {
+            uint64_t ns = mono + wall_minus_mono;
+            time_t t = ns / 1000000000ULL;
+            struct tm stm;
+            gmtime_r(&t, &stm);
+            strftime(stamp, sizeof(stamp), "%F %T", &stm);
+            line += '[';
+            line += stamp;
+            snprintf(stamp, sizeof(stamp), ":%03lu] ",
+                     (unsigned long) (ns / 1000000ULL) % 1000);
+            line += stamp;
+        }
+        else
+        {
+            snprintf(stamp, sizeof(stamp), "[%.6f] ", mono * 1e-9);
+            line += stamp;
+        }
+
+        line += '[';
+        if (Logger::FINE < level) level = Logger::BAD_LEVEL;
+        line += Logger::get_level_string((Logger::Level) level);
+        line += "] ";
+
+        if (comp_id)
+        {
+            line += '[';
+            line += formats[comp_id];
+            line += "] ";
+        }
+
+        line += "[thread-" + std::to_string(thread) + "] ";
+
+        if (BINLOG_MESSAGE == type)
+        {
+            auto fit = formats.find(fmt_id);
+            if (formats.end() == fit)
+                throw IOException(TRACE_INFO,
+                    "Binary log uses undefined format id %u", fmt_id);
+            line += render(fit->second, payload);
+        }
+        else
+            line += payload;
+
+        out << line << '\n';
+        nmsgs++;
+    }
+    return nmsgs;
+}
@@ -0,0 +1,88 @@
+/*
+ * opencog/util/binary_log.h
+ *
+ * Binary log record format, used by the Logger in binary mode.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_BINARY_LOG_H
+#define _OPENCOG_BINARY_LOG_H
+
+#include <cstdarg>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+/**
+ * In binary mode, the Logger does not format messages. Instead, it
+ * writes a stream of records, each starting with a one-byte record
+ * type. All integers are in host byte order.
+ *
+ *   'C' u64 wall-clock-ns u64 monotonic-ns
+ *       Clock synchronization; lets the decoder turn the monotonic
+ *       message timestamps into wall-clock time.
+ *   'F' u32 id u32 len char[len]
+ *       Defines a format string (or component name). Appears once,
+ *       before the first record that uses the id.
+ *   'M' u32 fmt-id u32 component-id u8 level u64 monotonic-ns
+ *       u64 thread u32 len byte[len]
+ *       A printf-style message: the raw argument bytes, in the order
+ *       of the conversion specifications in the format string.
+ *       Integers and pointers take 8 bytes, floating point values
+ *       are stored as 8-byte doubles, and strings as u32 len char[len].
+ *   'T' u32 component-id u8 level u64 monotonic-ns u64 thread
+ *       u32 len char[len]
+ *       An already-formatted text message.
+ *
+ * A component-id of zero means "no component".
+ */
+enum binlog_record : char
+{
+    BINLOG_CLOCK = 'C',
+    BINLOG_FORMAT = 'F',
+    BINLOG_MESSAGE = 'M',
+    BINLOG_TEXT = 'T'
+};
+
+uint64_t binlog_monotonic_ns();
+uint64_t binlog_thread_tag();
+
+void binlog_append_clock(std::string&);
+void binlog_append_format(std::string&, uint32_t id, const char* fmt);
+void binlog_append_message(std::string&, uint32_t fmt_id, uint32_t comp_id,
+                           int level, const char* fmt, va_list);
+void binlog_append_text(std::string&, uint32_t comp_id, int level,
+                        const std::string&);
+
+/**
+ * Render a binary log as text, in the same layout as the text-mode
+ * Logger (with timestamp, level, component and thread id). Returns
+ * the number of messages decoded. Throws an IOException if the input
+ * is truncated or corrupt.
+ */
+size_t binlog_decode(std::istream&, std::ostream&);
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_BINARY_LOG_H
@@ -0,0 +1,118 @@
+/*
+ * opencog/util/cache_registry.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <chrono>
+#include <sstream>
+
+#include <opencog/util/cache_registry.h>
+#include <opencog/util/Logger.h>
+#include <opencog/util/lru_cache.h>
+#include <opencog/util/memory_accounting.h>
+
+using namespace opencog;
+
+std::string cache_stats::to_string() const
+{
+    std::stringstream ss;
+    ss << name << ": size=" << size << " capacity=" << capacity
+       << " hits=" << hits << " misses=" << misses
+       << " collapsed=" << collapsed << " evictions=" << evictions
+       << " bytes=" << bytes << " hit_ratio=" << hit_ratio();
+    return ss.str();
+}
+
+cache_registry& cache_registry::instance()
+{
+    static cache_registry reg;
+    return reg;
+}
+
+cache_registry::cache_registry() : _dumping(false)
+{
+    _memory_source = add_memory_source("caches", [this]() {
+        size_t bytes = 0;
+        for (const cache_stats& st : snapshot()) bytes += st.bytes;
+        return bytes;
+    });
+}
+
+cache_registry::~cache_registry()
+{
+    remove_memory_source(_memory_source);
+    stop_dump();
+}
+
+void cache_registry::add(const inf_cache_base* c)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    _caches.insert(c);
+}
+
+void cache_registry::remove(const inf_cache_base* c)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    _caches.erase(c);
+}
+
+std::vector<cache_stats> cache_registry::snapshot() const
+{
+    // The stats are all atomics, in the base class, so it is safe to
+    // read them even while the cache is being used, or destroyed;
+    // removal waits for the lock.
+    std::lock_guard<std::mutex> lock(_mtx);
+    std::vector<cache_stats> stats;
+    for (const inf_cache_base* c : _caches)
+        stats.push_back(c->get_stats());
+    return stats;
+}
+
+std::string cache_registry::to_string() const
+{
+    std::stringstream ss;
+    for (const cache_stats& st : snapshot())
+        ss << st.to_string() << std::endl;
+    return ss.str();
+}
+
+void cache_registry::start_dump(unsigned period_sec)
+{
+    stop_dump();
+    std::lock_guard<std::mutex> lock(_dump_mtx);
+    _dumping = true;
+    _dump_thread = std::thread([this, period_sec]() {
+        std::unique_lock<std::mutex> lock(_dump_mtx);
+        while (_dumping)
+        {
+            _dump_cond.wait_for(lock, std::chrono::seconds(period_sec));
+            if (not _dumping) break;
+            for (const cache_stats& st : snapshot())
+                logger().info("Cache stats %s", st.to_string().c_str());
+        }
+    });
+}
+
+void cache_registry::stop_dump()
+{
+    {
+        std::lock_guard<std::mutex> lock(_dump_mtx);
+        _dumping = false;
+    }
+    _dump_cond.notify_all();
+    if (_dump_thread.joinable()) _dump_thread.join();
+}
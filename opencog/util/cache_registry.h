@@ -0,0 +1,104 @@
+/*
+ * opencog/util/cache_registry.h
+ *
+ * A process-wide list of all the caches in lru_cache.h.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_CACHE_REGISTRY_H
+#define _OPENCOG_CACHE_REGISTRY_H
+
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+struct inf_cache_base;
+
+//! The statistics of one cache, at one instant in time.
+struct cache_stats
+{
+    std::string name;
+    size_t capacity = 0;        // 0 for unlimited caches
+    size_t size = 0;            // number of entries
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t collapsed = 0;       // misses that waited for another thread
+    size_t evictions = 0;
+    size_t bytes = 0;           // memory held by the entries
+
+    double hit_ratio() const
+    { return (hits + misses) ? double(hits) / (hits + misses) : 0.0; }
+
+    std::string to_string() const;
+};
+
+//! Every cache registers itself here, when constructed, and leaves
+//! when destroyed. So snapshot() lists every live cache.
+///
+/// The memory in use is exact for budget_lru_cache, and estimated from
+/// the size of the key and result types for the others; see
+/// entry_sizeof. The total of all caches is reported to
+/// memory_accounts(), as "caches".
+class cache_registry
+{
+public:
+    static cache_registry& instance();
+
+    void add(const inf_cache_base*);
+    void remove(const inf_cache_base*);
+
+    std::vector<cache_stats> snapshot() const;
+
+    /// One line per cache.
+    std::string to_string() const;
+
+    /// Write the snapshot to the log, at INFO level, every period_sec
+    /// seconds, until stop_dump() is called.
+    void start_dump(unsigned period_sec);
+    void stop_dump();
+
+    ~cache_registry();
+
+private:
+    cache_registry();
+    cache_registry(const cache_registry&) = delete;
+    cache_registry& operator=(const cache_registry&) = delete;
+
+    mutable std::mutex _mtx;
+    std::set<const inf_cache_base*> _caches;
+
+    std::mutex _dump_mtx;
+    std::condition_variable _dump_cond;
+    std::thread _dump_thread;
+    bool _dumping;
+
+    unsigned _memory_source;    // see memory_accounting.h
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_CACHE_REGISTRY_H
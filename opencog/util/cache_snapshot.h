@@ -0,0 +1,302 @@
+/*
+ * opencog/util/cache_snapshot.h
+ *
+ * Saving the entries of a cache, and loading them back after a
+ * restart.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_CACHE_SNAPSHOT_H
+#define _OPENCOG_CACHE_SNAPSHOT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <opencog/util/exceptions.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! How a cache snapshot writes and reads values of type T.
+///
+/// Specialize it for the keys and results of the caches to be saved,
+/// with the same two static members: write() puts a T on the binary
+/// stream, and read() gets it back, setting the failbit of the stream
+/// if it cannot. It is provided for the trivially copyable types (as
+/// their bytes, so a snapshot is only good on machines of the same
+/// byte order), std::string, and the pairs and vectors of those.
+template<typename T, typename Enable = void>
+struct snapshot_traits;
+
+template<typename T>
+struct snapshot_traits<T, typename std::enable_if<
+                              std::is_trivially_copyable<T>::value>::type>
+{
+    static void write(std::ostream& out, const T& x)
+    {
+        out.write(reinterpret_cast<const char*>(&x), sizeof(T));
+    }
+    static void read(std::istream& in, T& x)
+    {
+        in.read(reinterpret_cast<char*>(&x), sizeof(T));
+    }
+};
+
+namespace detail
+{
+inline void write_snapshot_size(std::ostream& out, uint64_t n)
+{
+    snapshot_traits<uint64_t>::write(out, n);
+}
+
+// The sizes read are not trusted: the strings and vectors are read
+// at most this many bytes, or elements, at a time, so that a corrupt
+// size fails once the stream runs out, rather than first allocating
+// all of it.
+const size_t snapshot_chunk = 1 << 16;
+
+inline uint64_t read_snapshot_size(std::istream& in)
+{
+    uint64_t n = 0;
+    snapshot_traits<uint64_t>::read(in, n);
+    if (std::numeric_limits<size_t>::max() < n) in.setstate(std::ios::failbit);
+    return in ? n : 0;
+}
+} // namespace detail
+
+template<>
+struct snapshot_traits<std::string>
+{
+    static void write(std::ostream& out, const std::string& s)
+    {
+        detail::write_snapshot_size(out, s.size());
+        out.write(s.data(), s.size());
+    }
+    static void read(std::istream& in, std::string& s)
+    {
+        uint64_t n = detail::read_snapshot_size(in);
+        s.clear();
+        while (in and s.size() < n)
+        {
+            size_t have = s.size();
+            size_t chunk = std::min<uint64_t>(n - have, detail::snapshot_chunk);
+            s.resize(have + chunk);
+            in.read(&s[have], chunk);
+        }
+    }
+};
+
+template<typename A, typename B>
+struct snapshot_traits<std::pair<A, B>, typename std::enable_if<
+                           not std::is_trivially_copyable<
+                               std::pair<A, B>>::value>::type>
+{
+    static void write(std::ostream& out, const std::pair<A, B>& p)
+    {
+        snapshot_traits<A>::write(out, p.first);
+        snapshot_traits<B>::write(out, p.second);
+    }
+    static void read(std::istream& in, std::pair<A, B>& p)
+    {
+        snapshot_traits<A>::read(in, p.first);
+        snapshot_traits<B>::read(in, p.second);
+    }
+};
+
+template<typename T>
+struct snapshot_traits<std::vector<T>>
+{
+    static void write(std::ostream& out, const std::vector<T>& v)
+    {
+        detail::write_snapshot_size(out, v.size());
+        for (const T& x : v) snapshot_traits<T>::write(out, x);
+    }
+    static void read(std::istream& in, std::vector<T>& v)
+    {
+        uint64_t n = detail::read_snapshot_size(in);
+        v.clear();
+        v.reserve(std::min<uint64_t>(n, detail::snapshot_chunk));
+        for (uint64_t i = 0; i < n and in; i++)
+        {
+            v.emplace_back();
+            snapshot_traits<T>::read(in, v.back());
+        }
+    }
+};
+
+namespace detail
+{
+// "occache" and the version of the format
+const char snapshot_magic[8] = {'o', 'c', 'c', 'a', 'c', 'h', 'e', 1};
+
+// Each entry is preceded by ENTRY, and the last one followed by END,
+// so that a truncated snapshot is told apart from a complete one.
+const char snapshot_entry = 1, snapshot_end = 0;
+} // namespace detail
+
+//! Write the entries of the cache to the binary stream, from the most
+//! recently used to the least (if the cache keeps track of it; see
+//! for_each_entry() in lru_cache.h), at most max_entries of them.
+/// Return the number of entries written.
+///
+/// The cache is not otherwise touched: the hits and misses, and the
+/// order of recency, are left as they were.
+template<typename Cache,
+         typename KeyTraits = snapshot_traits<typename Cache::argument_type>,
+         typename ValueTraits = snapshot_traits<typename Cache::result_type>>
+size_t save_cache_snapshot(const Cache& cache, std::ostream& out,
+                           size_t max_entries =
+                               std::numeric_limits<size_t>::max())
+{
+    typedef typename Cache::argument_type argument_type;
+    typedef typename Cache::result_type result_type;
+
+    out.write(detail::snapshot_magic, sizeof(detail::snapshot_magic));
+    size_t n = 0;
+    cache.for_each_entry([&](const argument_type& x, const result_type& y) {
+        if (max_entries <= n) return false;
+        out.put(detail::snapshot_entry);
+        KeyTraits::write(out, x);
+        ValueTraits::write(out, y);
+        n++;
+        return bool(out);
+    });
+    out.put(detail::snapshot_end);
+    if (not out)
+        throw IOException(TRACE_INFO,
+                          "save_cache_snapshot - failed to write.");
+    return n;
+}
+
+//! Read a snapshot written by save_cache_snapshot(), and preload its
+//! entries into the cache, keeping the order of recency, until the
+//! cache is full or max_entries are inserted. As the most recently used
+/// entries come first, the cache gets the hottest ones. Return the
+/// number of entries inserted. The entries already in the cache are
+/// kept, and stay more recently used than the loaded ones.
+///
+/// Throws an IOException if the stream is not a snapshot, or is
+/// truncated or otherwise unreadable; the entries read up to then
+/// are kept.
+template<typename Cache,
+         typename KeyTraits = snapshot_traits<typename Cache::argument_type>,
+         typename ValueTraits = snapshot_traits<typename Cache::result_type>>
+size_t load_cache_snapshot(Cache& cache, std::istream& in,
+                           size_t max_entries =
+                               std::numeric_limits<size_t>::max())
+{
+    typedef typename std::decay<typename Cache::argument_type>::type
+        argument_type;
+    typedef typename std::decay<typename Cache::result_type>::type
+        result_type;
+
+    char magic[sizeof(detail::snapshot_magic)];
+    if (not in.read(magic, sizeof(magic))
+        or 0 != memcmp(magic, detail::snapshot_magic, sizeof(magic)))
+        throw IOException(TRACE_INFO,
+                          "load_cache_snapshot - not a cache snapshot.");
+
+    size_t n = 0;
+    argument_type x;
+    result_type y;
+    while (n < max_entries)
+    {
+        int tag = in.get();
+        if (detail::snapshot_end == tag) return n;
+        if (detail::snapshot_entry != tag) break;
+        KeyTraits::read(in, x);
+        ValueTraits::read(in, y);
+        if (not in) break;
+        if (cache.preload(x, y)) n++;
+        else if (cache.full()) return n;
+    }
+    if (max_entries <= n) return n;
+    throw IOException(TRACE_INFO,
+                      "load_cache_snapshot - corrupt or truncated snapshot.");
+}
+
+//! Save the snapshot to a file, atomically: it is written next to it
+//! first, then renamed over it, so that a crash midway leaves the
+//! previous snapshot in place.
+template<typename Cache,
+         typename KeyTraits = snapshot_traits<typename Cache::argument_type>,
+         typename ValueTraits = snapshot_traits<typename Cache::result_type>>
+size_t save_cache_snapshot(const Cache& cache, const std::string& filename,
+                           size_t max_entries =
+                               std::numeric_limits<size_t>::max())
+{
+    std::string tmp = filename + ".tmp";
+    size_t n = 0;
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (not out)
+            throw IOException(TRACE_INFO,
+                              "save_cache_snapshot - cannot open %s.",
+                              tmp.c_str());
+        try {
+            n = save_cache_snapshot<Cache, KeyTraits, ValueTraits>(
+                cache, out, max_entries);
+            out.close();
+            if (not out)
+                throw IOException(TRACE_INFO,
+                                  "save_cache_snapshot - cannot write %s.",
+                                  tmp.c_str());
+        } catch (...) {
+            std::remove(tmp.c_str());
+            throw;
+        }
+    }
+    if (0 != std::rename(tmp.c_str(), filename.c_str()))
+    {
+        std::remove(tmp.c_str());
+        throw IOException(TRACE_INFO,
+                          "save_cache_snapshot - cannot rename %s.",
+                          tmp.c_str());
+    }
+    return n;
+}
+
+//! Load the snapshot from a file. A missing file is not an error,
+//! just a cold start: nothing is loaded.
+template<typename Cache,
+         typename KeyTraits = snapshot_traits<typename Cache::argument_type>,
+         typename ValueTraits = snapshot_traits<typename Cache::result_type>>
+size_t load_cache_snapshot(Cache& cache, const std::string& filename,
+                           size_t max_entries =
+                               std::numeric_limits<size_t>::max())
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (not in) return 0;
+    return load_cache_snapshot<Cache, KeyTraits, ValueTraits>(
+        cache, in, max_entries);
+}
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_CACHE_SNAPSHOT_H
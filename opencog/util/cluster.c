@@ -33,10 +33,20 @@
 #include <limits.h>
 #include <string.h>
 #include "cluster.h"
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
 #ifdef WINDOWS
 #  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
 #endif
 
+/* Whether data[i][j] is there; a NULL mask means that no value is missing. */
+#define PRESENT(mask, i, j) (!(mask) || (mask)[i][j])
+
 #ifndef min
 #define min(x, y)      ((x) < (y) ? (x) : (y))
 #endif
@@ -159,9 +169,13 @@ double median (int n, double x[])
 
 /* ********************************************************************** */
 
-//! used in the quicksort algorithm
+//! used in the quicksort algorithm (one per thread, as the metrics that
+//! sort may run on several threads at once)
 //! 
 static const double* sortdata = NULL; 
+#ifdef _OPENMP
+#pragma omp threadprivate(sortdata)
+#endif
 
 /* ---------------------------------------------------------------------- */
 
@@ -288,6 +302,36 @@ freedatamask(int n, double** data, int** mask)
 
 /* ---------------------------------------------------------------------- */
 
+static int
+rowpointers(int nrows, const double* data, const int* mask, int stride,
+  double*** pdata, int*** pmask)
+/*
+Point the rows of a ragged array into a contiguous row-major matrix, whose
+row i starts at data + i*stride; no value is copied. If mask is NULL, so is
+*pmask. Returns 0 if memory could not be allocated.
+*/
+{ int i;
+  double** rows = malloc(nrows*sizeof(double*));
+  int** mrows = NULL;
+  if (!rows) return 0;
+  if (mask)
+  { mrows = malloc(nrows*sizeof(int*));
+    if (!mrows)
+    { free(rows);
+      return 0;
+    }
+  }
+  for (i = 0; i < nrows; i++)
+  { rows[i] = (double*)data + (size_t)i*stride;
+    if (mask) mrows[i] = (int*)mask + (size_t)i*stride;
+  }
+  *pdata = rows;
+  *pmask = mrows;
+  return 1;
+}
+
+/* ---------------------------------------------------------------------- */
+
 /**
 \internal
 
@@ -314,18 +358,41 @@ the shortest distance.
 */
 static
 double find_closest_pair(int n, double** distmatrix, int* ip, int* jp)
-{ int i, j;
-  double temp;
-  double distance = distmatrix[1][0];
+{ double distance = distmatrix[1][0];
   *ip = 1;
   *jp = 0;
-  for (i = 1; i < n; i++)
-  { for (j = 0; j < i; j++)
-    { temp = distmatrix[i][j];
-      if (temp<distance)
-      { distance = temp;
-        *ip = i;
-        *jp = j;
+  /* Each thread finds the closest pair of its rows; the first of those in
+   * the order of the serial scan is then kept, so that ties go to the same
+   * pair on any number of threads. */
+#ifdef _OPENMP
+  #pragma omp parallel if (n > 256)
+#endif
+  { int i, j;
+    double tdistance = distmatrix[1][0];
+    int tip = 1;
+    int tjp = 0;
+#ifdef _OPENMP
+    #pragma omp for schedule(dynamic, 16) nowait
+#endif
+    for (i = 1; i < n; i++)
+    { for (j = 0; j < i; j++)
+      { const double temp = distmatrix[i][j];
+        if (temp<tdistance)
+        { tdistance = temp;
+          tip = i;
+          tjp = j;
+        }
+      }
+    }
+#ifdef _OPENMP
+    #pragma omp critical (find_closest_pair)
+#endif
+    { if (tdistance<distance
+          || (tdistance==distance
+              && (tip<*ip || (tip==*ip && tjp<*jp))))
+      { distance = tdistance;
+        *ip = tip;
+        *jp = tjp;
       }
     }
   }
@@ -941,9 +1008,21 @@ double euclid (int n, double** data1, double** data2, int** mask1, int** mask2,
   double result = 0.;
   double tweight = 0;
   int i;
-  if (transpose==0) /* Calculate the distance between two rows */
+  if (transpose==0 && !mask1 && !mask2) /* Two full rows: vectorized */
+  { const double* x = data1[index1];
+    const double* y = data2[index2];
+#ifdef _OPENMP
+    #pragma omp simd reduction(+:result,tweight)
+#endif
+    for (i = 0; i < n; i++)
+    { double term = x[i] - y[i];
+      result += weight[i]*term*term;
+      tweight += weight[i];
+    }
+  }
+  else if (transpose==0) /* Calculate the distance between two rows */
   { for (i = 0; i < n; i++)
-    { if (mask1[index1][i] && mask2[index2][i])
+    { if (PRESENT(mask1,index1,i) && PRESENT(mask2,index2,i))
       { double term = data1[index1][i] - data2[index2][i];
         result += weight[i]*term*term;
         tweight += weight[i];
@@ -952,7 +1031,7 @@ double euclid (int n, double** data1, double** data2, int** mask1, int** mask2,
   }
   else
   { for (i = 0; i < n; i++)
-    { if (mask1[i][index1] && mask2[i][index2])
+    { if (PRESENT(mask1,i,index1) && PRESENT(mask2,i,index2))
       { double term = data1[i][index1] - data2[i][index2];
         result += weight[i]*term*term;
         tweight += weight[i];
@@ -1016,9 +1095,20 @@ double cityblock (int n, double** data1, double** data2, int** mask1,
 { double result = 0.;
   double tweight = 0;
   int i;
-  if (transpose==0) /* Calculate the distance between two rows */
+  if (transpose==0 && !mask1 && !mask2) /* Two full rows: vectorized */
+  { const double* x = data1[index1];
+    const double* y = data2[index2];
+#ifdef _OPENMP
+    #pragma omp simd reduction(+:result,tweight)
+#endif
+    for (i = 0; i < n; i++)
+    { result += weight[i]*fabs(x[i] - y[i]);
+      tweight += weight[i];
+    }
+  }
+  else if (transpose==0) /* Calculate the distance between two rows */
   { for (i = 0; i < n; i++)
-    { if (mask1[index1][i] && mask2[index2][i])
+    { if (PRESENT(mask1,index1,i) && PRESENT(mask2,index2,i))
       { double term = data1[index1][i] - data2[index2][i];
         result = result + weight[i]*fabs(term);
         tweight += weight[i];
@@ -1027,7 +1117,7 @@ double cityblock (int n, double** data1, double** data2, int** mask1,
   }
   else
   { for (i = 0; i < n; i++)
-    { if (mask1[i][index1] && mask2[i][index2])
+    { if (PRESENT(mask1,i,index1) && PRESENT(mask2,i,index2))
       { double term = data1[i][index1] - data2[i][index2];
         result = result + weight[i]*fabs(term);
         tweight += weight[i];
@@ -1098,10 +1188,27 @@ Otherwise, the distance between two columns in the matrix is calculated.
   double denom1 = 0.;
   double denom2 = 0.;
   double tweight = 0.;
-  if (transpose==0) /* Calculate the distance between two rows */
+  if (transpose==0 && !mask1 && !mask2) /* Two full rows: vectorized */
+  { const double* x = data1[index1];
+    const double* y = data2[index2];
+    int i;
+#ifdef _OPENMP
+    #pragma omp simd reduction(+:sum1,sum2,result,denom1,denom2,tweight)
+#endif
+    for (i = 0; i < n; i++)
+    { double w = weight[i];
+      sum1 += w*x[i];
+      sum2 += w*y[i];
+      result += w*x[i]*y[i];
+      denom1 += w*x[i]*x[i];
+      denom2 += w*y[i]*y[i];
+      tweight += w;
+    }
+  }
+  else if (transpose==0) /* Calculate the distance between two rows */
   { int i;
     for (i = 0; i < n; i++)
-    { if (mask1[index1][i] && mask2[index2][i])
+    { if (PRESENT(mask1,index1,i) && PRESENT(mask2,index2,i))
       { double term1 = data1[index1][i];
         double term2 = data2[index2][i];
         double w = weight[i];
@@ -1117,7 +1224,7 @@ Otherwise, the distance between two columns in the matrix is calculated.
   else
   { int i;
     for (i = 0; i < n; i++)
-    { if (mask1[i][index1] && mask2[i][index2])
+    { if (PRESENT(mask1,i,index1) && PRESENT(mask2,i,index2))
       { double term1 = data1[i][index1];
         double term2 = data2[i][index2];
         double w = weight[i];
@@ -1202,7 +1309,7 @@ Otherwise, the distance between two columns in the matrix is calculated.
   if (transpose==0) /* Calculate the distance between two rows */
   { int i;
     for (i = 0; i < n; i++)
-    { if (mask1[index1][i] && mask2[index2][i])
+    { if (PRESENT(mask1,index1,i) && PRESENT(mask2,index2,i))
       { double term1 = data1[index1][i];
         double term2 = data2[index2][i];
         double w = weight[i];
@@ -1218,7 +1325,7 @@ Otherwise, the distance between two columns in the matrix is calculated.
   else
   { int i;
     for (i = 0; i < n; i++)
-    { if (mask1[i][index1] && mask2[i][index2])
+    { if (PRESENT(mask1,i,index1) && PRESENT(mask2,i,index2))
       { double term1 = data1[i][index1];
         double term2 = data2[i][index2];
         double w = weight[i];
@@ -1306,7 +1413,7 @@ Otherwise, the distance between two columns in the matrix is calculated.
   if (transpose==0) /* Calculate the distance between two rows */
   { int i;
     for (i = 0; i < n; i++)
-    { if (mask1[index1][i] && mask2[index2][i])
+    { if (PRESENT(mask1,index1,i) && PRESENT(mask2,index2,i))
       { double term1 = data1[index1][i];
         double term2 = data2[index2][i];
         double w = weight[i];
@@ -1320,7 +1427,7 @@ Otherwise, the distance between two columns in the matrix is calculated.
   else
   { int i;
     for (i = 0; i < n; i++)
-    { if (mask1[i][index1] && mask2[i][index2])
+    { if (PRESENT(mask1,i,index1) && PRESENT(mask2,i,index2))
       { double term1 = data1[i][index1];
         double term2 = data2[i][index2];
         double w = weight[i];
@@ -1403,7 +1510,7 @@ Otherwise, the distance between two columns in the matrix is calculated.
   if (transpose==0) /* Calculate the distance between two rows */
   { int i;
     for (i = 0; i < n; i++)
-    { if (mask1[index1][i] && mask2[index2][i])
+    { if (PRESENT(mask1,index1,i) && PRESENT(mask2,index2,i))
       { double term1 = data1[index1][i];
         double term2 = data2[index2][i];
         double w = weight[i];
@@ -1417,7 +1524,7 @@ Otherwise, the distance between two columns in the matrix is calculated.
   else
   { int i;
     for (i = 0; i < n; i++)
-    { if (mask1[i][index1] && mask2[i][index2])
+    { if (PRESENT(mask1,i,index1) && PRESENT(mask2,i,index2))
       { double term1 = data1[i][index1];
         double term2 = data2[i][index2];
         double w = weight[i];
@@ -1506,7 +1613,7 @@ Otherwise, the distance between two columns in the matrix is calculated.
   }
   if (transpose==0)
   { for (i = 0; i < n; i++)
-    { if (mask1[index1][i] && mask2[index2][i])
+    { if (PRESENT(mask1,index1,i) && PRESENT(mask2,index2,i))
       { tdata1[m] = data1[index1][i];
         tdata2[m] = data2[index2][i];
         m++;
@@ -1515,7 +1622,7 @@ Otherwise, the distance between two columns in the matrix is calculated.
   }
   else
   { for (i = 0; i < n; i++)
-    { if (mask1[i][index1] && mask2[i][index2])
+    { if (PRESENT(mask1,i,index1) && PRESENT(mask2,i,index2))
       { tdata1[m] = data1[i][index1];
         tdata2[m] = data2[i][index2];
         m++;
@@ -1630,9 +1737,9 @@ Otherwise, the distance between two columns in the matrix is calculated.
   int i, j;
   if (transpose==0)
   { for (i = 0; i < n; i++)
-    { if (mask1[index1][i] && mask2[index2][i])
+    { if (PRESENT(mask1,index1,i) && PRESENT(mask2,index2,i))
       { for (j = 0; j < i; j++)
-        { if (mask1[index1][j] && mask2[index2][j])
+        { if (PRESENT(mask1,index1,j) && PRESENT(mask2,index2,j))
           { double x1 = data1[index1][i];
             double x2 = data1[index1][j];
             double y1 = data2[index2][i];
@@ -1651,9 +1758,9 @@ Otherwise, the distance between two columns in the matrix is calculated.
   }
   else
   { for (i = 0; i < n; i++)
-    { if (mask1[i][index1] && mask2[i][index2])
+    { if (PRESENT(mask1,i,index1) && PRESENT(mask2,i,index2))
       { for (j = 0; j < i; j++)
-        { if (mask1[j][index1] && mask2[j][index2])
+        { if (PRESENT(mask1,j,index1) && PRESENT(mask2,j,index2))
           { double x1 = data1[i][index1];
             double x2 = data1[j][index1];
             double y1 = data2[i][index2];
@@ -2035,7 +2142,7 @@ columns (microarrays) are specified.
     for (k = 0; k < nrows; k++)
     { i = clusterid[k];
       for (j = 0; j < ncolumns; j++)
-      { if (mask[k][j] != 0)
+      { if (PRESENT(mask,k,j))
         { cdata[i][j]+=data[k][j];
           cmask[i][j]++;
         }
@@ -2060,7 +2167,7 @@ columns (microarrays) are specified.
     for (k = 0; k < ncolumns; k++)
     { i = clusterid[k];
       for (j = 0; j < nrows; j++)
-      { if (mask[j][k] != 0)
+      { if (PRESENT(mask,j,k))
         { cdata[j][i]+=data[j][k];
           cmask[j][i]++;
         }
@@ -2148,7 +2255,7 @@ calculating the medians.
     { for (j = 0; j < ncolumns; j++)
       { int count = 0;
         for (k = 0; k < nrows; k++)
-        { if (i==clusterid[k] && mask[k][j])
+        { if (i==clusterid[k] && PRESENT(mask,k,j))
           { cache[count] = data[k][j];
             count++;
           }
@@ -2169,7 +2276,7 @@ calculating the medians.
     { for (j = 0; j < nrows; j++)
       { int count = 0;
         for (k = 0; k < ncolumns; k++)
-        { if (i==clusterid[k] && mask[j][k])
+        { if (i==clusterid[k] && PRESENT(mask,j,k))
           { cache[count] = data[j][k];
             count++;
           }
@@ -2216,230 +2323,295 @@ int getclustercentroids(int nclusters, int nrows, int ncolumns,
 void getclustermedoids(int nclusters, int nelements, double** distance,
   int clusterid[], int centroids[], double errors[])
 { int i, j, k;
+  int nthreads = 1;
+  double* terrors = NULL;
+  int* tcentroids = NULL;
   for (j = 0; j < nclusters; j++) errors[j] = DBL_MAX;
+#ifdef _OPENMP
+  if (nelements > 256) nthreads = omp_get_max_threads();
+#endif
+  if (nthreads > 1)
+  { terrors = malloc(nthreads*nclusters*sizeof(double));
+    tcentroids = malloc(nthreads*nclusters*sizeof(int));
+    if (!terrors || !tcentroids) nthreads = 1;
+  }
+  if (nthreads == 1)
+  { free(terrors);
+    free(tcentroids);
+    for (i = 0; i < nelements; i++)
+    { double d = 0.0;
+      j = clusterid[i];
+      for (k = 0; k < nelements; k++)
+      { if (i==k || clusterid[k]!=j) continue;
+        d += (i < k ? distance[k][i] : distance[i][k]);
+        if (d > errors[j]) break;
+      }
+      if (d < errors[j])
+      { errors[j] = d;
+        centroids[j] = i;
+      }
+    }
+    return;
+  }
+
+  /* Each thread finds the medoids among its elements, with its own errors to
+   * cut the sums short. The medoids of the threads are then merged, the
+   * element first in order winning ties, as in the serial loop. */
+  for (i = 0; i < nthreads*nclusters; i++)
+  { terrors[i] = DBL_MAX;
+    tcentroids[i] = -1;
+  }
+#ifdef _OPENMP
+  #pragma omp parallel for num_threads(nthreads) private(j, k) \
+    schedule(dynamic, 16)
+#endif
   for (i = 0; i < nelements; i++)
   { double d = 0.0;
+#ifdef _OPENMP
+    const int t = omp_get_thread_num();
+#else
+    const int t = 0;
+#endif
+    double* te = terrors + t*nclusters;
+    int* tc = tcentroids + t*nclusters;
     j = clusterid[i];
     for (k = 0; k < nelements; k++)
     { if (i==k || clusterid[k]!=j) continue;
       d += (i < k ? distance[k][i] : distance[i][k]);
-      if (d > errors[j]) break;
+      if (d > te[j]) break;
     }
-    if (d < errors[j])
-    { errors[j] = d;
-      centroids[j] = i;
+    if (d < te[j])
+    { te[j] = d;
+      tc[j] = i;
     }
   }
+  for (i = 1; i < nthreads; i++)
+  { for (j = 0; j < nclusters; j++)
+    { const double e = terrors[i*nclusters+j];
+      const int c = tcentroids[i*nclusters+j];
+      if (c < 0) continue;
+      if (tcentroids[j] < 0 || e < terrors[j]
+          || (e == terrors[j] && c < tcentroids[j]))
+      { terrors[j] = e;
+        tcentroids[j] = c;
+      }
+    }
+  }
+  for (j = 0; j < nclusters; j++)
+  { if (tcentroids[j] < 0) continue;
+    errors[j] = terrors[j];
+    centroids[j] = tcentroids[j];
+  }
+  free(terrors);
+  free(tcentroids);
 }
 
 /* ********************************************************************* */
 
-static int
-kmeans(int nclusters, int nrows, int ncolumns, double** data, int** mask,
-  double weight[], int transpose, int npass, char dist,
-  double** cdata, int** cmask, int clusterid[], double* error,
-  int tclusterid[], int counts[], int mapping[])
-{ int i, j, k;
-  const int nelements = (transpose==0) ? nrows : ncolumns;
-  const int ndata = (transpose==0) ? ncolumns : nrows;
-  int ifound = 1;
-  int ipass = 0;
-  /* Set the metric function as indicated by dist */
-  double (*metric)
-    (int, double**, double**, int**, int**, const double[], int, int, int) =
-       setmetric(dist);
-
-  /* We save the clustering solution periodically and check if it reappears */
-  int* saved = malloc(nelements*sizeof(int));
-  if (saved==NULL) return -1;
-
-  *error = DBL_MAX;
-
-  do
-  { double total = DBL_MAX;
-    int counter = 0;
-    int period = 10;
+/**
+\internal
 
-    /* Perform the EM algorithm. First, randomly assign elements to clusters. */
-    if (npass!=0) randomassign (nclusters, nelements, tclusterid);
+The memory used by one pass of k-means or k-medians. When several passes run
+at once, on different threads, each has its own.
+*/
+typedef struct
+{ double** cdata;
+  int** cmask;
+  int* tclusterid;
+  int* counts;
+  int* saved;
+  int* closest;
+  double* distances;
+  double* cache;
+  int owntclusterid;
+} kworkspace;
 
-    for (i = 0; i < nclusters; i++) counts[i] = 0;
-    for (i = 0; i < nelements; i++) counts[tclusterid[i]]++;
+/* ---------------------------------------------------------------------- */
 
-    /* Start the loop */
-    while(1)
-    { double previous = total;
-      total = 0.0;
+static void
+freekworkspace(kworkspace* w, int nclusters, int ndata, int transpose)
+{ if (w->cdata)
+  { if (transpose==0) freedatamask(nclusters, w->cdata, w->cmask);
+    else freedatamask(ndata, w->cdata, w->cmask);
+  }
+  if (w->owntclusterid) free(w->tclusterid);
+  free(w->counts);
+  free(w->saved);
+  free(w->closest);
+  free(w->distances);
+  free(w->cache);
+}
 
-      if (counter % period == 0) /* Save the current cluster assignments */
-      { for (i = 0; i < nelements; i++) saved[i] = tclusterid[i];
-        if (period < INT_MAX / 2) period *= 2;
-      }
-      counter++;
+/* ---------------------------------------------------------------------- */
 
-      /* Find the center */
-      getclustermeans(nclusters, nrows, ncolumns, data, mask, tclusterid,
-                      cdata, cmask, transpose);
+/* Allocate the workspace of a pass, whose clustering goes to tclusterid, or
+ * to a new array if tclusterid is NULL. Returns 0 if out of memory. */
+static int
+makekworkspace(kworkspace* w, int nclusters, int nelements, int ndata,
+  int transpose, char method, int* tclusterid)
+{ int ok;
+  w->owntclusterid = (tclusterid==NULL);
+  w->tclusterid = tclusterid ? tclusterid : malloc(nelements*sizeof(int));
+  w->counts = malloc(nclusters*sizeof(int));
+  w->saved = malloc(nelements*sizeof(int));
+  w->closest = malloc(nelements*sizeof(int));
+  w->distances = malloc(nelements*sizeof(double));
+  w->cache = (method=='m') ? malloc(nelements*sizeof(double)) : NULL;
+  if (transpose==0) ok = makedatamask(nclusters, ndata, &w->cdata, &w->cmask);
+  else ok = makedatamask(ndata, nclusters, &w->cdata, &w->cmask);
+  return ok && w->tclusterid && w->counts && w->saved && w->closest
+    && w->distances && (method!='m' || w->cache);
+}
 
-      for (i = 0; i < nelements; i++)
-      /* Calculate the distances */
-      { double distance;
-        k = tclusterid[i];
-        if (counts[k]==1) continue;
-        /* No reassignment if that would lead to an empty cluster */
-        /* Treat the present cluster as a special case */
-        distance = metric(ndata,data,cdata,mask,cmask,weight,i,k,transpose);
-        for (j = 0; j < nclusters; j++)
-        { double tdistance;
-          if (j==k) continue;
-          tdistance = metric(ndata,data,cdata,mask,cmask,weight,i,j,transpose);
-          if (tdistance < distance)
-          { distance = tdistance;
-            counts[tclusterid[i]]--;
-            tclusterid[i] = j;
-            counts[j]++;
-          }
-        }
-        total += distance;
-      }
-      if (total>=previous) break;
-      /* total>=previous is FALSE on some machines even if total and previous
-       * are bitwise identical. */
-      for (i = 0; i < nelements; i++)
-        if (saved[i]!=tclusterid[i]) break;
-      if (i==nelements)
-        break; /* Identical solution found; break out of this loop */
-    }
+/* ---------------------------------------------------------------------- */
 
-    if (npass<=1) 
-    { *error = total;
-      break;
-    }
+/**
+\internal
 
-    for (i = 0; i < nclusters; i++) mapping[i] = -1;
-    for (i = 0; i < nelements; i++)
-    { j = tclusterid[i];
-      k = clusterid[i];
-      if (mapping[k] == -1) mapping[k] = j;
-      else if (mapping[k] != j)
-      { if (total < *error)
-        { ifound = 1;
-          *error = total;
-          for (j = 0; j < nelements; j++) clusterid[j] = tclusterid[j];
-        }
-        break;
+The assignment step of k-means and k-medians: each element moves to the
+cluster with the closest center, unless that would leave its cluster empty.
+The distances are calculated in parallel, and the elements are then moved in
+order, so that the clusters come out the same as if done serially. Returns
+the sum of the distances of the elements to their cluster.
+*/
+static double
+kassign(int nclusters, int ndata, int nelements, double** data, int** mask,
+  double weight[], int transpose,
+  double (*metric)
+    (int, double**, double**, int**, int**, const double[], int, int, int),
+  kworkspace* w)
+{ int i;
+  double total = 0.0;
+  /* Without missing values, no cluster center misses any either, as no
+   * cluster is empty; the metric may then take its fast path. */
+  int** cmask = mask ? w->cmask : NULL;
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(static)
+#endif
+  for (i = 0; i < nelements; i++)
+  { int j;
+    const int k = w->tclusterid[i];
+    double distance =
+      metric(ndata,data,w->cdata,mask,cmask,weight,i,k,transpose);
+    w->closest[i] = k;
+    for (j = 0; j < nclusters; j++)
+    { double tdistance;
+      if (j==k) continue;
+      tdistance =
+        metric(ndata,data,w->cdata,mask,cmask,weight,i,j,transpose);
+      if (tdistance < distance)
+      { distance = tdistance;
+        w->closest[i] = j;
       }
     }
-    if (i==nelements) ifound++; /* break statement not encountered */
-  } while (++ipass < npass);
-
-  free(saved);
-  return ifound;
+    w->distances[i] = distance;
+  }
+  for (i = 0; i < nelements; i++)
+  { const int k = w->tclusterid[i];
+    /* No reassignment if that would lead to an empty cluster */
+    if (w->counts[k]==1) continue;
+    w->counts[k]--;
+    w->tclusterid[i] = w->closest[i];
+    w->counts[w->closest[i]]++;
+    total += w->distances[i];
+  }
+  return total;
 }
 
 /* ---------------------------------------------------------------------- */
 
-static int
-kmedians(int nclusters, int nrows, int ncolumns, double** data, int** mask,
-  double weight[], int transpose, int npass, char dist,
-  double** cdata, int** cmask, int clusterid[], double* error,
-  int tclusterid[], int counts[], int mapping[], double cache[])
-{ int i, j, k;
+/**
+\internal
+
+One pass of the EM algorithm of k-means (method 'a') or k-medians (method
+'m'), from the initial clustering in w->tclusterid to a local optimum, also
+left in w->tclusterid. Returns the within-cluster sum of distances.
+*/
+static double
+kpass(int nclusters, int nrows, int ncolumns, double** data, int** mask,
+  double weight[], int transpose, char method, char dist, kworkspace* w)
+{ int i;
   const int nelements = (transpose==0) ? nrows : ncolumns;
   const int ndata = (transpose==0) ? ncolumns : nrows;
-  int ifound = 1;
-  int ipass = 0;
+  double total = DBL_MAX;
+  int counter = 0;
+  int period = 10;
   /* Set the metric function as indicated by dist */
   double (*metric)
     (int, double**, double**, int**, int**, const double[], int, int, int) =
        setmetric(dist);
 
-  /* We save the clustering solution periodically and check if it reappears */
-  int* saved = malloc(nelements*sizeof(int));
-  if (saved==NULL) return -1;
-
-  *error = DBL_MAX;
+  for (i = 0; i < nclusters; i++) w->counts[i] = 0;
+  for (i = 0; i < nelements; i++) w->counts[w->tclusterid[i]]++;
 
-  do
-  { double total = DBL_MAX;
-    int counter = 0;
-    int period = 10;
-
-    /* Perform the EM algorithm. First, randomly assign elements to clusters. */
-    if (npass!=0) randomassign (nclusters, nelements, tclusterid);
+  /* Start the loop */
+  while(1)
+  { double previous = total;
 
-    for (i = 0; i < nclusters; i++) counts[i]=0;
-    for (i = 0; i < nelements; i++) counts[tclusterid[i]]++;
-
-    /* Start the loop */
-    while(1)
-    { double previous = total;
-      total = 0.0;
+    if (counter % period == 0) /* Save the current cluster assignments */
+    { for (i = 0; i < nelements; i++) w->saved[i] = w->tclusterid[i];
+      if (period < INT_MAX / 2) period *= 2;
+    }
+    counter++;
 
-      if (counter % period == 0) /* Save the current cluster assignments */
-      { for (i = 0; i < nelements; i++) saved[i] = tclusterid[i];
-        if (period < INT_MAX / 2) period *= 2;
-      }
-      counter++;
+    /* Find the center */
+    if (method=='m')
+      getclustermedians(nclusters, nrows, ncolumns, data, mask, w->tclusterid,
+                        w->cdata, w->cmask, transpose, w->cache);
+    else
+      getclustermeans(nclusters, nrows, ncolumns, data, mask, w->tclusterid,
+                      w->cdata, w->cmask, transpose);
+
+    total = kassign(nclusters, ndata, nelements, data, mask, weight,
+                    transpose, metric, w);
+    if (total>=previous) break;
+    /* total>=previous is FALSE on some machines even if total and previous
+     * are bitwise identical. */
+    for (i = 0; i < nelements; i++)
+      if (w->saved[i]!=w->tclusterid[i]) break;
+    if (i==nelements)
+      break; /* Identical solution found; break out of this loop */
+  }
+  return total;
+}
 
-      /* Find the center */
-      getclustermedians(nclusters, nrows, ncolumns, data, mask, tclusterid,
-                        cdata, cmask, transpose, cache);
+/* ---------------------------------------------------------------------- */
 
-      for (i = 0; i < nelements; i++)
-      /* Calculate the distances */
-      { double distance;
-        k = tclusterid[i];
-        if (counts[k]==1) continue;
-        /* No reassignment if that would lead to an empty cluster */
-        /* Treat the present cluster as a special case */
-        distance = metric(ndata,data,cdata,mask,cmask,weight,i,k,transpose);
-        for (j = 0; j < nclusters; j++)
-        { double tdistance;
-          if (j==k) continue;
-          tdistance = metric(ndata,data,cdata,mask,cmask,weight,i,j,transpose);
-          if (tdistance < distance)
-          { distance = tdistance;
-            counts[tclusterid[i]]--;
-            tclusterid[i] = j;
-            counts[j]++;
-          }
-        }
-        total += distance;
+/* Keep the solution of a pass, tclusterid, if it is better than the best one
+ * so far, clusterid, and count how many times the best one was found. */
+static void
+kkeep(int nclusters, int nelements, const int tclusterid[], double total,
+  int clusterid[], double* error, int* ifound, int mapping[])
+{ int i, j, k;
+  for (i = 0; i < nclusters; i++) mapping[i] = -1;
+  for (i = 0; i < nelements; i++)
+  { j = tclusterid[i];
+    k = clusterid[i];
+    if (mapping[k] == -1) mapping[k] = j;
+    else if (mapping[k] != j)
+    { if (total < *error)
+      { *ifound = 1;
+        *error = total;
+        for (j = 0; j < nelements; j++) clusterid[j] = tclusterid[j];
       }
-      if (total>=previous) break;
-      /* total>=previous is FALSE on some machines even if total and previous
-       * are bitwise identical. */
-      for (i = 0; i < nelements; i++)
-        if (saved[i]!=tclusterid[i]) break;
-      if (i==nelements)
-        break; /* Identical solution found; break out of this loop */
-    }
-
-    if (npass<=1) 
-    { *error = total;
       break;
     }
+  }
+  if (i==nelements) (*ifound)++; /* break statement not encountered */
+}
 
-    for (i = 0; i < nclusters; i++) mapping[i] = -1;
-    for (i = 0; i < nelements; i++)
-    { j = tclusterid[i];
-      k = clusterid[i];
-      if (mapping[k] == -1) mapping[k] = j;
-      else if (mapping[k] != j)
-      { if (total < *error)
-        { ifound = 1;
-          *error = total;
-          for (j = 0; j < nelements; j++) clusterid[j] = tclusterid[j];
-        }
-        break;
-      }
-    }
-    if (i==nelements) ifound++; /* break statement not encountered */
-  } while (++ipass < npass);
+/* ---------------------------------------------------------------------- */
 
-  free(saved);
-  return ifound;
+/* Number of passes to run at once, one per thread. */
+static int
+kbatchsize(int npass)
+{
+#ifdef _OPENMP
+  const int nthreads = omp_get_max_threads();
+  return (npass < nthreads) ? npass : nthreads;
+#else
+  return 1;
+#endif
 }
 
 /* ********************************************************************* */
@@ -2451,13 +2623,11 @@ void kcluster (int nclusters, int nrows, int ncolumns,
 { const int nelements = (transpose==0) ? nrows : ncolumns;
   const int ndata = (transpose==0) ? ncolumns : nrows;
 
-  int i;
-  int ok;
-  int* tclusterid;
-  int* mapping = NULL;
-  double** cdata;
-  int** cmask;
-  int* counts;
+  int i, b, nbatch;
+  int ok = 1;
+  int* mapping;
+  double* totals;
+  kworkspace* workspaces;
 
   if (nelements < nclusters)
   { *ifound = 0;
@@ -2467,186 +2637,259 @@ void kcluster (int nclusters, int nrows, int ncolumns,
 
   *ifound = -1;
 
-  /* This will contain the number of elements in each cluster, which is
-   * needed to check for empty clusters. */
-  counts = malloc(nclusters*sizeof(int));
-  if(!counts) return;
-
   /* Find out if the user specified an initial clustering */
-  if (npass<=1) tclusterid = clusterid;
-  else
-  { tclusterid = malloc(nelements*sizeof(int));
-    if (!tclusterid)
-    { free(counts);
-      return;
+  if (npass<=1)
+  { kworkspace w;
+    if (makekworkspace(&w, nclusters, nelements, ndata, transpose, method,
+                       clusterid))
+    { if (npass!=0) randomassign (nclusters, nelements, clusterid);
+      *error = kpass(nclusters, nrows, ncolumns, data, mask, weight,
+                     transpose, method, dist, &w);
+      *ifound = 1;
     }
-    mapping = malloc(nclusters*sizeof(int));
-    if (!mapping)
-    { free(counts);
-      free(tclusterid);
-      return;
-    }
-    for (i = 0; i < nelements; i++) clusterid[i] = 0;
+    freekworkspace(&w, nclusters, ndata, transpose);
+    return;
   }
 
-  /* Allocate space to store the centroid data */
-  if (transpose==0) ok = makedatamask(nclusters, ndata, &cdata, &cmask);
-  else ok = makedatamask(ndata, nclusters, &cdata, &cmask);
-  if(!ok)
-  {
-    if(npass>1)
-    { free(tclusterid);
-      free(counts);
-      free(mapping);
-      return;
-    }
+  /* The passes are run by batches, one pass per thread. The initial
+   * clusterings are drawn, and the solutions compared, in the order of the
+   * passes, so that the result does not depend on the number of threads. */
+  nbatch = kbatchsize(npass);
+  mapping = malloc(nclusters*sizeof(int));
+  totals = malloc(nbatch*sizeof(double));
+  workspaces = calloc(nbatch, sizeof(kworkspace));
+  if (!mapping || !totals || !workspaces)
+  { free(mapping);
+    free(totals);
+    free(workspaces);
+    return;
   }
-  
-  if (method=='m')
-  { double* cache = malloc(nelements*sizeof(double));
-    if(cache)
-    { *ifound = kmedians(nclusters, nrows, ncolumns, data, mask, weight,
-                         transpose, npass, dist, cdata, cmask, clusterid, error,
-                         tclusterid, counts, mapping, cache);
-      free(cache);
+  for (b = 0; b < nbatch; b++)
+    ok = makekworkspace(&workspaces[b], nclusters, nelements, ndata,
+                        transpose, method, NULL) && ok;
+
+  if (ok)
+  { for (i = 0; i < nelements; i++) clusterid[i] = 0;
+    *error = DBL_MAX;
+    *ifound = 1;
+    for (i = 0; i < npass; i += nbatch)
+    { const int n = (npass - i < nbatch) ? npass - i : nbatch;
+      for (b = 0; b < n; b++)
+        randomassign (nclusters, nelements, workspaces[b].tclusterid);
+#ifdef _OPENMP
+      #pragma omp parallel for schedule(dynamic, 1)
+#endif
+      for (b = 0; b < n; b++)
+        totals[b] = kpass(nclusters, nrows, ncolumns, data, mask, weight,
+                          transpose, method, dist, &workspaces[b]);
+      for (b = 0; b < n; b++)
+        kkeep(nclusters, nelements, workspaces[b].tclusterid, totals[b],
+              clusterid, error, ifound, mapping);
     }
   }
-  else
-    *ifound = kmeans(nclusters, nrows, ncolumns, data, mask, weight,
-                     transpose, npass, dist, cdata, cmask, clusterid, error,
-                     tclusterid, counts, mapping);
 
   /* Deallocate temporarily used space */
-  if (npass > 1)
-  { free(mapping);
-    free(tclusterid);
-  }
-
-  if (transpose==0) freedatamask(nclusters, cdata, cmask);
-  else freedatamask(ndata, cdata, cmask);
-
-  free(counts);
+  for (b = 0; b < nbatch; b++)
+    freekworkspace(&workspaces[b], nclusters, ndata, transpose);
+  free(workspaces);
+  free(totals);
+  free(mapping);
 }
 
 /* *********************************************************************** */
 
-void kmedoids (int nclusters, int nelements, double** distmatrix,
-  int npass, int clusterid[], double* error, int* ifound)
-{ int i, j, icluster;
-  int* tclusterid;
+/**
+\internal
+
+The memory used by one pass of k-medoids.
+*/
+typedef struct
+{ int* tclusterid;
   int* saved;
   int* centroids;
   double* errors;
-  int ipass = 0;
+  double* distances;
+  int owntclusterid;
+} kmworkspace;
 
-  if (nelements < nclusters)
-  { *ifound = 0;
-    return;
-  } /* More clusters asked for than elements available */
+/* ---------------------------------------------------------------------- */
 
-  *ifound = -1;
+static void
+freekmworkspace(kmworkspace* w)
+{ if (w->owntclusterid) free(w->tclusterid);
+  free(w->saved);
+  free(w->centroids);
+  free(w->errors);
+  free(w->distances);
+}
 
-  /* We save the clustering solution periodically and check if it reappears */
-  saved = malloc(nelements*sizeof(int));
-  if (saved==NULL) return;
+/* ---------------------------------------------------------------------- */
 
-  centroids = malloc(nclusters*sizeof(int));
-  if(!centroids)
-  { free(saved);
-    return;
-  }
+static int
+makekmworkspace(kmworkspace* w, int nclusters, int nelements, int* tclusterid)
+{ w->owntclusterid = (tclusterid==NULL);
+  w->tclusterid = tclusterid ? tclusterid : malloc(nelements*sizeof(int));
+  w->saved = malloc(nelements*sizeof(int));
+  w->centroids = malloc(nclusters*sizeof(int));
+  w->errors = malloc(nclusters*sizeof(double));
+  w->distances = malloc(nelements*sizeof(double));
+  return w->tclusterid && w->saved && w->centroids && w->errors
+    && w->distances;
+}
 
-  errors = malloc(nclusters*sizeof(double));
-  if(!errors)
-  { free(saved);
-    free(centroids);
-    return;
-  }
+/* ---------------------------------------------------------------------- */
 
-  /* Find out if the user specified an initial clustering */
-  if (npass<=1) tclusterid = clusterid;
-  else
-  { tclusterid = malloc(nelements*sizeof(int));
-    if(!tclusterid)
-    { free(saved);
-      free(centroids);
-      free(errors);
-      return;
+/**
+\internal
+
+One pass of k-medoids, from the initial clustering in w->tclusterid to a local
+optimum, also left in w->tclusterid, with the medoids in w->centroids. Returns
+the within-cluster sum of distances. The elements are assigned in parallel.
+*/
+static double
+kmpass(int nclusters, int nelements, double** distmatrix, kmworkspace* w)
+{ int i;
+  double total = DBL_MAX;
+  int counter = 0;
+  int period = 10;
+
+  while(1)
+  { double previous = total;
+    total = 0.0;
+
+    if (counter % period == 0) /* Save the current cluster assignments */
+    { for (i = 0; i < nelements; i++) w->saved[i] = w->tclusterid[i];
+      if (period < INT_MAX / 2) period *= 2;
     }
-  }
+    counter++;
 
-  *error = DBL_MAX;
-  do /* Start the loop */
-  { double total = DBL_MAX;
-    int counter = 0;
-    int period = 10;
+    /* Find the center */
+    getclustermedoids(nclusters, nelements, distmatrix, w->tclusterid,
+                      w->centroids, w->errors);
 
-    if (npass!=0) randomassign (nclusters, nelements, tclusterid);
-    while(1)
-    { double previous = total;
-      total = 0.0;
-
-      if (counter % period == 0) /* Save the current cluster assignments */
-      { for (i = 0; i < nelements; i++) saved[i] = tclusterid[i];
-        if (period < INT_MAX / 2) period *= 2;
-      }
-      counter++;
-
-      /* Find the center */
-      getclustermedoids(nclusters, nelements, distmatrix, tclusterid,
-                        centroids, errors);
-
-      for (i = 0; i < nelements; i++)
-      /* Find the closest cluster */
-      { double distance = DBL_MAX;
-        for (icluster = 0; icluster < nclusters; icluster++)
-        { double tdistance;
-          j = centroids[icluster];
-          if (i==j)
-          { distance = 0.0;
-            tclusterid[i] = icluster;
-            break;
-          }
-          tdistance = (i > j) ? distmatrix[i][j] : distmatrix[j][i];
-          if (tdistance < distance)
-          { distance = tdistance;
-            tclusterid[i] = icluster;
-          }
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (i = 0; i < nelements; i++)
+    /* Find the closest cluster */
+    { int icluster;
+      double distance = DBL_MAX;
+      for (icluster = 0; icluster < nclusters; icluster++)
+      { double tdistance;
+        const int j = w->centroids[icluster];
+        if (i==j)
+        { distance = 0.0;
+          w->tclusterid[i] = icluster;
+          break;
+        }
+        tdistance = (i > j) ? distmatrix[i][j] : distmatrix[j][i];
+        if (tdistance < distance)
+        { distance = tdistance;
+          w->tclusterid[i] = icluster;
         }
-        total += distance;
       }
-      if (total>=previous) break;
-      /* total>=previous is FALSE on some machines even if total and previous
-       * are bitwise identical. */
-      for (i = 0; i < nelements; i++)
-        if (saved[i]!=tclusterid[i]) break;
-      if (i==nelements)
-        break; /* Identical solution found; break out of this loop */
+      w->distances[i] = distance;
     }
+    /* Summed in order, for the same total on any number of threads */
+    for (i = 0; i < nelements; i++) total += w->distances[i];
 
+    if (total>=previous) break;
+    /* total>=previous is FALSE on some machines even if total and previous
+     * are bitwise identical. */
     for (i = 0; i < nelements; i++)
-    { if (clusterid[i]!=centroids[tclusterid[i]])
-      { if (total < *error)
-        { *ifound = 1;
-          *error = total;
-          /* Replace by the centroid in each cluster. */
-          for (j = 0; j < nelements; j++)
-            clusterid[j] = centroids[tclusterid[j]];
-        }
-        break;
+      if (w->saved[i]!=w->tclusterid[i]) break;
+    if (i==nelements)
+      break; /* Identical solution found; break out of this loop */
+  }
+  return total;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Keep the solution of a k-medoids pass if it is better than the best one
+ * so far, clusterid, and count how many times the best one was found. */
+static void
+kmkeep(int nelements, const kmworkspace* w, double total,
+  int clusterid[], double* error, int* ifound)
+{ int i, j;
+  for (i = 0; i < nelements; i++)
+  { if (clusterid[i]!=w->centroids[w->tclusterid[i]])
+    { if (total < *error)
+      { *ifound = 1;
+        *error = total;
+        /* Replace by the centroid in each cluster. */
+        for (j = 0; j < nelements; j++)
+          clusterid[j] = w->centroids[w->tclusterid[j]];
       }
+      break;
     }
-    if (i==nelements) (*ifound)++; /* break statement not encountered */
-  } while (++ipass < npass);
+  }
+  if (i==nelements) (*ifound)++; /* break statement not encountered */
+}
 
-  /* Deallocate temporarily used space */
-  if (npass > 1) free(tclusterid);
+/* ---------------------------------------------------------------------- */
 
-  free(saved);
-  free(centroids);
-  free(errors);
+void kmedoids (int nclusters, int nelements, double** distmatrix,
+  int npass, int clusterid[], double* error, int* ifound)
+{ int i, b, nbatch;
+  int ok = 1;
+  double* totals;
+  kmworkspace* workspaces;
 
-  return;
+  if (nelements < nclusters)
+  { *ifound = 0;
+    return;
+  } /* More clusters asked for than elements available */
+
+  *ifound = -1;
+
+  /* Find out if the user specified an initial clustering */
+  if (npass<=1)
+  { kmworkspace w;
+    if (makekmworkspace(&w, nclusters, nelements, clusterid))
+    { double total;
+      *error = DBL_MAX;
+      if (npass!=0) randomassign (nclusters, nelements, clusterid);
+      total = kmpass(nclusters, nelements, distmatrix, &w);
+      kmkeep(nelements, &w, total, clusterid, error, ifound);
+    }
+    freekmworkspace(&w);
+    return;
+  }
+
+  /* As in kcluster, the passes are run by batches of one pass per thread,
+   * with the same result as if run one after the other. */
+  nbatch = kbatchsize(npass);
+  totals = malloc(nbatch*sizeof(double));
+  workspaces = calloc(nbatch, sizeof(kmworkspace));
+  if (!totals || !workspaces)
+  { free(totals);
+    free(workspaces);
+    return;
+  }
+  for (b = 0; b < nbatch; b++)
+    ok = makekmworkspace(&workspaces[b], nclusters, nelements, NULL) && ok;
+
+  if (ok)
+  { *error = DBL_MAX;
+    for (i = 0; i < npass; i += nbatch)
+    { const int n = (npass - i < nbatch) ? npass - i : nbatch;
+      for (b = 0; b < n; b++)
+        randomassign (nclusters, nelements, workspaces[b].tclusterid);
+#ifdef _OPENMP
+      #pragma omp parallel for schedule(dynamic, 1)
+#endif
+      for (b = 0; b < n; b++)
+        totals[b] = kmpass(nclusters, nelements, distmatrix, &workspaces[b]);
+      for (b = 0; b < n; b++)
+        kmkeep(nelements, &workspaces[b], totals[b], clusterid, error, ifound);
+    }
+  }
+
+  /* Deallocate temporarily used space */
+  for (b = 0; b < nbatch; b++) freekmworkspace(&workspaces[b]);
+  free(workspaces);
+  free(totals);
 }
 
 /* ******************************************************************** */
@@ -2682,7 +2925,11 @@ double** distancematrix (int nrows, int ncolumns, double** data,
     return NULL;
   }
 
-  /* Calculate the distances and save them in the ragged array */
+  /* Calculate the distances and save them in the ragged array. The rows
+   * grow longer, so they are handed to the threads in small chunks. */
+#ifdef _OPENMP
+  #pragma omp parallel for private(j) schedule(dynamic, 16)
+#endif
   for (i = 1; i < n; i++)
     for (j = 0; j < i; j++)
       matrix[i][j]=metric(ndata,data,data,mask,mask,weights,i,j,transpose);
@@ -2873,7 +3120,7 @@ If a memory error occurs, pclcluster returns NULL.
   { for (i = 0; i < nelements; i++)
     { for (j = 0; j < ndata; j++)
       { newdata[i][j] = data[j][i];
-        newmask[i][j] = mask[j][i];
+        newmask[i][j] = PRESENT(mask,j,i);
       }
     }
     data = newdata;
@@ -2882,7 +3129,8 @@ If a memory error occurs, pclcluster returns NULL.
   else
   { for (i = 0; i < nelements; i++)
     { memcpy(newdata[i], data[i], ndata*sizeof(double));
-      memcpy(newmask[i], mask[i], ndata*sizeof(int));
+      if (mask) memcpy(newmask[i], mask[i], ndata*sizeof(int));
+      else for (j = 0; j < ndata; j++) newmask[i][j] = 1;
     }
     data = newdata;
     mask = newmask;
@@ -2915,14 +3163,20 @@ If a memory error occurs, pclcluster returns NULL.
       distmatrix[i][is] = distmatrix[nnodes-inode][i];
 
     distid[js] = -inode-1;
-    for (i = 0; i < js; i++)
-      distmatrix[js][i] = metric(ndata,data,data,mask,mask,weight,js,i,0);
-    for (i = js + 1; i < nnodes-inode; i++)
-      distmatrix[i][js] = metric(ndata,data,data,mask,mask,weight,js,i,0);
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) if (nnodes-inode > 256)
+#endif
+    for (i = 0; i < nnodes-inode; i++)
+    { if (i < js)
+        distmatrix[js][i] = metric(ndata,data,data,mask,mask,weight,js,i,0);
+      else if (i > js)
+        distmatrix[i][js] = metric(ndata,data,data,mask,mask,weight,js,i,0);
+    }
   }
 
-  /* Free temporarily allocated space */
-  freedatamask(nelements, data, mask);
+  /* Free temporarily allocated space. Each merge freed a row and moved the
+   * last one in its place, so only row 0 is left; the others are stale. */
+  freedatamask(1, data, mask);
   free(distid);
  
   return result;
@@ -2944,6 +3198,63 @@ int nodecompare(const void* a, const void* b)
 
 /* ---------------------------------------------------------------------- */
 
+static
+void slinkrow (int i, double temp[], Node result[], int vector[])
+/*
+One step of SLINK: adds element i to the pointer representation, held in
+result[].distance and vector[], of the single-linkage tree of elements 0..i-1,
+given the distances temp[j] from element i to those. temp is overwritten.
+*/
+{ int j, k;
+  result[i].distance = DBL_MAX;
+  for (j = 0; j < i; j++)
+  { k = vector[j];
+    if (result[j].distance >= temp[j])
+    { if (result[j].distance < temp[k]) temp[k] = result[j].distance;
+      result[j].distance = temp[j];
+      vector[j] = i;
+    }
+    else if (temp[j] < temp[k]) temp[k] = temp[j];
+  }
+  for (j = 0; j < i; j++)
+    if (result[j].distance >= result[vector[j]].distance) vector[j] = i;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static
+Node* slinktree (int nelements, Node* result, int vector[], int index[])
+/*
+Turns the pointer representation built by slinkrow into the nelements-1 nodes
+of the tree, in result. Frees vector and index, and result on failure.
+*/
+{ int i, j, k;
+  const int nnodes = nelements - 1;
+  Node* result_realloc;
+
+  for (i = 0; i < nnodes; i++) result[i].left = i;
+  qsort(result, nnodes, sizeof(Node), nodecompare);
+
+  for (i = 0; i < nelements; i++) index[i] = i;
+  for (i = 0; i < nnodes; i++)
+  { j = result[i].left;
+    k = vector[j];
+    result[i].left = index[j];
+    result[i].right = index[k];
+    index[k] = -i-1;
+  }
+  free(vector);
+  free(index);
+
+  result_realloc = realloc(result, nnodes*sizeof(Node));
+  if (result_realloc == NULL)
+    free(result);
+
+  return result_realloc;
+}
+
+/* ---------------------------------------------------------------------- */
+
 static
 Node* pslcluster (int nrows, int ncolumns, double** data, int** mask,
   double weight[], double** distmatrix, char dist, int transpose)
@@ -3029,14 +3340,13 @@ If a memory error occurs, pslcluster returns NULL.
 
 
 */
-{ int i, j, k;
+{ int i, j;
   const int nelements = transpose ? ncolumns : nrows;
   const int nnodes = nelements - 1;
   int* vector;
   double* temp;
   int* index;
   Node* result;
-  Node* result_realloc;
 
   temp = malloc(nnodes*sizeof(double));
   if(!temp) return NULL;
@@ -3062,22 +3372,9 @@ If a memory error occurs, pslcluster returns NULL.
   for (i = 0; i < nnodes; i++) vector[i] = i;
 
   if(distmatrix)
-  { for (i = 0; i < nrows; i++)
-    { result[i].distance = DBL_MAX;
-      for (j = 0; j < i; j++) temp[j] = distmatrix[i][j];
-      for (j = 0; j < i; j++)
-      { k = vector[j];
-        if (result[j].distance >= temp[j])
-        { if (result[j].distance < temp[k]) temp[k] = result[j].distance;
-          result[j].distance = temp[j];
-          vector[j] = i;
-        }
-        else if (temp[j] < temp[k]) temp[k] = temp[j];
-      }
-      for (j = 0; j < i; j++)
-      {
-        if (result[j].distance >= result[vector[j]].distance) vector[j] = i;
-      }
+  { for (i = 0; i < nelements; i++)
+    { for (j = 0; j < i; j++) temp[j] = distmatrix[i][j];
+      slinkrow(i, temp, result, vector);
     }
   }
   else
@@ -3088,43 +3385,18 @@ If a memory error occurs, pslcluster returns NULL.
          setmetric(dist);
 
     for (i = 0; i < nelements; i++)
-    { result[i].distance = DBL_MAX;
+    {
+#ifdef _OPENMP
+      #pragma omp parallel for schedule(static) if (i > 256)
+#endif
       for (j = 0; j < i; j++) temp[j] =
         metric(ndata, data, data, mask, mask, weight, i, j, transpose);
-      for (j = 0; j < i; j++)
-      { k = vector[j];
-        if (result[j].distance >= temp[j])
-        { if (result[j].distance < temp[k]) temp[k] = result[j].distance;
-          result[j].distance = temp[j];
-          vector[j] = i;
-        }
-        else if (temp[j] < temp[k]) temp[k] = temp[j];
-      }
-      for (j = 0; j < i; j++)
-        if (result[j].distance >= result[vector[j]].distance) vector[j] = i;
+      slinkrow(i, temp, result, vector);
     }
   }
   free(temp);
 
-  for (i = 0; i < nnodes; i++) result[i].left = i;
-  qsort(result, nnodes, sizeof(Node), nodecompare);
-
-  for (i = 0; i < nelements; i++) index[i] = i;
-  for (i = 0; i < nnodes; i++)
-  { j = result[i].left;
-    k = vector[j];
-    result[i].left = index[j];
-    result[i].right = index[k];
-    index[k] = -i-1;
-  }
-  free(vector);
-  free(index);
-
-  result_realloc = realloc(result, nnodes*sizeof(Node));
-  if (result_realloc == NULL)
-    free(result);
-
-  return result_realloc;
+  return slinktree(nelements, result, vector, index);
 }
 /* ******************************************************************** */
 
@@ -3356,6 +3628,429 @@ Node* treecluster (int nrows, int ncolumns, double** data, int** mask,
   return result;
 }
 
+/* ---------------------------------------------------------------------- */
+
+double** distancematrix_rowmajor (int nrows, int ncolumns, const double* data,
+  const int* mask, int stride, double weight[], char dist, int transpose)
+{ double** rows;
+  int** mrows;
+  double** result;
+  if (!rowpointers(nrows, data, mask, stride, &rows, &mrows)) return NULL;
+  result = distancematrix(nrows, ncolumns, rows, mrows, weight, dist,
+                          transpose);
+  free(rows);
+  free(mrows);
+  return result;
+}
+
+/* ---------------------------------------------------------------------- */
+
+double** distancematrix_rowmajor_float (int nrows, int ncolumns,
+  const float* data, const int* mask, int stride, double weight[], char dist,
+  int transpose)
+/* The metrics compute in double precision: the values are converted once,
+ * in O(nrows*ncolumns), against O(nrows*nrows*ncolumns) for the matrix. */
+{ int i, j;
+  double** result;
+  double* values = malloc((size_t)nrows*ncolumns*sizeof(double));
+  int* mvalues = NULL;
+  if (!values) return NULL;
+  if (mask)
+  { mvalues = malloc((size_t)nrows*ncolumns*sizeof(int));
+    if (!mvalues)
+    { free(values);
+      return NULL;
+    }
+  }
+  for (i = 0; i < nrows; i++)
+    for (j = 0; j < ncolumns; j++)
+    { values[(size_t)i*ncolumns+j] = data[(size_t)i*stride+j];
+      if (mask) mvalues[(size_t)i*ncolumns+j] = mask[(size_t)i*stride+j];
+    }
+  result = distancematrix_rowmajor(nrows, ncolumns, values, mvalues, ncolumns,
+                                   weight, dist, transpose);
+  free(values);
+  free(mvalues);
+  return result;
+}
+
+/* ---------------------------------------------------------------------- */
+
+void kcluster_rowmajor (int nclusters, int nrows, int ncolumns,
+  const double* data, const int* mask, int stride, double weight[],
+  int transpose, int npass, char method, char dist,
+  int clusterid[], double* error, int* ifound)
+{ double** rows;
+  int** mrows;
+  if (!rowpointers(nrows, data, mask, stride, &rows, &mrows))
+  { *ifound = -1;
+    return;
+  }
+  kcluster(nclusters, nrows, ncolumns, rows, mrows, weight, transpose, npass,
+           method, dist, clusterid, error, ifound);
+  free(rows);
+  free(mrows);
+}
+
+/* ---------------------------------------------------------------------- */
+
+Node* treecluster_rowmajor (int nrows, int ncolumns, const double* data,
+  const int* mask, int stride, double weight[], int transpose, char dist,
+  char method, double** distmatrix)
+{ double** rows;
+  int** mrows;
+  Node* result;
+  if (!rowpointers(nrows, data, mask, stride, &rows, &mrows)) return NULL;
+  result = treecluster(nrows, ncolumns, rows, mrows, weight, transpose, dist,
+                       method, distmatrix);
+  free(rows);
+  free(mrows);
+  return result;
+}
+
+/* Row i of a condensed matrix, holding the distances d(i,j) for j < i */
+#define CONDENSEDROW(distances, i) ((distances) + (size_t)(i)*((i)-1)/2)
+
+static
+float* condensedalloc (int nelements, const char* filename)
+/* Space for a condensed matrix; on the heap, or mapped from a new file. */
+{ const size_t size = (size_t)nelements*(nelements-1)/2*sizeof(float);
+  if (!filename) return malloc(size);
+#ifdef WINDOWS
+  return NULL;
+#else
+  { void* p;
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, (off_t)size) != 0)
+    { close(fd);
+      return NULL;
+    }
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return p == MAP_FAILED ? NULL : p;
+  }
+#endif
+}
+
+/* ---------------------------------------------------------------------- */
+
+float* distancematrix_condensed (int nrows, int ncolumns, double** data,
+  int** mask, double weights[], char dist, int transpose,
+  const char* filename)
+{ const int n = (transpose==0) ? nrows : ncolumns;
+  const int ndata = (transpose==0) ? ncolumns : nrows;
+  int i;
+  float* distances;
+
+  /* Set the metric function as indicated by dist */
+  double (*metric)
+    (int, double**, double**, int**, int**, const double[], int, int, int) =
+       setmetric(dist);
+
+  if (n < 2) return NULL;
+  distances = condensedalloc(n, filename);
+  if (!distances) return NULL;
+
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic, 16)
+#endif
+  for (i = 1; i < n; i++)
+  { float* row = CONDENSEDROW(distances, i);
+    int j;
+    for (j = 0; j < i; j++)
+      row[j] = (float)
+        metric(ndata,data,data,mask,mask,weights,i,j,transpose);
+  }
+  return distances;
+}
+
+/* ---------------------------------------------------------------------- */
+
+void freedistancematrix_condensed (float* distances, int nelements,
+  int mapped)
+{ if (!distances) return;
+#ifndef WINDOWS
+  if (mapped)
+  { munmap(distances, (size_t)nelements*(nelements-1)/2*sizeof(float));
+    return;
+  }
+#endif
+  free(distances);
+}
+
+/* ---------------------------------------------------------------------- */
+
+static
+double find_closest_pair_condensed(int n, float** rows, int* ip, int* jp)
+/* Same as find_closest_pair, on the rows of a condensed matrix. */
+{ double distance = rows[1][0];
+  *ip = 1;
+  *jp = 0;
+#ifdef _OPENMP
+  #pragma omp parallel if (n > 256)
+#endif
+  { int i, j;
+    float tdistance = rows[1][0];
+    int tip = 1;
+    int tjp = 0;
+#ifdef _OPENMP
+    #pragma omp for schedule(dynamic, 16) nowait
+#endif
+    for (i = 1; i < n; i++)
+    { const float* row = rows[i];
+      for (j = 0; j < i; j++)
+        if (row[j]<tdistance)
+        { tdistance = row[j];
+          tip = i;
+          tjp = j;
+        }
+    }
+#ifdef _OPENMP
+    #pragma omp critical (find_closest_pair)
+#endif
+    { if (tdistance<distance
+          || (tdistance==distance
+              && (tip<*ip || (tip==*ip && tjp<*jp))))
+      { distance = tdistance;
+        *ip = tip;
+        *jp = tjp;
+      }
+    }
+  }
+  return distance;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static float
+linkage(char method, float djs, float dis, int njs, int nis)
+/* Distance to the merge of clusters js and is, from those to each of them */
+{ if (method=='m') return max(djs, dis);
+  return (float)(((double)dis*nis + (double)djs*njs) / (nis+njs));
+}
+
+/* ---------------------------------------------------------------------- */
+
+static
+Node* pairwisecondensed (int nelements, float** rows, char method)
+/*
+Pairwise maximum- (method=='m') or average-linkage (method=='a') clustering,
+as pmlcluster and palcluster do, on the rows of a condensed matrix, which is
+modified. Returns NULL if memory cannot be allocated.
+*/
+{ int j;
+  int n;
+  int* clusterid = malloc(nelements*sizeof(int));
+  int* number = malloc(nelements*sizeof(int));
+  Node* result = malloc((nelements-1)*sizeof(Node));
+  if (!clusterid || !number || !result)
+  { free(clusterid);
+    free(number);
+    free(result);
+    return NULL;
+  }
+
+  for (j = 0; j < nelements; j++)
+  { number[j] = 1;
+    clusterid[j] = j;
+  }
+
+  for (n = nelements; n > 1; n--)
+  { int is = 1;
+    int js = 0;
+    int nis, njs;
+    result[nelements-n].distance =
+      find_closest_pair_condensed(n, rows, &is, &js);
+    result[nelements-n].left = clusterid[is];
+    result[nelements-n].right = clusterid[js];
+
+    /* Fix the distances */
+    nis = number[is];
+    njs = number[js];
+    for (j = 0; j < js; j++)
+      rows[js][j] = linkage(method, rows[js][j], rows[is][j], njs, nis);
+    for (j = js+1; j < is; j++)
+      rows[j][js] = linkage(method, rows[j][js], rows[is][j], njs, nis);
+    for (j = is+1; j < n; j++)
+      rows[j][js] = linkage(method, rows[j][js], rows[j][is], njs, nis);
+
+    for (j = 0; j < is; j++) rows[is][j] = rows[n-1][j];
+    for (j = is+1; j < n-1; j++) rows[j][is] = rows[n-1][j];
+
+    number[js] = nis + njs;
+    number[is] = number[n-1];
+    clusterid[js] = n-nelements-1;
+    clusterid[is] = clusterid[n-1];
+  }
+  free(clusterid);
+  free(number);
+
+  return result;
+}
+
+/* ---------------------------------------------------------------------- */
+
+Node* treecluster_condensed (int nelements, float* distances, char method)
+{ int i, j;
+  Node* result;
+
+  if (nelements < 2) return NULL;
+
+  if (method=='s')
+  { /* SLINK, reading the matrix one row at a time */
+    double* temp = malloc((nelements-1)*sizeof(double));
+    int* vector = malloc((nelements-1)*sizeof(int));
+    int* index = malloc(nelements*sizeof(int));
+    result = malloc(nelements*sizeof(Node));
+    if (!temp || !vector || !index || !result)
+    { free(temp);
+      free(vector);
+      free(index);
+      free(result);
+      return NULL;
+    }
+    for (i = 0; i < nelements-1; i++) vector[i] = i;
+    for (i = 0; i < nelements; i++)
+    { const float* row = CONDENSEDROW(distances, i);
+      for (j = 0; j < i; j++) temp[j] = row[j];
+      slinkrow(i, temp, result, vector);
+    }
+    free(temp);
+    return slinktree(nelements, result, vector, index);
+  }
+
+  if (method=='m' || method=='a')
+  { float** rows = malloc(nelements*sizeof(float*));
+    if (!rows) return NULL;
+    for (i = 0; i < nelements; i++) rows[i] = CONDENSEDROW(distances, i);
+    result = pairwisecondensed(nelements, rows, method);
+    free(rows);
+    return result;
+  }
+
+  return NULL;
+}
+
+/* ******************************************************************* */
+
+int kcluster_minibatch (int nclusters, int nrows, int ncolumns,
+  double** data, int** mask, double weight[], int batchsize, int niter,
+  char dist, int clusterid[], double** cdata, double* error)
+{ int i, j, k, iter;
+  int* batch;
+  int* bclusterid;
+  int** cmask = NULL;
+  int* ccount;
+  double total;
+
+  /* Set the metric function as indicated by dist */
+  double (*metric)
+    (int, double**, double**, int**, int**, const double[], int, int, int) =
+       setmetric(dist);
+
+  if (nclusters < 1 || nclusters > nrows || batchsize < 1) return 0;
+
+  /* The batch array holds the initial centers first */
+  batch = malloc(max(batchsize, nclusters)*sizeof(int));
+  bclusterid = malloc(batchsize*sizeof(int));
+  ccount = malloc((size_t)nclusters*ncolumns*sizeof(int));
+  if (mask)
+  { cmask = malloc(nclusters*sizeof(int*));
+    if (cmask)
+      for (k = 0; k < nclusters; k++) cmask[k] = ccount + (size_t)k*ncolumns;
+  }
+  if (!batch || !bclusterid || !ccount || (mask && !cmask))
+  { free(batch);
+    free(bclusterid);
+    free(ccount);
+    free(cmask);
+    return 0;
+  }
+
+  /* The centers start at nclusters distinct rows, drawn at random (Floyd's
+   * algorithm), found in the batch array for the duration. */
+  for (i = nrows - nclusters, k = 0; i < nrows; i++, k++)
+  { int t = (int)((i+1)*uniform());
+    if (t > i) t = i;
+    for (j = 0; j < k; j++) if (batch[j] == t) break;
+    batch[k] = (j < k) ? i : t;
+  }
+  for (k = 0; k < nclusters; k++)
+    for (j = 0; j < ncolumns; j++)
+    { const int present = PRESENT(mask, batch[k], j);
+      cdata[k][j] = present ? data[batch[k]][j] : 0.0;
+      ccount[(size_t)k*ncolumns+j] = present;
+    }
+
+  for (iter = 0; iter < niter; iter++)
+  { for (i = 0; i < batchsize; i++)
+    { batch[i] = (int)(nrows*uniform());
+      if (batch[i] >= nrows) batch[i] = nrows - 1;
+    }
+
+    /* Assign the batch to the nearest centers. A center coordinate is
+     * missing until some row had a value there; cmask, sharing the counts,
+     * tells exactly that. */
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (i = 0; i < batchsize; i++)
+    { int kk;
+      double best = DBL_MAX;
+      bclusterid[i] = 0;
+      for (kk = 0; kk < nclusters; kk++)
+      { double d =
+          metric(ncolumns,data,cdata,mask,cmask,weight,batch[i],kk,0);
+        if (d < best)
+        { best = d;
+          bclusterid[i] = kk;
+        }
+      }
+    }
+
+    /* Move each center toward its rows, by a step of one over the number of
+     * rows it has seen so far, so that it stays their running mean. */
+    for (i = 0; i < batchsize; i++)
+    { const int row = batch[i];
+      int* count = ccount + (size_t)bclusterid[i]*ncolumns;
+      double* center = cdata[bclusterid[i]];
+      for (j = 0; j < ncolumns; j++)
+        if (PRESENT(mask, row, j))
+        { count[j]++;
+          center[j] += (data[row][j] - center[j]) / count[j];
+        }
+    }
+  }
+
+  /* Assign all rows, in one pass */
+  total = 0.0;
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(static) reduction(+:total)
+#endif
+  for (i = 0; i < nrows; i++)
+  { int kk;
+    double best = DBL_MAX;
+    int id = 0;
+    for (kk = 0; kk < nclusters; kk++)
+    { double d = metric(ncolumns,data,cdata,mask,cmask,weight,i,kk,0);
+      if (d < best)
+      { best = d;
+        id = kk;
+      }
+    }
+    if (clusterid) clusterid[i] = id;
+    total += best;
+  }
+  if (error) *error = total;
+
+  free(batch);
+  free(bclusterid);
+  free(ccount);
+  free(cmask);
+  return 1;
+}
+
 /* ******************************************************************* */
 
 static
@@ -150,6 +150,7 @@ The array containing the gene expression data.
 \param mask       (input) int[nrows][ncolumns]
 This array shows which data values are missing. If mask[i][j]==0, then
 data[i][j] is missing.
+If mask is NULL, no value is missing, and the distances skip the checks.
 
 \param weight (input) double[n]
 The weights that are used to calculate the distance. The length of this vector
@@ -285,6 +286,7 @@ expression data).
 \param mask       (input) int[nrows][ncolumns]
 This array shows which data values are missing. If
 mask[i][j] == 0, then data[i][j] is missing.
+If mask is NULL, no value is missing, and the distances skip the checks.
 
 \param nrows     (input) int
 The number of rows in the data matrix, equal to the number of genes.
@@ -306,6 +308,8 @@ genes to clusters. The clustering solution with the lowest within-cluster sum
 of distances is chosen.
 If npass==0, then the clustering algorithm will be run once, where the initial
 assignment of elements to clusters is taken from the clusterid array.
+With OpenMP, the passes run in parallel, one per thread; the result is the
+same as if they ran one after the other.
 
 \param method     (input) char
 Defines whether the arithmetic mean (method=='a') or the median
@@ -370,6 +374,8 @@ to clusters. The clustering solution with the lowest within-cluster sum of
 distances is chosen.
 If npass==0, then the clustering algorithm will be run once, where the initial
 assignment of elements to clusters is taken from the clusterid array.
+With OpenMP, the passes run in parallel, one per thread; the result is the
+same as if they ran one after the other.
 
 \param clusterid  (output; input) int[nelements]
 On input, if npass==0, then clusterid contains the initial clustering assignment
@@ -427,6 +433,7 @@ The array containing the data of the vectors to be clustered.
 \param mask       (input) int[nrows][ncolumns]
 This array shows which data values are missing. If mask[i][j]==0, then
 data[i][j] is missing.
+If mask is NULL, no value is missing, and the distances skip the checks.
 
 \param weight (input) double array[n]
 The weights that are used to calculate the distance.
@@ -504,6 +511,124 @@ error occured, all elements in clusterid are set to -1.
 */
 void cuttree (int nelements, Node* tree, int nclusters, int clusterid[]);
 
+/* Row-major entry points.
+The same routines, on a matrix in one contiguous row-major buffer: row i of
+data, and of mask if not NULL, starts at offset i*stride (stride >= ncolumns).
+The rows are used in place, without copying. A NULL mask means that no value
+is missing; with no missing value, the inner loops of the Euclidean,
+city-block and correlation distances between rows vectorize.
+If memory cannot be allocated they fail as the routines above do.
+*/
+double** distancematrix_rowmajor (int nrows, int ncolumns, const double* data,
+  const int* mask, int stride, double weight[], char dist, int transpose);
+
+/** The distances are computed in double precision, the floats being
+converted once, in O(nrows*ncolumns). */
+double** distancematrix_rowmajor_float (int nrows, int ncolumns,
+  const float* data, const int* mask, int stride, double weight[], char dist,
+  int transpose);
+
+void kcluster_rowmajor (int nclusters, int nrows, int ncolumns,
+  const double* data, const int* mask, int stride, double weight[],
+  int transpose, int npass, char method, char dist,
+  int clusterid[], double* error, int* ifound);
+
+Node* treecluster_rowmajor (int nrows, int ncolumns, const double* data,
+  const int* mask, int stride, double weight[], int transpose, char dist,
+  char method, double** distmatrix);
+
+/**
+The distancematrix_condensed routine calculates the same distances as
+distancematrix, in single precision, in a condensed matrix: one block of
+nelements*(nelements-1)/2 floats, holding the lower triangle row after row, so
+that the distance between elements i and j, j < i, is at offset
+i*(i-1)/2 + j. That takes a quarter of the memory of the ragged array, and no
+allocation per row. nelements is nrows if transpose==0, ncolumns otherwise.
+
+The arguments are those of distancematrix, plus:
+
+\param filename   (input) const char*
+If NULL, the matrix is allocated on the heap. Otherwise the file is created
+(or truncated) and the matrix is mapped from it, so that the operating system
+may page it out: the matrix can then be larger than the memory. The file is
+left in place when the matrix is freed.
+
+The routine returns NULL if nelements < 2, or if the matrix could not be
+allocated or mapped. It must be freed with freedistancematrix_condensed.
+*/
+float* distancematrix_condensed (int nrows, int ncolumns, double** data,
+  int** mask, double weights[], char dist, int transpose,
+  const char* filename);
+
+/**
+Frees a matrix returned by distancematrix_condensed; mapped tells whether it
+was given a filename.
+*/
+void freedistancematrix_condensed (float* distances, int nelements,
+  int mapped);
+
+/**
+The treecluster_condensed routine performs hierarchical clustering, as
+treecluster does, from a condensed distance matrix.
+
+\param nelements  (input) int
+The number of elements clustered.
+
+\param distances  (input) float[nelements*(nelements-1)/2]
+The condensed distance matrix, as returned by distancematrix_condensed. It is
+only read for single linkage, and used as work space, hence modified, for the
+others.
+
+\param method     (input) char
+method=='s': pairwise single-linkage clustering
+method=='m': pairwise maximum- (or complete-) linkage clustering
+method=='a': pairwise average-linkage clustering
+Centroid linkage (method=='c') needs the data, so is not supported here.
+
+The routine returns the nelements-1 nodes of the tree, or NULL if memory
+cannot be allocated or the method is not supported. For single linkage, note
+that treecluster with distmatrix==NULL needs no distance matrix at all.
+*/
+Node* treecluster_condensed (int nelements, float* distances, char method);
+
+/**
+The kcluster_minibatch routine performs k-means clustering of the rows of the
+data by mini-batches (Sculley, D. (2010). Web-scale k-means clustering.
+WWW '10: 1177-1178). Each iteration draws batchsize rows at random, assigns
+them to their nearest centers, then moves each center toward its rows by a
+step of one over the number of rows it has seen so far. Beyond clusterid, the
+memory used is that of the centers and of one batch, whatever the number of
+rows; no distance matrix is built. The centers start at nclusters distinct
+rows drawn at random.
+
+\param nclusters  (input) int
+The number of clusters.
+
+\param nrows, ncolumns, data, mask, weight, dist
+As for kcluster, with transpose==0. mask may be NULL.
+
+\param batchsize  (input) int
+The number of rows drawn per iteration.
+
+\param niter      (input) int
+The number of iterations.
+
+\param clusterid  (output) int[nrows]
+The cluster of each row after the last iteration, if not NULL.
+
+\param cdata      (output) double[nclusters][ncolumns]
+The centers. Array space should be allocated before the call.
+
+\param error      (output) double*
+The sum of the distances of the rows to their centers, if not NULL.
+
+The routine returns 1, or 0 if nclusters is not in [1, nrows], if batchsize is
+less than 1 or if memory cannot be allocated.
+*/
+int kcluster_minibatch (int nclusters, int nrows, int ncolumns,
+  double** data, int** mask, double weight[], int batchsize, int niter,
+  char dist, int clusterid[], double** cdata, double* error);
+
 /* Chapter 5 */
 /**
 The somcluster routine implements a self-organizing map (Kohonen) on a
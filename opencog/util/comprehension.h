@@ -24,6 +24,9 @@
 #ifndef _OPENCOG_COMPREHENSION_H
 #define _OPENCOG_COMPREHENSION_H
 
+#include <iterator>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <list>
 #include <set>
@@ -32,6 +35,7 @@
 #include <boost/range/adaptor/filtered.hpp>
 
 #include <opencog/util/functional.h>
+#include <opencog/util/thread_pool.h>
 
 namespace opencog {
 /** \addtogroup grp_cogutil
@@ -142,9 +146,250 @@ auto set_comp(const Container& c, const Function& func,
     return v;
 }
 
-}
+///@}
+
+/** @name Lazy comprehensions
+ * The comprehensions above build a whole container at each call, so
+ * that chaining them builds one per step. A comp_view instead only
+ * records the steps, and runs them all at once, in a single pass over
+ * the input, when the result is collected:
+ *
+ * auto res = (comp_view(container)
+ *             | comp_map(function)
+ *             | comp_filter(filter)
+ *             | comp_map(other_function)).to_vector();
+ *
+ * Each element goes through all the steps before the next is looked
+ * at, and nothing is stored in between. The steps are composed at
+ * compile time, so the loop is as fast as if written by hand. When no
+ * step filters, the size of the result is known, and it is allocated
+ * once. The container must outlive the view.
+ *
+ * parallel_collect() does the same over the shared thread_pool(), for
+ * large inputs with random access.
+ */
+///@{
+
+namespace detail {
+
+// The steps of a comp_view: push(x, sink) passes x through them, and
+// the result on to sink, unless filtered out. Sinks return false to
+// stop the pass, and so does push(). output<T> is the type of the
+// result for an input of type T. exact is true if every input gives
+// one result.
+struct comp_identity
+{
+    static constexpr bool exact = true;
+    template<typename T> using output = T;
+
+    template<typename T, typename Sink>
+    bool push(T&& x, Sink& sink) const
+    { return sink(std::forward<T>(x)); }
+};
+
+template<typename Prev, typename F>
+struct comp_mapped
+{
+    Prev prev;
+    F f;
+
+    static constexpr bool exact = Prev::exact;
+    template<typename T> using output =
+        decltype(std::declval<const F&>()(
+                     std::declval<typename Prev::template output<T>>()));
+
+    template<typename T, typename Sink>
+    bool push(T&& x, Sink& sink) const
+    {
+        auto next = [this, &sink](auto&& y)
+            { return sink(f(std::forward<decltype(y)>(y))); };
+        return prev.push(std::forward<T>(x), next);
+    }
+};
+
+template<typename Prev, typename P>
+struct comp_filtered
+{
+    Prev prev;
+    P pred;
+
+    static constexpr bool exact = false;
+    template<typename T> using output = typename Prev::template output<T>;
+
+    template<typename T, typename Sink>
+    bool push(T&& x, Sink& sink) const
+    {
+        auto next = [this, &sink](auto&& y)
+            { return pred(y) ? sink(std::forward<decltype(y)>(y)) : true; };
+        return prev.push(std::forward<T>(x), next);
+    }
+};
+
+template<typename F> struct comp_map_step { F f; };
+template<typename P> struct comp_filter_step { P pred; };
+
+template<typename C, typename T>
+auto comp_insert(C& c, T&& x, int) -> decltype(c.push_back(std::forward<T>(x)))
+{ return c.push_back(std::forward<T>(x)); }
+
+template<typename C, typename T>
+void comp_insert(C& c, T&& x, long)
+{ c.insert(c.end(), std::forward<T>(x)); }
+
+template<typename C>
+auto comp_reserve(C& c, size_t n, int) -> decltype(c.reserve(n))
+{ return c.reserve(n); }
+
+template<typename C>
+void comp_reserve(C&, size_t, long) {}
+
+} // namespace detail
+
+//! Step of a comp_view: replace each element x by f(x)
+template<typename F>
+detail::comp_map_step<F> comp_map(F f) { return {f}; }
+
+//! Step of a comp_view: keep only the elements x such that pred(x)
+template<typename P>
+detail::comp_filter_step<P> comp_filter(P pred) { return {pred}; }
+
+//! A lazy comprehension: a range of the input, and the steps that
+//! its elements go through. See above.
+template<typename It, typename Steps = detail::comp_identity>
+class comp_view
+{
+public:
+    typedef typename std::decay<typename Steps::template output<
+        decltype(*std::declval<It>())>>::type value_type;
+
+    comp_view(It begin, It end, Steps steps = Steps())
+        : _begin(begin), _end(end), _steps(steps) {}
+
+    template<typename Container>
+    comp_view(const Container& c) : _begin(c.begin()), _end(c.end()) {}
+
+    template<typename F>
+    comp_view<It, detail::comp_mapped<Steps, F>>
+    operator|(detail::comp_map_step<F> m) const
+    {
+        return {_begin, _end, detail::comp_mapped<Steps, F>{_steps, m.f}};
+    }
+
+    template<typename P>
+    comp_view<It, detail::comp_filtered<Steps, P>>
+    operator|(detail::comp_filter_step<P> flt) const
+    {
+        return {_begin, _end,
+                detail::comp_filtered<Steps, P>{_steps, flt.pred}};
+    }
+
+    //! Call f on each result, in order
+    template<typename F>
+    void for_each(F f) const
+    {
+        auto sink = [&f](auto&& y)
+            { f(std::forward<decltype(y)>(y)); return true; };
+        run(_begin, _end, sink);
+    }
+
+    //! The results, in a container of the given type; it should have
+    //! push_back(), like std::vector and std::list, or insert(), like
+    //! std::set.
+    template<typename Container>
+    Container collect() const
+    {
+        Container res;
+        if (Steps::exact)
+            detail::comp_reserve(res, std::distance(_begin, _end), 0);
+        auto sink = [&res](auto&& y)
+            { detail::comp_insert(res, std::forward<decltype(y)>(y), 0);
+              return true; };
+        run(_begin, _end, sink);
+        return res;
+    }
+
+    std::vector<value_type> to_vector() const
+    { return collect<std::vector<value_type>>(); }
+    std::list<value_type> to_list() const
+    { return collect<std::list<value_type>>(); }
+    std::set<value_type> to_set() const
+    { return collect<std::set<value_type>>(); }
+
+    //! The number of results
+    size_t count() const
+    {
+        size_t n = 0;
+        auto sink = [&n](auto&&) { n++; return true; };
+        run(_begin, _end, sink);
+        return n;
+    }
+
+    //! Same as to_vector(), in parallel, over the shared thread_pool(),
+    //! in chunks of grain elements of the input; the functions of the
+    //! steps must then be safe to call from many threads at once. The
+    //! order of the results is kept. Without filters, each result
+    //! goes straight to its place in the vector; otherwise, each chunk
+    //! collects its own, and they are joined at the end.
+    std::vector<value_type> parallel_collect(size_t grain = 4096) const
+    {
+        static_assert(std::is_base_of<std::random_access_iterator_tag,
+                      typename std::iterator_traits<It>::iterator_category>
+                      ::value, "parallel_collect needs random access");
+        size_t n = _end - _begin;
+        grain = std::max<size_t>(grain, 1);
+
+        if constexpr (Steps::exact and
+                      std::is_default_constructible<value_type>::value)
+        {
+            std::vector<value_type> res(n);
+            parallel_for(0, n, grain, [&](size_t i) {
+                auto sink = [&res, i](auto&& y)
+                    { res[i] = std::forward<decltype(y)>(y); return true; };
+                _steps.push(_begin[i], sink);
+            });
+            return res;
+        }
+        else
+        {
+            size_t nchunks = (n + grain - 1) / grain;
+            std::vector<std::vector<value_type>> parts(nchunks);
+            parallel_for(0, nchunks, 1, [&](size_t c) {
+                std::vector<value_type>& part = parts[c];
+                auto sink = [&part](auto&& y)
+                    { part.push_back(std::forward<decltype(y)>(y));
+                      return true; };
+                It lo = _begin + c * grain;
+                run(lo, lo + std::min(grain, n - c * grain), sink);
+            });
+            size_t total = 0;
+            for (const auto& part : parts) total += part.size();
+            std::vector<value_type> res;
+            res.reserve(total);
+            for (auto& part : parts)
+                std::move(part.begin(), part.end(), std::back_inserter(res));
+            return res;
+        }
+    }
+
+private:
+    It _begin, _end;
+    Steps _steps;
+
+    template<typename Sink>
+    void run(It b, It e, Sink& sink) const
+    {
+        for (; b != e; ++b)
+            if (not _steps.push(*b, sink)) return;
+    }
+};
+
+template<typename Container>
+comp_view(const Container&) -> comp_view<typename Container::const_iterator>;
 
 ///@}
+
+}
+
 /** @}*/
 
 #endif // _OPENCOG_COMPREHENSION_H
@@ -0,0 +1,365 @@
+/*
+ * opencog/util/concurrent_bounded_queue.h
+ *
+ * A lock-free, bounded, multi-producer, multi-consumer queue.
+ * Same API as concurrent_queue.h, plus batch push and pop.
+ *
+ * The ring buffer follows Dmitry Vyukov's bounded MPMC queue:
+ * http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OC_CONCURRENT_BOUNDED_QUEUE_H
+#define _OC_CONCURRENT_BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! A bounded thread-safe first in-first out list, without locks.
+///
+/// This behaves like concurrent_queue: any thread can push, any thread
+/// can pop, popping from an empty queue blocks, and cancel() wakes up
+/// everyone that is waiting. The differences are:
+///
+/// 1) The queue holds at most capacity() elements. Pushing onto a full
+///    queue blocks until there is room; try_push() does not block.
+/// 2) Push and pop never take a lock. Each slot of the ring carries a
+///    sequence number, which says whether it is ready to be written
+///    or read; threads claim slots with a compare-and-swap.
+/// 3) try_push_n() and try_pop_n() claim a whole run of slots with a
+///    single compare-and-swap.
+/// 4) Threads that have to wait spin briefly, then yield, and only then
+///    sleep in the kernel. Pushers and poppers only make a system call
+///    to wake someone up if someone is actually asleep.
+///
+/// There is no wait_and_take_all(); use pop_batch() instead.
+
+template<typename Element>
+class concurrent_bounded_queue
+{
+private:
+    // Number of times to re-try, before yielding and then sleeping.
+    static constexpr unsigned SPIN_COUNT = 64;
+    static constexpr unsigned YIELD_COUNT = 4;
+
+    struct alignas(64) Cell
+    {
+        std::atomic<size_t> seq;
+        Element data;
+    };
+
+    // An eventcount: a sleeper reads the epoch, re-checks the queue,
+    // and then sleeps only if the epoch has not changed since.
+    struct alignas(64) Event
+    {
+        std::atomic<uint32_t> epoch;
+        std::atomic<uint32_t> sleepers;
+#ifndef __linux__
+        std::mutex mtx;
+        std::condition_variable cond;
+#endif
+        Event() : epoch(0), sleepers(0) {}
+
+        uint32_t prepare()
+        {
+            sleepers.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            return epoch.load();
+        }
+        void retire() { sleepers.fetch_sub(1); }
+
+        void wait(uint32_t ep)
+        {
+#ifdef __linux__
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch),
+                    FUTEX_WAIT_PRIVATE, ep, nullptr, nullptr, 0);
+#else
+            std::unique_lock<std::mutex> lock(mtx);
+            while (epoch.load() == ep) cond.wait(lock);
+#endif
+            sleepers.fetch_sub(1);
+        }
+
+        void notify(int nwake, bool force = false)
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (not force and 0 == sleepers.load()) return;
+            epoch.fetch_add(1);
+#ifdef __linux__
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch),
+                    FUTEX_WAKE_PRIVATE, nwake, nullptr, nullptr, 0);
+#else
+            std::lock_guard<std::mutex> lock(mtx);
+            cond.notify_all();
+#endif
+        }
+    };
+
+    std::unique_ptr<Cell[]> _ring;
+    size_t _mask;
+    alignas(64) std::atomic<size_t> _head;   // next slot to push into
+    alignas(64) std::atomic<size_t> _tail;   // next slot to pop from
+    Event _not_empty;
+    Event _not_full;
+    std::atomic<bool> is_canceled;
+
+    concurrent_bounded_queue(const concurrent_bounded_queue&) = delete;
+    concurrent_bounded_queue& operator=(const concurrent_bounded_queue&) = delete;
+
+    static void pause()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    /// Claim up to max consecutive slots, starting at the head, that
+    /// are ready to be written. Return the number claimed; *first is
+    /// set to the position of the first one.
+    size_t claim(std::atomic<size_t>& pos, size_t max, size_t lag,
+                 size_t* first)
+    {
+        size_t p = pos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            size_t n = 0;
+            while (n < max and n <= _mask)
+            {
+                size_t seq = _ring[(p + n) & _mask].seq.load(std::memory_order_acquire);
+                if (seq != p + n + lag) break;
+                n++;
+            }
+            if (0 == n)
+            {
+                // Either the queue is full/empty, or another thread
+                // got here first, and we have a stale position.
+                size_t seq = _ring[p & _mask].seq.load(std::memory_order_acquire);
+                intptr_t dif = intptr_t(seq) - intptr_t(p + lag);
+                if (dif < 0) return 0;
+                p = pos.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (pos.compare_exchange_weak(p, p + n, std::memory_order_relaxed))
+            {
+                *first = p;
+                return n;
+            }
+        }
+    }
+
+    template<typename Put>
+    size_t do_push(size_t max, const Put& put)
+    {
+        if (is_canceled) throw Canceled();
+        size_t first;
+        size_t n = claim(_head, max, 0, &first);
+        for (size_t i = 0; i < n; i++)
+        {
+            Cell& c = _ring[(first + i) & _mask];
+            put(c.data, i);
+            c.seq.store(first + i + 1, std::memory_order_release);
+        }
+        if (0 < n) _not_empty.notify(1 == n ? 1 : INT_MAX);
+        return n;
+    }
+
+    template<typename Take>
+    size_t do_pop(size_t max, const Take& take)
+    {
+        if (is_canceled) throw Canceled();
+        size_t first;
+        size_t n = claim(_tail, max, 1, &first);
+        for (size_t i = 0; i < n; i++)
+        {
+            Cell& c = _ring[(first + i) & _mask];
+            take(c.data);
+            c.seq.store(first + i + _mask + 1, std::memory_order_release);
+        }
+        if (0 < n) _not_full.notify(1 == n ? 1 : INT_MAX);
+        return n;
+    }
+
+    /// Keep calling attempt() until it succeeds, spinning, then
+    /// yielding, then sleeping on the event.
+    template<typename Attempt>
+    void wait_until(Event& ev, const Attempt& attempt)
+    {
+        for (unsigned i = 0; i < SPIN_COUNT + YIELD_COUNT; i++)
+        {
+            if (attempt()) return;
+            if (i < SPIN_COUNT) pause();
+            else std::this_thread::yield();
+        }
+        while (true)
+        {
+            uint32_t ep = ev.prepare();
+            bool done;
+            try { done = attempt(); }
+            catch (...) { ev.retire(); throw; }
+            if (done) { ev.retire(); return; }
+            ev.wait(ep);
+        }
+    }
+
+public:
+    /// The capacity is rounded up to a power of two.
+    concurrent_bounded_queue(size_t capacity = 1024)
+        : _head(0), _tail(0), is_canceled(false)
+    {
+        size_t cap = 2;
+        while (cap < capacity) cap <<= 1;
+        _ring.reset(new Cell[cap]);
+        for (size_t i = 0; i < cap; i++)
+            _ring[i].seq.store(i, std::memory_order_relaxed);
+        _mask = cap - 1;
+    }
+    ~concurrent_bounded_queue()
+    { if (not is_canceled) cancel(); }
+
+    struct Canceled : public std::exception
+    {
+        const char * what() { return "Cancellation of wait on concurrent_bounded_queue"; }
+    };
+
+    size_t capacity() const noexcept { return _mask + 1; }
+
+    /// Try to push the Element onto the queue, without blocking.
+    /// Return false if the queue is full.
+    bool try_push(const Element& item)
+    {
+        return 1 == do_push(1, [&](Element& d, size_t) { d = item; });
+    }
+
+    bool try_push(Element&& item)
+    {
+        return 1 == do_push(1, [&](Element& d, size_t) { d = std::move(item); });
+    }
+
+    /// Push as many of the n items as there is room for, without
+    /// blocking, starting with the first. Return how many were pushed.
+    size_t try_push_n(const Element* items, size_t n)
+    {
+        return do_push(n, [&](Element& d, size_t i) { d = items[i]; });
+    }
+
+    /// Push the Element onto the queue. Block if the queue is full.
+    void push(const Element& item)
+    {
+        wait_until(_not_full, [&]() { return try_push(item); });
+    }
+
+    /// Push the Element onto the queue, by moving it.
+    void push(Element&& item)
+    {
+        wait_until(_not_full, [&]() { return try_push(std::move(item)); });
+    }
+
+    /// Return true if the queue is empty at this instant in time.
+    bool is_empty() const
+    {
+        if (is_canceled) throw Canceled();
+        return 0 == size();
+    }
+
+    /// Return true if the queue is full at this instant in time.
+    bool is_full() const noexcept { return capacity() <= size(); }
+
+    /// Return the size of the queue at this instant in time.
+    unsigned int size() const
+    {
+        size_t tail = _tail.load();
+        size_t head = _head.load();
+        return (tail < head) ? head - tail : 0;
+    }
+
+    /// Try to get an element off the front of the queue. Return true
+    /// if success, else return false.
+    bool try_get(Element& value)
+    {
+        return 1 == do_pop(1, [&](Element& d) { value = std::move(d); });
+    }
+    bool try_pop(Element& value) { return try_get(value); }
+
+    /// Move up to max elements off of the queue, appending them to the
+    /// vector, without blocking. Return how many were moved.
+    size_t try_pop_n(std::vector<Element>& out, size_t max)
+    {
+        return do_pop(max, [&](Element& d) { out.push_back(std::move(d)); });
+    }
+
+    /// Pop an item off the queue. Block if the queue is empty.
+    void pop(Element& value)
+    {
+        wait_until(_not_empty, [&]() { return try_get(value); });
+    }
+    void wait_pop(Element& value) { pop(value); }
+
+    Element value_pop()
+    {
+        Element value;
+        pop(value);
+        return value;
+    }
+
+    /// Get up to max items from the queue, appending them to the
+    /// vector. Block if the queue is empty.
+    void pop_batch(std::vector<Element>& out, size_t max)
+    {
+        wait_until(_not_empty, [&]() { return 0 < try_pop_n(out, max); });
+    }
+
+    void cancel_reset()
+    {
+       // This doesn't lose data, but it instead allows new calls
+       // to not throw Canceled exceptions
+       is_canceled = false;
+    }
+    void open() { cancel_reset(); }
+
+    void cancel()
+    {
+       if (is_canceled.exchange(true)) throw Canceled();
+       _not_empty.notify(INT_MAX, true);
+       _not_full.notify(INT_MAX, true);
+    }
+    void close() { cancel(); }
+
+    bool is_closed() const noexcept { return is_canceled; }
+
+    static bool is_lock_free() noexcept { return true; }
+};
+/** @}*/
+
+#endif // _OC_CONCURRENT_BOUNDED_QUEUE_H
@@ -33,10 +33,14 @@
 #ifndef _OC_CONCURRENT_QUEUE_H
 #define _OC_CONCURRENT_QUEUE_H
 
+#include <chrono>
 #include <condition_variable>
 #include <queue>
 #include <exception>
 #include <mutex>
+#include <vector>
+
+#include <opencog/util/trace_event.h>
 
 /** \addtogroup grp_cogutil
  *  @{
@@ -72,6 +76,54 @@ private:
     concurrent_queue(const concurrent_queue&) = delete;  // disable copying
     concurrent_queue& operator=(const concurrent_queue&) = delete; // no assign
 
+    // The waits on the condition, as spans of the trace (see
+    // trace_event.h).
+    void traced_wait(std::unique_lock<std::mutex>& lock)
+    {
+        OC_TRACE_SCOPE("concurrent_queue::wait");
+        the_cond.wait(lock);
+    }
+    template<typename TimePoint>
+    std::cv_status traced_wait_until(std::unique_lock<std::mutex>& lock,
+        const TimePoint& deadline, const char* what = "concurrent_queue::wait")
+    {
+        OC_TRACE_SCOPE(what);
+        return the_cond.wait_until(lock, deadline);
+    }
+
+    template<typename Rep, typename Period>
+    bool wait_for_item(std::unique_lock<std::mutex>& lock,
+                       const std::chrono::duration<Rep, Period>& timeout)
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (the_queue.empty() and not is_canceled and
+               std::cv_status::timeout != traced_wait_until(lock, deadline))
+        {}
+        if (is_canceled) throw Canceled();
+        return not the_queue.empty();
+    }
+
+    template<typename Rep, typename Period>
+    void take_batch(std::unique_lock<std::mutex>& lock,
+                    std::vector<Element>& out, size_t max,
+                    const std::chrono::duration<Rep, Period>& linger)
+    {
+        if (the_queue.size() < max and 0 < linger.count())
+        {
+            auto deadline = std::chrono::steady_clock::now() + linger;
+            while (the_queue.size() < max and not is_canceled and
+                   std::cv_status::timeout != traced_wait_until(lock, deadline,
+                                                "concurrent_queue::linger"))
+            {}
+        }
+
+        while (0 < max-- and not the_queue.empty())
+        {
+            out.push_back(std::move(the_queue.front()));
+            the_queue.pop();
+        }
+    }
+
 public:
     concurrent_queue(void)
         : the_queue(), the_mutex(), the_cond(), is_canceled(false)
@@ -157,7 +209,7 @@ public:
         {
             while (the_queue.empty() and not is_canceled)
             {
-                the_cond.wait(lock);
+                traced_wait(lock);
             }
             if (is_canceled) throw Canceled();
         }
@@ -185,7 +237,7 @@ public:
         {
             while (the_queue.empty() and not is_canceled)
             {
-                the_cond.wait(lock);
+                traced_wait(lock);
             }
             if (is_canceled) break;
         }
@@ -196,6 +248,55 @@ public:
         return retval;
     }
 
+    /// Get up to max items from the queue, appending them to the
+    /// vector. Block if the queue is empty. Once there is at least one
+    /// item, wait up to linger for more to arrive, so that up to max
+    /// of them can be gotten at once. Throws Canceled if the queue is
+    /// canceled while waiting for the first item.
+    template<typename Rep, typename Period>
+    void pop_batch(std::vector<Element>& out, size_t max,
+               const std::chrono::duration<Rep, Period>& linger)
+    {
+        std::unique_lock<std::mutex> lock(the_mutex);
+        do
+        {
+            while (the_queue.empty() and not is_canceled)
+            {
+                traced_wait(lock);
+            }
+            if (is_canceled) throw Canceled();
+        }
+        while (the_queue.empty());
+
+        take_batch(lock, out, max, linger);
+    }
+
+    /// Same as above, except that it waits at most timeout for the
+    /// first item to arrive. Return false if none did.
+    template<typename Rep, typename Period, typename Rep2, typename Period2>
+    bool pop_batch_for(std::vector<Element>& out, size_t max,
+                       const std::chrono::duration<Rep, Period>& linger,
+                       const std::chrono::duration<Rep2, Period2>& timeout)
+    {
+        std::unique_lock<std::mutex> lock(the_mutex);
+        if (not wait_for_item(lock, timeout)) return false;
+        take_batch(lock, out, max, linger);
+        return true;
+    }
+
+    /// Pop an item off the queue. If the queue is empty, wait at most
+    /// timeout for an item to arrive; return false if none did.
+    template<typename Rep, typename Period>
+    bool try_pop_for(Element& value,
+                     const std::chrono::duration<Rep, Period>& timeout)
+    {
+        std::unique_lock<std::mutex> lock(the_mutex);
+        if (not wait_for_item(lock, timeout)) return false;
+        value = std::move(the_queue.front());
+        the_queue.pop();
+        return true;
+    }
+
     /// A weak barrier.  This will block as long as the queue is empty,
     /// returning only when the queue isn't. It's "weak", because while
     /// it waits, other threads may push and then pop something from
@@ -209,7 +310,7 @@ public:
 
         while (the_queue.empty() and not is_canceled)
         {
-            the_cond.wait(lock);
+            traced_wait(lock);
         }
         if (is_canceled) throw Canceled();
     }
@@ -33,10 +33,12 @@
 #ifndef _OC_CONCURRENT_SET_H
 #define _OC_CONCURRENT_SET_H
 
+#include <chrono>
 #include <condition_variable>
 #include <set>
 #include <exception>
 #include <mutex>
+#include <vector>
 
 /** \addtogroup grp_cogutil
  *  @{
@@ -219,6 +221,42 @@ public:
         return retval;
     }
 
+    /// Get up to max items from the set, appending them to the
+    /// vector. Block if the set is empty. Once there is at least one
+    /// item, wait up to linger for more to arrive, so that up to max
+    /// of them can be gotten at once. Throws Canceled if the set is
+    /// canceled while waiting for the first item.
+    template<typename Rep, typename Period>
+    void get_batch(std::vector<Element>& out, size_t max,
+               const std::chrono::duration<Rep, Period>& linger)
+    {
+        std::unique_lock<std::mutex> lock(the_mutex);
+        do
+        {
+            while (the_set.empty() and not is_canceled)
+            {
+                the_cond.wait(lock);
+            }
+            if (is_canceled) throw Canceled();
+        }
+        while (the_set.empty());
+
+        if (the_set.size() < max and 0 < linger.count())
+        {
+            auto deadline = std::chrono::steady_clock::now() + linger;
+            while (the_set.size() < max and not is_canceled and
+                   std::cv_status::timeout != the_cond.wait_until(lock, deadline))
+            {}
+        }
+
+        while (0 < max-- and not the_set.empty())
+        {
+            auto it = the_set.begin();
+            out.push_back(*it);
+            the_set.erase(it);
+        }
+    }
+
     /// A weak barrier.  This will block as long as the set is empty,
     /// returning only when the set isn't. It's "weak", because while
     /// it waits, other threads may insert and then remove something from
@@ -0,0 +1,308 @@
+/*
+ * opencog/util/concurrent_sharded_set.h
+ *
+ * A thread-safe set, split into independently-locked shards.
+ * Same API as concurrent_set.h, but scales to many inserting threads.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OC_CONCURRENT_SHARDED_SET_H
+#define _OC_CONCURRENT_SHARDED_SET_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! A thread-safe set, with the elements spread over many shards.
+///
+/// This behaves like concurrent_set: inserting an item that is already
+/// in the set does nothing, which provides a de-duplication service;
+/// getting an item removes it; getting from an empty set blocks until
+/// something is inserted; and cancel() wakes up all waiting threads.
+///
+/// The difference is that the elements are spread over a number of
+/// shards, according to their hash, and each shard has its own lock.
+/// Threads inserting different elements thus rarely contend with one
+/// another. Getting scans the shards, starting at a different shard
+/// each time. The Element must have a hash (for choosing the shard),
+/// and whatever the per-shard Set needs: a std::less, by default.
+/// See concurrent_unordered_set for shards that are hash sets.
+///
+/// There are no ordering guarantees of any kind when getting; not even
+/// the (unfair) std::less ordering that concurrent_set provides.
+
+template<typename Element, typename Hash = std::hash<Element>,
+         typename Set = std::set<Element>>
+class concurrent_sharded_set
+{
+private:
+    struct alignas(64) Shard
+    {
+        std::mutex mtx;
+        Set set;
+        std::atomic<size_t> count;
+        Shard() : count(0) {}
+    };
+
+    std::unique_ptr<Shard[]> _shards;
+    size_t _nshards;
+    unsigned _shift;
+    Hash _hash;
+
+    // Total number of elements, and number of threads waiting for one.
+    alignas(64) std::atomic<size_t> _size;
+    std::atomic<size_t> _waiters;
+    std::atomic<size_t> _next_shard;
+    std::atomic<bool> is_canceled;
+    std::mutex _wait_mutex;
+    std::condition_variable _cond;
+
+    concurrent_sharded_set(const concurrent_sharded_set&) = delete;
+    concurrent_sharded_set& operator=(const concurrent_sharded_set&) = delete;
+
+    Shard& shard_of(const Element& item)
+    {
+        // Fibonacci hashing; std::hash is often the identity.
+        uint64_t h = _hash(item) * 0x9E3779B97F4A7C15ULL;
+        return _shards[(0 == _shift) ? 0 : h >> (64 - _shift)];
+    }
+
+    bool do_insert(Shard& sh, std::unique_lock<std::mutex>& lock,
+                   bool inserted)
+    {
+        if (inserted)
+        {
+            sh.count++;
+            _size++;
+        }
+        lock.unlock();
+
+        // Only pay for a wakeup if someone is actually waiting.
+        if (inserted and 0 < _waiters)
+        {
+            std::lock_guard<std::mutex> wlock(_wait_mutex);
+            _cond.notify_one();
+        }
+        return inserted;
+    }
+
+    /// Move up to max elements into out; return how many were moved.
+    size_t take(std::vector<Element>* out, Element* one, size_t max)
+    {
+        size_t got = 0;
+        size_t start = _next_shard++;
+        for (size_t i = 0; i < _nshards and got < max; i++)
+        {
+            Shard& sh = _shards[(start + i) % _nshards];
+            if (0 == sh.count) continue;
+
+            std::lock_guard<std::mutex> lock(sh.mtx);
+            while (got < max and not sh.set.empty())
+            {
+                auto node = sh.set.extract(sh.set.begin());
+                if (one) *one = std::move(node.value());
+                else out->push_back(std::move(node.value()));
+                sh.count--;
+                _size--;
+                got++;
+            }
+        }
+        return got;
+    }
+
+    /// Block until the set is (probably) not empty.
+    void wait_nonempty()
+    {
+        if (0 < _size) return;
+        std::unique_lock<std::mutex> lock(_wait_mutex);
+        _waiters++;
+        while (0 == _size and not is_canceled)
+            _cond.wait(lock);
+        _waiters--;
+    }
+
+public:
+    concurrent_sharded_set(size_t nshards = 64)
+        : _size(0), _waiters(0), _next_shard(0), is_canceled(false)
+    {
+        _nshards = 1;
+        _shift = 0;
+        while (_nshards < nshards) { _nshards <<= 1; _shift++; }
+        _shards.reset(new Shard[_nshards]);
+    }
+    ~concurrent_sharded_set()
+    { if (not is_canceled) cancel(); }
+
+    struct Canceled : public std::exception
+    {
+        const char * what() { return "Cancellation of wait on concurrent_sharded_set"; }
+    };
+
+    size_t shards() const noexcept { return _nshards; }
+
+    /// Insert the Element into the set; copies the item.
+    /// Return true if the item was not already in the set,
+    /// else return false.
+    bool insert(const Element& item)
+    {
+        if (is_canceled) throw Canceled();
+        Shard& sh = shard_of(item);
+        std::unique_lock<std::mutex> lock(sh.mtx);
+        return do_insert(sh, lock, sh.set.insert(item).second);
+    }
+
+    /// Insert the Element into the set, by moving it.
+    /// Return true if the item was not already in the set,
+    /// else return false.
+    bool insert(Element&& item)
+    {
+        if (is_canceled) throw Canceled();
+        Shard& sh = shard_of(item);
+        std::unique_lock<std::mutex> lock(sh.mtx);
+        return do_insert(sh, lock, sh.set.insert(std::move(item)).second);
+    }
+
+    /// Return true if the item is in the set at this instant in time.
+    bool contains(const Element& item)
+    {
+        Shard& sh = shard_of(item);
+        if (0 == sh.count) return false;
+        std::lock_guard<std::mutex> lock(sh.mtx);
+        return sh.set.find(item) != sh.set.end();
+    }
+
+    /// Return true if the set is empty at this instant in time.
+    bool is_empty() const
+    {
+        if (is_canceled) throw Canceled();
+        return 0 == _size;
+    }
+
+    /// The set is unbounded. It will never get full.
+    bool is_full() const noexcept { return false; }
+
+    /// Return the size of the set at this instant in time.
+    unsigned int size() const
+    {
+        return _size;
+    }
+
+    /// Try to get an element in the set. Return true if success,
+    /// else return false. The element is removed from the set.
+    bool try_get(Element& value)
+    {
+        if (is_canceled) throw Canceled();
+        return 1 == take(nullptr, &value, 1);
+    }
+
+    /// Get an item from the set. Block if the set is empty.
+    /// The element is removed from the set, before this returns.
+    void get(Element& value)
+    {
+        while (true)
+        {
+            wait_nonempty();
+            if (is_canceled) throw Canceled();
+            if (1 == take(nullptr, &value, 1)) return;
+        }
+    }
+    void wait_get(Element& value) { get(value); }
+
+    Element value_get()
+    {
+        Element value;
+        get(value);
+        return value;
+    }
+
+    /// Get up to max items from the set, appending them to the
+    /// vector. Block if the set is empty. Once there is at least one
+    /// item, wait up to linger for more to arrive, so that up to max
+    /// of them can be gotten at once. Throws Canceled if the set is
+    /// canceled while waiting for the first item.
+    template<typename Rep, typename Period>
+    void get_batch(std::vector<Element>& out, size_t max,
+                   const std::chrono::duration<Rep, Period>& linger)
+    {
+        while (true)
+        {
+            wait_nonempty();
+            if (is_canceled) throw Canceled();
+            if (_size < max and 0 < linger.count())
+            {
+                auto deadline = std::chrono::steady_clock::now() + linger;
+                std::unique_lock<std::mutex> lock(_wait_mutex);
+                _waiters++;
+                while (_size < max and not is_canceled and
+                       std::cv_status::timeout != _cond.wait_until(lock, deadline))
+                {}
+                _waiters--;
+            }
+            if (0 < take(&out, nullptr, max)) return;
+        }
+    }
+
+    /// Block until the set is not empty, and then remove everything
+    /// in it. Returns an empty vector if the set is canceled.
+    std::vector<Element> wait_and_take_all()
+    {
+        std::vector<Element> all;
+        while (not is_canceled)
+        {
+            wait_nonempty();
+            if (is_canceled) break;
+            if (0 < take(&all, nullptr, SIZE_MAX)) break;
+        }
+        return all;
+    }
+
+    void cancel_reset()
+    {
+       // This doesn't lose data, but it instead allows new calls
+       // to not throw Canceled exceptions
+       is_canceled = false;
+    }
+    void open() { cancel_reset(); }
+
+    void cancel()
+    {
+       std::unique_lock<std::mutex> lock(_wait_mutex);
+       if (is_canceled) throw Canceled();
+       is_canceled = true;
+       lock.unlock();
+       _cond.notify_all();
+    }
+    void close() { cancel(); }
+
+    bool is_closed() const noexcept { return is_canceled; }
+
+    static bool is_lock_free() noexcept { return false; }
+};
+/** @}*/
+
+#endif // _OC_CONCURRENT_SHARDED_SET_H
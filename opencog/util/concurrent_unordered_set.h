@@ -0,0 +1,50 @@
+/*
+ * opencog/util/concurrent_unordered_set.h
+ *
+ * A thread-safe hash set, with striped locks.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OC_CONCURRENT_UNORDERED_SET_H
+#define _OC_CONCURRENT_UNORDERED_SET_H
+
+#include <functional>
+#include <unordered_set>
+
+#include <opencog/util/concurrent_sharded_set.h>
+
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! A thread-safe std::unordered_set.
+///
+/// Same API and semantics as concurrent_set: insert de-duplicates,
+/// get() and wait_get() remove what they return, and block while the
+/// set is empty; get_batch() and wait_and_take_all() drain many at
+/// once. But inserts and lookups are O(1), and threads working on
+/// different elements almost never contend, since each of the shards
+/// is a hash set under its own lock. The Element needs a hash and an
+/// operator==, but no ordering.
+
+template<typename Element, typename Hash = std::hash<Element>>
+using concurrent_unordered_set =
+    concurrent_sharded_set<Element, Hash, std::unordered_set<Element, Hash>>;
+
+/** @}*/
+
+#endif // _OC_CONCURRENT_UNORDERED_SET_H
@@ -23,12 +23,15 @@
 #ifndef _OPENCOG_DIGRAPH_H
 #define _OPENCOG_DIGRAPH_H
 
+#include <atomic>
+#include <climits>
 #include <queue>
 #include <vector>
 #include <set>
 #include <opencog/util/algorithm.h>
 #include <opencog/util/exceptions.h>
 #include <opencog/util/oc_assert.h>
+#include <opencog/util/oc_omp.h>
 #include <boost/iterator/counting_iterator.hpp>
 
 namespace opencog
@@ -62,7 +65,10 @@ struct digraph {
     }
     //! return the number of edges
     size_type n_edges() const {
-        return accumulate2d(_incoming.begin(), _incoming.end(), size_type(0));
+        size_type n = 0;
+        for (const value_set& s : _incoming)
+            n += s.size();
+        return n;
     }
     bool empty() const {
         return (n_edges() == 0);
@@ -118,6 +124,179 @@ Out randomized_topological_sort(digraph g, Out out)
     return out;
 }
 
+//! A digraph frozen in compressed sparse row form.
+/**
+ * The arcs of all nodes are held in two contiguous arrays, one for
+ * the successors and one for the predecessors, each node owning the
+ * slice [offset[x], offset[x+1]), sorted. It takes 8 bytes per arc
+ * where digraph takes a set node on each side, and traversals walk
+ * memory in order.
+ *
+ * It cannot change once built; build a digraph and convert it.
+ */
+struct csr_digraph {
+    typedef digraph::size_type size_type;
+    typedef digraph::value_type value_type;
+    typedef const value_type* const_iterator;
+
+    //! A slice of the arc arrays, the neighbors of a node
+    struct range {
+        const_iterator first, last;
+        const_iterator begin() const { return first; }
+        const_iterator end() const { return last; }
+        size_type size() const { return last - first; }
+        bool empty() const { return first == last; }
+    };
+
+    //! The distance to an unreachable node, in bfs()
+    static const size_type unreachable = UINT_MAX;
+
+    explicit csr_digraph(const digraph& g)
+        : _out_offset(g.n_nodes() + 1), _in_offset(g.n_nodes() + 1)
+    {
+        size_type n = g.n_nodes();
+        _out_offset[0] = _in_offset[0] = 0;
+        for (size_type x = 0; x < n; x++) {
+            _out_offset[x + 1] = _out_offset[x] + g.outgoing(x).size();
+            _in_offset[x + 1] = _in_offset[x] + g.incoming(x).size();
+        }
+        _out.reserve(_out_offset[n]);
+        _in.reserve(_in_offset[n]);
+        for (size_type x = 0; x < n; x++) {
+            _out.insert(_out.end(), g.outgoing(x).begin(), g.outgoing(x).end());
+            _in.insert(_in.end(), g.incoming(x).begin(), g.incoming(x).end());
+        }
+    }
+
+    //! return the number of nodes
+    size_type n_nodes() const {
+        return _out_offset.size() - 1;
+    }
+    //! return the number of edges
+    size_type n_edges() const {
+        return _out.size();
+    }
+    bool empty() const {
+        return _out.empty();
+    }
+    //! return the direct predecessor nodes of x, sorted
+    range incoming(value_type x) const {
+        return {_in.data() + _in_offset[x], _in.data() + _in_offset[x + 1]};
+    }
+    //! return the direct successor nodes of x, sorted
+    range outgoing(value_type x) const {
+        return {_out.data() + _out_offset[x], _out.data() + _out_offset[x + 1]};
+    }
+
+    //! Fill 'out' with the nodes in topological order, nodes of no
+    //! predecessor in increasing order first (Kahn's algorithm).
+    /**
+     * It is assumed that the graph is a dag, an assert is raised
+     * otherwise.
+     */
+    template<typename Out>
+    Out topological_sort(Out out) const
+    {
+        size_type n = n_nodes();
+        std::vector<size_type> indegree(n);
+        std::vector<value_type> order;
+        order.reserve(n);
+        for (value_type x = 0; x < n; x++) {
+            indegree[x] = _in_offset[x + 1] - _in_offset[x];
+            if (indegree[x] == 0) order.push_back(x);
+        }
+        // order is the queue: nodes are appended as they become free
+        for (size_type i = 0; i < order.size(); i++)
+            for (value_type dst : outgoing(order[i]))
+                if (--indegree[dst] == 0)
+                    order.push_back(dst);
+        OC_ASSERT(order.size() == n, "csr_digraph - g must be a DAG.");
+        return std::copy(order.begin(), order.end(), out);
+    }
+
+    //! return, for each node, its distance in arcs from src, or
+    //! unreachable.
+    /**
+     * The breadth-first search goes level by level; each level is
+     * expanded in parallel, with the threads set by setting_omp(),
+     * when it is large enough to be worth it. The result does not
+     * depend on the number of threads.
+     */
+    std::vector<size_type> bfs(value_type src) const
+    {
+        return bfs(&src, &src + 1);
+    }
+
+    //! Same as above, from all the nodes of [from, to) at once
+    template<typename It>
+    std::vector<size_type> bfs(It from, It to) const
+    {
+        size_type n = n_nodes();
+        std::vector<std::atomic<size_type>> dist(n);
+        for (auto& d : dist) d.store(unreachable, std::memory_order_relaxed);
+        std::vector<value_type> frontier, next;
+        for (; from != to; ++from) {
+            OC_ASSERT(*from < n, "csr_digraph - no such node.");
+            if (dist[*from].exchange(0) == unreachable)
+                frontier.push_back(*from);
+        }
+
+        for (size_type level = 1; !frontier.empty(); level++) {
+            next.clear();
+            expand(frontier, level, dist, next);
+            frontier.swap(next);
+        }
+        return std::vector<size_type>(dist.begin(), dist.end());
+    }
+
+    //! return, for each node, whether it can be reached from src
+    //! (src included)
+    std::vector<bool> reachable(value_type src) const
+    {
+        std::vector<size_type> dist = bfs(src);
+        std::vector<bool> res(dist.size());
+        for (size_type x = 0; x < dist.size(); x++)
+            res[x] = dist[x] != unreachable;
+        return res;
+    }
+
+private:
+    std::vector<size_type> _out_offset, _in_offset;
+    std::vector<value_type> _out, _in;
+
+    // Claim the unvisited successors of the frontier for level, and
+    // append them to next. Each node is claimed once, by whichever
+    // thread swaps its distance first, so next has no duplicates.
+    void expand(const std::vector<value_type>& frontier, size_type level,
+                std::vector<std::atomic<size_type>>& dist,
+                std::vector<value_type>& next) const
+    {
+        long nf = frontier.size();
+#ifdef OC_OMP
+        // Below that, the threads cost more than they save.
+        const long min_parallel = 1024;
+        #pragma omp parallel num_threads(num_threads()) if (nf >= min_parallel)
+#endif
+        {
+            std::vector<value_type> local;
+#ifdef OC_OMP
+            #pragma omp for schedule(dynamic, 64) nowait
+#endif
+            for (long i = 0; i < nf; i++)
+                for (value_type dst : outgoing(frontier[i])) {
+                    size_type expected = unreachable;
+                    if (dist[dst].load(std::memory_order_relaxed) == unreachable
+                        and dist[dst].compare_exchange_strong(expected, level))
+                        local.push_back(dst);
+                }
+#ifdef OC_OMP
+            #pragma omp critical
+#endif
+            next.insert(next.end(), local.begin(), local.end());
+        }
+    }
+};
+
 /** @}*/
 } //~namespace opencog
 
@@ -25,6 +25,13 @@
 
 #include "exceptions.h"
 
+#include <algorithm>
+#include <atomic>
+
+#if defined(HAVE_GNU_BACKTRACE)
+#include <execinfo.h>
+#endif
+
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -35,9 +42,29 @@
 #include <opencog/util/Logger.h>
 
 #define MAX_MSG_LENGTH 2048
+// Deepest stack captured by exceptions whose logging is deferred
+#define MAX_STACK_DEPTH 50
 
 using namespace opencog;
 
+static std::atomic<bool> deferred_logging(false);
+
+void opencog::set_deferred_exception_logging(bool deferred)
+{
+    deferred_logging.store(deferred, std::memory_order_relaxed);
+}
+
+bool opencog::get_deferred_exception_logging()
+{
+    return deferred_logging.load(std::memory_order_relaxed);
+}
+
+struct StandardException::captured_stack
+{
+    void* frames[MAX_STACK_DEPTH];
+    int depth;
+};
+
 /*
  * ----------------------------------------------------------------------
  * StandardException class
@@ -48,37 +75,49 @@ void StandardException::parse_error_message(const char* fmt, va_list ap, bool lo
     char buf[MAX_MSG_LENGTH];
 
     vsnprintf(buf, sizeof(buf), fmt, ap);
-
-    // If buf contains %s %x %d %u etc. because one of the ap's did,
-    // then it becomes a horrid strange crash. So be careful, use %s.
-    if (logError) opencog::logger().error("%s", buf);
-    set_message(buf);
+    report(buf, logError);
 }
 
 void StandardException::parse_error_message(const char *trace, const char * msg, va_list ap, bool logError)
 {
-    size_t tlen = 0;
-    if (trace) tlen = strlen(trace);
-
-    size_t mlen = strlen(msg);
-    char * concatMsg = new char[tlen + mlen + 1];
-
-    strcpy(concatMsg, msg);
-    if (trace) {
-        // If "trace" is a string that contains %d %s %x %u or any
-        // format string, there will be confusing horrors!  Thus,
-        // blank out any %'s in "trace".
-        char * pcnt = concatMsg + mlen;
-        strcpy(pcnt, trace);
-        do {
-            pcnt = strchr(pcnt, '%');
-            if (pcnt) *pcnt = ' ';
-        } while (pcnt);
+    char buf[MAX_MSG_LENGTH];
+
+    // The trace is appended after formatting, rather than to the
+    // format, so that any % in it is taken literally, and is not
+    // copied twice.
+    int len = vsnprintf(buf, sizeof(buf), msg, ap);
+    if (len < 0) len = 0;
+    if (trace and len < MAX_MSG_LENGTH - 1)
+    {
+        strncpy(buf + len, trace, MAX_MSG_LENGTH - 1 - len);
+        buf[MAX_MSG_LENGTH - 1] = '\0';
     }
+    report(buf, logError);
+}
 
-    parse_error_message(concatMsg, ap, logError);
+void StandardException::report(const char* msg, bool logError)
+{
+    set_message(msg);
+    if (not logError) return;
 
-    delete [] concatMsg;
+    if (not get_deferred_exception_logging())
+    {
+        // If msg contains %s %x %d %u etc. because one of the ap's
+        // did, then it becomes a horrid strange crash. So be careful,
+        // use %s.
+        opencog::logger().error("%s", msg);
+        return;
+    }
+
+#if defined(HAVE_GNU_BACKTRACE)
+    // Skip report() itself.
+    auto cs = std::make_shared<captured_stack>();
+    int depth = backtrace(cs->frames, MAX_STACK_DEPTH);
+    int skip = std::min(depth, 1);
+    cs->depth = depth - skip;
+    memmove(cs->frames, cs->frames + skip, cs->depth * sizeof(void*));
+    stack = std::move(cs);
+#endif
 }
 
 StandardException::StandardException() :
@@ -88,7 +127,7 @@ StandardException::StandardException() :
 // Exceptions must have a copy constructor, as otherwise the
 // catcher will not be able to see the message! Ouch!
 StandardException::StandardException(const StandardException& ex) :
-    message(nullptr)
+    message(nullptr), stack(ex.stack)
 {
     if (ex.message)
     {
@@ -102,6 +141,7 @@ StandardException& StandardException::operator=(const StandardException& ex)
     {
         set_message(ex.message);
     }
+    stack = ex.stack;
     return *this;
 }
 
@@ -128,6 +168,20 @@ void StandardException::set_message(const char * msg)
     strcpy(message, msg);
 }
 
+int StandardException::get_stack_depth() const
+{
+    return stack ? stack->depth : 0;
+}
+
+void StandardException::log_error() const
+{
+    if (stack)
+        opencog::logger().log_backtrace(Logger::ERROR, get_message(),
+                                        stack->frames, stack->depth);
+    else
+        opencog::logger().error("%s", get_message());
+}
+
 /*
  * ----------------------------------------------------------------------
  * RuntimeException class
@@ -341,8 +395,7 @@ AssertionException::AssertionException(const char* fmt, ...)
     vsnprintf(buf, sizeof(buf), fmt, ap);
     va_end(ap);
 
-    set_message(buf);
-    opencog::logger().error("%s", buf);
+    report(buf, true);
 }
 
 AssertionException::AssertionException(const char* fmt, va_list ap)
@@ -350,6 +403,5 @@ AssertionException::AssertionException(const char* fmt, va_list ap)
     char    buf[MAX_MSG_LENGTH];
 
     vsnprintf(buf, sizeof(buf), fmt, ap);
-    set_message(buf);
-    opencog::logger().error("%s", buf);
+    report(buf, true);
 }
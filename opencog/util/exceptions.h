@@ -26,6 +26,7 @@
 #ifndef _OPENCOG_EXCEPTIONS_H
 #define _OPENCOG_EXCEPTIONS_H
 
+#include <memory>
 #include <string>
 #include <iostream>
 
@@ -39,6 +40,21 @@ namespace opencog
  *  @{
  */
 
+/**
+ * Set whether the exceptions that log an error when thrown defer it.
+ *
+ * By default, they log their message at once, at the ERROR level,
+ * together with the stack trace printed by the Logger, which must
+ * resolve every return address to a symbol name; that is slow. When
+ * deferred, they only record the raw return addresses of the stack,
+ * which is cheap, and log nothing: it is up to the catcher to call
+ * log_error() if the exception turns out to be an error, and only then
+ * is the stack resolved. This suits code that uses these exceptions
+ * for control flow.
+ */
+void set_deferred_exception_logging(bool);
+bool get_deferred_exception_logging();
+
 /**
  * Base exception class from which all other exceptions should inheritates.
  */
@@ -50,6 +66,12 @@ private:
      */
     char * message;
 
+    /**
+     * Raw stack captured in place of logging; shared by the copies.
+     */
+    struct captured_stack;
+    std::shared_ptr<const captured_stack> stack;
+
 protected:
     /**
      * Parse error message, substituting formatting characters (such
@@ -60,6 +82,12 @@ protected:
     void parse_error_message(const char * trace, const char* fmt,
                              va_list ap, bool logError=true);
 
+    /**
+     * Set the message, and log it, or only capture the stack if
+     * logging is deferred.
+     */
+    void report(const char* msg, bool logError);
+
 public:
     /**
      * Construtor and destructor.
@@ -87,6 +115,20 @@ public:
      */
     void set_message(const char *);
 
+    /**
+     * Number of return addresses captured when the exception was
+     * constructed, in place of logging it; 0 if it was logged, or
+     * never meant to be.
+     */
+    int get_stack_depth() const;
+
+    /**
+     * Log the message at the ERROR level, with the stack captured at
+     * construction, if any. Meant for exceptions whose logging was
+     * deferred, once they are found to be errors.
+     */
+    void log_error() const;
+
 }; // StandardException
 
 /**
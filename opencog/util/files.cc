@@ -20,16 +20,21 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
 #include <string.h>
 #include <stdlib.h>
 
+#include "exceptions.h"
 #include "files.h"
 #include "platform.h"
 
@@ -102,6 +107,73 @@ std::vector<std::string> opencog::get_module_paths()
 	return results;
 }
 
+opencog::module_resolver::module_resolver()
+    : _default_paths(true), _paths(get_module_paths())
+{
+}
+
+opencog::module_resolver::module_resolver(
+    const std::vector<std::string>& paths)
+    : _default_paths(false), _paths(paths)
+{
+}
+
+void opencog::module_resolver::refresh()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    _dirs.clear();
+    if (_default_paths)
+        _paths = get_module_paths();
+}
+
+// The entries of the directory, read on first call. A missing
+// directory has none.
+const opencog::module_resolver::entries&
+opencog::module_resolver::read_dir(const std::string& dir)
+{
+    std::unique_ptr<entries>& ents = _dirs[dir];
+    if (ents)
+        return *ents;
+    ents.reset(new entries());
+    if (DIR* d = opendir(dir.empty() ? "." : dir.c_str())) {
+        while (struct dirent* ent = readdir(d))
+            ents->insert(ent->d_name);
+        closedir(d);
+    }
+    return *ents;
+}
+
+std::string opencog::module_resolver::find_module(const std::string& name)
+{
+    if (name.empty())
+        return "";
+    std::string::size_type slash = name.rfind('/');
+    std::string subdir = slash == std::string::npos ?
+        "" : name.substr(0, slash + 1);
+    std::string base = name.substr(slash + 1);
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    for (const std::string& path : _paths) {
+        std::string prefix = path;
+        if (not prefix.empty() and prefix.back() != '/')
+            prefix += '/';
+        if (read_dir(prefix + subdir).count(base))
+            return prefix + name;
+    }
+    return "";
+}
+
+opencog::module_resolver& opencog::get_module_resolver()
+{
+    static module_resolver resolver;
+    return resolver;
+}
+
+std::string opencog::find_module(const std::string& name)
+{
+    return get_module_resolver().find_module(name);
+}
+
 bool opencog::file_exists(const char* filename)
 {
     std::fstream dumpFile(filename, std::ios::in);
@@ -148,49 +220,188 @@ bool opencog::create_directory(const char* directory)
     return false;
 }
 
-bool opencog::append_file_content(const char* filename, std::string &s)
+// Read the whole file into s, sized once from fstat, then read()
+// straight into it; the file is copied once, from the page cache.
+static bool read_file(const char* filename, std::string& s)
 {
-    std::ifstream in(filename);
-    if (!in.is_open())
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
         return false;
 
-    char c;
     std::string str;
-    while (in.get(c))
-        str += c;
-
-    if (!in.eof())
-        return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 and S_ISREG(st.st_mode))
+        str.resize(st.st_size);
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
 
-    s = str;
+    // The size may be wrong, as for /proc files, or change while
+    // reading; read until read() says the end is reached.
+    size_t len = 0;
+    while (true) {
+        if (len == str.size())
+            str.resize(std::max<size_t>(2 * len, 4096));
+        ssize_t n = read(fd, &str[len], str.size() - len);
+        if (n < 0 and errno == EINTR)
+            continue;
+        if (n < 0) {
+            close(fd);
+            return false;
+        }
+        if (n == 0)
+            break;
+        len += n;
+    }
+    close(fd);
+    str.resize(len);
+    s.swap(str);
     return true;
 }
 
+bool opencog::append_file_content(const char* filename, std::string &s)
+{
+    return read_file(filename, s);
+}
+
 bool opencog::load_text_file(const std::string &fname, std::string& dest)
 {
-    FILE *f = fopen(fname.c_str(), "rt");
-    if (f == NULL) {
-        puts("File not found.");
-        return false;
+    if (read_file(fname.c_str(), dest))
+        return true;
+    puts("File not found.");
+    return false;
+}
+
+static int madvice(opencog::mapped_file::access hint)
+{
+    switch (hint) {
+    case opencog::mapped_file::SEQUENTIAL: return MADV_SEQUENTIAL;
+    case opencog::mapped_file::RANDOM: return MADV_RANDOM;
+    case opencog::mapped_file::WILLNEED: return MADV_WILLNEED;
+    default: return MADV_NORMAL;
     }
-    fseek(f, 0L, SEEK_END);
-    long fsize = ftell(f);
-    fseek(f, 0L, SEEK_SET);
+}
 
-    char *buf = new char[fsize+2];
-    long bptr = 0;
+opencog::mapped_file::mapped_file(const std::string& filename, access hint)
+    : _data(nullptr), _size(0)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw IOException(TRACE_INFO, "mapped_file - cannot open %s",
+                          filename.c_str());
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw IOException(TRACE_INFO, "mapped_file - cannot stat %s",
+                          filename.c_str());
+    }
 
-    while (!feof(f))
-        buf[bptr++] = getc(f);
-// fread(buf, 8000, 1+(fsize/8000), f);
-    buf[bptr] = '\0';
+    // An empty file cannot be mapped, and needs not be.
+    _size = st.st_size;
+    if (0 < _size) {
+        void* p = mmap(NULL, _size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            throw IOException(TRACE_INFO, "mapped_file - cannot map %s",
+                              filename.c_str());
+        }
+        _data = static_cast<const char*>(p);
+        advise(hint);
+    }
+    close(fd);
+}
 
-    fclose(f);
+opencog::mapped_file::~mapped_file()
+{
+    if (_data)
+        munmap(const_cast<char*>(_data), _size);
+}
+
+opencog::mapped_file::mapped_file(mapped_file&& mf)
+    : _data(mf._data), _size(mf._size)
+{
+    mf._data = nullptr;
+    mf._size = 0;
+}
+
+opencog::mapped_file& opencog::mapped_file::operator=(mapped_file&& mf)
+{
+    std::swap(_data, mf._data);
+    std::swap(_size, mf._size);
+    return *this;
+}
 
-    dest = buf;
+void opencog::mapped_file::advise(access hint) const
+{
+    if (_data)
+        madvise(const_cast<char*>(_data), _size, madvice(hint));
+}
 
-    delete[] buf;
+opencog::line_reader::line_reader(const std::string& filename,
+                                  size_t buffer_size)
+    : _buf(std::max<size_t>(buffer_size, 16)), _begin(0), _end(0),
+      _eof(false), _line_number(0), _filename(filename)
+{
+    _fd = open(filename.c_str(), O_RDONLY);
+    if (_fd < 0)
+        throw IOException(TRACE_INFO, "line_reader - cannot open %s",
+                          filename.c_str());
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+opencog::line_reader::~line_reader()
+{
+    close(_fd);
+}
 
+bool opencog::line_reader::fill()
+{
+    if (_eof)
+        return false;
+    if (0 < _begin) {
+        memmove(_buf.data(), _buf.data() + _begin, _end - _begin);
+        _end -= _begin;
+        _begin = 0;
+    }
+    if (_end == _buf.size())
+        _buf.resize(2 * _buf.size());
+
+    ssize_t n;
+    do n = read(_fd, _buf.data() + _end, _buf.size() - _end);
+    while (n < 0 and errno == EINTR);
+    if (n < 0)
+        throw IOException(TRACE_INFO, "line_reader - cannot read %s",
+                          _filename.c_str());
+    if (n == 0)
+        _eof = true;
+    _end += n;
+    return 0 < n;
+}
+
+bool opencog::line_reader::next(std::string_view& line)
+{
+    size_t scanned = _begin;
+    while (true) {
+        const char* nl = static_cast<const char*>(
+            memchr(_buf.data() + scanned, '\n', _end - scanned));
+        if (nl) {
+            size_t pos = nl - _buf.data();
+            line = std::string_view(_buf.data() + _begin, pos - _begin);
+            _begin = pos + 1;
+            _line_number++;
+            return true;
+        }
+        // fill() moves the data to the front of the buffer.
+        scanned = _end - _begin;
+        if (not fill()) break;
+    }
+    if (_begin == _end)
+        return false;
+    line = std::string_view(_buf.data() + _begin, _end - _begin);
+    _begin = _end;
+    _line_number++;
     return true;
 }
 
@@ -30,7 +30,13 @@
  *
  */
 
+#include <cstddef>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace opencog
@@ -52,6 +58,56 @@ extern const std::vector<std::string> DEFAULT_MODULE_PATHS;
  */
 std::vector<std::string> get_module_paths();
 
+/**
+ * Find modules in a list of search paths, the first path that has it
+ * winning, with each directory read once and its entries indexed.
+ *
+ * A name may have directories, as in "opencog/scm/utils.scm"; then
+ * the subdirectory of each search path is read, once too. Directories
+ * are read when first looked in, so the index goes stale if they
+ * change afterwards, or the current directory does (the default
+ * paths have relative ones); refresh() forgets it. Safe to use from
+ * several threads.
+ */
+class module_resolver
+{
+public:
+    //! Search in get_module_paths()
+    module_resolver();
+    explicit module_resolver(const std::vector<std::string>& paths);
+
+    const std::vector<std::string>& paths() const { return _paths; }
+
+    /**
+     * The path of the module, a search path followed by the name, or
+     * the empty string if no search path has it.
+     */
+    std::string find_module(const std::string& name);
+
+    //! Forget what was read; with get_module_paths(), for the default
+    //! constructor, read the search paths again too.
+    void refresh();
+
+private:
+    typedef std::unordered_set<std::string> entries;
+
+    bool _default_paths;
+    std::vector<std::string> _paths;
+    std::unordered_map<std::string, std::unique_ptr<entries>> _dirs;
+    std::mutex _mtx;
+
+    const entries& read_dir(const std::string& dir);
+};
+
+/**
+ * The resolver of get_module_paths(), shared by the process: the
+ * search paths and their contents are read once for all lookups.
+ */
+module_resolver& get_module_resolver();
+
+/** Same as get_module_resolver().find_module(name) */
+std::string find_module(const std::string& name);
+
 /**
  * Check if a file exists in the current directory
  *
@@ -92,6 +148,94 @@ bool append_file_content(const char* filename, std::string &s);
 /** Load the contents of a textfile \param fname to \param dest. */
 bool load_text_file(const std::string &fname, std::string& dest);
 
+/**
+ * A read-only view of the content of a file, mapped in memory.
+ *
+ * The pages are read from the file as they are touched, and are
+ * shared with the page cache, so a large file is not copied into the
+ * memory of the process. The access hint is given to the kernel with
+ * madvise: SEQUENTIAL reads ahead aggressively and drops the pages
+ * behind, RANDOM does not read ahead.
+ *
+ * The content must not be changed by another process while mapped;
+ * truncating the file makes reads beyond the new end fault.
+ */
+class mapped_file
+{
+public:
+    enum access { NORMAL, SEQUENTIAL, RANDOM, WILLNEED };
+
+    mapped_file() : _data(nullptr), _size(0) {}
+    //! Throw IOException if the file cannot be opened or mapped
+    explicit mapped_file(const std::string& filename,
+                         access hint = SEQUENTIAL);
+    ~mapped_file();
+
+    mapped_file(mapped_file&&);
+    mapped_file& operator=(mapped_file&&);
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const char* data() const { return _data; }
+    size_t size() const { return _size; }
+    bool empty() const { return 0 == _size; }
+    const char* begin() const { return _data; }
+    const char* end() const { return _data + _size; }
+    std::string_view view() const { return std::string_view(_data, _size); }
+
+    //! Give another access hint for the whole file
+    void advise(access hint) const;
+
+private:
+    const char* _data;
+    size_t _size;
+};
+
+/**
+ * Read a file line by line, through a buffer that is reused from
+ * line to line, so that reading allocates nothing once the buffer
+ * has grown to the longest line.
+ *
+ *     line_reader in(filename);
+ *     std::string_view line;
+ *     while (in.next(line)) ...
+ *
+ * Lines are split on '\n', which is not part of the line; a last line
+ * without one is returned too.
+ */
+class line_reader
+{
+public:
+    //! Throw IOException if the file cannot be opened
+    explicit line_reader(const std::string& filename,
+                         size_t buffer_size = 1 << 16);
+    ~line_reader();
+
+    line_reader(const line_reader&) = delete;
+    line_reader& operator=(const line_reader&) = delete;
+
+    //! Set line to the next line and return true, or return false at
+    //! the end of the file. The view is valid until the next call.
+    //! Throw IOException on a read error.
+    bool next(std::string_view& line);
+
+    //! The number of lines read so far
+    size_t line_number() const { return _line_number; }
+
+private:
+    int _fd;
+    std::vector<char> _buf;
+    size_t _begin;      //!< of the unread data in _buf
+    size_t _end;        //!< of the unread data in _buf
+    bool _eof;
+    size_t _line_number;
+    std::string _filename;
+
+    //! Move the unread data to the front of the buffer, growing it if
+    //! full, and read more after it. Return false at the end of the file.
+    bool fill();
+};
+
 /**
  * Get the file name (including absolute path) of current executing file
  */
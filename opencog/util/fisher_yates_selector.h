@@ -0,0 +1,238 @@
+/*
+ * opencog/util/fisher_yates_selector.h
+ *
+ * Sampling without replacement, in memory proportional to the sample.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_FISHER_YATES_SELECTOR_H
+#define _OPENCOG_FISHER_YATES_SELECTOR_H
+
+#include <cstdint>
+#include <numeric>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <opencog/util/mt19937ar.h>
+#include <opencog/util/oc_assert.h>
+#include <opencog/util/RandGen.h>
+#include <opencog/util/rng_engines.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+/**
+ * Selects integers in [0, n), uniformly, never twice the same; like
+ * lazy_random_selector, but in O(1) time per draw and in memory that
+ * does not grow node by node, as its std::unordered_set does.
+ *
+ * It runs a Fisher-Yates shuffle of [0, n) lazily: the t-th draw swaps
+ * a random element of [t, n) into place t, and returns it. When n is
+ * small compared to the number of draws expected, the array is kept in
+ * full (dense mode). Otherwise only the places that were written to are
+ * kept, in a flat open-addressing table sized once for the expected
+ * number of draws (sparse mode): k draws then take O(k) memory,
+ * whatever n is, with no rehashing unless more draws are made than
+ * were announced.
+ */
+class fisher_yates_selector
+{
+public:
+    //! select from [0, n); expected is the number of draws planned
+    //! (any number can be made, but it picks the mode)
+    fisher_yates_selector(unsigned n, unsigned expected)
+        : _n(n), _t(0), _dense(n <= 4 * uint64_t(expected)), _used(0)
+    {
+        if (_dense)
+        {
+            _perm.resize(n);
+            std::iota(_perm.begin(), _perm.end(), 0U);
+        }
+        else
+            reserve(expected);
+    }
+
+    bool empty() const { return _t >= _n; }
+
+    //! number of values that can still be drawn
+    unsigned count_n_free() const { return _n - _t; }
+
+    //! returns the selected number (never twice the same)
+    unsigned operator()(RandGen& rng = randGen())
+    {
+        OC_ASSERT(!empty(), "fisher_yates_selector - selector is empty.");
+        return next(_t + rng.randint(_n - _t));
+    }
+
+    //! same, with one of the engines of rng_engines.h
+    template<typename Engine,
+             typename std::enable_if<is_fast_engine<Engine>::value, int>::type = 0>
+    unsigned operator()(Engine& eng)
+    {
+        OC_ASSERT(!empty(), "fisher_yates_selector - selector is empty.");
+        return next(_t + unsigned(rand_below(eng, _n - _t)));
+    }
+
+    //! true if storing the full array of n values
+    bool dense() const { return _dense; }
+
+private:
+    static constexpr unsigned EMPTY = ~0U;
+
+    unsigned _n;
+    unsigned _t;                      // number of draws so far
+    bool _dense;
+    std::vector<unsigned> _perm;      // dense mode
+    std::vector<std::pair<unsigned, unsigned>> _table;  // sparse mode
+    size_t _used;
+
+    unsigned next(unsigned j)
+    {
+        unsigned res;
+        if (_dense)
+        {
+            res = _perm[j];
+            _perm[j] = _perm[_t];
+        }
+        else
+        {
+            // Place t is never read again, so it need not be stored.
+            res = get(j);
+            put(j, get(_t));
+        }
+        _t++;
+        return res;
+    }
+
+    void reserve(size_t k)
+    {
+        size_t cap = 16;
+        while (cap < 2 * k) cap *= 2;
+        std::vector<std::pair<unsigned, unsigned>> old;
+        old.swap(_table);
+        _table.assign(cap, {EMPTY, 0});
+        _used = 0;
+        for (const auto& kv : old)
+            if (EMPTY != kv.first) put(kv.first, kv.second);
+    }
+
+    size_t slot(unsigned key) const
+    {
+        size_t mask = _table.size() - 1;
+        size_t i = (key * 0x9e3779b1U) & mask;
+        while (EMPTY != _table[i].first and key != _table[i].first)
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    // Value at place j of the virtual array.
+    unsigned get(unsigned j) const
+    {
+        const auto& kv = _table[slot(j)];
+        return EMPTY == kv.first ? j : kv.second;
+    }
+
+    void put(unsigned j, unsigned v)
+    {
+        size_t i = slot(j);
+        if (EMPTY == _table[i].first)
+        {
+            if (3 * _table.size() < 4 * (_used + 1))
+            {
+                reserve(_table.size());
+                i = slot(j);
+            }
+            _used++;
+        }
+        _table[i] = {j, v};
+    }
+};
+
+namespace detail {
+
+inline unsigned draw_below(RandGen& rng, unsigned n)
+{
+    return rng.randint(n);
+}
+
+template<typename Engine,
+         typename std::enable_if<is_fast_engine<Engine>::value, int>::type = 0>
+unsigned draw_below(Engine& eng, unsigned n)
+{
+    return unsigned(rand_below(eng, n));
+}
+
+} // ~namespace detail
+
+/**
+ * Return k distinct integers of [0, n), drawn uniformly, in random
+ * order; k must not exceed n. The method depends on k/n:
+ *
+ * - if k > n/2, a partial Fisher-Yates shuffle of the whole range;
+ * - else if the range is at most 64 times k, rejection against a
+ *   bitset of n bits (at most k 64-bit words, and fewer than 2k draws
+ *   on average);
+ * - else a sparse Fisher-Yates shuffle (see fisher_yates_selector),
+ *   in O(k) memory.
+ *
+ * Each is O(k) time, and O(k) memory beyond the result.
+ */
+template<typename Rng>
+std::vector<unsigned> sample_without_replacement(unsigned n, unsigned k, Rng& rng)
+{
+    OC_ASSERT(k <= n, "sample_without_replacement - k > n.");
+    std::vector<unsigned> res;
+    res.reserve(k);
+    if (n < 2 * uint64_t(k))
+    {
+        fisher_yates_selector sel(n, n);
+        while (res.size() < k) res.push_back(sel(rng));
+    }
+    else if (n <= 64 * uint64_t(k))
+    {
+        std::vector<uint64_t> bits((n + 63) / 64, 0);
+        while (res.size() < k)
+        {
+            unsigned x = detail::draw_below(rng, n);
+            uint64_t& word = bits[x / 64];
+            uint64_t bit = uint64_t(1) << (x % 64);
+            if (word & bit) continue;
+            word |= bit;
+            res.push_back(x);
+        }
+    }
+    else
+    {
+        fisher_yates_selector sel(n, k);
+        while (res.size() < k) res.push_back(sel(rng));
+    }
+    return res;
+}
+
+inline std::vector<unsigned> sample_without_replacement(unsigned n, unsigned k)
+{
+    return sample_without_replacement(n, k, randGen());
+}
+
+/** @}*/
+} //~namespace opencog
+
+#endif // _OPENCOG_FISHER_YATES_SELECTOR_H
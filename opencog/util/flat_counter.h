@@ -0,0 +1,343 @@
+/*
+ * opencog/util/flat_counter.h
+ *
+ * A Counter kept in a sorted vector.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_FLAT_COUNTER_H
+#define _OPENCOG_FLAT_COUNTER_H
+
+#include <algorithm>
+#include <initializer_list>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include <boost/operators.hpp>
+
+#include <opencog/util/Counter.h>
+
+namespace opencog {
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! Same as Counter, but with the key:count pairs in a sorted vector
+/**
+ * Lookups are binary searches over contiguous memory, iterating is a
+ * walk along an array, and the arithmetic between counters is a
+ * linear merge of two arrays, none of which chase pointers or
+ * allocate per key as the std::map under Counter does. Inserting a
+ * new key one at a time is O(n) though (the tail of the array is
+ * shifted), so it suits counters of up to a few thousand keys, or
+ * counting in bulk: add_range() counts known keys in place, and sorts
+ * the new ones to merge them in by batches, O(m log(m + n) + n) for m
+ * elements, whatever the number of new keys.
+ *
+ * The interface follows Counter's, except that the pairs may only be
+ * iterated over as const (a key changed in place would break the
+ * order), and keys() returns a sorted vector. Counters convert to and
+ * from Counter.
+ */
+template<typename T, typename CT, typename CMP = std::less<T>>
+class flat_counter
+	: boost::arithmetic<flat_counter<T, CT, CMP>>
+	, boost::arithmetic2<flat_counter<T, CT, CMP>, CT>
+	, boost::equality_comparable<flat_counter<T, CT, CMP>>
+{
+public:
+	typedef std::pair<T, CT> value_type;
+	typedef std::vector<value_type> storage_type;
+	typedef typename storage_type::const_iterator const_iterator;
+	typedef const_iterator iterator;
+	typedef Counter<T, CT, CMP> counter_type;
+
+	flat_counter(const CMP& cmp = CMP()) : _cmp(cmp) {}
+
+	template<typename IT>
+	flat_counter(IT from, IT to)
+	{
+		add_range(from, to);
+	}
+
+	template<typename Container>
+	flat_counter(const Container& c)
+	{
+		add_range(c.begin(), c.end());
+	}
+
+	flat_counter(const std::initializer_list<value_type>& il)
+	{
+		for (const auto& v : il)
+			this->operator[](v.first) = v.second;
+	}
+
+	//! Copy of a Counter, whose keys are already in order
+	flat_counter(const counter_type& c)
+		: _data(c.begin(), c.end()), _cmp(c.key_comp()) {}
+
+	counter_type to_counter() const
+	{
+		counter_type res;
+		for (const auto& v : _data)
+			res.emplace_hint(res.end(), v.first, v.second);
+		return res;
+	}
+
+	const_iterator begin() const { return _data.begin(); }
+	const_iterator end() const { return _data.end(); }
+	size_t size() const { return _data.size(); }
+	bool empty() const { return _data.empty(); }
+	void clear() { _data.clear(); }
+	void reserve(size_t n) { _data.reserve(n); }
+	const CMP& key_comp() const { return _cmp; }
+
+	const_iterator find(const T& key) const
+	{
+		auto it = lower_bound(key);
+		return it != _data.end() and not _cmp(key, it->first) ?
+			const_iterator(it) : end();
+	}
+
+	size_t count(const T& key) const { return find(key) != end(); }
+
+	//! Remove a key; returns the number of keys removed (0 or 1)
+	size_t erase(const T& key)
+	{
+		auto it = lower_bound(key);
+		if (it == _data.end() or _cmp(key, it->first)) return 0;
+		_data.erase(it);
+		return 1;
+	}
+
+	//! Count of a key, inserting it with a count of CT() if absent
+	CT& operator[](const T& key)
+	{
+		auto it = lower_bound(key);
+		if (it == _data.end() or _cmp(key, it->first))
+			it = _data.insert(it, value_type(key, CT()));
+		return it->second;
+	}
+
+	//! Return the count of a key, or c if it is absent (without
+	//! inserting it)
+	CT get(const T& key, CT c = CT()) const
+	{
+		auto it = find(key);
+		return it == end() ? c : it->second;
+	}
+
+	//! Count each element of [from, to) once more
+	template<typename IT>
+	void add_range(IT from, IT to)
+	{
+		// Elements whose key is already in are counted in place;
+		// the others are set aside, then sorted and merged in by
+		// batches, the batches growing with the counter so that the
+		// merges stay linear overall.
+		std::vector<T> misses;
+		for (; from != to; ++from) {
+			auto it = lower_bound(*from);
+			if (it != _data.end() and not _cmp(*from, it->first))
+				it->second += 1;
+			else {
+				misses.push_back(*from);
+				if (misses.size() >= std::max<size_t>(64, _data.size()))
+					merge_keys(misses);
+			}
+		}
+		merge_keys(misses);
+	}
+
+	//! Return the total of all counted elements
+	CT total_count() const
+	{
+		CT res = 0;
+		for (const auto& v : _data)
+			res += v.second;
+		return res;
+	}
+
+	//! Return the mode, the element that occurs most frequently
+	T mode() const
+	{
+		auto best = _data.begin();
+		for (auto it = _data.begin(); it != _data.end(); ++it)
+			if (best->second < it->second)
+				best = it;
+		return best->first;
+	}
+
+	//! Return all keys, in order
+	std::vector<T> keys() const
+	{
+		std::vector<T> ks;
+		ks.reserve(_data.size());
+		for (const auto& v : _data)
+			ks.push_back(v.first);
+		return ks;
+	}
+
+	/* Counter operators, with the same results as those of Counter:
+	 * c1 = {'a':1, 'b':2}
+	 * c2 = {'b':2, 'c':3}
+	 *
+	 * c1 + c2 = {'a':1, 'b':4, 'c':3}
+	 * c1 - c2 = {'a':1, 'b':0, 'c':-3}
+	 * c1 * c2 = {'a':0, 'b':4, 'c':0}
+	 * c1 / c2 = {'a':1, 'b':1, 'c':0}
+	 */
+	flat_counter& operator+=(const flat_counter& other) {
+		merge(other, [](const CT& a, const CT& b) { return a + b; },
+		      [](const CT& a) { return a; });
+		return *this;
+	}
+
+	flat_counter& operator-=(const flat_counter& other) {
+		merge(other, [](const CT& a, const CT& b) { return a - b; },
+		      [](const CT& a) { return a; });
+		return *this;
+	}
+
+	flat_counter& operator*=(const flat_counter& other) {
+		merge(other, [](const CT& a, const CT& b) { return a * b; },
+		      [](const CT&) { return CT(); });
+		return *this;
+	}
+
+	flat_counter& operator/=(const flat_counter& other) {
+		merge(other, [](const CT& a, const CT& b) { return a / b; },
+		      [](const CT& a) { return a; });
+		return *this;
+	}
+
+	flat_counter& operator+=(const CT& num) {
+		for (auto& v : _data)
+			v.second += num;
+		return *this;
+	}
+
+	flat_counter& operator-=(const CT& num) {
+		for (auto& v : _data)
+			v.second -= num;
+		return *this;
+	}
+
+	flat_counter& operator*=(const CT& num) {
+		for (auto& v : _data)
+			v.second *= num;
+		return *this;
+	}
+
+	flat_counter& operator/=(const CT& num) {
+		for (auto& v : _data)
+			v.second /= num;
+		return *this;
+	}
+
+	bool operator==(const flat_counter& other) const {
+		return _data == other._data;
+	}
+
+protected:
+	storage_type _data;
+	CMP _cmp;
+
+	typename storage_type::iterator lower_bound(const T& key)
+	{
+		return std::lower_bound(_data.begin(), _data.end(), key,
+		                        [this](const value_type& v, const T& k) {
+			                        return _cmp(v.first, k); });
+	}
+
+	typename storage_type::const_iterator lower_bound(const T& key) const
+	{
+		return std::lower_bound(_data.begin(), _data.end(), key,
+		                        [this](const value_type& v, const T& k) {
+			                        return _cmp(v.first, k); });
+	}
+
+	// Count the keys of ks once more, and empty ks.
+	void merge_keys(std::vector<T>& ks)
+	{
+		std::sort(ks.begin(), ks.end(), _cmp);
+		flat_counter other(_cmp);
+		for (auto it = ks.begin(); it != ks.end();) {
+			auto next = it + 1;
+			while (next != ks.end() and not _cmp(*it, *next)) ++next;
+			CT c = CT();
+			//we don't use ++ to put the least assumption on on CT
+			for (auto s = it; s != next; ++s) c += 1;
+			other._data.emplace_back(*it, c);
+			it = next;
+		}
+		*this += other;
+		ks.clear();
+	}
+
+	/**
+	 * Merge the keys of other in, in one pass over both arrays: the
+	 * counts of keys of both become both(mine, theirs), those only in
+	 * other both(CT(), theirs), and those only in this mine_only(mine).
+	 */
+	template<typename Both, typename MineOnly>
+	void merge(const flat_counter& other, Both both, MineOnly mine_only)
+	{
+		storage_type res;
+		res.reserve(_data.size() + other._data.size());
+		auto it = _data.begin();
+		auto oit = other._data.begin();
+		while (it != _data.end() and oit != other._data.end()) {
+			if (_cmp(it->first, oit->first)) {
+				res.emplace_back(it->first, mine_only(it->second));
+				++it;
+			} else if (_cmp(oit->first, it->first)) {
+				res.emplace_back(oit->first, both(CT(), oit->second));
+				++oit;
+			} else {
+				res.emplace_back(it->first, both(it->second, oit->second));
+				++it;
+				++oit;
+			}
+		}
+		for (; it != _data.end(); ++it)
+			res.emplace_back(it->first, mine_only(it->second));
+		for (; oit != other._data.end(); ++oit)
+			res.emplace_back(oit->first, both(CT(), oit->second));
+		_data.swap(res);
+	}
+};
+
+template<typename T, typename CT, typename CMP = std::less<T>>
+std::ostream& operator<<(std::ostream& out, const flat_counter<T, CT, CMP>& c)
+{
+	out << "{";
+	for (auto it = c.begin(); it != c.end();) {
+		out << it->first << ": " << it->second;
+		++it;
+		if (it != c.end())
+			out << ", ";
+	}
+	out << "}";
+	return out;
+}
+
+/** @}*/
+} // ~namespace opencog
+
+#endif // _OPENCOG_FLAT_COUNTER_H
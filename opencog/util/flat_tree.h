@@ -0,0 +1,254 @@
+/*
+ * opencog/util/flat_tree.h
+ *
+ * A frozen tree, flattened into contiguous arrays.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_FLAT_TREE_H
+#define _OPENCOG_FLAT_TREE_H
+
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/util/tree.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! An immutable tree, stored in pre-order in one contiguous array.
+///
+/// Each node is named by its index in the pre-order walk. Alongside
+/// the data, two parallel arrays hold the number of children of each
+/// node, and the number of nodes in the subtree rooted at it (itself
+/// included). So the first child of node i, if any, is i+1, and the
+/// next sibling of node i is i + subtree_size(i). A pre-order walk is
+/// a plain walk over the array, and a sibling walk just hops forwards;
+/// neither ever chases a pointer.
+///
+/// Like tree, a flat_tree may hold a forest: the top-level nodes are
+/// the siblings starting at index 0.
+///
+/// Use this for trees that are built once, and are then evaluated,
+/// compared or hashed many times. Convert to a tree to modify them.
+template<typename T>
+class flat_tree
+{
+public:
+    typedef T value_type;
+    typedef uint32_t index_type;
+
+    /// Pre-order iteration is iteration over the data array.
+    typedef typename std::vector<T>::const_iterator pre_order_iterator;
+    typedef pre_order_iterator iterator;
+
+    //! Walks a run of siblings, yielding their indexes.
+    class sibling_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef index_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const index_type* pointer;
+        typedef const index_type& reference;
+
+        sibling_iterator() : _sizes(nullptr), _node(0) {}
+        sibling_iterator(const index_type* sizes, index_type node)
+            : _sizes(sizes), _node(node) {}
+
+        const index_type& operator*() const { return _node; }
+        sibling_iterator& operator++()
+        { _node += _sizes[_node]; return *this; }
+        sibling_iterator operator++(int)
+        { sibling_iterator tmp(*this); ++*this; return tmp; }
+        bool operator==(const sibling_iterator& other) const
+        { return _node == other._node; }
+        bool operator!=(const sibling_iterator& other) const
+        { return _node != other._node; }
+
+    private:
+        const index_type* _sizes;
+        index_type _node;
+    };
+
+    //! A range of siblings, for use in range-for loops.
+    struct sibling_range
+    {
+        sibling_iterator first, last;
+        sibling_iterator begin() const { return first; }
+        sibling_iterator end() const { return last; }
+    };
+
+    flat_tree() {}
+
+    /// Flatten the tree.
+    template<typename Alloc>
+    explicit flat_tree(const tree<T, Alloc>& tr)
+    {
+        size_t n = tr.size();
+        _data.reserve(n);
+        _arity.reserve(n);
+        _size.reserve(n);
+        for (auto sib = tr.begin(); sib != tr.end(); sib = tr.next_sibling(sib))
+            flatten(sib);
+    }
+
+    /// Rebuild an ordinary tree, with the same shape and data.
+    template<typename Alloc = std::allocator<tree_node_<T>>>
+    tree<T, Alloc> to_tree() const
+    {
+        tree<T, Alloc> tr;
+        if (empty()) return tr;
+
+        typedef typename tree<T, Alloc>::pre_order_iterator tree_it;
+        std::vector<tree_it> parents(size());
+        for (index_type i : roots())
+        {
+            tree_it it = tr.insert(tr.end(), _data[i]);
+            parents[i] = it;
+            unflatten(tr, i, parents);
+        }
+        return tr;
+    }
+
+    size_t size() const { return _data.size(); }
+    bool empty() const { return _data.empty(); }
+
+    /// The data, and the shape, of node i.
+    const T& operator[](index_type i) const { return _data[i]; }
+    const T& data(index_type i) const { return _data[i]; }
+    index_type arity(index_type i) const { return _arity[i]; }
+    index_type subtree_size(index_type i) const { return _size[i]; }
+    bool is_leaf(index_type i) const { return 0 == _arity[i]; }
+
+    /// The first child of node i; only valid if i is not a leaf.
+    index_type first_child(index_type i) const { return i + 1; }
+
+    /// The next sibling of node i; equal to the index one past the end
+    /// of the parent's subtree, if i is the last child.
+    index_type next_sibling(index_type i) const { return i + _size[i]; }
+
+    /// The children of node i.
+    sibling_range children(index_type i) const
+    {
+        return {sibling_iterator(_size.data(), i + 1),
+                sibling_iterator(_size.data(), i + _size[i])};
+    }
+
+    /// The top-level nodes.
+    sibling_range roots() const
+    {
+        return {sibling_iterator(_size.data(), 0),
+                sibling_iterator(_size.data(), size())};
+    }
+
+    /// Walk all of the data, in pre-order.
+    pre_order_iterator begin() const { return _data.begin(); }
+    pre_order_iterator end() const { return _data.end(); }
+
+    /// Walk the data of the subtree rooted at node i, in pre-order.
+    pre_order_iterator begin(index_type i) const { return _data.begin() + i; }
+    pre_order_iterator end(index_type i) const { return _data.begin() + i + _size[i]; }
+
+    /// Copy out the subtree rooted at node i.
+    flat_tree subtree(index_type i) const
+    {
+        if (size() <= i)
+            throw IndexErrorException(TRACE_INFO,
+                "flat_tree - node %u out of range.", i);
+        flat_tree ft;
+        ft._data.assign(_data.begin() + i, _data.begin() + i + _size[i]);
+        ft._arity.assign(_arity.begin() + i, _arity.begin() + i + _size[i]);
+        ft._size.assign(_size.begin() + i, _size.begin() + i + _size[i]);
+        return ft;
+    }
+
+    bool operator==(const flat_tree& other) const
+    {
+        return _size == other._size and _arity == other._arity
+            and _data == other._data;
+    }
+    bool operator!=(const flat_tree& other) const
+    { return not (*this == other); }
+
+private:
+    std::vector<T> _data;
+    std::vector<index_type> _arity;
+    std::vector<index_type> _size;
+
+    template<typename Iter>
+    void flatten(Iter top)
+    {
+        // Iterative, so that very deep trees do not blow the stack.
+        // Each node is written when first seen; its subtree size is
+        // patched in once its last descendant has been written.
+        typedef tree_node_<T> node;
+        std::vector<std::pair<node*, index_type>> stack;
+        stack.emplace_back(top.node, 0);
+        while (not stack.empty())
+        {
+            node* n = stack.back().first;
+            if (n != nullptr)
+            {
+                index_type i = _data.size();
+                _data.push_back(n->data);
+                _arity.push_back(0);
+                _size.push_back(0);
+                stack.back().second = i;
+                stack.back().first = nullptr;
+
+                // Push the children in reverse, to pop them in order.
+                for (node* c = n->last_child; c; c = c->prev_sibling)
+                {
+                    _arity[i]++;
+                    stack.emplace_back(c, 0);
+                }
+            }
+            else
+            {
+                index_type i = stack.back().second;
+                _size[i] = _data.size() - i;
+                stack.pop_back();
+            }
+        }
+    }
+
+    template<typename Tree, typename Parents>
+    void unflatten(Tree& tr, index_type top, Parents& parents) const
+    {
+        // The nodes of the subtree are in pre-order, so the parent of
+        // each one has already been inserted. Track the open ancestors
+        // on a stack, popping those whose subtree has been finished.
+        std::vector<index_type> open{top};
+        for (index_type i = top + 1; i < top + _size[top]; i++)
+        {
+            while (open.back() + _size[open.back()] <= i) open.pop_back();
+            parents[i] = tr.append_child(parents[open.back()], _data[i]);
+            if (0 < _arity[i]) open.push_back(i);
+        }
+    }
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_FLAT_TREE_H
@@ -23,7 +23,16 @@
 #ifndef _OPENCOG_HASHING_H
 #define _OPENCOG_HASHING_H
 
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
 #include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <opencog/util/tree.h>
 
@@ -64,12 +73,442 @@ struct deref_equals {
     Equals equals;
 };
 
+//! Fast, non-cryptographic hashing: wyhash.
+/**
+ * boost::hash of an integer is the integer itself, which makes poor
+ * buckets for keys with a pattern (multiples of a power of 2, say),
+ * and boost::hash of a string combines its characters one at a time,
+ * which is slow. hash_bytes() hashes 16 to 48 bytes per step, with
+ * 64x128-bit multiplications, and each bit of its output depends on
+ * all bits of the input.
+ *
+ * The hashes depend on the byte order of the machine, and are not
+ * meant to be stored, or resist inputs chosen to collide (a seed may
+ * be given, though).
+ */
+namespace wyhash {
+
+const uint64_t secret[4] = { 0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL,
+                             0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL };
+
+//! The low and high halves of the 128-bit product of a and b.
+inline void mum(uint64_t& a, uint64_t& b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = __uint128_t(a) * b;
+    a = uint64_t(r);
+    b = uint64_t(r >> 64);
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = uint32_t(a), lb = uint32_t(b);
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    a = lo;
+    b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+inline uint64_t mix(uint64_t a, uint64_t b)
+{
+    mum(a, b);
+    return a ^ b;
+}
+
+inline uint64_t read8(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint64_t read4(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+// 1 to 3 bytes
+inline uint64_t read3(const uint8_t* p, size_t k)
+{
+    return (uint64_t(p[0]) << 16) | (uint64_t(p[k >> 1]) << 8) | p[k - 1];
+}
+
+} // ~namespace wyhash
+
+//! Hash of the len bytes at key.
+inline uint64_t hash_bytes(const void* key, size_t len, uint64_t seed = 0)
+{
+    using namespace wyhash;
+    const uint8_t* p = static_cast<const uint8_t*>(key);
+    seed ^= mix(seed ^ secret[0], secret[1]);
+    uint64_t a, b;
+    if (len <= 16)
+    {
+        if (len >= 4)
+        {
+            a = (read4(p) << 32) | read4(p + ((len >> 3) << 2));
+            b = (read4(p + len - 4) << 32)
+                | read4(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if (len > 0)
+        {
+            a = read3(p, len);
+            b = 0;
+        }
+        else a = b = 0;
+    }
+    else
+    {
+        size_t i = len;
+        if (i > 48)
+        {
+            // Three independent lanes
+            uint64_t see1 = seed, see2 = seed;
+            do
+            {
+                seed = mix(read8(p) ^ secret[1], read8(p + 8) ^ seed);
+                see1 = mix(read8(p + 16) ^ secret[2], read8(p + 24) ^ see1);
+                see2 = mix(read8(p + 32) ^ secret[3], read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            }
+            while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16)
+        {
+            seed = mix(read8(p) ^ secret[1], read8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read8(p + i - 16);
+        b = read8(p + i - 8);
+    }
+    a ^= secret[1];
+    b ^= seed;
+    mum(a, b);
+    return mix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+//! Hash of a 64-bit value; cheaper than hash_bytes(&x, 8).
+inline uint64_t hash_u64(uint64_t x, uint64_t seed = 0)
+{
+    uint64_t a = x ^ wyhash::secret[0], b = seed ^ wyhash::secret[1];
+    wyhash::mum(a, b);
+    return wyhash::mix(a ^ wyhash::secret[0], b ^ wyhash::secret[1]);
+}
+
+//! The hash of a sequence, from the hash of what precedes (seed) and
+//! that of the next element. Unlike hash_u64(seed ^ h), the order of
+//! the elements matters.
+inline uint64_t hash_combine_fast(uint64_t seed, uint64_t h)
+{
+    return wyhash::mix(seed ^ wyhash::secret[2], h ^ wyhash::secret[3]);
+}
+
+//! Functor hashing with hash_bytes() and hash_u64().
+/**
+ * It may be given as the Hash of the containers and caches (see
+ * lru_cache.h) in place of boost::hash. It is defined for
+ *  - integers, enums and pointers;
+ *  - float and double (with 0.0 and -0.0 hashed the same);
+ *  - std::string, std::string_view, and the vectors of integers
+ *    (hashed as one range of bytes);
+ *  - the other trivially copyable types without padding (such as
+ *    structs of ints) as their bytes;
+ *  - std::pair, std::vector of any hashable type, and tree (see
+ *    below), element by element.
+ * Types with padding are left out: their padding bytes may differ
+ * between equal values. Specialize it for other types.
+ */
+template<typename T, typename Enable = void>
+struct fast_hash;
+
 template<typename T>
-std::size_t hash_value(const tree<T>& tr)
+struct fast_hash<T, typename std::enable_if<std::is_integral<T>::value
+                                            or std::is_enum<T>::value
+                                            or std::is_pointer<T>::value>::type>
+{
+    size_t operator()(T x) const
+    {
+        uint64_t u;
+        if constexpr (std::is_pointer<T>::value)
+            u = reinterpret_cast<uintptr_t>(x);
+        else
+            u = uint64_t(x);
+        return hash_u64(u);
+    }
+};
+
+template<typename T>
+struct fast_hash<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+    size_t operator()(T x) const
+    {
+        if (x == 0) x = 0;      // -0.0 == 0.0
+        return hash_bytes(&x, sizeof(T));
+    }
+};
+
+template<typename T>
+struct fast_hash<T, typename std::enable_if<
+                        std::is_class<T>::value
+                        and std::is_trivially_copyable<T>::value
+                        and std::has_unique_object_representations<T>::value>::type>
+{
+    size_t operator()(const T& x) const
+    {
+        return hash_bytes(&x, sizeof(T));
+    }
+};
+
+template<>
+struct fast_hash<std::string_view>
+{
+    size_t operator()(std::string_view s) const
+    {
+        return hash_bytes(s.data(), s.size());
+    }
+};
+
+template<>
+struct fast_hash<std::string>
+{
+    size_t operator()(const std::string& s) const
+    {
+        return hash_bytes(s.data(), s.size());
+    }
+};
+
+template<typename A, typename B>
+struct fast_hash<std::pair<A, B>, typename std::enable_if<
+                     not std::has_unique_object_representations<
+                         std::pair<A, B>>::value>::type>
+{
+    size_t operator()(const std::pair<A, B>& p) const
+    {
+        return hash_combine_fast(fast_hash<A>()(p.first),
+                                 fast_hash<B>()(p.second));
+    }
+};
+
+template<typename T, typename Alloc>
+struct fast_hash<std::vector<T, Alloc>>
+{
+    size_t operator()(const std::vector<T, Alloc>& v) const
+    {
+        if constexpr (std::is_integral<T>::value
+                      and std::has_unique_object_representations<T>::value)
+            return hash_bytes(v.data(), v.size() * sizeof(T));
+        else
+        {
+            uint64_t seed = v.size();
+            fast_hash<T> hash;
+            for (const T& x : v) seed = hash_combine_fast(seed, hash(x));
+            return seed;
+        }
+    }
+};
+
+namespace detail {
+
+// Merkle hash of the subtree rooted at top: each node hashes its own
+// data, its arity, and the hashes of its children, in order. So trees
+// of different shapes get different hashes, even when they have the
+// same nodes in pre-order. Iterative, so that deep trees do not blow
+// the stack. If a cache is given, hashes found in it are used as is,
+// and those that are computed are added to it.
+template<typename T, typename Hash, typename Cache>
+std::size_t merkle_hash(const tree_node_<T>* top, const Hash& hash, Cache* cache)
+{
+    typedef tree_node_<T> node;
+    std::vector<std::pair<const node*, bool>> todo{{top, false}};
+    std::vector<std::size_t> done;
+    while (not todo.empty())
+    {
+        const node* n = todo.back().first;
+        if (not todo.back().second)
+        {
+            if (cache)
+            {
+                auto it = cache->find(n);
+                if (it != cache->end())
+                {
+                    done.push_back(it->second);
+                    todo.pop_back();
+                    continue;
+                }
+            }
+            todo.back().second = true;
+            for (const node* c = n->last_child; c; c = c->prev_sibling)
+                todo.emplace_back(c, false);
+            continue;
+        }
+        todo.pop_back();
+
+        std::size_t arity = 0;
+        for (const node* c = n->first_child; c; c = c->next_sibling) arity++;
+        std::size_t seed = hash(n->data);
+        boost::hash_combine(seed, arity);
+        for (std::size_t i = done.size() - arity; i < done.size(); i++)
+            boost::hash_combine(seed, done[i]);
+        done.resize(done.size() - arity);
+        done.push_back(seed);
+        if (cache) cache->emplace(n, seed);
+    }
+    return done.back();
+}
+
+template<typename Tree, typename Subtree>
+std::size_t forest_hash(const Tree& tr, const Subtree& subtree)
+{
+    std::size_t seed = 0;
+    for (auto sib = tr.begin(); sib != tr.end(); sib = tr.next_sibling(sib))
+        boost::hash_combine(seed, subtree(sib));
+    return seed;
+}
+
+} // ~namespace detail
+
+//! Structural hash of a subtree, see tree_hasher.
+template<typename It, typename Hash = boost::hash<typename It::value_type>>
+std::size_t subtree_hash(It it, const Hash& hash = Hash())
 {
-    return boost::hash_range(tr.begin(), tr.end());
+    typedef typename It::value_type T;
+    return detail::merkle_hash<T, Hash,
+        boost::unordered_map<const tree_node_<T>*, std::size_t>>(it.node, hash, nullptr);
 }
 
+template<typename T, typename Alloc>
+std::size_t hash_value(const tree<T, Alloc>& tr)
+{
+    return detail::forest_hash(tr, [](const typename tree<T, Alloc>::iterator_base& it)
+                                   { return subtree_hash(it); });
+}
+
+//! Same as hash_value(tr), with the node data hashed by hash (such as
+//! fast_hash<T>) rather than boost::hash.
+template<typename T, typename Alloc, typename Hash>
+std::size_t hash_value(const tree<T, Alloc>& tr, const Hash& hash)
+{
+    return detail::forest_hash(tr, [&hash](const typename tree<T, Alloc>::iterator_base& it)
+                                   { return subtree_hash(it, hash); });
+}
+
+//! Trees, by their structure, with the data of their nodes hashed by
+//! fast_hash<T>.
+template<typename T, typename Alloc>
+struct fast_hash<tree<T, Alloc>>
+{
+    size_t operator()(const tree<T, Alloc>& tr) const
+    {
+        return hash_value(tr, fast_hash<T>());
+    }
+};
+
+//! Hashes trees by their structure, remembering the hash of every
+//! subtree it has seen.
+/**
+ * The hash of a node combines its data, its arity and the hashes of
+ * its children (a Merkle hash), so it is the same as subtree_hash(),
+ * and hash_value() for a whole tree. Hashing a subtree that has
+ * already been hashed is a single lookup; hashing a tree after a
+ * change re-hashes only the nodes on the path from the change up to
+ * the root.
+ *
+ * The cache is keyed by node address, so the hasher has to be told
+ * about changes. Either make them through the append_child(),
+ * replace() and erase() below, or call invalidate(it) after changing
+ * the node at it (or its children), and forget(it) before erasing the
+ * subtree at it. A hasher must not outlive the trees it has hashed,
+ * unless clear() is called first.
+ */
+template<typename T, typename Hash = boost::hash<T>>
+class tree_hasher
+{
+    typedef tree_node_<T> node;
+    typedef boost::unordered_map<const node*, std::size_t> cache_map;
+
+    Hash _hash;
+    mutable cache_map _cache;
+
+public:
+    tree_hasher(const Hash& h = Hash()) : _hash(h) {}
+
+    /// Hash of the whole tree; equal to hash_value(tr).
+    template<typename Alloc>
+    std::size_t operator()(const tree<T, Alloc>& tr) const
+    {
+        return detail::forest_hash(tr, [this](const typename tree<T, Alloc>::iterator_base& it)
+                                       { return (*this)(it); });
+    }
+
+    /// Hash of the subtree at it; equal to subtree_hash(it).
+    template<typename It>
+    std::size_t operator()(const It& it) const
+    {
+        return detail::merkle_hash<T>(it.node, _hash, &_cache);
+    }
+
+    /// The node at it, or its children, have changed: drop the cached
+    /// hashes of it and its ancestors.
+    template<typename It>
+    void invalidate(const It& it)
+    {
+        for (const node* n = it.node; n; n = n->parent)
+            if (0 == _cache.erase(n)) break;
+    }
+
+    /// The subtree at it is about to be erased: drop the cached hashes
+    /// of all its nodes, and those of its ancestors.
+    template<typename It>
+    void forget(const It& it)
+    {
+        std::vector<const node*> todo{it.node};
+        while (not todo.empty())
+        {
+            const node* n = todo.back();
+            todo.pop_back();
+            _cache.erase(n);
+            for (const node* c = n->first_child; c; c = c->next_sibling)
+                todo.push_back(c);
+        }
+        for (const node* n = it.node->parent; n; n = n->parent)
+            if (0 == _cache.erase(n)) break;
+    }
+
+    /// Same as tr.append_child(parent, x), keeping the cache up to date.
+    template<typename Alloc, typename It>
+    It append_child(tree<T, Alloc>& tr, It parent, const T& x)
+    {
+        invalidate(parent);
+        return tr.append_child(parent, x);
+    }
+
+    /// Same as tr.replace(position, x), keeping the cache up to date.
+    template<typename Alloc, typename It>
+    It replace(tree<T, Alloc>& tr, It position, const T& x)
+    {
+        invalidate(position);
+        return tr.replace(position, x);
+    }
+
+    /// Same as tr.erase(position), keeping the cache up to date.
+    template<typename Alloc, typename It>
+    It erase(tree<T, Alloc>& tr, It position)
+    {
+        forget(position);
+        return tr.erase(position);
+    }
+
+    void clear() { _cache.clear(); }
+
+    /// Number of subtree hashes currently cached.
+    std::size_t cached() const { return _cache.size(); }
+};
+
 //! Functor comparing the addresses of objects pointed by
 //! tree iterators.
 /**
@@ -0,0 +1,545 @@
+/*
+ * opencog/util/hnsw.h
+ *
+ * Approximate nearest neighbor search over a navigable small world
+ * graph.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_HNSW_H
+#define _OPENCOG_HNSW_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/util/oc_assert.h>
+#include <opencog/util/oc_omp.h>
+#include <opencog/util/rng_engines.h>
+
+namespace opencog {
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! Approximate k-nearest-neighbor index, for points of many dimensions
+/**
+ * A hierarchical navigable small world graph (Malkov and Yashunin,
+ * "Efficient and robust approximate nearest neighbor search using
+ * Hierarchical Navigable Small World graphs", 2016). Where the search
+ * of a CoverTree degrades to brute force as the dimension grows, this
+ * one stays logarithmic, at the price of an occasional miss.
+ *
+ * Points follow the same concept as in Cover_Tree.h: Point must have a
+ * double Point::distance(const Point&) const, a metric (or close to
+ * one). The index does not copy the points, it refers to them by their
+ * position in the array given at construction, which must outlive it.
+ *
+ * The recall/latency knob is ef, the number of candidates a search
+ * keeps (at least k): raising it finds more of the true neighbors, in
+ * proportion more time. The quality of the graph itself is set at
+ * build time by M and ef_construction.
+ *
+ * The build inserts the points in parallel, with the threads set by
+ * setting_omp(). Queries may run concurrently.
+ *
+ * save() writes the graph (not the points) to a file, which the
+ * loading constructor maps in memory rather than reads: a process
+ * opens an index in constant time, and processes mapping the same
+ * file share its pages. The file is in the byte order of the machine
+ * that wrote it.
+ */
+template<class Point>
+class hnsw_index
+{
+public:
+    typedef uint32_t id_type;
+    //! A neighbor: its distance to the query, and its index in points
+    typedef std::pair<double, id_type> result_type;
+
+    struct params
+    {
+        //! Links per node and level; twice as many on level 0
+        unsigned M = 16;
+        //! Candidates kept while inserting a point
+        unsigned ef_construction = 200;
+        //! Default candidates kept by a query (see set_ef())
+        unsigned ef_search = 64;
+        //! Seed of the draw of the node levels
+        uint64_t seed = 0;
+    };
+
+    //! Index points[0, n)
+    hnsw_index(const Point* points, size_t n, const params& p = params())
+        : _points(points), _n(n), _M(p.M), _M0(2 * p.M),
+          _ef(p.ef_search), _efc(p.ef_construction), _map(NULL)
+    {
+        OC_ASSERT(_M >= 2, "hnsw_index - M must be at least 2");
+        OC_ASSERT(_n < UINT32_MAX, "hnsw_index - too many points");
+        build(p.seed);
+    }
+
+    hnsw_index(const std::vector<Point>& points, const params& p = params())
+        : hnsw_index(points.data(), points.size(), p) {}
+
+    //! Map the graph saved by save() in filename, over points[0, n),
+    //! the points it was built from.
+    hnsw_index(const std::string& filename, const Point* points, size_t n,
+               unsigned ef_search = params().ef_search)
+        : _points(points), _n(n), _ef(ef_search), _efc(0), _map(NULL)
+    {
+        map(filename);
+    }
+
+    hnsw_index(const std::string& filename, const std::vector<Point>& points,
+               unsigned ef_search = params().ef_search)
+        : hnsw_index(filename, points.data(), points.size(), ef_search) {}
+
+    hnsw_index(const hnsw_index&) = delete;
+    hnsw_index& operator=(const hnsw_index&) = delete;
+
+    ~hnsw_index()
+    {
+        if (_map) munmap(_map, _map_size);
+    }
+
+    size_t size() const { return _n; }
+
+    //! Set the number of candidates kept by queries
+    void set_ef(unsigned ef) { _ef = ef; }
+    unsigned ef() const { return _ef; }
+
+    //! The (approximately) k nearest points to q, nearest first, with
+    //! ef candidates (the default if 0, at least k).
+    std::vector<result_type> search(const Point& q, unsigned k,
+                                    unsigned ef = 0) const;
+
+    //! Same as CoverTree::k_nearest_neighbors, approximately, and
+    //! without ties beyond k.
+    std::vector<Point> k_nearest_neighbors(const Point& q, unsigned k) const
+    {
+        std::vector<Point> res;
+        for (const result_type& r : search(q, k))
+            res.push_back(_points[r.second]);
+        return res;
+    }
+
+    /**
+     * search() for each of the nq queries, in parallel, into
+     * caller-supplied arrays of nq*k entries: ids[i*k + j] is the
+     * j-th nearest point to queries[i], at distance dists[i*k + j]
+     * (unless dists is NULL). If the index has fewer than k points,
+     * the remaining entries are UINT32_MAX, at an infinite distance.
+     */
+    void search_batch(const Point* queries, size_t nq, unsigned k,
+                      id_type* ids, double* dists = NULL,
+                      unsigned ef = 0) const;
+
+    //! Write the graph to filename
+    void save(const std::string& filename) const;
+
+private:
+    const Point* _points;
+    size_t _n;
+    unsigned _M, _M0, _ef, _efc;
+    unsigned _max_level = 0;
+    id_type _entry = 0;
+
+    // Each node has a level; on level 0 a block of _M0 + 1 words (the
+    // number of links, then the links), and on each level above a
+    // block of _M + 1 words, those of node i starting at offset[i] in
+    // upper.
+    const uint32_t* _level;
+    const uint32_t* _offset;
+    const uint32_t* _links0;
+    const uint32_t* _upper;
+
+    // Storage, when built (rather than mapped)
+    std::vector<uint32_t> _level_v, _offset_v, _links0_v, _upper_v;
+    void* _map;
+    size_t _map_size = 0;
+
+    // Locks of the nodes while building, striped
+    std::unique_ptr<std::mutex[]> _locks;
+    static const size_t n_locks = 4096;
+    std::mutex _entry_mtx;
+
+    struct header
+    {
+        char magic[8];
+        uint64_t n, M, M0, max_level, entry, upper_size;
+    };
+
+    const uint32_t* links(id_type i, unsigned level) const
+    {
+        return level == 0 ? _links0 + size_t(i) * (_M0 + 1)
+            : _upper + _offset[i] + size_t(level - 1) * (_M + 1);
+    }
+    uint32_t* links(id_type i, unsigned level)
+    {
+        return const_cast<uint32_t*>(
+            static_cast<const hnsw_index*>(this)->links(i, level));
+    }
+
+    double dist(const Point& q, id_type i) const
+    {
+        return q.distance(_points[i]);
+    }
+
+    // The neighbors of i on level, copied into out under the lock of i
+    // if Locked (while building).
+    template<bool Locked>
+    void neighbors(id_type i, unsigned level,
+                   std::vector<id_type>& out) const
+    {
+        const uint32_t* l = links(i, level);
+        if (Locked) {
+            std::lock_guard<std::mutex> lock(_locks[i % n_locks]);
+            out.assign(l + 1, l + 1 + l[0]);
+        } else out.assign(l + 1, l + 1 + l[0]);
+    }
+
+    template<bool Locked>
+    id_type greedy(const Point& q, id_type ep,
+                   unsigned from, unsigned to) const;
+
+    template<bool Locked>
+    std::vector<result_type> search_layer(const Point& q, id_type ep,
+                                          unsigned ef, unsigned level) const;
+
+    std::vector<result_type> select(const std::vector<result_type>& cands,
+                                    unsigned m) const;
+
+    void build(uint64_t seed);
+    void insert(id_type i);
+    void map(const std::string& filename);
+};
+
+template<class Point>
+template<bool Locked>
+typename hnsw_index<Point>::id_type
+hnsw_index<Point>::greedy(const Point& q, id_type ep,
+                          unsigned from, unsigned to) const
+{
+    // Walk down from level from to level to (exclusive), each time
+    // to the nearest neighbor until none is nearer.
+    static thread_local std::vector<id_type> nbs;
+    double d = dist(q, ep);
+    for (unsigned level = from; level > to; level--) {
+        for (bool moved = true; moved;) {
+            moved = false;
+            neighbors<Locked>(ep, level, nbs);
+            for (id_type e : nbs) {
+                double de = dist(q, e);
+                if (de < d) {
+                    d = de;
+                    ep = e;
+                    moved = true;
+                }
+            }
+        }
+    }
+    return ep;
+}
+
+template<class Point>
+template<bool Locked>
+std::vector<typename hnsw_index<Point>::result_type>
+hnsw_index<Point>::search_layer(const Point& q, id_type ep, unsigned ef,
+                                unsigned level) const
+{
+    // The visited nodes are those marked with the current tag, so
+    // that the marks need no clearing between searches.
+    static thread_local std::vector<uint32_t> marks;
+    static thread_local uint32_t tag = 0;
+    static thread_local std::vector<id_type> nbs;
+    if (marks.size() < _n) marks.resize(_n, tag);
+    if (++tag == 0) {
+        std::fill(marks.begin(), marks.end(), 0);
+        tag = 1;
+    }
+
+    // candidates is a min-heap, found a max-heap of at most ef
+    std::priority_queue<result_type, std::vector<result_type>,
+                        std::greater<result_type>> candidates;
+    std::priority_queue<result_type> found;
+    result_type start(dist(q, ep), ep);
+    candidates.push(start);
+    found.push(start);
+    marks[ep] = tag;
+    while (!candidates.empty()) {
+        result_type c = candidates.top();
+        if (c.first > found.top().first) break;
+        candidates.pop();
+        neighbors<Locked>(c.second, level, nbs);
+        for (id_type e : nbs) {
+            if (marks[e] == tag) continue;
+            marks[e] = tag;
+            double d = dist(q, e);
+            if (found.size() < ef || d < found.top().first) {
+                candidates.emplace(d, e);
+                found.emplace(d, e);
+                if (found.size() > ef) found.pop();
+            }
+        }
+    }
+    std::vector<result_type> res(found.size());
+    for (size_t i = res.size(); i-- > 0; found.pop())
+        res[i] = found.top();
+    return res;
+}
+
+template<class Point>
+std::vector<typename hnsw_index<Point>::result_type>
+hnsw_index<Point>::select(const std::vector<result_type>& cands,
+                          unsigned m) const
+{
+    // The heuristic of the paper: keep a candidate only if it is
+    // nearer to the base than to any candidate kept, so that the
+    // links spread in all directions.
+    std::vector<result_type> res;
+    for (const result_type& c : cands) {
+        if (res.size() >= m) break;
+        bool keep = true;
+        for (const result_type& r : res)
+            if (_points[c.second].distance(_points[r.second]) < c.first) {
+                keep = false;
+                break;
+            }
+        if (keep) res.push_back(c);
+    }
+    return res;
+}
+
+template<class Point>
+void hnsw_index<Point>::build(uint64_t seed)
+{
+    // Levels, drawn from a geometric law of mean 1/ln(M), from the
+    // seed and the index of the point, so whatever the threads.
+    _level_v.resize(_n);
+    _offset_v.resize(_n);
+    const double ml = 1.0 / std::log(double(_M));
+    size_t upper_size = 0;
+    for (size_t i = 0; i < _n; i++) {
+        splitmix64 sm(seed ^ (i * 0xd1b54a32d192ed03ULL));
+        double u = ((sm() >> 11) + 1) * 0x1.0p-53;
+        _level_v[i] = std::min(unsigned(-std::log(u) * ml), 31u);
+        _offset_v[i] = upper_size;
+        upper_size += size_t(_level_v[i]) * (_M + 1);
+        OC_ASSERT(upper_size < UINT32_MAX, "hnsw_index - graph too large");
+    }
+    _links0_v.assign(_n * (_M0 + 1), 0);
+    _upper_v.assign(upper_size, 0);
+    _level = _level_v.data();
+    _offset = _offset_v.data();
+    _links0 = _links0_v.data();
+    _upper = _upper_v.data();
+    if (_n == 0) return;
+
+    _locks.reset(new std::mutex[n_locks]);
+    _entry = 0;
+    _max_level = _level[0];
+    long n = _n;
+#ifdef OC_OMP
+    #pragma omp parallel for schedule(dynamic, 64) num_threads(num_threads())
+#endif
+    for (long i = 1; i < n; i++)
+        insert(i);
+    _locks.reset();
+}
+
+template<class Point>
+void hnsw_index<Point>::insert(id_type i)
+{
+    const Point& q = _points[i];
+    const unsigned level = _level[i];
+    id_type ep;
+    unsigned top;
+    {
+        std::lock_guard<std::mutex> lock(_entry_mtx);
+        ep = _entry;
+        top = _max_level;
+    }
+
+    if (top > level) ep = greedy<true>(q, ep, top, level);
+    static thread_local std::vector<id_type> nbs;
+    for (unsigned l = std::min(top, level) + 1; l-- > 0;) {
+        const unsigned max_links = l == 0 ? _M0 : _M;
+        std::vector<result_type> found = search_layer<true>(q, ep, _efc, l);
+        std::vector<result_type> chosen = select(found, _M);
+        {
+            std::lock_guard<std::mutex> lock(_locks[i % n_locks]);
+            uint32_t* li = links(i, l);
+            li[0] = chosen.size();
+            for (size_t j = 0; j < chosen.size(); j++)
+                li[j + 1] = chosen[j].second;
+        }
+        // Link back, pruning the links of the neighbors that overflow
+        for (const result_type& c : chosen) {
+            std::lock_guard<std::mutex> lock(_locks[c.second % n_locks]);
+            uint32_t* le = links(c.second, l);
+            if (le[0] < max_links) {
+                le[++le[0]] = i;
+                continue;
+            }
+            const Point& e = _points[c.second];
+            std::vector<result_type> cands(1, result_type(c.first, i));
+            for (uint32_t j = 1; j <= le[0]; j++)
+                cands.emplace_back(e.distance(_points[le[j]]), le[j]);
+            std::sort(cands.begin(), cands.end());
+            std::vector<result_type> kept = select(cands, max_links);
+            le[0] = kept.size();
+            for (size_t j = 0; j < kept.size(); j++)
+                le[j + 1] = kept[j].second;
+        }
+        ep = found.front().second;
+    }
+
+    if (level > top) {
+        std::lock_guard<std::mutex> lock(_entry_mtx);
+        if (level > _max_level) {
+            _max_level = level;
+            _entry = i;
+        }
+    }
+}
+
+template<class Point>
+std::vector<typename hnsw_index<Point>::result_type>
+hnsw_index<Point>::search(const Point& q, unsigned k, unsigned ef) const
+{
+    if (_n == 0 || k == 0) return std::vector<result_type>();
+    ef = std::max(ef ? ef : _ef, k);
+    // The searches of a built index take no lock
+    id_type ep = greedy<false>(q, _entry, _max_level, 0);
+    std::vector<result_type> res = search_layer<false>(q, ep, ef, 0);
+    if (res.size() > k) res.resize(k);
+    return res;
+}
+
+template<class Point>
+void hnsw_index<Point>::search_batch(const Point* queries, size_t nq,
+                                     unsigned k, id_type* ids, double* dists,
+                                     unsigned ef) const
+{
+    long n = nq;
+#ifdef OC_OMP
+    #pragma omp parallel for schedule(dynamic, 16) num_threads(num_threads())
+#endif
+    for (long i = 0; i < n; i++) {
+        std::vector<result_type> res = search(queries[i], k, ef);
+        res.resize(k, result_type(HUGE_VAL, UINT32_MAX));
+        for (unsigned j = 0; j < k; j++) {
+            ids[i * k + j] = res[j].second;
+            if (dists) dists[i * k + j] = res[j].first;
+        }
+    }
+}
+
+template<class Point>
+void hnsw_index<Point>::save(const std::string& filename) const
+{
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw IOException(TRACE_INFO, "hnsw_index - cannot write %s",
+                          filename.c_str());
+    size_t upper_size = 0;
+    for (size_t i = 0; i < _n; i++)
+        upper_size += size_t(_level[i]) * (_M + 1);
+    header h;
+    std::memcpy(h.magic, "OCHNSW1", 8);
+    h.n = _n;
+    h.M = _M;
+    h.M0 = _M0;
+    h.max_level = _max_level;
+    h.entry = _entry;
+    h.upper_size = upper_size;
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    out.write(reinterpret_cast<const char*>(_level), _n * 4);
+    out.write(reinterpret_cast<const char*>(_offset), _n * 4);
+    out.write(reinterpret_cast<const char*>(_links0), _n * (_M0 + 1) * 4);
+    out.write(reinterpret_cast<const char*>(_upper), upper_size * 4);
+    if (!out)
+        throw IOException(TRACE_INFO, "hnsw_index - cannot write %s",
+                          filename.c_str());
+}
+
+template<class Point>
+void hnsw_index<Point>::map(const std::string& filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw IOException(TRACE_INFO, "hnsw_index - cannot open %s",
+                          filename.c_str());
+    struct stat st;
+    if (fstat(fd, &st) != 0 or size_t(st.st_size) < sizeof(header)) {
+        close(fd);
+        throw InconsistenceException(TRACE_INFO,
+            "hnsw_index - %s is not an index", filename.c_str());
+    }
+    _map_size = st.st_size;
+    _map = mmap(NULL, _map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (_map == MAP_FAILED) {
+        _map = NULL;
+        throw IOException(TRACE_INFO, "hnsw_index - cannot map %s",
+                          filename.c_str());
+    }
+
+    header h;
+    std::memcpy(&h, _map, sizeof(h));
+    size_t expected = sizeof(h) + (2 * h.n + h.n * (h.M0 + 1)
+                                   + h.upper_size) * 4;
+    if (std::memcmp(h.magic, "OCHNSW1", 8) != 0 or h.n != _n
+        or h.M0 != 2 * h.M or expected != _map_size) {
+        munmap(_map, _map_size);
+        _map = NULL;
+        throw InconsistenceException(TRACE_INFO,
+            "hnsw_index - %s is not an index of these %zu points",
+            filename.c_str(), _n);
+    }
+    _M = h.M;
+    _M0 = h.M0;
+    _max_level = h.max_level;
+    _entry = h.entry;
+    const uint32_t* words = reinterpret_cast<const uint32_t*>(
+        static_cast<const char*>(_map) + sizeof(h));
+    _level = words;
+    _offset = _level + _n;
+    _links0 = _offset + _n;
+    _upper = _links0 + _n * (_M0 + 1);
+}
+
+/** @}*/
+} // ~namespace opencog
+
+#endif // _OPENCOG_HNSW_H
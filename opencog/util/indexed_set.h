@@ -0,0 +1,68 @@
+/*
+ * opencog/util/indexed_set.h
+ *
+ * Sorted sets and maps with access by rank.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_INDEXED_SET_H
+#define _OPENCOG_INDEXED_SET_H
+
+#include <functional>
+
+#include <ext/pb_ds/assoc_container.hpp>
+#include <ext/pb_ds/tree_policy.hpp>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+/**
+ * A sorted set, like std::set, that also finds its n-th element, and
+ * the rank of a key, in O(log n): each node of the red-black tree keeps
+ * the size of its subtree (libstdc++'s order statistics tree).
+ *
+ * On top of the std::set interface (insert, erase, find, lower_bound,
+ * iterators...), it has
+ *
+ *     s.find_by_order(i)   // iterator to the i-th smallest element
+ *     s.order_of_key(k)    // number of elements less than k
+ *
+ * and rand_element() (see random.h) picks from it in O(log n) rather
+ * than the O(n) of std::advance on a std::set. Unlike std::set, there
+ * is no emplace, and insert only takes one element at a time.
+ */
+template<typename Key, typename Compare = std::less<Key>>
+using indexed_set =
+    __gnu_pbds::tree<Key, __gnu_pbds::null_type, Compare,
+                     __gnu_pbds::rb_tree_tag,
+                     __gnu_pbds::tree_order_statistics_node_update>;
+
+//! Same as indexed_set, as a map from Key to T; find_by_order(i)
+//! points to the pair of the i-th smallest key.
+template<typename Key, typename T, typename Compare = std::less<Key>>
+using indexed_map =
+    __gnu_pbds::tree<Key, T, Compare,
+                     __gnu_pbds::rb_tree_tag,
+                     __gnu_pbds::tree_order_statistics_node_update>;
+
+/** @}*/
+} // ~namespace opencog
+
+#endif // _OPENCOG_INDEXED_SET_H
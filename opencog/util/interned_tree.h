@@ -0,0 +1,317 @@
+/*
+ * opencog/util/interned_tree.h
+ *
+ * Hash-consed trees: identical subtrees are stored only once.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_INTERNED_TREE_H
+#define _OPENCOG_INTERNED_TREE_H
+
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/util/hashing.h>
+#include <opencog/util/tree.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+template<typename T, typename Hash> class interned_tree;
+
+//! A store of unique subtrees.
+///
+/// Each distinct subtree (same data, same children, in the same order)
+/// is stored exactly once, as its data plus the ids of its children,
+/// and is named by its id. Interning a tree interns its subtrees
+/// bottom-up, so any subtree that has been seen before is found, and
+/// shared, rather than stored again.
+///
+/// Nodes are hashed like subtree_hash() in hashing.h, so the hash of
+/// an interned subtree is the same as that of the original tree.
+///
+/// Subtrees are never removed, except all at once by clear(). The
+/// interner is not thread safe.
+template<typename T, typename Hash = boost::hash<T>>
+class tree_interner
+{
+public:
+    typedef uint32_t id_type;
+    typedef interned_tree<T, Hash> handle;
+
+    tree_interner(const Hash& h = Hash()) : _hash(h) {}
+
+    /// Intern the node with this data and these (interned) children.
+    id_type intern(const T& data, const std::vector<id_type>& children)
+    {
+        std::size_t h = node_hash(data, children.begin(), children.end());
+        id_type id;
+        if (lookup(h, data, children, id)) return id;
+        id = _nodes.size();
+        _nodes.push_back({data, children, h});
+        _index.emplace(h, id);
+        return id;
+    }
+
+    /// Intern the subtree of a tree<T> at it.
+    template<typename It>
+    id_type intern(const It& it)
+    {
+        id_type id;
+        bottom_up(it, id, [this](const T& data, const std::vector<id_type>& kids,
+                                 id_type& found) {
+            found = intern(data, kids);
+            return true;
+        });
+        return id;
+    }
+
+    /// Look for the subtree of a tree<T> at it, without interning it.
+    /// Return true, and set id, if it has been interned already.
+    template<typename It>
+    bool find(const It& it, id_type& id) const
+    {
+        return bottom_up(it, id, [this](const T& data, const std::vector<id_type>& kids,
+                                        id_type& found) {
+            return lookup(node_hash(data, kids.begin(), kids.end()), data, kids, found);
+        });
+    }
+
+    /// Intern a tree, which must have a single root.
+    template<typename Alloc>
+    handle operator()(const tree<T, Alloc>& tr)
+    {
+        if (tr.empty() or tr.begin().node->next_sibling != tr.end().node)
+            throw InconsistenceException(TRACE_INFO,
+                "tree_interner - can only intern a tree with exactly one root.");
+        return handle(this, intern(tr.begin()));
+    }
+
+    /// Rebuild the subtree with this id as an ordinary tree.
+    template<typename Alloc = std::allocator<tree_node_<T>>>
+    tree<T, Alloc> to_tree(id_type id) const
+    {
+        typedef typename tree<T, Alloc>::pre_order_iterator tree_it;
+        tree<T, Alloc> tr(_nodes[id].data);
+        std::vector<std::pair<tree_it, id_type>> todo{{tr.begin(), id}};
+        while (not todo.empty())
+        {
+            tree_it it = todo.back().first;
+            id_type i = todo.back().second;
+            todo.pop_back();
+            for (id_type c : _nodes[i].children)
+                todo.emplace_back(tr.append_child(it, _nodes[c].data), c);
+        }
+        return tr;
+    }
+
+    const T& data(id_type id) const { return _nodes[id].data; }
+    const std::vector<id_type>& children(id_type id) const
+    { return _nodes[id].children; }
+    std::size_t hash(id_type id) const { return _nodes[id].hash; }
+
+    /// Number of distinct subtrees stored.
+    std::size_t size() const { return _nodes.size(); }
+
+    /// Forget everything; all handles and ids become invalid.
+    void clear()
+    {
+        _nodes.clear();
+        _index.clear();
+    }
+
+private:
+    struct Node
+    {
+        T data;
+        std::vector<id_type> children;
+        std::size_t hash;
+    };
+
+    Hash _hash;
+    std::vector<Node> _nodes;
+    boost::unordered_multimap<std::size_t, id_type> _index;
+
+    // Post-order walk of the subtree at it, without recursion, calling
+    // f(data, children ids, id) to get the id of each node; done holds
+    // the ids of the children of the nodes still on the todo stack.
+    // Stops, returning false, as soon as f does.
+    template<typename It, typename F>
+    static bool bottom_up(const It& it, id_type& id, const F& f)
+    {
+        typedef tree_node_<T> node;
+        std::vector<std::pair<const node*, bool>> todo{{it.node, false}};
+        std::vector<id_type> done;
+        std::vector<id_type> kids;
+        while (not todo.empty())
+        {
+            const node* n = todo.back().first;
+            if (not todo.back().second)
+            {
+                todo.back().second = true;
+                for (const node* c = n->last_child; c; c = c->prev_sibling)
+                    todo.emplace_back(c, false);
+                continue;
+            }
+            todo.pop_back();
+
+            std::size_t arity = 0;
+            for (const node* c = n->first_child; c; c = c->next_sibling) arity++;
+            kids.assign(done.end() - arity, done.end());
+            done.resize(done.size() - arity);
+            id_type found;
+            if (not f(n->data, kids, found)) return false;
+            done.push_back(found);
+        }
+        id = done.back();
+        return true;
+    }
+
+    bool lookup(std::size_t h, const T& data,
+                const std::vector<id_type>& children, id_type& id) const
+    {
+        auto range = _index.equal_range(h);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            const Node& n = _nodes[it->second];
+            if (n.children == children and n.data == data)
+            {
+                id = it->second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Must match detail::merkle_hash() in hashing.h
+    template<typename It>
+    std::size_t node_hash(const T& data, It from, It to) const
+    {
+        std::size_t seed = _hash(data);
+        boost::hash_combine(seed, std::size_t(to - from));
+        for (; from != to; ++from)
+            boost::hash_combine(seed, _nodes[*from].hash);
+        return seed;
+    }
+};
+
+//! A handle on a subtree stored in a tree_interner.
+///
+/// Copying a handle is O(1), and so is comparing two handles from the
+/// same interner: equal subtrees have equal ids. The interner must
+/// outlive its handles.
+template<typename T, typename Hash = boost::hash<T>>
+class interned_tree
+{
+public:
+    typedef tree_interner<T, Hash> interner;
+    typedef typename interner::id_type id_type;
+
+    //! Walks the data of the subtree in pre-order, like the
+    //! pre_order_iterator of tree<T>.
+    class pre_order_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        pre_order_iterator() : _in(nullptr) {}
+        pre_order_iterator(const interner* in, id_type top) : _in(in), _todo{top} {}
+
+        const T& operator*() const { return _in->data(_todo.back()); }
+        const T* operator->() const { return &**this; }
+        pre_order_iterator& operator++()
+        {
+            id_type i = _todo.back();
+            _todo.pop_back();
+            const std::vector<id_type>& kids = _in->children(i);
+            _todo.insert(_todo.end(), kids.rbegin(), kids.rend());
+            return *this;
+        }
+        pre_order_iterator operator++(int)
+        { pre_order_iterator tmp(*this); ++*this; return tmp; }
+
+        // Only meaningful between iterators over the same subtree.
+        bool operator==(const pre_order_iterator& other) const
+        { return _todo == other._todo; }
+        bool operator!=(const pre_order_iterator& other) const
+        { return not (*this == other); }
+
+    private:
+        const interner* _in;
+        std::vector<id_type> _todo;
+    };
+    typedef pre_order_iterator iterator;
+
+    interned_tree() : _in(nullptr), _id(0) {}
+    interned_tree(const interner* in, id_type id) : _in(in), _id(id) {}
+
+    id_type id() const { return _id; }
+    const T& data() const { return _in->data(_id); }
+    std::size_t arity() const { return _in->children(_id).size(); }
+    bool is_leaf() const { return 0 == arity(); }
+    interned_tree child(std::size_t i) const
+    { return interned_tree(_in, _in->children(_id)[i]); }
+
+    pre_order_iterator begin() const { return pre_order_iterator(_in, _id); }
+    pre_order_iterator end() const { return pre_order_iterator(); }
+
+    template<typename Alloc = std::allocator<tree_node_<T>>>
+    tree<T, Alloc> to_tree() const { return _in->template to_tree<Alloc>(_id); }
+
+    /// Same as the hash_value() of the tree it was interned from.
+    std::size_t hash() const
+    {
+        std::size_t seed = 0;
+        boost::hash_combine(seed, _in->hash(_id));
+        return seed;
+    }
+
+    bool operator==(const interned_tree& other) const
+    { return _id == other._id and _in == other._in; }
+    bool operator!=(const interned_tree& other) const
+    { return not (*this == other); }
+    bool operator<(const interned_tree& other) const
+    { return _id < other._id; }
+
+private:
+    const interner* _in;
+    id_type _id;
+};
+
+template<typename T, typename Hash>
+std::size_t hash_value(const interned_tree<T, Hash>& it)
+{
+    return it.hash();
+}
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_INTERNED_TREE_H
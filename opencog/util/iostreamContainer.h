@@ -26,7 +26,16 @@
 
 #include <iterator>
 #include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
 #include <ctype.h>
 
 #include <boost/lexical_cast.hpp>
@@ -44,6 +53,90 @@ namespace opencog {
     ///@{
 
 
+    namespace detail {
+        //! Whether T is formatted by to_chars in ostream_container,
+        //! and parsed by from_chars in istream_container: the
+        //! arithmetic types, but bool and the character types, which
+        //! streams handle differently.
+        template<class T>
+        struct charconv_element : std::integral_constant<bool,
+            std::is_arithmetic<T>::value
+            and not std::is_same<T, bool>::value
+            and not std::is_same<T, char>::value
+            and not std::is_same<T, signed char>::value
+            and not std::is_same<T, unsigned char>::value
+            and not std::is_same<T, wchar_t>::value
+            and not std::is_same<T, char16_t>::value
+            and not std::is_same<T, char32_t>::value> {};
+
+        //! Whether the stream is set as by default, for which to_chars
+        //! gives the same text as operator<<: decimal integers, and
+        //! floats as by %g at the stream precision, in the C locale.
+        inline bool default_format(const std::ostream& out)
+        {
+            return 0 == out.width() and out.getloc() == std::locale::classic()
+                and 0 == (out.flags()
+                & ((std::ios_base::basefield & ~std::ios_base::dec)
+                   | std::ios_base::floatfield | std::ios_base::showpos
+                   | std::ios_base::showpoint | std::ios_base::uppercase));
+        }
+
+        template<class T>
+        std::to_chars_result to_chars(char* first, char* last, T v,
+                                      int precision)
+        {
+            if constexpr (std::is_floating_point<T>::value)
+                return std::to_chars(first, last, v,
+                                     std::chars_format::general, precision);
+            else
+                return std::to_chars(first, last, v);
+        }
+
+        //! ostream_container for arithmetic elements and a stream set
+        //! as by default: the text is formatted by to_chars into a
+        //! buffer, written out whenever full, without going through
+        //! the locale and the stream for every element.
+        template<class It>
+        void ostream_charconv(std::ostream& out, It from, It to,
+                              const std::string& delimiter)
+        {
+            std::array<char, 4096> buf;
+            char* const last = buf.data() + buf.size();
+            char* p = buf.data();
+            int precision = out.precision();
+            auto put = [&](const char* s, size_t n) {
+                if (size_t(last - p) < n) {
+                    out.write(buf.data(), p - buf.data());
+                    p = buf.data();
+                    if (buf.size() < n) { out.write(s, n); return; }
+                }
+                std::memcpy(p, s, n);
+                p += n;
+            };
+            while (from != to) {
+                // 64 is more than any number takes, at the precisions
+                // that make sense, and to_chars fails rather than
+                // overflow beyond that.
+                if (last - p < 64) {
+                    out.write(buf.data(), p - buf.data());
+                    p = buf.data();
+                }
+                std::to_chars_result r =
+                    detail::to_chars(p, last, *from, precision);
+                if (r.ec == std::errc()) p = r.ptr;
+                else {
+                    std::ostringstream ss;
+                    ss.precision(precision);
+                    ss << *from;
+                    put(ss.str().data(), ss.str().size());
+                }
+                if (++from != to)
+                    put(delimiter.data(), delimiter.size());
+            }
+            out.write(buf.data(), p - buf.data());
+        }
+    }
+
     /**
      * stream out all elements in [from, to( with delimiter
      * 'delimiter', opening with 'left' and closing with 'right'.
@@ -52,6 +145,10 @@ namespace opencog {
      * ostreamContainer(std::cout, N.begin(), N.end(), ";", "{", "}")
      * displays "{1;2;3;4}"
      *
+     * Numbers are formatted with std::to_chars, into a buffer, when
+     * the stream is an std::ostream set to the default format; the
+     * text is the same.
+     *
      * @param empty_rl is a flag indicating whether to print left and
      *                 right when the container is empty. If true then
      *                 they are always printed, if false then they
@@ -66,8 +163,19 @@ namespace opencog {
                            const std::string& right = "",
                            bool empty_lr = true)
     {
+        typedef typename std::iterator_traits<It>::value_type T;
         if(empty_lr || from!=to)
             out << left;
+        if constexpr (std::is_base_of<std::ostream, Out>::value
+                      and detail::charconv_element<T>::value) {
+            if(detail::default_format(out)) {
+                bool nonempty = from != to;
+                detail::ostream_charconv(out, from, to, delimiter);
+                if(empty_lr || nonempty)
+                    out << right;
+                return out;
+            }
+        }
         if(from != to) {
             while(from != to) {
                 out << *from;
@@ -253,6 +361,29 @@ namespace opencog {
      * @todo it may be more appropriate to throw an expection rather
      * than raising an OC_ASSERT
      */
+    namespace detail {
+        //! boost::lexical_cast<T>(s), with std::from_chars for the
+        //! arithmetic types; throws boost::bad_lexical_cast likewise.
+        template<class T>
+        T parse_element(const std::string& s)
+        {
+            if constexpr (charconv_element<T>::value) {
+                const char* first = s.data();
+                const char* last = first + s.size();
+                // lexical_cast takes a leading '+', from_chars not.
+                if (1 < s.size() and '+' == s[0] and '-' != s[1])
+                    first++;
+                T v;
+                std::from_chars_result r = std::from_chars(first, last, v);
+                if (r.ec == std::errc() and r.ptr == last and first != last)
+                    return v;
+                throw boost::bad_lexical_cast(typeid(std::string), typeid(T));
+            }
+            else
+                return boost::lexical_cast<T>(s);
+        }
+    }
+
     template<class In, class OutIt>
     In& istream_container(In& in,
                           OutIt out,
@@ -270,12 +401,12 @@ namespace opencog {
                   "left = %s is not a substring of s = %s",
                   left.c_str(), s.c_str());
         s = s.substr(left.size());
-        *out++ = boost::lexical_cast<T>(s);
+        *out++ = detail::parse_element<T>(s);
 
         while(!in.eof()) {
             in >> s;
             try {
-                *out++ = boost::lexical_cast<T>(s);
+                *out++ = detail::parse_element<T>(s);
             }
             catch(boost::bad_lexical_cast &)
             {
@@ -283,13 +414,88 @@ namespace opencog {
                 int appended_pos = s.size() - right.size();
                 OC_ASSERT(appended_pos > 0
                           && s.rfind(right) == (size_t)appended_pos);
-                *out++ = boost::lexical_cast<T>(s.substr(0, appended_pos));
+                *out++ = detail::parse_element<T>(s.substr(0, appended_pos));
                 break;
             }
         }
         return in;
     }
 
+    /**
+     * Write the elements of the container in binary: their number, as
+     * a 64-bit integer, then their bytes, in the byte order of the
+     * machine. The elements must be trivially copyable; a vector is
+     * written in a single write.
+     */
+    template<class Con>
+    std::ostream& ostream_container_binary(std::ostream& out,
+                                           const Con& container)
+    {
+        typedef typename Con::value_type T;
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "binary serialization of a non trivially copyable type");
+        uint64_t n = std::distance(container.begin(), container.end());
+        out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        if constexpr (std::is_same<Con, std::vector<T>>::value)
+            out.write(reinterpret_cast<const char*>(container.data()),
+                      n * sizeof(T));
+        else
+            for (const T& v : container)
+                out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+        return out;
+    }
+
+    /**
+     * Read elements written by ostream_container_binary, and put them
+     * in the output iterator. Into a vector, use the overload below,
+     * which reads them in place.
+     *
+     * An OC_ASSERT is raised if the input ends before the elements.
+     */
+    template<class T, class OutIt>
+    std::istream& istream_container_binary(std::istream& in, OutIt out)
+    {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "binary serialization of a non trivially copyable type");
+        uint64_t n = 0;
+        in.read(reinterpret_cast<char*>(&n), sizeof(n));
+        OC_ASSERT(in.good(), "istream_container_binary - no size");
+        for (uint64_t i = 0; i < n; i++) {
+            T v;
+            in.read(reinterpret_cast<char*>(&v), sizeof(T));
+            OC_ASSERT(size_t(in.gcount()) == sizeof(T),
+                      "istream_container_binary - truncated input");
+            *out++ = v;
+        }
+        return in;
+    }
+
+    //! Same as above, replacing the content of the vector
+    template<class T>
+    std::istream& istream_container_binary(std::istream& in,
+                                           std::vector<T>& v)
+    {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "binary serialization of a non trivially copyable type");
+        uint64_t n = 0;
+        in.read(reinterpret_cast<char*>(&n), sizeof(n));
+        OC_ASSERT(in.good(), "istream_container_binary - no size");
+        // The size is untrusted; grow the vector in chunks, as the
+        // bytes arrive, so that a corrupt one fails on the end of the
+        // input rather than on a huge allocation.
+        const uint64_t chunk = std::max<uint64_t>(1, (1 << 16) / sizeof(T));
+        v.clear();
+        while (v.size() < n) {
+            size_t off = v.size();
+            size_t m = std::min(chunk, n - off);
+            v.resize(off + m);
+            in.read(reinterpret_cast<char*>(v.data() + off), m * sizeof(T));
+            OC_ASSERT(size_t(in.gcount()) == m * sizeof(T),
+                      "istream_container_binary - truncated input");
+        }
+        return in;
+    }
+
     ///@}
 
 /** @}*/
@@ -30,6 +30,9 @@ namespace opencog {
 /**
  * Calculate the Jaccard index (see
  * http://en.wikipedia.org/wiki/Jaccard_index) of 2 sts.
+ *
+ * For sets too big to hold, see minhash in sketches.h, whose
+ * jaccard_index() approximates this one in O(k).
  */
 
 template<typename Set>
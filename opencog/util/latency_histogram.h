@@ -0,0 +1,251 @@
+/*
+ * opencog/util/latency_histogram.h
+ *
+ * Lock-free latency histogram, and the telemetry reported by
+ * async_caller and async_buffer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OC_LATENCY_HISTOGRAM_H
+#define _OC_LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! A histogram of durations, in nanoseconds, that can be updated
+/// concurrently by any number of threads, without locks.
+///
+/// Buckets are log-linear: each power of two is split into 8 equal
+/// sub-buckets, so that any value is reported to within 12.5%. This
+/// covers the whole range of a uint64_t in 4KB of counters.  Reading
+/// the percentiles while other threads are recording gives a slightly
+/// fuzzy, but consistent-enough, picture; that is good enough for
+/// periodic scraping.
+class latency_histogram
+{
+    static constexpr unsigned SUB_BITS = 3;
+    static constexpr unsigned SUB = 1 << SUB_BITS;
+    static constexpr unsigned NBUCKETS = (64 - SUB_BITS + 1) * SUB;
+
+    std::atomic<uint64_t> _buckets[NBUCKETS];
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _sum;
+    std::atomic<uint64_t> _max;
+
+    static unsigned bucket(uint64_t v)
+    {
+        if (v < SUB) return v;
+        unsigned msb = 63 - __builtin_clzll(v);
+        unsigned sub = (v >> (msb - SUB_BITS)) & (SUB - 1);
+        return (msb - SUB_BITS + 1) * SUB + sub;
+    }
+
+    // The middle of the range of values that land in the bucket.
+    static double midpoint(unsigned b)
+    {
+        if (b < SUB) return b;
+        unsigned msb = b / SUB + SUB_BITS - 1;
+        uint64_t lo = (uint64_t(SUB + b % SUB)) << (msb - SUB_BITS);
+        uint64_t width = uint64_t(1) << (msb - SUB_BITS);
+        return lo + (width - 1) / 2.0;
+    }
+
+public:
+    latency_histogram() { reset(); }
+
+    void reset()
+    {
+        for (auto& b : _buckets) b.store(0, std::memory_order_relaxed);
+        _count = 0;
+        _sum = 0;
+        _max = 0;
+    }
+
+    void record(uint64_t nsec)
+    {
+        _buckets[bucket(nsec)].fetch_add(1, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(nsec, std::memory_order_relaxed);
+        uint64_t m = _max.load(std::memory_order_relaxed);
+        while (m < nsec and
+               not _max.compare_exchange_weak(m, nsec, std::memory_order_relaxed))
+        {}
+    }
+
+    uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return _sum.load(std::memory_order_relaxed); }
+    uint64_t max() const { return _max.load(std::memory_order_relaxed); }
+    double mean() const
+    {
+        uint64_t n = count();
+        return n ? double(sum()) / n : 0.0;
+    }
+
+    /// The value below which the fraction q of all recorded values
+    /// fall; for example, percentile(0.99) is the p99 latency.
+    double percentile(double q) const
+    {
+        uint64_t n = 0;
+        for (const auto& b : _buckets) n += b.load(std::memory_order_relaxed);
+        if (0 == n) return 0.0;
+
+        uint64_t rank = q * n;
+        if (n <= rank) rank = n - 1;
+        uint64_t seen = 0;
+        for (unsigned i = 0; i < NBUCKETS; i++)
+        {
+            seen += _buckets[i].load(std::memory_order_relaxed);
+            if (rank < seen)
+            {
+                // Never report more than the largest value seen.
+                double mid = midpoint(i);
+                double mx = max();
+                return (mx < mid) ? mx : mid;
+            }
+        }
+        return max();
+    }
+};
+
+//! A snapshot of the performance of an async_caller or async_buffer.
+struct async_telemetry
+{
+    /// Number of elements written, and their enqueue-to-written
+    /// latency, in microseconds.
+    uint64_t written = 0;
+    double p50_usec = 0.0;
+    double p99_usec = 0.0;
+    double p999_usec = 0.0;
+    double mean_usec = 0.0;
+    double max_usec = 0.0;
+
+    /// Fraction of the time that the writer threads spent writing.
+    double busy_ratio = 0.0;
+
+    /// Number of pending elements: right now, the most ever, and the
+    /// average over time.
+    unsigned long depth = 0;
+    unsigned long peak_depth = 0;
+    double mean_depth = 0.0;
+
+    /// Seconds since the stats were last cleared.
+    double elapsed_sec = 0.0;
+
+    std::string to_string() const
+    {
+        std::stringstream ss;
+        ss << "written=" << written
+           << " p50=" << p50_usec << "us p99=" << p99_usec
+           << "us p999=" << p999_usec << "us max=" << max_usec
+           << "us busy=" << busy_ratio
+           << " depth=" << depth << " peak=" << peak_depth
+           << " mean_depth=" << mean_depth;
+        return ss.str();
+    }
+};
+
+//! The bookkeeping behind async_telemetry. All methods are lock-free,
+/// and may be called from any thread.
+class async_stats
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+private:
+    latency_histogram _latency;
+    std::atomic<uint64_t> _busy_nsec;
+    std::atomic<unsigned long> _peak_depth;
+    std::atomic<clock::rep> _start;
+
+    static uint64_t nsec(clock::duration d)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    }
+
+public:
+    async_stats() { clear(); }
+
+    void clear()
+    {
+        _latency.reset();
+        _busy_nsec = 0;
+        _peak_depth = 0;
+        _start = clock::now().time_since_epoch().count();
+    }
+
+    /// Record the number of pending elements, just after an insert.
+    void note_depth(unsigned long depth)
+    {
+        unsigned long peak = _peak_depth.load(std::memory_order_relaxed);
+        while (peak < depth and
+               not _peak_depth.compare_exchange_weak(peak, depth,
+                                                     std::memory_order_relaxed))
+        {}
+    }
+
+    /// A writer thread spent the time from start to end writing.
+    void note_busy(clock::time_point start, clock::time_point end)
+    {
+        _busy_nsec.fetch_add(nsec(end - start), std::memory_order_relaxed);
+    }
+
+    /// An element queued at the given time was written by the end time.
+    void note_written(clock::time_point queued, clock::time_point end)
+    {
+        _latency.record(nsec(end - queued));
+    }
+
+    async_telemetry snapshot(unsigned long depth, unsigned nthreads) const
+    {
+        async_telemetry t;
+        clock::time_point start{clock::duration(_start.load())};
+        double elapsed = nsec(clock::now() - start);
+
+        t.written = _latency.count();
+        t.p50_usec = _latency.percentile(0.5) / 1000.0;
+        t.p99_usec = _latency.percentile(0.99) / 1000.0;
+        t.p999_usec = _latency.percentile(0.999) / 1000.0;
+        t.mean_usec = _latency.mean() / 1000.0;
+        t.max_usec = _latency.max() / 1000.0;
+        if (0 < elapsed and 0 < nthreads)
+            t.busy_ratio = _busy_nsec / (elapsed * nthreads);
+
+        // By Little's law, the time-averaged depth is the total time
+        // spent in the queue by all elements, divided by the elapsed
+        // time. No need to sample the depth.
+        t.depth = depth;
+        t.peak_depth = std::max(depth, _peak_depth.load());
+        if (0 < elapsed) t.mean_depth = _latency.sum() / elapsed;
+        t.elapsed_sec = elapsed / 1e9;
+        return t;
+    }
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OC_LATENCY_HISTOGRAM_H
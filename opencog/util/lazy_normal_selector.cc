@@ -20,14 +20,36 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <cmath>
+
 #include "lazy_normal_selector.h"
+#include "random_fill.h"
 
 namespace opencog
 {
 
 unsigned int lazy_normal_selector::select()
 {
-    return _s;
+    if (0 == _sd) return _s;
+
+    double x = 0;
+    for (int tries = 0; tries < 16; tries++)
+    {
+        x = std::round(_s + _sd * next_deviate());
+        if (_l <= x and x < _u) return (unsigned int)x;
+    }
+    return x < _l ? _l : _u - 1;
+}
+
+double lazy_normal_selector::next_deviate()
+{
+    if (_pos == _buf.size())
+    {
+        _buf.resize(256);
+        fill_normal(_buf, 0.0, 1.0, _eng);
+        _pos = 0;
+    }
+    return _buf[_pos++];
 }
 
 } //~namespace opencog
@@ -23,8 +23,13 @@
 #ifndef _OPENCOG_LAZY_NORMAL_SELECTOR_H
 #define _OPENCOG_LAZY_NORMAL_SELECTOR_H
 
+#include <vector>
+
 #include <opencog/util/lazy_selector.h>
+#include <opencog/util/mt19937ar.h>
 #include <opencog/util/oc_assert.h>
+#include <opencog/util/RandGen.h>
+#include <opencog/util/rng_engines.h>
 
 namespace opencog
 {
@@ -32,22 +37,32 @@ namespace opencog
  *  @{
  */
 
-//! apply lazy_selector but the select method returns always the same
-//! number, created for testing
-//
-// XXX FIXME this makes no sense; the normal distribution is not a
-// single number, the normal selector should return a normal
-// distribution with the given mean and deviation, right?
+//! apply lazy_selector with a normal distribution of mean s and
+//! standard deviation sd, rounded to the nearest integer. Draws
+//! falling outside of [l, u) are drawn again, a few times, and then
+//! clamped. With sd = 0 (the default) select always returns s, which
+//! was the only behaviour of this class so far.
+///
+/// The deviates are generated in batches (see fill_normal()), into a
+/// buffer, with an engine seeded from rng at construction.
 ///
 struct lazy_normal_selector : public lazy_selector {
-    lazy_normal_selector(unsigned int n, unsigned int s = 0) :
-        lazy_selector(n), _s(s) {
+    lazy_normal_selector(unsigned int n, unsigned int s = 0, double sd = 0,
+                         RandGen& rng = randGen()) :
+        lazy_selector(n), _s(s), _sd(sd), _eng(0 < sd ? rng() : 0), _pos(0) {
         OC_ASSERT(s < n);
+        OC_ASSERT(0 <= sd);
     }
 protected:
     unsigned int select();
 private:
     unsigned int _s;
+    double _sd;
+    xoshiro256ss _eng;
+    std::vector<double> _buf;
+    size_t _pos;
+
+    double next_deviate();
 };
 
 /** @}*/
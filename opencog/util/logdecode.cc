@@ -0,0 +1,59 @@
+/*
+ * opencog/util/logdecode.cc
+ *
+ * cogutil-logdecode: render binary-mode log files as text.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <fstream>
+#include <iostream>
+
+#include <opencog/util/binary_log.h>
+#include <opencog/util/exceptions.h>
+
+using namespace opencog;
+
+// Usage: cogutil-logdecode [file ...]
+// With no arguments, reads from stdin. Writes text to stdout.
+int main(int argc, char* argv[])
+{
+    try
+    {
+        if (argc < 2)
+        {
+            binlog_decode(std::cin, std::cout);
+            return 0;
+        }
+
+        for (int i = 1; i < argc; i++)
+        {
+            std::ifstream in(argv[i], std::ios::binary);
+            if (not in)
+            {
+                std::cerr << "Unable to open " << argv[i] << std::endl;
+                return 1;
+            }
+            binlog_decode(in, std::cout);
+        }
+    }
+    catch (const StandardException& ex)
+    {
+        std::cerr << ex.get_message() << std::endl;
+        return 1;
+    }
+    return 0;
+}
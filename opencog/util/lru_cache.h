@@ -23,17 +23,25 @@
 #ifndef _OPENCOG_LRU_CACHE_H
 #define _OPENCOG_LRU_CACHE_H
 
+#include <algorithm>
 #include <list>
 #include <limits>
 #include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include <boost/unordered_map.hpp>
 #include <boost/thread.hpp>
 #include <boost/numeric/conversion/cast.hpp>
 
+#include <opencog/util/cache_registry.h>
 #include <opencog/util/exceptions.h>
 #include <opencog/util/hashing.h>
 #include <opencog/util/Logger.h>
+#include <opencog/util/memory_monitor.h>
 #include <opencog/util/oc_assert.h>
 #include <opencog/util/platform.h>
 
@@ -55,31 +63,71 @@ struct inf_cache_base
     typedef size_t size_type;
 
     inf_cache_base(const std::string& name) :
-        _misses(0), _hits(0), _cache_name(name)
+        _misses(0), _hits(0), _collapsed(0), _evictions(0), _nentries(0),
+        _mem_bytes(0), _entry_bytes(0), _capacity(0), _cache_name(name)
     {
         logger().info("Cache %s", _cache_name.c_str());
+        cache_registry::instance().add(this);
     }
 
     ~inf_cache_base()
     {
+        cache_registry::instance().remove(this);
         logger().info("Cache %s hits=%u misses=%u",
                       _cache_name.c_str(), get_hits(), get_misses());
     }
 
     size_type get_misses() const { return _misses.load(); }
     size_type get_hits() const { return _hits.load(); }
+    size_type get_collapsed() const { return _collapsed.load(); }
+    size_type get_evictions() const { return _evictions.load(); }
+
+    /// The statistics, as reported by the cache_registry.
+    cache_stats get_stats() const {
+        cache_stats st;
+        st.name = _cache_name;
+        st.capacity = _capacity;
+        st.size = _nentries;
+        st.hits = _hits;
+        st.misses = _misses;
+        st.collapsed = _collapsed;
+        st.evictions = _evictions;
+        st.bytes = _entry_bytes ? st.size * _entry_bytes : _mem_bytes.load();
+        return st;
+    }
 
 protected:
     mutable std::atomic<size_type> _misses;   // number of cache misses
     mutable std::atomic<size_type> _hits;     // number of cache hits
+    mutable std::atomic<size_type> _collapsed; // misses that waited for
+                                               // another thread's call
+    mutable std::atomic<size_type> _evictions; // entries pushed out
+
+    // Kept up to date by the caches, for get_stats(): the number of
+    // entries, and either the exact memory use, or an estimate per
+    // entry; and the capacity, which is _n, for the limited caches.
+    mutable std::atomic<size_type> _nentries;
+    mutable std::atomic<size_type> _mem_bytes;
+    size_type _entry_bytes;
+    std::atomic<size_type> _capacity;
     std::string _cache_name;          // name of the cache (useful for logging)
+
+    void note_size(size_type n) const
+    { _nentries.store(n, std::memory_order_relaxed); }
+
+    template<typename Arg, typename Result>
+    void estimate_entry_bytes() {
+        // A list node (two links) and a hash map node (a link, the
+        // key, an iterator and a bucket pointer), roughly.
+        _entry_bytes = 2 * sizeof(Arg) + sizeof(Result) + 6 * sizeof(void*);
+    }
 };
 
 //! base class for all caches limited in size
 struct cache_base : public inf_cache_base
 {
     cache_base(size_type n, const std::string& name)
-        : inf_cache_base(name), _n(n) {}
+        : inf_cache_base(name), _n(n) { _capacity = n; }
 
     ~cache_base() {}
 
@@ -87,6 +135,8 @@ struct cache_base : public inf_cache_base
 
 protected:
     size_type _n;                            // cache size
+
+    void set_capacity(size_type n) { _n = n; _capacity = n; }
 };
 
 //! Least Recently Used Cache. Non thread safe, use
@@ -106,7 +156,8 @@ struct lru_cache : public F, public cache_base
     typedef typename map::iterator map_iter;
 
     lru_cache(size_type n, const F& f=F(), const std::string name = "lru_cache")
-        : F(f), cache_base(n, name), _fu(f), _map(n+1) {}
+        : F(f), cache_base(n, name), _fu(f), _map(n+1)
+    { estimate_entry_bytes<argument_type, result_type>(); }
 
     inline bool full() const { return _map.size()==_n; }
     inline bool empty() const { return _map.empty(); }
@@ -119,6 +170,7 @@ struct lru_cache : public F, public cache_base
             // remove existing entry
             _lru.erase(it->first);
             _map.erase(it);
+            note_size(_map.size());
         }
         // remove temporary
         _lru.pop_front();
@@ -130,6 +182,7 @@ struct lru_cache : public F, public cache_base
                 return if_f(x);
             _lru.push_front(x);
             map_iter it = _map.insert(make_pair(_lru.begin(), ifx_f(x))).first;
+            note_size(_map.size());
             return it->second;
         }
 
@@ -152,7 +205,9 @@ struct lru_cache : public F, public cache_base
         if (_map.size() > _n) {
             _map.erase(--_lru.end());
             _lru.pop_back();
+            ++_evictions;
         }
+        note_size(_map.size());
 
         OC_ASSERT(_map.size() <= _n,
                   "lru_cache - _map size greater than _n (%d).", _n);
@@ -166,22 +221,48 @@ struct lru_cache : public F, public cache_base
     void clear() {
         _map.clear();
         _lru.clear();
+        note_size(0);
     }
 
     void resize(unsigned n) {
-        _n = n;
+        set_capacity(n);
         while(_map.size() > _n) {
-            _lru.begin();
-            map_iter it = _map.find(_lru.begin());
+            map_iter it = _map.find(--_lru.end());
             OC_ASSERT(it != _map.end(),
                       "Element in _lru has no corresponding iterator in _map");
             _lru.erase(it->first);
             _map.erase(it);
+            ++_evictions;
         }
+        note_size(_map.size());
         OC_ASSERT(_lru.size() == _map.size(),
                   "lru_cache - _lru size different from _map size.");
     }
 
+    //! Call f(x, y) on every entry, from the most recently used to
+    //! the least, as long as f returns true. See cache_snapshot.h.
+    template<typename Visit>
+    void for_each_entry(Visit f) const {
+        for (list_iter lit = _lru.begin(); lit != _lru.end(); ++lit) {
+            map_iter it = _map.find(lit);
+            if (not f(*lit, it->second)) return;
+        }
+    }
+
+    //! Insert an entry known from elsewhere (a snapshot of an earlier
+    //! run), as the least recently used one, unless the cache is full
+    //! or already holds x. Return true if inserted. Not a miss.
+    bool preload(const argument_type& x, const result_type& y) {
+        if (_map.size() >= _n) return false;
+        _lru.push_back(x);
+        if (not _map.insert(make_pair(--_lru.end(), y)).second) {
+            _lru.pop_back();
+            return false;
+        }
+        note_size(_map.size());
+        return true;
+    }
+
 protected:
     const F& _fu;
     mutable map _map;
@@ -322,6 +403,17 @@ public:
         super::clear();
     }
 
+    template<typename Visit>
+    void for_each_entry(Visit f) const {
+        shared_lock lock(mutex);
+        super::for_each_entry(f);
+    }
+
+    bool preload(const argument_type& x, const result_type& y) {
+        unique_lock lock(mutex);
+        return super::preload(x, y);
+    }
+
 protected:
     mutable cache_mutex mutex;
 
@@ -355,6 +447,612 @@ protected:
     }
 };
 
+//! Least Recently Used Cache, like lru_cache, but allocating nothing
+//! once it is full. Non thread safe.
+///
+/// Each entry is a single node, holding the key, the result, and the
+/// links of the LRU list, in a slab of n nodes allocated up front. The
+/// nodes are indexed by an open-addressing (linear probing) hash table
+/// of node numbers, which also holds some bits of the hash of each key,
+/// so that most probes never touch a node. When the cache is full, a
+/// miss re-uses the least recently used node in place: the new key and
+/// result are assigned over the old ones (types such as std::string
+/// then re-use their storage, too), and nothing is allocated or freed.
+///
+/// The argument and result types must be default-constructible and
+/// assignable. The cache has the same interface as lru_cache.
+template<typename F,
+         typename Hash=boost::hash<typename F::argument_type>,
+         typename Equals=std::equal_to<typename F::argument_type> >
+struct slab_lru_cache : public F, public cache_base
+{
+    typedef typename F::argument_type argument_type;
+    typedef typename F::result_type result_type;
+
+    slab_lru_cache(size_type n, const F& f=F(),
+                   const std::string name = "slab_lru_cache")
+        : F(f), cache_base(n, name) {
+        estimate_entry_bytes<argument_type, result_type>();
+        resize(n);
+    }
+
+    inline size_type size() const { return _used - _free.size(); }
+    inline bool full() const { return size() == _n; }
+    inline bool empty() const { return 0 == size(); }
+
+    //! Remove (aka make dirty) x from cache because entry invalid
+    void remove(const argument_type& x) {
+        uint32_t tag = tag_of(x);
+        size_t slot;
+        if (not find(x, tag, slot)) return;
+        uint32_t nd = _slots[slot].node;
+        erase_slot(slot);
+        unlink(nd);
+        _free.push_back(nd);
+        note_size(size());
+    }
+
+    result_type operator()(const argument_type& x) const {
+        if (0 == _n) return if_f(x);
+
+        uint32_t tag = tag_of(x);
+        size_t slot;
+        if (find(x, tag, slot)) {
+            uint32_t nd = _slots[slot].node;
+            unlink(nd);
+            link_front(nd);
+            ++_hits;
+            return _nodes[nd].value;
+        }
+
+        // Nothing has been touched yet, so if this throws, there is
+        // nothing to undo.
+        result_type y = if_f(x);
+
+        uint32_t nd;
+        if (not _free.empty()) {
+            nd = _free.back();
+            _free.pop_back();
+        } else if (_used < _n) {
+            nd = _used++;
+        } else {
+            // Recycle the least recently used node.
+            nd = _tail;
+            size_t old;
+            bool found = find(_nodes[nd].key, _nodes[nd].tag, old);
+            OC_ASSERT(found, "slab_lru_cache - node missing from the index");
+            erase_slot(old);
+            unlink(nd);
+            ++_evictions;
+            // The erase may have shifted the free slot for x.
+            find(x, tag, slot);
+        }
+
+        Node& node = _nodes[nd];
+        node.key = x;
+        node.value = y;
+        node.tag = tag;
+        _slots[slot].node = nd;
+        _slots[slot].tag = tag;
+        link_front(nd);
+        note_size(size());
+        return node.value;
+    }
+
+    void clear() {
+        for (Slot& sl : _slots) sl.node = NIL;
+        _free.clear();
+        _used = 0;
+        _head = _tail = NIL;
+        note_size(0);
+    }
+
+    /// Re-size the cache, keeping the n most recently used entries.
+    /// This allocates a new slab and index.
+    void resize(unsigned n) {
+        std::vector<Node> old;
+        for (uint32_t nd = _head; nd != NIL; nd = _nodes[nd].next)
+            old.push_back(std::move(_nodes[nd]));
+
+        set_capacity(n);
+        _nodes.clear();
+        _nodes.resize(n);
+        _free.clear();
+        _free.reserve(n);
+        size_t nslots = 2;
+        _bits = 1;
+        while (nslots < 2 * (size_t) n) { nslots <<= 1; _bits++; }
+        _slots.assign(nslots, Slot());
+        _mask = nslots - 1;
+        clear();
+
+        // Re-insert, least recent first, so the order is kept.
+        size_t keep = std::min<size_t>(old.size(), n);
+        _evictions += old.size() - keep;
+        for (size_t i = keep; 0 < i; i--) {
+            Node& o = old[i - 1];
+            size_t slot;
+            find(o.key, o.tag, slot);
+            uint32_t nd = _used++;
+            _nodes[nd] = std::move(o);
+            _slots[slot].node = nd;
+            _slots[slot].tag = _nodes[nd].tag;
+            link_front(nd);
+        }
+        note_size(size());
+    }
+
+protected:
+    static constexpr uint32_t NIL = std::numeric_limits<uint32_t>::max();
+
+    struct Node {
+        argument_type key;
+        result_type value;
+        uint32_t prev = NIL;
+        uint32_t next = NIL;
+        uint32_t tag = 0;
+    };
+    struct Slot {
+        uint32_t node = NIL;
+        uint32_t tag = 0;
+    };
+
+    mutable std::vector<Node> _nodes;
+    mutable std::vector<Slot> _slots;
+    mutable std::vector<uint32_t> _free;   // nodes freed by remove()
+    mutable uint32_t _used = 0;            // nodes ever handed out
+    mutable uint32_t _head = NIL;          // most recently used
+    mutable uint32_t _tail = NIL;          // least recently used
+    size_t _mask = 0;
+    unsigned _bits = 0;
+
+    // The top 32 bits of the (Fibonacci-mixed) hash. The top bits of
+    // the tag are also the home slot.
+    static uint32_t tag_of(const argument_type& x) {
+        return (uint64_t(Hash()(x)) * 0x9E3779B97F4A7C15ULL) >> 32;
+    }
+    size_t home(uint32_t tag) const { return tag >> (32 - _bits); }
+
+    /// Look for x; if not found, slot is where it would go.
+    bool find(const argument_type& x, uint32_t tag, size_t& slot) const {
+        Equals eq;
+        for (slot = home(tag); ; slot = (slot + 1) & _mask) {
+            const Slot& sl = _slots[slot];
+            if (sl.node == NIL) return false;
+            if (sl.tag == tag and eq(_nodes[sl.node].key, x)) return true;
+        }
+    }
+
+    /// Backward-shift deletion, so that no tombstones are needed.
+    void erase_slot(size_t i) const {
+        size_t j = i;
+        while (true) {
+            j = (j + 1) & _mask;
+            if (_slots[j].node == NIL) break;
+            size_t k = home(_slots[j].tag);
+            bool stays = (i <= j) ? (i < k and k <= j) : (i < k or k <= j);
+            if (stays) continue;
+            _slots[i] = _slots[j];
+            i = j;
+        }
+        _slots[i].node = NIL;
+    }
+
+    void unlink(uint32_t nd) const {
+        Node& node = _nodes[nd];
+        if (node.prev != NIL) _nodes[node.prev].next = node.next;
+        else _head = node.next;
+        if (node.next != NIL) _nodes[node.next].prev = node.prev;
+        else _tail = node.prev;
+        node.prev = node.next = NIL;
+    }
+
+    void link_front(uint32_t nd) const {
+        Node& node = _nodes[nd];
+        node.prev = NIL;
+        node.next = _head;
+        if (_head != NIL) _nodes[_head].prev = nd;
+        _head = nd;
+        if (_tail == NIL) _tail = nd;
+    }
+
+    // increment failure and call
+    inline result_type if_f(const argument_type& x) const {
+        ++_misses;
+        return F::operator()(x);
+    }
+};
+
+//! The default size-of functor for budget_lru_cache: the shallow size
+//! of the key and result, plus the bookkeeping for one entry. Supply
+//! your own for keys or results that own heap memory.
+template<typename Arg, typename Result>
+struct entry_sizeof
+{
+    size_t operator()(const Arg&, const Result&) const {
+        // Same estimate as inf_cache_base::estimate_entry_bytes().
+        return 2 * sizeof(Arg) + sizeof(Result) + 6 * sizeof(void*);
+    }
+};
+
+//! Least Recently Used Cache, limited by bytes rather than by number
+//! of entries. Non thread safe.
+///
+/// The SizeOf functor is called, once, on each new entry, as
+/// sizeof(key, result), and should return the number of bytes of
+/// memory that the entry holds. Least recently used entries are
+/// evicted until the total is within the budget again; an entry
+/// larger than the whole budget is not cached at all.
+///
+/// For this cache, max_size() and resize() are in bytes, so that
+/// adaptive_cache can grow and shrink the byte budget. get_bytes()
+/// is the total currently in use.
+template<typename F,
+         typename SizeOf=entry_sizeof<typename F::argument_type,
+                                      typename F::result_type>,
+         typename Hash=boost::hash<typename F::argument_type>,
+         typename Equals=std::equal_to<typename F::argument_type> >
+struct budget_lru_cache : public F, public cache_base
+{
+    typedef typename F::argument_type argument_type;
+    typedef typename F::result_type result_type;
+
+    budget_lru_cache(size_type max_bytes, const F& f=F(),
+                     const SizeOf& sizeof_f=SizeOf(),
+                     const std::string name = "budget_lru_cache")
+        : F(f), cache_base(max_bytes, name), _sizeof(sizeof_f) {}
+
+    inline size_type size() const { return _map.size(); }
+    inline bool empty() const { return _map.empty(); }
+
+    /// True if another entry of average size would not fit.
+    inline bool full() const {
+        if (_map.empty()) return 0 == _n;
+        return _n < _mem_bytes + _mem_bytes / _map.size();
+    }
+
+    size_type get_bytes() const { return _mem_bytes; }
+
+    //! Remove (aka make dirty) x from cache because entry invalid
+    void remove(const argument_type& x) {
+        map_iter it = _map.find(x);
+        if (it == _map.end()) return;
+        _mem_bytes -= it->second->bytes;
+        _lru.erase(it->second);
+        _map.erase(it);
+        note_size(_map.size());
+    }
+
+    result_type operator()(const argument_type& x) const {
+        map_iter it = _map.find(x);
+        if (it != _map.end()) {
+            _lru.splice(_lru.begin(), _lru, it->second);
+            ++_hits;
+            return it->second->value;
+        }
+
+        ++_misses;
+        result_type y = F::operator()(x);
+        size_type bytes = _sizeof(x, y);
+        if (_n < bytes) return y;
+
+        _lru.push_front(Entry{x, y, bytes});
+        _map[x] = _lru.begin();
+        _mem_bytes += bytes;
+        evict();
+        return y;
+    }
+
+    void clear() {
+        _map.clear();
+        _lru.clear();
+        _mem_bytes = 0;
+        note_size(0);
+    }
+
+    void resize(unsigned max_bytes) {
+        set_capacity(max_bytes);
+        evict();
+    }
+
+protected:
+    struct Entry {
+        argument_type key;
+        result_type value;
+        size_type bytes;
+    };
+    typedef std::list<Entry> list;
+    typedef typename list::iterator list_iter;
+    typedef boost::unordered_map<argument_type, list_iter, Hash, Equals> map;
+    typedef typename map::iterator map_iter;
+
+    SizeOf _sizeof;
+    mutable list _lru;
+    mutable map _map;
+
+    void evict() const {
+        while (_n < _mem_bytes) {
+            const Entry& e = _lru.back();
+            _mem_bytes -= e.bytes;
+            _map.erase(e.key);
+            _lru.pop_back();
+            _evictions++;
+        }
+        note_size(_map.size());
+    }
+};
+
+//! CLOCK Cache, an approximation of LRU with a cheaper hit path. Non
+//! thread safe.
+///
+/// The entries sit in a circular array, each with a reference bit. A
+/// hit merely sets the bit; there is no list to splice. On a miss, when
+/// full, the clock hand sweeps the array, clearing the bits it finds
+/// set, and replaces the first entry whose bit is already clear. So an
+/// entry survives for as long as it is used at least once per sweep.
+template<typename F,
+         typename Hash=boost::hash<typename F::argument_type>,
+         typename Equals=std::equal_to<typename F::argument_type> >
+struct clock_cache : public F, public cache_base
+{
+    typedef typename F::argument_type argument_type;
+    typedef typename F::result_type result_type;
+    typedef boost::unordered_map<argument_type, size_t, Hash, Equals> map;
+    typedef typename map::iterator map_iter;
+
+    clock_cache(size_type n, const F& f=F(),
+                const std::string name = "clock_cache")
+        : F(f), cache_base(n, name), _hand(0), _map(n+1)
+    { estimate_entry_bytes<argument_type, result_type>(); }
+
+    inline size_type size() const { return _map.size(); }
+    inline bool full() const { return _map.size() == _n; }
+    inline bool empty() const { return _map.empty(); }
+
+    //! Remove (aka make dirty) x from cache because entry invalid
+    void remove(const argument_type& x) {
+        map_iter it = _map.find(x);
+        if (it == _map.end()) return;
+
+        // Fill the hole with the last entry.
+        size_t i = it->second;
+        _map.erase(it);
+        if (i + 1 != _entries.size()) {
+            _entries[i] = std::move(_entries.back());
+            _map[_entries[i].key] = i;
+        }
+        _entries.pop_back();
+        if (_entries.size() <= _hand) _hand = 0;
+        note_size(_map.size());
+    }
+
+    result_type operator()(const argument_type& x) const {
+        map_iter it = _map.find(x);
+        if (it != _map.end()) {
+            Entry& e = _entries[it->second];
+            e.referenced = true;
+            ++_hits;
+            return e.value;
+        }
+
+        ++_misses;
+        result_type y = F::operator()(x);
+        if (0 == _n) return y;
+
+        if (_entries.size() < _n) {
+            _map[x] = _entries.size();
+            _entries.push_back(Entry{x, y, false});
+            note_size(_map.size());
+            return y;
+        }
+
+        // Sweep until an unreferenced entry comes up.
+        while (_entries[_hand].referenced) {
+            _entries[_hand].referenced = false;
+            _hand = (_hand + 1) % _entries.size();
+        }
+        Entry& victim = _entries[_hand];
+        _map.erase(victim.key);
+        victim.key = x;
+        victim.value = y;
+        _map[x] = _hand;
+        _hand = (_hand + 1) % _entries.size();
+        ++_evictions;
+        return y;
+    }
+
+    void clear() {
+        _map.clear();
+        _entries.clear();
+        _hand = 0;
+        note_size(0);
+    }
+
+    void resize(unsigned n) {
+        set_capacity(n);
+        while (_entries.size() > _n) {
+            _map.erase(_entries.back().key);
+            _entries.pop_back();
+            ++_evictions;
+        }
+        if (_entries.size() <= _hand) _hand = 0;
+        note_size(_map.size());
+    }
+
+protected:
+    struct Entry {
+        argument_type key;
+        result_type value;
+        bool referenced;
+    };
+
+    mutable std::vector<Entry> _entries;
+    mutable size_t _hand;
+    mutable map _map;
+};
+
+//! Adaptive Replacement Cache. Non thread safe.
+///
+/// Megiddo and Modha, "ARC: A Self-Tuning, Low Overhead Replacement
+/// Cache" (FAST 2003). The cached entries are split over two LRU
+/// lists: T1 holds entries seen once recently, T2 entries seen at
+/// least twice. Two more lists, B1 and B2, remember the keys (only)
+/// recently evicted from T1 and T2. A miss that hits in B1 means T1
+/// is too small, and a miss that hits in B2 means T2 is, so the split
+/// between T1 and T2 adapts to the workload. A long scan of keys that
+/// are used only once passes through T1 and leaves the frequently used
+/// entries in T2 alone; this is what makes ARC scan-resistant, where
+/// plain LRU gets flushed.
+template<typename F,
+         typename Hash=boost::hash<typename F::argument_type>,
+         typename Equals=std::equal_to<typename F::argument_type> >
+struct arc_cache : public F, public cache_base
+{
+    typedef typename F::argument_type argument_type;
+    typedef typename F::result_type result_type;
+
+protected:
+    enum Where { T1, T2, B1, B2 };
+    struct Entry {
+        argument_type key;
+        result_type value;     // meaningless in B1 and B2
+        Where where;
+    };
+    typedef std::list<Entry> list;
+    typedef typename list::iterator list_iter;
+    typedef boost::unordered_map<argument_type, list_iter, Hash, Equals> map;
+    typedef typename map::iterator map_iter;
+
+public:
+    arc_cache(size_type n, const F& f=F(), const std::string name = "arc_cache")
+        : F(f), cache_base(n, name), _p(0), _map(2*n+1)
+    { estimate_entry_bytes<argument_type, result_type>(); }
+
+    inline size_type size() const
+    { return _lists[T1].size() + _lists[T2].size(); }
+    inline bool full() const { return size() == _n; }
+    inline bool empty() const { return 0 == size(); }
+
+    /// The adaptive target size of T1.
+    size_type get_target() const { return _p; }
+
+    //! Remove (aka make dirty) x from cache because entry invalid
+    void remove(const argument_type& x) {
+        map_iter it = _map.find(x);
+        if (it == _map.end()) return;
+        _lists[it->second->where].erase(it->second);
+        _map.erase(it);
+        note_size(size());
+    }
+
+    result_type operator()(const argument_type& x) const {
+        map_iter it = _map.find(x);
+        Where where = (it == _map.end()) ? T1 : it->second->where;
+
+        // Case I: a hit. Move it to the front of T2.
+        if (it != _map.end() and (T1 == where or T2 == where)) {
+            move_to(it->second, T2);
+            ++_hits;
+            return it->second->value;
+        }
+
+        // A miss. Call first, so that a throw leaves the lists alone.
+        ++_misses;
+        result_type y = F::operator()(x);
+        if (0 == _n) return y;
+
+        size_type b1 = _lists[B1].size(), b2 = _lists[B2].size();
+        if (it != _map.end()) {
+            // Cases II and III: a ghost hit. Adapt, and make room.
+            if (B1 == where)
+                _p = std::min<size_type>(_n, _p + std::max<size_type>(b2 / b1, 1));
+            else
+                _p = (_p > std::max<size_type>(b1 / b2, 1)) ?
+                     _p - std::max<size_type>(b1 / b2, 1) : 0;
+            replace(B2 == where);
+            it->second->value = y;
+            move_to(it->second, T2);
+            note_size(size());
+            return y;
+        }
+
+        // Case IV: not seen recently at all.
+        size_type t1 = _lists[T1].size();
+        size_type total = t1 + b1 + _lists[T2].size() + b2;
+        if (t1 + b1 == _n) {
+            if (t1 < _n) {
+                drop_last(B1);
+                replace(false);
+            } else {
+                drop_last(T1);
+            }
+        } else if (_n <= total) {
+            if (total == 2 * _n) drop_last(B2);
+            replace(false);
+        }
+
+        list& l1 = _lists[T1];
+        l1.push_front(Entry{x, y, T1});
+        _map[x] = l1.begin();
+        note_size(size());
+        return y;
+    }
+
+    void clear() {
+        _map.clear();
+        for (list& l : _lists) l.clear();
+        _p = 0;
+        note_size(0);
+    }
+
+    void resize(unsigned n) {
+        set_capacity(n);
+        _p = std::min<size_type>(_p, _n);
+        while (size() > _n) replace(false);
+        while (_lists[T1].size() + _lists[B1].size() > _n and
+               not _lists[B1].empty())
+            drop_last(B1);
+        while (size() + _lists[B1].size() + _lists[B2].size() > 2 * _n and
+               not _lists[B2].empty())
+            drop_last(B2);
+        note_size(size());
+    }
+
+protected:
+    mutable list _lists[4];
+    mutable size_type _p;
+    mutable map _map;
+
+    void move_to(list_iter it, Where to) const {
+        _lists[to].splice(_lists[to].begin(), _lists[it->where], it);
+        it->where = to;
+    }
+
+    // Evict the LRU of T1 or of T2 into its ghost list.
+    void replace(bool in_b2) const {
+        size_type t1 = _lists[T1].size();
+        if ((0 < t1 and ((in_b2 and t1 == _p) or _p < t1)) or _lists[T2].empty())
+            to_ghost(T1, B1);
+        else
+            to_ghost(T2, B2);
+    }
+
+    void to_ghost(Where from, Where to) const {
+        if (_lists[from].empty()) return;
+        list_iter it = --_lists[from].end();
+        it->value = result_type();
+        move_to(it, to);
+        ++_evictions;
+    }
+
+    void drop_last(Where from) const {
+        if (_lists[from].empty()) return;
+        if (T1 == from or T2 == from) ++_evictions;
+        _map.erase(_lists[from].back().key);
+        _lists[from].pop_back();
+    }
+};
+
 //! Pseudo Random Replacement Cache, very fast, but very dumb, it just
 //! removes the first element of the hash table when the cache is
 //! full. No thread safety, use prr_cache_threaded for that.
@@ -369,7 +1067,8 @@ struct prr_cache : public F, public cache_base
     typedef typename map::iterator map_iter;
 
     prr_cache(size_type n, const F& f=F(), const std::string name = "prr_cache")
-        : F(f), cache_base(n, name), _fu(f), _map(n+1) {}
+        : F(f), cache_base(n, name), _fu(f), _map(n+1)
+    { estimate_entry_bytes<argument_type, result_type>(); }
 
     bool full() const { return _map.size() == _n; }
     bool empty() const { return _map.empty(); }
@@ -387,22 +1086,28 @@ struct prr_cache : public F, public cache_base
             result_type res = if_f(x);
             if (full()) { // if the cache is full randomly remove an element
                 _map.erase(_map.begin());
+                ++_evictions;
             }
             _map[x] = res;
+            note_size(_map.size());
             return res;
         }
     }
 
     void resize(unsigned n)
     {
-        _n = n;
-        while (_map.size() > _n)
+        set_capacity(n);
+        while (_map.size() > _n) {
             _map.erase(_map.begin());
+            ++_evictions;
+        }
+        note_size(_map.size());
     }
 
     void clear()
     {
         _map.clear();
+        note_size(0);
     }
 
 protected:
@@ -483,11 +1188,13 @@ public:
             // crashes anyway. So at least explain why.
             OC_ASSERT (0 < super::_n, "zero-sized cache is unusable!");
             super::_map.erase(super::_map.begin());
+            ++super::_evictions;
             super::_map[x] = res;
             return res;
         }
         unique_lock lock(mutex);
         super::_map[x] = res;
+        super::note_size(super::_map.size());
         return res;
     }
 
@@ -514,8 +1221,258 @@ protected:
     }
 };
 
+/**
+ * The calls to the cached function that are in progress, for the
+ * thread-safe caches. The first thread to miss on a key registers a
+ * promise here, and makes the call; any other thread that misses on
+ * the same key, before the call returns, waits on that same promise,
+ * instead of calling the (possibly very expensive) function again.
+ * If the call throws, all the waiting threads get the exception, and
+ * nothing is cached. The caller provides the locking.
+ */
+template<typename Arg, typename Result, typename Hash, typename Equals>
+struct single_flight
+{
+    typedef std::shared_future<Result> future;
+    typedef std::shared_ptr<std::promise<Result>> promise;
+
+    /// If another thread is already calling for x, return true, and
+    /// set fut to its result. Otherwise, return false, and set prom;
+    /// the caller must then call, and finish(x) with the promise.
+    bool join(const Arg& x, future& fut, promise& prom) {
+        auto it = _pending.find(x);
+        if (it != _pending.end()) {
+            fut = it->second;
+            return true;
+        }
+        prom = std::make_shared<std::promise<Result>>();
+        _pending.emplace(x, prom->get_future().share());
+        return false;
+    }
+
+    /// The call for x is done; stop offering its promise to others.
+    void finish(const Arg& x) { _pending.erase(x); }
+
+private:
+    boost::unordered_map<Arg, future, Hash, Equals> _pending;
+};
+
+/**
+ * Least Recently Used Cache, thread safe, and scaling with the number
+ * of threads. The keys are partitioned by hash over a number of
+ * shards, each one an independent LRU list under its own lock, so
+ * that threads looking up different keys rarely contend. Each shard
+ * holds an equal part of the total size; the least recently used
+ * element of a shard, rather than of the whole cache, is evicted. A
+ * cache smaller than its number of shards uses only as many of them
+ * (rounded down to a power of 2) as it has entries, so that every
+ * key can be cached.
+ *
+ * The function is called outside of the locks, so that misses
+ * proceed in parallel; F::operator() must thus be thread safe. If
+ * several threads miss on the same key at the same time, only the
+ * first calls the function; the others wait for its result, and are
+ * counted by get_collapsed().
+ */
+template<typename F,
+         typename Hash=boost::hash<typename F::argument_type>,
+         typename Equals=std::equal_to<typename F::argument_type> >
+struct sharded_lru_cache : public F, public cache_base
+{
+    typedef typename F::argument_type argument_type;
+    typedef typename F::result_type result_type;
+    typedef std::list<std::pair<argument_type, result_type>> list;
+    typedef typename list::iterator list_iter;
+    typedef boost::unordered_map<argument_type, list_iter, Hash, Equals> map;
+    typedef typename map::iterator map_iter;
+    typedef single_flight<argument_type, result_type, Hash, Equals> pending;
+
+    sharded_lru_cache(size_type n, const F& f=F(),
+                      const std::string name = "sharded_lru_cache",
+                      unsigned nshards = 16)
+        : F(f), cache_base(n, name)
+    {
+        _nshards = 1;
+        _max_shift = 0;
+        while (_nshards < nshards) { _nshards <<= 1; _max_shift++; }
+        _shift = 0;
+        _shards.reset(new Shard[_nshards]);
+        estimate_entry_bytes<argument_type, result_type>();
+        resize(n);
+    }
+
+    size_type size() const {
+        size_type sz = 0;
+        for (size_type i = 0; i < _nshards; i++) {
+            std::lock_guard<std::mutex> lock(_shards[i].mtx);
+            sz += _shards[i].index.size();
+        }
+        return sz;
+    }
+    bool full() const { return size() >= _n; }
+    bool empty() const { return 0 == size(); }
+    //! Number of shards in use
+    unsigned shards() const { return 1u << _shift.load(); }
+
+    //! Remove (aka make dirty) x from cache because entry invalid
+    void remove(const argument_type& x) {
+        Shard& sh = shard_of(x);
+        std::lock_guard<std::mutex> lock(sh.mtx);
+        map_iter it = sh.index.find(x);
+        if (it != sh.index.end()) {
+            sh.lru.erase(it->second);
+            sh.index.erase(it);
+            --_nentries;
+        }
+    }
+
+    result_type operator()(const argument_type& x) const {
+        Shard& sh = shard_of(x);
+        typename pending::future fut;
+        typename pending::promise prom;
+        {
+            std::lock_guard<std::mutex> lock(sh.mtx);
+            map_iter it = sh.index.find(x);
+            if (it != sh.index.end()) {
+                sh.lru.splice(sh.lru.begin(), sh.lru, it->second);
+                ++_hits;
+                return it->second->second;
+            }
+            ++_misses;
+            if (sh.inflight.join(x, fut, prom)) ++_collapsed;
+        }
+        if (fut.valid()) return fut.get();
+
+        try {
+            result_type y = F::operator()(x);
+            {
+                std::lock_guard<std::mutex> lock(sh.mtx);
+                sh.inflight.finish(x);
+                if (0 < sh.n and sh.index.find(x) == sh.index.end()) {
+                    sh.lru.emplace_front(x, y);
+                    sh.index.emplace(x, sh.lru.begin());
+                    ++_nentries;
+                    evict(sh);
+                }
+            }
+            prom->set_value(y);
+            return y;
+        } catch(...) {
+            {
+                std::lock_guard<std::mutex> lock(sh.mtx);
+                sh.inflight.finish(x);
+            }
+            prom->set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    void clear() {
+        for (size_type i = 0; i < _nshards; i++) {
+            std::lock_guard<std::mutex> lock(_shards[i].mtx);
+            _nentries -= _shards[i].index.size();
+            _shards[i].index.clear();
+            _shards[i].lru.clear();
+        }
+    }
+
+    void resize(unsigned n) {
+        // No more shards in use than entries, so that none is empty.
+        unsigned shift = 0;
+        while (shift < _max_shift and (2u << shift) <= n) shift++;
+        size_type used = size_type(1) << shift;
+
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (size_type i = 0; i < _nshards; i++)
+            locks.emplace_back(_shards[i].mtx);
+        set_capacity(n);
+        // Spread the remainder over the first shards.
+        for (size_type i = 0; i < _nshards; i++)
+            _shards[i].n = (i < used) ? n / used + (i < n % used ? 1 : 0) : 0;
+
+        if (shift != _shift) {
+            // Move the entries to the shards that they now hash to,
+            // keeping their order of use within each former shard. A
+            // call that picked its shard before the change may still
+            // insert there; the entry is then merely never hit, and
+            // is evicted in time like any other.
+            list all;
+            for (size_type i = 0; i < _nshards; i++) {
+                _shards[i].index.clear();
+                all.splice(all.end(), _shards[i].lru);
+            }
+            _shift = shift;
+            while (not all.empty()) {
+                Shard& sh = shard_of(all.front().first);
+                sh.lru.splice(sh.lru.end(), all, all.begin());
+                sh.index.emplace(sh.lru.back().first, --sh.lru.end());
+            }
+        }
+        for (size_type i = 0; i < _nshards; i++)
+            evict(_shards[i]);
+    }
+
+    //! Call f(x, y) on every entry, shard by shard, each from the most
+    //! recently used to the least, as long as f returns true. Each
+    //! shard is locked while visited.
+    template<typename Visit>
+    void for_each_entry(Visit f) const {
+        for (size_type i = 0; i < _nshards; i++) {
+            std::lock_guard<std::mutex> lock(_shards[i].mtx);
+            for (const auto& e : _shards[i].lru)
+                if (not f(e.first, e.second)) return;
+        }
+    }
+
+    //! Insert an entry as the least recently used one of its shard,
+    //! unless the shard is full or already holds x. Return true if
+    //! inserted. Not a miss.
+    bool preload(const argument_type& x, const result_type& y) {
+        Shard& sh = shard_of(x);
+        std::lock_guard<std::mutex> lock(sh.mtx);
+        if (sh.index.size() >= sh.n or sh.index.find(x) != sh.index.end())
+            return false;
+        sh.lru.emplace_back(x, y);
+        sh.index.emplace(x, --sh.lru.end());
+        ++_nentries;
+        return true;
+    }
+
+protected:
+    struct alignas(64) Shard {
+        std::mutex mtx;
+        map index;
+        list lru;
+        pending inflight;
+        size_type n = 0;
+    };
+
+    std::unique_ptr<Shard[]> _shards;
+    size_type _nshards;               // shards allocated
+    unsigned _max_shift;              // log2 of _nshards
+    std::atomic<unsigned> _shift;     // log2 of the shards in use
+
+    Shard& shard_of(const argument_type& x) const {
+        // Fibonacci hashing, so that weak hashes still spread out.
+        uint64_t h = Hash()(x) * 0x9E3779B97F4A7C15ULL;
+        unsigned shift = _shift.load(std::memory_order_relaxed);
+        return _shards[(0 == shift) ? 0 : h >> (64 - shift)];
+    }
+
+    void evict(Shard& sh) const {
+        while (sh.index.size() > sh.n) {
+            sh.index.erase(sh.lru.back().first);
+            sh.lru.pop_back();
+            --_nentries;
+            ++_evictions;
+        }
+    }
+};
+
 /**
  * Unlimited cache, will grow as much as necessary. Thread safe!!!
+ * Concurrent misses on the same key call the function only once;
+ * see single_flight.
  */
 template<typename F,
          typename Hash=boost::hash<typename F::argument_type>,
@@ -528,9 +1485,11 @@ struct inf_cache : public F, public inf_cache_base {
     typedef boost::shared_mutex cache_mutex;
     typedef boost::shared_lock<cache_mutex> shared_lock;
     typedef boost::unique_lock<cache_mutex> unique_lock;
+    typedef single_flight<argument_type, result_type, Hash, Equals> pending;
 
     inf_cache(const F& f=F(), const std::string name = "inf_cache")
-        : F(f), inf_cache_base(name) {}
+        : F(f), inf_cache_base(name)
+    { estimate_entry_bytes<argument_type, result_type>(); }
 
     result_type operator()(const argument_type& x) const {
         // hit?
@@ -542,24 +1501,79 @@ struct inf_cache : public F, public inf_cache_base {
                 return it->second;
             }
         }
-        // then miss
-        ++_misses;
-        result_type y = F::operator()(x);
+        // then miss; unless some other thread is already on it.
+        typename pending::future fut;
+        typename pending::promise prom;
         {
             unique_lock lock(_mutex);
-            return _map[x] = y;
+            auto it = _map.find(x);
+            if (it != _map.end()) {
+                ++_hits;
+                return it->second;
+            }
+            ++_misses;
+            if (_inflight.join(x, fut, prom)) ++_collapsed;
+        }
+        if (fut.valid()) return fut.get();
+
+        try {
+            result_type y = F::operator()(x);
+            {
+                unique_lock lock(_mutex);
+                _inflight.finish(x);
+                _map[x] = y;
+                note_size(_map.size());
+            }
+            prom->set_value(y);
+            return y;
+        } catch(...) {
+            {
+                unique_lock lock(_mutex);
+                _inflight.finish(x);
+            }
+            prom->set_exception(std::current_exception());
+            throw;
         }
     }
+
+    bool full() const { return false; }
+
+    //! Call f(x, y) on every entry, in no particular order, as long as
+    //! f returns true.
+    template<typename Visit>
+    void for_each_entry(Visit f) const {
+        shared_lock lock(_mutex);
+        for (const auto& e : _map)
+            if (not f(e.first, e.second)) return;
+    }
+
+    //! Insert an entry, unless x is already there. Return true if
+    //! inserted. Not a miss.
+    bool preload(const argument_type& x, const result_type& y) {
+        unique_lock lock(_mutex);
+        if (not _map.emplace(x, y).second) return false;
+        note_size(_map.size());
+        return true;
+    }
 protected:
     mutable cache_mutex _mutex;
     mutable map _map;
+    mutable pending _inflight;
 };
 
 /// Cache adjusting automatically its size to avoid running out of RAM
-/// or not using enough of the available RAM. The adjustment is done
-/// every n calls (as provided in the constructor).
+/// or not using enough of the available RAM.
+///
+/// The memory pressure is polled in the background, by the
+/// memory_monitor, which knows about container (cgroup) memory limits.
+/// The monitor thread only decides on a new size; the resize itself is
+/// done by the next thread to make a call, so that the cache is never
+/// touched from the monitor thread. Whether the cache is full is
+/// sampled every ncycles calls (as provided in the constructor); the
+/// cache is only grown if it was full.
 ///
-/// WARNING!!!! This code is NOT thread safe!!!!!!
+/// This wrapper is thread safe: it is safe to call it from many
+/// threads at once, if the wrapped cache is (e.g. sharded_lru_cache).
 ///
 /// Besides it also should be implemented so that it inherits the
 /// cache given in the constructor (that way attributes of the cache
@@ -568,10 +1582,11 @@ template<typename Cache>
 struct adaptive_cache {
     typedef typename Cache::result_type result_type;
     typedef typename Cache::argument_type argument_type;
+    typedef typename Cache::size_type size_type;
 
-    /// If 1 - (free memory / total memory) > ulimit then the cache size is
-    /// divided by ufrac. If used 1 - (free memory / total memory) < llimit then
-    /// the cache size is multiplied by lfact.
+    /// If the memory pressure (the fraction of the memory in use) is
+    /// above ulimit, then the cache size is divided by ufrac. If it is
+    /// below llimit, then the cache size is multiplied by lfact.
     /// Try not to set ulimit above 90%, as otherwise, the Linux kernel
     /// obligingly tries to swap everything out to disk (see vm.swappiness
     /// setting & LKML discussions w/ AKPM)
@@ -579,47 +1594,80 @@ struct adaptive_cache {
                    unsigned ncycles = 1000,
                    float llimit = 0.75, float lfact = 2,
                    float ulimit = 0.90, float ufrac = 2)
-        : _cache(cache), _counter(0), _ncycles(ncycles),
+        : _cache(cache), _counter(0), _ncycles(std::max(1U, ncycles)),
           _llimit(llimit), _lfact(lfact),
-          _ulimit(ulimit), _ufrac(ufrac) {}
+          _ulimit(ulimit), _ufrac(ufrac),
+          _target(cache.max_size()), _pending(0), _was_full(false)
+    {
+        _listener = memory_monitor::instance().add(
+            [this](double pressure) { on_pressure(pressure); });
+    }
+
+    ~adaptive_cache()
+    {
+        memory_monitor::instance().remove(_listener);
+    }
 
     result_type operator()(const argument_type& x) const {
+        unsigned n = _pending.exchange(0);
+        if (0 < n) {
+            std::lock_guard<std::mutex> lock(_resize_mutex);
+            _cache.resize(n);
+        }
+
+        if (_counter++ % _ncycles == 0)
+            _was_full = _cache.full();
+        return _cache(x);
+    }
+
+    size_type get_misses() const { return _cache.get_misses(); }
+    size_type get_hits() const { return _cache.get_hits(); }
+
+    /// Called by the memory_monitor.
+    void on_pressure(double pressure) {
         using boost::numeric_cast;
         using boost::numeric::positive_overflow;
         using std::numeric_limits;
 
-        if(_counter++ % _ncycles == 0) {
-            float tram = getTotalRAM();
-            float fram = getFreeRAM();
-            float free_mem_ratio = 1 - fram/tram;
-            if(free_mem_ratio < _llimit && _cache.full()) {
-                try {
-                    _cache.resize(numeric_cast<unsigned>(_cache.max_size()*_lfact));
-                } catch(positive_overflow&) {
-                    _cache.resize(numeric_limits<unsigned>::max());
-                }
-            }
-            else if(free_mem_ratio > _ulimit) {
-                _cache.resize(std::max(1U, (unsigned)(_cache.max_size()/_ufrac)));
+        unsigned n = _target;
+        if (pressure < _llimit and _was_full) {
+            try {
+                n = numeric_cast<unsigned>(n * _lfact);
+            } catch(positive_overflow&) {
+                n = numeric_limits<unsigned>::max();
             }
+            // Don't grow again before seeing that it filled up.
+            _was_full = false;
         }
-        return _cache(x);
+        else if (pressure > _ulimit) {
+            n = std::max(1U, (unsigned)(n / _ufrac));
+        }
+        if (n == _target) return;
+        _target = n;
+        _pending = n;
     }
 
-    unsigned get_misses() const { return _cache.get_misses(); }
-    unsigned get_hits() const { return _cache.get_hits(); }
-
 private:
     Cache& _cache;
 
-    mutable unsigned _counter; // call counter, if it eventually wraps around
-                               // it's no big deal
+    mutable std::atomic<unsigned> _counter; // call counter, if it
+                                            // eventually wraps around
+                                            // it's no big deal
 
     unsigned _ncycles;
     float _llimit;
     float _lfact;
     float _ulimit;
     float _ufrac;
+
+    std::atomic<unsigned> _target;          // the size decided upon
+    mutable std::atomic<unsigned> _pending; // not yet applied, or 0
+    mutable std::atomic<bool> _was_full;
+    mutable std::mutex _resize_mutex;
+    unsigned _listener;
+
+    adaptive_cache(const adaptive_cache&) = delete;
+    adaptive_cache& operator=(const adaptive_cache&) = delete;
 };
 
 
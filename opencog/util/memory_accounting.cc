@@ -0,0 +1,124 @@
+/*
+ * opencog/util/memory_accounting.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+#include <opencog/util/memory_accounting.h>
+#include <opencog/util/platform.h>
+
+using namespace opencog;
+
+namespace {
+
+struct registry
+{
+    std::mutex mtx;
+    std::set<const memory_account*> accounts;
+    std::map<unsigned, std::pair<std::string, std::function<size_t()>>>
+        sources;
+    unsigned next_id = 0;
+};
+
+// Constructed by the first account or source, so that it outlives
+// all the static ones.
+registry& get_registry()
+{
+    static registry reg;
+    return reg;
+}
+
+} // ~namespace
+
+memory_account::memory_account(const std::string& name)
+    : _name(name), _bytes(0), _peak(0)
+{
+    registry& reg = get_registry();
+    std::lock_guard<std::mutex> lock(reg.mtx);
+    reg.accounts.insert(this);
+}
+
+memory_account::~memory_account()
+{
+    registry& reg = get_registry();
+    std::lock_guard<std::mutex> lock(reg.mtx);
+    reg.accounts.erase(this);
+}
+
+unsigned opencog::add_memory_source(const std::string& name,
+                                    std::function<size_t()> f)
+{
+    registry& reg = get_registry();
+    std::lock_guard<std::mutex> lock(reg.mtx);
+    unsigned id = reg.next_id++;
+    reg.sources[id] = std::make_pair(name, std::move(f));
+    return id;
+}
+
+void opencog::remove_memory_source(unsigned id)
+{
+    registry& reg = get_registry();
+    std::lock_guard<std::mutex> lock(reg.mtx);
+    reg.sources.erase(id);
+}
+
+std::vector<memory_usage> opencog::memory_accounts()
+{
+    // Sources are called under the lock, so that they cannot be
+    // called once removed.
+    std::map<std::string, memory_usage> by_name;
+    {
+        registry& reg = get_registry();
+        std::lock_guard<std::mutex> lock(reg.mtx);
+        for (const memory_account* a : reg.accounts)
+        {
+            memory_usage& mu = by_name[a->name()];
+            mu.bytes += a->bytes();
+            mu.peak += a->peak();
+        }
+        for (const auto& s : reg.sources)
+            by_name[s.second.first].bytes += s.second.second();
+    }
+
+    std::vector<memory_usage> res;
+    for (auto& nm : by_name)
+    {
+        nm.second.name = nm.first;
+        res.push_back(std::move(nm.second));
+    }
+    return res;
+}
+
+std::string opencog::memory_report()
+{
+    std::stringstream ss;
+    ss << get_memory_sample().to_string() << "\n";
+    ss.precision(1);
+    ss << std::fixed;
+    for (const memory_usage& mu : memory_accounts())
+    {
+        ss << mu.name << ": " << double(mu.bytes) / (1 << 20) << "MB";
+        if (0 < mu.peak)
+            ss << " (peak=" << double(mu.peak) / (1 << 20) << "MB)";
+        ss << "\n";
+    }
+    return ss.str();
+}
@@ -0,0 +1,108 @@
+/*
+ * opencog/util/memory_accounting.h
+ *
+ * Counts of the bytes held by each subsystem.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_MEMORY_ACCOUNTING_H
+#define _OPENCOG_MEMORY_ACCOUNTING_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! The bytes held by one subsystem, as reported by its own code.
+///
+/// The code that allocates on behalf of the subsystem calls add() and
+/// sub(); each is a single relaxed atomic add, so the hooks can stay
+/// in place in production. Accounts register themselves when
+/// constructed, and leave when destroyed, so memory_accounts() lists
+/// every live one. They are meant to be long lived, typically static:
+///
+///     static memory_account acct("my subsystem");
+///     acct.add(n * sizeof(node));
+///
+/// Several accounts may have the same name; their counts are listed
+/// under that name, summed.
+class memory_account
+{
+public:
+    explicit memory_account(const std::string& name);
+    ~memory_account();
+
+    void add(size_t bytes)
+    {
+        int64_t b = _bytes.fetch_add(bytes, std::memory_order_relaxed)
+            + int64_t(bytes);
+        int64_t p = _peak.load(std::memory_order_relaxed);
+        while (p < b and not _peak.compare_exchange_weak(
+                   p, b, std::memory_order_relaxed)) {}
+    }
+    void sub(size_t bytes)
+    {
+        _bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    int64_t bytes() const { return _bytes.load(std::memory_order_relaxed); }
+    int64_t peak() const { return _peak.load(std::memory_order_relaxed); }
+    const std::string& name() const { return _name; }
+
+private:
+    memory_account(const memory_account&) = delete;
+    memory_account& operator=(const memory_account&) = delete;
+
+    std::string _name;
+    std::atomic<int64_t> _bytes;
+    std::atomic<int64_t> _peak;
+};
+
+//! The bytes of a subsystem that knows its own memory use, and is
+//! asked for it, rather than keeping an account: the function is
+//! called by memory_accounts(), from whatever thread calls that.
+/// Returns an id, for remove_memory_source().
+unsigned add_memory_source(const std::string& name,
+                           std::function<size_t()>);
+void remove_memory_source(unsigned id);
+
+//! One line of memory_accounts()
+struct memory_usage
+{
+    std::string name;
+    int64_t bytes = 0;
+    int64_t peak = 0;       // 0 for sources, which keep no peak
+};
+
+//! The bytes of every account and source, by name.
+std::vector<memory_usage> memory_accounts();
+
+//! The memory sample of the process (see get_memory_sample()), then
+//! one line per account and source.
+std::string memory_report();
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_MEMORY_ACCOUNTING_H
@@ -0,0 +1,105 @@
+/*
+ * opencog/util/memory_monitor.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/util/memory_monitor.h>
+#include <opencog/util/platform.h>
+
+using namespace opencog;
+
+memory_monitor& memory_monitor::instance()
+{
+    static memory_monitor mon;
+    return mon;
+}
+
+memory_monitor::memory_monitor()
+    : _next_id(1), _interval_msec(1000), _pressure(0.0), _stopping(false)
+{}
+
+memory_monitor::~memory_monitor()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _stopping = true;
+    }
+    _cond.notify_all();
+    if (_thread.joinable()) _thread.join();
+}
+
+unsigned memory_monitor::add(Listener l)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    unsigned id = _next_id++;
+    _listeners[id] = l;
+    if (not _thread.joinable())
+        _thread = std::thread(&memory_monitor::loop, this);
+    return id;
+}
+
+void memory_monitor::remove(unsigned id)
+{
+    // Wait for any poll in progress.
+    std::lock_guard<std::mutex> clock(_call_mtx);
+    std::lock_guard<std::mutex> lock(_mtx);
+    _listeners.erase(id);
+}
+
+void memory_monitor::set_interval(unsigned msec)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _interval_msec = (0 == msec) ? 1 : msec;
+    }
+    _cond.notify_all();
+}
+
+void memory_monitor::set_source(Source src)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    _source = src;
+}
+
+void memory_monitor::poll()
+{
+    std::lock_guard<std::mutex> clock(_call_mtx);
+    Source src;
+    std::map<unsigned, Listener> listeners;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        src = _source;
+        listeners = _listeners;
+    }
+
+    double p = src ? src() : getMemoryPressure();
+    _pressure = p;
+    for (auto& idl : listeners) idl.second(p);
+}
+
+void memory_monitor::loop()
+{
+    std::unique_lock<std::mutex> lock(_mtx);
+    while (not _stopping)
+    {
+        _cond.wait_for(lock, std::chrono::milliseconds(_interval_msec));
+        if (_stopping) break;
+        lock.unlock();
+        poll();
+        lock.lock();
+    }
+}
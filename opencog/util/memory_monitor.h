@@ -0,0 +1,102 @@
+/*
+ * opencog/util/memory_monitor.h
+ *
+ * Background polling of memory pressure.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_MEMORY_MONITOR_H
+#define _OPENCOG_MEMORY_MONITOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! Polls the memory pressure in a background thread, and tells all
+//! registered listeners about it.
+///
+/// The pressure is the fraction of the available memory in use, as
+/// given by getMemoryPressure(): relative to the cgroup limit when
+/// running in a container, and to the physical RAM otherwise. Reading
+/// it takes several system calls; having one thread do that, every
+/// so often, keeps them off of everyone else's hot path.
+///
+/// The thread is started by the first add(), and runs until the
+/// process exits. The listeners are called from that thread, one at
+/// a time; once remove() returns, that listener will not be called
+/// again.
+class memory_monitor
+{
+public:
+    typedef std::function<void(double)> Listener;
+    typedef std::function<double()> Source;
+
+    static memory_monitor& instance();
+
+    /// Register a listener, to be called with the pressure after each
+    /// poll. Returns an id, for remove().
+    unsigned add(Listener);
+    void remove(unsigned id);
+
+    /// Milliseconds between polls; the default is 1000.
+    void set_interval(unsigned msec);
+
+    /// Replace getMemoryPressure() by some other source of pressure
+    /// readings; mostly for testing. An empty Source restores the
+    /// default.
+    void set_source(Source);
+
+    /// Poll now, in the calling thread, and call the listeners.
+    void poll();
+
+    /// The most recent reading.
+    double get_pressure() const { return _pressure; }
+
+    ~memory_monitor();
+
+private:
+    memory_monitor();
+    memory_monitor(const memory_monitor&) = delete;
+    memory_monitor& operator=(const memory_monitor&) = delete;
+
+    void loop();
+
+    std::mutex _mtx;        // guards everything but the listener calls
+    std::mutex _call_mtx;   // held while calling the listeners
+    std::condition_variable _cond;
+    std::map<unsigned, Listener> _listeners;
+    unsigned _next_id;
+    unsigned _interval_msec;
+    Source _source;
+    std::atomic<double> _pressure;
+    std::thread _thread;
+    bool _stopping;
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_MEMORY_MONITOR_H
@@ -29,16 +29,18 @@
 
 using namespace opencog;
 
-// MIT HAKMEM Count
 unsigned int opencog::bitcount(unsigned long n)
 {
-    /* works for 32-bit numbers only    */
-    /* fix last line for 64-bit numbers */
-    unsigned long tmp;
-
-    tmp = n - ((n >> 1) & 033333333333)
-          - ((n >> 2) & 011111111111);
-    return ((tmp + (tmp >> 3)) & 030707070707) % 63;
+#ifdef __GNUC__
+    // The POPCNT insn, where the target has it.
+    return __builtin_popcountl(n);
+#else
+    unsigned long long x = n;
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+#endif
 }
 
 #ifndef CYGWIN
@@ -44,6 +44,7 @@ namespace opencog
 
 /**
  * Counts the number of bits in 1 in the given unsigned long argument.
+ * For the bits of a whole array, see popcount() in numeric.h.
  */
 unsigned int bitcount(unsigned long n);
 
@@ -0,0 +1,178 @@
+/*
+ * opencog/util/mpsc_ring.h
+ *
+ * Bounded multi-producer, single-consumer ring buffer.
+ * The slot sequencing follows Dmitry Vyukov's bounded MPMC queue,
+ * specialized here for the case of a single consumer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OC_MPSC_RING_H
+#define _OC_MPSC_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! A bounded, lock-free, multi-producer single-consumer ring buffer.
+///
+/// The ring consists of a fixed number of pre-allocated slots. Each
+/// producer claims a slot with a single compare-and-swap on the tail
+/// counter, copies its element into the slot, and then publishes it.
+/// No locks are taken, and, if the Element type re-uses its storage
+/// on assignment (as std::string does, when the new value fits into
+/// the existing capacity), then no memory is allocated either.
+///
+/// There must be only one consumer. The consumer inspects the
+/// published slots with peek() and at(), processes as many as it
+/// wishes to, in place, and then hands them back with release(). This
+/// allows the consumer to work on a whole batch of elements at once,
+/// without copying them out of the ring.
+///
+/// If the ring is full, try_push() fails, and it is up to the caller
+/// to decide what to do (wait, drop, or go elsewhere).
+///
+/// The capacity is rounded up to a power of two.
+
+template<typename Element>
+class mpsc_ring
+{
+private:
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        Element data;
+    };
+
+    std::vector<Slot> _slots;
+    size_t _mask;
+
+    // Keep the producer and consumer counters on different cache
+    // lines, so that they don't ping-pong between cores.
+    alignas(64) std::atomic<size_t> _tail;
+    alignas(64) std::atomic<size_t> _head;
+
+    mpsc_ring(const mpsc_ring&) = delete;
+    mpsc_ring& operator=(const mpsc_ring&) = delete;
+
+public:
+    /// Create a ring with (at least) nslots slots. Each slot is
+    /// initialized with a copy of proto; use proto to pre-reserve
+    /// storage in the slots.
+    mpsc_ring(size_t nslots, const Element& proto = Element())
+    {
+        size_t cap = 2;
+        while (cap < nslots) cap <<= 1;
+        _mask = cap - 1;
+
+        _slots = std::vector<Slot>(cap);
+        for (size_t i = 0; i < cap; i++)
+        {
+            _slots[i].seq.store(i, std::memory_order_relaxed);
+            _slots[i].data = proto;
+        }
+        _tail.store(0, std::memory_order_relaxed);
+        _head.store(0, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const noexcept { return _mask + 1; }
+
+    /// Copy the Element into the ring. Return false if the ring is
+    /// full. Safe to call from any number of threads.
+    bool try_push(const Element& item)
+    {
+        size_t pos = _tail.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true)
+        {
+            slot = &_slots[pos & _mask];
+            size_t seq = slot->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+            if (0 == diff)
+            {
+                if (_tail.compare_exchange_weak(pos, pos + 1,
+                                                std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = _tail.load(std::memory_order_relaxed);
+        }
+
+        slot->data = item;
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Return the number of published elements at the head of the
+    /// ring, up to max.  These are ready for at(). Consumer only.
+    size_t peek(size_t max) const
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        size_t n = 0;
+        while (n < max and n <= _mask and
+               _slots[(head + n) & _mask].seq.load(std::memory_order_acquire)
+                   == head + n + 1)
+            n++;
+        return n;
+    }
+
+    /// The i'th published element, counting from the head. Only valid
+    /// for i less than the value last returned by peek(). Consumer only.
+    Element& at(size_t i)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        return _slots[(head + i) & _mask].data;
+    }
+
+    /// Hand the first n elements back to the producers. The slots keep
+    /// their contents (and storage) until they are overwritten.
+    /// Consumer only.
+    void release(size_t n)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < n; i++)
+            _slots[(head + i) & _mask].seq.store(head + i + _mask + 1,
+                                                 std::memory_order_release);
+        _head.store(head + n, std::memory_order_release);
+    }
+
+    /// Return the number of reserved slots at this instant in time.
+    /// This includes slots that have been claimed by producers, but
+    /// not yet published. The head is loaded first, so that it cannot
+    /// have moved past the tail, which would wrap the difference.
+    size_t size() const
+    {
+        size_t head = _head.load(std::memory_order_acquire);
+        size_t tail = _tail.load(std::memory_order_acquire);
+        return std::min(tail - head, _mask + 1);
+    }
+
+    bool is_empty() const { return 0 == size(); }
+
+    static bool is_lock_free() noexcept { return true; }
+};
+/** @}*/
+
+#endif // _OC_MPSC_RING_H
@@ -0,0 +1,591 @@
+/*
+ * opencog/util/numeric.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "numeric.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// The distance kernels are plain loops, which the compiler vectorizes:
+// the reductions are marked "omp simd", which lets it reorder the sums
+// (it may not otherwise, floating point addition not being
+// associative). Where the toolchain supports it, each kernel is also
+// compiled for AVX2 and AVX-512, and the best version for the CPU is
+// picked when the library is loaded (GCC function multiversioning).
+// Elsewhere the baseline instruction set is used (NEON is baseline on
+// aarch64).
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) \
+    && defined(__linux__)
+#define OC_DISPATCH __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define OC_DISPATCH
+#endif
+
+#define OC_INLINE inline __attribute__((always_inline))
+
+namespace opencog
+{
+
+namespace {
+
+// DISTANCE_EPSILON of numeric.h, which does not export it.
+const double distance_epsilon = 1e-32;
+
+template<typename T>
+OC_INLINE T sum_abs_diff_loop(const T* a, const T* b, size_t n)
+{
+    T sum = 0;
+#pragma omp simd reduction(+:sum)
+    for (size_t i = 0; i < n; i++)
+        sum += std::fabs(a[i] - b[i]);
+    return sum;
+}
+
+template<typename T>
+OC_INLINE T sum_sq_diff_loop(const T* a, const T* b, size_t n)
+{
+    T sum = 0;
+#pragma omp simd reduction(+:sum)
+    for (size_t i = 0; i < n; i++)
+    {
+        T d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+template<typename T>
+OC_INLINE T max_abs_diff_loop(const T* a, const T* b, size_t n)
+{
+    T res = 0;
+#pragma omp simd reduction(max:res)
+    for (size_t i = 0; i < n; i++)
+        res = std::max(res, std::fabs(a[i] - b[i]));
+    return res;
+}
+
+// The three inner products a.b, a.a and b.b, in one pass.
+template<typename T>
+OC_INLINE void dots_loop(const T* a, const T* b, size_t n,
+                         T& ab, T& aa, T& bb)
+{
+    T sab = 0, saa = 0, sbb = 0;
+#pragma omp simd reduction(+:sab, saa, sbb)
+    for (size_t i = 0; i < n; i++)
+    {
+        sab += a[i] * b[i];
+        saa += a[i] * a[i];
+        sbb += b[i] * b[i];
+    }
+    ab = sab;
+    aa = saa;
+    bb = sbb;
+}
+
+OC_DISPATCH double sum_abs_diff(const double* a, const double* b, size_t n)
+{ return sum_abs_diff_loop(a, b, n); }
+OC_DISPATCH float sum_abs_diff(const float* a, const float* b, size_t n)
+{ return sum_abs_diff_loop(a, b, n); }
+
+OC_DISPATCH double sum_sq_diff(const double* a, const double* b, size_t n)
+{ return sum_sq_diff_loop(a, b, n); }
+OC_DISPATCH float sum_sq_diff(const float* a, const float* b, size_t n)
+{ return sum_sq_diff_loop(a, b, n); }
+
+OC_DISPATCH double max_abs_diff(const double* a, const double* b, size_t n)
+{ return max_abs_diff_loop(a, b, n); }
+OC_DISPATCH float max_abs_diff(const float* a, const float* b, size_t n)
+{ return max_abs_diff_loop(a, b, n); }
+
+OC_DISPATCH void dots(const double* a, const double* b, size_t n,
+                      double& ab, double& aa, double& bb)
+{ dots_loop(a, b, n, ab, aa, bb); }
+OC_DISPATCH void dots(const float* a, const float* b, size_t n,
+                      float& ab, float& aa, float& bb)
+{ dots_loop(a, b, n, ab, aa, bb); }
+
+template<typename T>
+T p_norm(const T* a, const T* b, size_t n, T p)
+{
+    if (1.0 == p) return sum_abs_diff(a, b, n);
+    if (2.0 == p) return std::sqrt(sum_sq_diff(a, b, n));
+    if (0.0 >= p) return max_abs_diff(a, b, n);
+
+    // pow does not vectorize; nothing to gain here.
+    T sum = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        T diff = std::fabs(a[i] - b[i]);
+        if (0.0 < diff)
+            sum += std::pow(diff, p);
+    }
+    return std::pow(sum, 1 / p);
+}
+
+template<typename T>
+T tanimoto(const T* a, const T* b, size_t n)
+{
+    T ab, aa, bb;
+    dots(a, b, n, ab, aa, bb);
+    T numerator = aa + bb - ab;
+    if (numerator >= T(distance_epsilon))
+        return 1 - (ab / numerator);
+    else
+        return 0;
+}
+
+template<typename T>
+T angular(const T* a, const T* b, size_t n, bool pos_n_neg)
+{
+    T ab, aa, bb;
+    dots(a, b, n, ab, aa, bb);
+    T numerator = std::sqrt(aa * bb);
+    if (numerator >= T(distance_epsilon)) {
+        // in case of rounding error
+        T r = clamp(ab / numerator, T(-1), T(1));
+        return (pos_n_neg ? 1 : 2) * std::acos(r) / M_PI;
+    }
+    else
+        return 0;
+}
+
+// Points are processed in tiles of about this many bytes, so that the
+// tile stays in L1 while every query is run against it.
+const size_t tile_bytes = 16 * 1024;
+
+template<typename T>
+size_t tile_rows(size_t dim)
+{
+    return std::max<size_t>(1, tile_bytes / (sizeof(T) * std::max<size_t>(1, dim)));
+}
+
+template<typename T>
+void p_norm_many(const T* q, const T* points, size_t n, size_t dim, T p,
+                 T* out)
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = p_norm(q, points + i * dim, dim, p);
+}
+
+template<typename T>
+OC_INLINE T dot_loop(const T* a, const T* b, size_t dim)
+{
+    T sum = 0;
+#pragma omp simd reduction(+:sum)
+    for (size_t k = 0; k < dim; k++)
+        sum += a[k] * b[k];
+    return sum;
+}
+
+// Rows of y are taken dot_cols at a time, transposed, so that the
+// products with a row of x are a sum of scaled columns: dot_cols
+// independent sums, in vector registers, and no horizontal additions.
+// Rows of x are taken 4 at a time, so that each value of y loaded
+// serves 4 products.
+const size_t dot_cols = 32;
+
+// out[r * ny + c] = x_r . yt_c, for r in [0, rows), c in [0, cols),
+// where yt holds dot_cols transposed rows of y.
+template<typename T, size_t rows>
+OC_INLINE void dot_block(const T* x, size_t dim, const T* yt, size_t cols,
+                         T* out, size_t ny)
+{
+    T acc[rows][dot_cols] = {};
+    for (size_t k = 0; k < dim; k++)
+    {
+        const T* ytk = yt + k * dot_cols;
+        for (size_t r = 0; r < rows; r++)
+        {
+            const T xk = x[r * dim + k];
+#pragma omp simd
+            for (size_t c = 0; c < dot_cols; c++)
+                acc[r][c] += xk * ytk[c];
+        }
+    }
+    for (size_t r = 0; r < rows; r++)
+        for (size_t c = 0; c < cols; c++)
+            out[r * ny + c] = acc[r][c];
+}
+
+// out[i * ny + j] = x_i . y_j
+template<typename T>
+OC_INLINE void dot_matrix_loop(const T* x, size_t nx, const T* y, size_t ny,
+                               size_t dim, T* out)
+{
+    std::vector<T> yt(dim * dot_cols);
+    for (size_t j0 = 0; j0 < ny; j0 += dot_cols)
+    {
+        size_t cols = std::min(dot_cols, ny - j0);
+        std::fill(yt.begin(), yt.end(), T(0));
+        for (size_t c = 0; c < cols; c++)
+            for (size_t k = 0; k < dim; k++)
+                yt[k * dot_cols + c] = y[(j0 + c) * dim + k];
+        size_t i = 0;
+        for (; i + 4 <= nx; i += 4)
+            dot_block<T, 4>(x + i * dim, dim, yt.data(), cols,
+                            out + i * ny + j0, ny);
+        for (; i < nx; i++)
+            dot_block<T, 1>(x + i * dim, dim, yt.data(), cols,
+                            out + i * ny + j0, ny);
+    }
+}
+
+OC_DISPATCH void dot_matrix(const double* x, size_t nx, const double* y,
+                            size_t ny, size_t dim, double* out)
+{ dot_matrix_loop(x, nx, y, ny, dim, out); }
+OC_DISPATCH void dot_matrix(const float* x, size_t nx, const float* y,
+                            size_t ny, size_t dim, float* out)
+{ dot_matrix_loop(x, nx, y, ny, dim, out); }
+
+OC_DISPATCH void squared_norms(const double* x, size_t n, size_t dim,
+                               double* out)
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = dot_loop(x + i * dim, x + i * dim, dim);
+}
+OC_DISPATCH void squared_norms(const float* x, size_t n, size_t dim,
+                               float* out)
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = dot_loop(x + i * dim, x + i * dim, dim);
+}
+
+template<typename T>
+void pairwise_p_norm(const T* x, size_t nx, const T* y, size_t ny,
+                     size_t dim, T p, T* out)
+{
+    const size_t tile = tile_rows<T>(dim);
+    for (size_t j0 = 0; j0 < ny; j0 += tile)
+    {
+        size_t j1 = std::min(ny, j0 + tile);
+        for (size_t i = 0; i < nx; i++)
+            for (size_t j = j0; j < j1; j++)
+                out[i * ny + j] = p_norm(x + i * dim, y + j * dim, dim, p);
+    }
+}
+
+template<typename T>
+void pairwise_euclidean(const T* x, size_t nx, const T* y, size_t ny,
+                        size_t dim, T* out)
+{
+    std::vector<T> xx(nx), yy(ny);
+    squared_norms(x, nx, dim, xx.data());
+    squared_norms(y, ny, dim, yy.data());
+    dot_matrix(x, nx, y, ny, dim, out);
+    for (size_t i = 0; i < nx; i++)
+        for (size_t j = 0; j < ny; j++)
+        {
+            T& o = out[i * ny + j];
+            // |x - y|^2 = |x|^2 + |y|^2 - 2 x.y, which may round below 0
+            o = std::sqrt(std::max(T(0), xx[i] + yy[j] - 2 * o));
+        }
+}
+
+template<typename T>
+void pairwise_angular(const T* x, size_t nx, const T* y, size_t ny,
+                      size_t dim, bool pos_n_neg, T* out)
+{
+    std::vector<T> xx(nx), yy(ny);
+    squared_norms(x, nx, dim, xx.data());
+    squared_norms(y, ny, dim, yy.data());
+    dot_matrix(x, nx, y, ny, dim, out);
+    for (size_t i = 0; i < nx; i++)
+        for (size_t j = 0; j < ny; j++)
+        {
+            T& o = out[i * ny + j];
+            T numerator = std::sqrt(xx[i] * yy[j]);
+            if (numerator >= T(distance_epsilon)) {
+                T r = clamp(o / numerator, T(-1), T(1));
+                o = (pos_n_neg ? 1 : 2) * std::acos(r) / M_PI;
+            }
+            else
+                o = 0;
+        }
+}
+
+} // ~namespace
+
+double p_norm_distance(const double* a, const double* b, size_t n, double p)
+{ return p_norm(a, b, n, p); }
+float p_norm_distance(const float* a, const float* b, size_t n, float p)
+{ return p_norm(a, b, n, p); }
+
+double tanimoto_distance(const double* a, const double* b, size_t n)
+{ return tanimoto(a, b, n); }
+float tanimoto_distance(const float* a, const float* b, size_t n)
+{ return tanimoto(a, b, n); }
+
+double angular_distance(const double* a, const double* b, size_t n,
+                        bool pos_n_neg)
+{ return angular(a, b, n, pos_n_neg); }
+float angular_distance(const float* a, const float* b, size_t n,
+                       bool pos_n_neg)
+{ return angular(a, b, n, pos_n_neg); }
+
+void p_norm_distances(const double* q, const double* points, size_t n,
+                      size_t dim, double p, double* out)
+{ p_norm_many(q, points, n, dim, p, out); }
+void p_norm_distances(const float* q, const float* points, size_t n,
+                      size_t dim, float p, float* out)
+{ p_norm_many(q, points, n, dim, p, out); }
+
+void pairwise_p_norm_distances(const double* x, size_t nx, const double* y,
+                               size_t ny, size_t dim, double p, double* out)
+{ pairwise_p_norm(x, nx, y, ny, dim, p, out); }
+void pairwise_p_norm_distances(const float* x, size_t nx, const float* y,
+                               size_t ny, size_t dim, float p, float* out)
+{ pairwise_p_norm(x, nx, y, ny, dim, p, out); }
+
+void pairwise_euclidean_distances(const double* x, size_t nx, const double* y,
+                                  size_t ny, size_t dim, double* out)
+{ pairwise_euclidean(x, nx, y, ny, dim, out); }
+void pairwise_euclidean_distances(const float* x, size_t nx, const float* y,
+                                  size_t ny, size_t dim, float* out)
+{ pairwise_euclidean(x, nx, y, ny, dim, out); }
+
+void pairwise_angular_distances(const double* x, size_t nx, const double* y,
+                                size_t ny, size_t dim, bool pos_n_neg,
+                                double* out)
+{ pairwise_angular(x, nx, y, ny, dim, pos_n_neg, out); }
+void pairwise_angular_distances(const float* x, size_t nx, const float* y,
+                                size_t ny, size_t dim, bool pos_n_neg,
+                                float* out)
+{ pairwise_angular(x, nx, y, ny, dim, pos_n_neg, out); }
+
+// The bit counts over words combine the words of a and b (for a
+// single array, b is a and the combination is just a), count the bits
+// of the combination, and sum the counts. There is a kernel for each
+// instruction set, picked once, by the first call, from the CPU it
+// runs on:
+//  - AVX-512 VPOPCNTDQ counts the bits of 8 words in one instruction;
+//  - AVX2 has no bit count, so it looks up the count of each 4 bits
+//    in a table of 16 (with PSHUFB), and sums the bytes with PSADBW;
+//  - POPCNT counts one word at a time;
+//  - the default is the compiler's own bit count.
+enum class bit_op { none, and_, or_, xor_ };
+
+template<bit_op Op>
+OC_INLINE uint64_t combine(uint64_t a, uint64_t b)
+{
+    if (Op == bit_op::and_) return a & b;
+    if (Op == bit_op::or_) return a | b;
+    if (Op == bit_op::xor_) return a ^ b;
+    return a;
+}
+
+template<bit_op Op>
+size_t popcount_default(const uint64_t* a, const uint64_t* b, size_t n)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++)
+        count += __builtin_popcountll(combine<Op>(a[i], b[i]));
+    return count;
+}
+
+typedef size_t (*popcount_kernel)(const uint64_t*, const uint64_t*, size_t);
+
+struct popcount_kernels
+{
+    popcount_kernel none, and_, or_, xor_;
+    const char* isa;
+};
+
+template<template<bit_op> class K>
+popcount_kernels make_kernels(const char* isa)
+{
+    return { K<bit_op::none>::run, K<bit_op::and_>::run,
+             K<bit_op::or_>::run, K<bit_op::xor_>::run, isa };
+}
+
+template<bit_op Op>
+struct default_kernel
+{
+    static size_t run(const uint64_t* a, const uint64_t* b, size_t n)
+    { return popcount_default<Op>(a, b, n); }
+};
+
+#if defined(__GNUC__) && defined(__x86_64__)
+
+#define OC_TARGET(isa) __attribute__((target(isa)))
+
+template<bit_op Op>
+struct popcnt_kernel
+{
+    OC_TARGET("popcnt")
+    static size_t run(const uint64_t* a, const uint64_t* b, size_t n)
+    {
+        // Four sums, so that the adds do not wait on each other
+        size_t c0 = 0, c1 = 0, c2 = 0, c3 = 0, i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            c0 += __builtin_popcountll(combine<Op>(a[i], b[i]));
+            c1 += __builtin_popcountll(combine<Op>(a[i+1], b[i+1]));
+            c2 += __builtin_popcountll(combine<Op>(a[i+2], b[i+2]));
+            c3 += __builtin_popcountll(combine<Op>(a[i+3], b[i+3]));
+        }
+        for (; i < n; i++)
+            c0 += __builtin_popcountll(combine<Op>(a[i], b[i]));
+        return c0 + c1 + c2 + c3;
+    }
+};
+
+template<bit_op Op>
+OC_TARGET("avx2") OC_INLINE __m256i combine_avx2(const uint64_t* a,
+                                                 const uint64_t* b)
+{
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+    if (Op == bit_op::none) return x;
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+    if (Op == bit_op::and_) return _mm256_and_si256(x, y);
+    if (Op == bit_op::or_) return _mm256_or_si256(x, y);
+    return _mm256_xor_si256(x, y);
+}
+
+template<bit_op Op>
+struct avx2_kernel
+{
+    OC_TARGET("avx2")
+    static size_t run(const uint64_t* a, const uint64_t* b, size_t n)
+    {
+        const __m256i table = _mm256_setr_epi8(
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i low = _mm256_set1_epi8(0x0f);
+        __m256i sum = _mm256_setzero_si256();
+        size_t i = 0;
+        while (i + 4 <= n)
+        {
+            // The counts of bytes add up to at most 8 per word, so
+            // 31 of them fit in a byte before they are summed.
+            __m256i bytes = _mm256_setzero_si256();
+            for (size_t j = 0; j < 31 and i + 4 <= n; j++, i += 4)
+            {
+                __m256i v = combine_avx2<Op>(a + i, b + i);
+                __m256i lo = _mm256_and_si256(v, low);
+                __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+                bytes = _mm256_add_epi8(bytes,
+                    _mm256_add_epi8(_mm256_shuffle_epi8(table, lo),
+                                    _mm256_shuffle_epi8(table, hi)));
+            }
+            sum = _mm256_add_epi64(sum, _mm256_sad_epu8(
+                                       bytes, _mm256_setzero_si256()));
+        }
+        size_t count = _mm256_extract_epi64(sum, 0)
+            + _mm256_extract_epi64(sum, 1) + _mm256_extract_epi64(sum, 2)
+            + _mm256_extract_epi64(sum, 3);
+        return count + popcnt_kernel<Op>::run(a + i, b + i, n - i);
+    }
+};
+
+template<bit_op Op>
+OC_TARGET("avx512f") OC_INLINE __m512i combine_avx512(__mmask8 m,
+                                                      const uint64_t* a,
+                                                      const uint64_t* b)
+{
+    __m512i x = _mm512_maskz_loadu_epi64(m, a);
+    if (Op == bit_op::none) return x;
+    __m512i y = _mm512_maskz_loadu_epi64(m, b);
+    if (Op == bit_op::and_) return _mm512_and_si512(x, y);
+    if (Op == bit_op::or_) return _mm512_or_si512(x, y);
+    return _mm512_xor_si512(x, y);
+}
+
+template<bit_op Op>
+struct avx512_kernel
+{
+    OC_TARGET("avx512f,avx512vpopcntdq")
+    static size_t run(const uint64_t* a, const uint64_t* b, size_t n)
+    {
+        __m512i s0 = _mm512_setzero_si512(), s1 = _mm512_setzero_si512();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            s0 = _mm512_add_epi64(s0, _mm512_popcnt_epi64(
+                                      combine_avx512<Op>(0xff, a + i, b + i)));
+            s1 = _mm512_add_epi64(s1, _mm512_popcnt_epi64(
+                                      combine_avx512<Op>(0xff, a + i + 8,
+                                                         b + i + 8)));
+        }
+        // The last words, under a mask
+        for (; i < n; i += 8)
+        {
+            __mmask8 m = n - i < 8 ? (1U << (n - i)) - 1 : 0xff;
+            s0 = _mm512_add_epi64(s0, _mm512_popcnt_epi64(
+                                      combine_avx512<Op>(m, a + i, b + i)));
+        }
+        uint64_t lanes[8];
+        _mm512_storeu_si512(lanes, _mm512_add_epi64(s0, s1));
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+            + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+    }
+};
+
+static popcount_kernels select_kernels()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")
+        and __builtin_cpu_supports("avx512vpopcntdq"))
+        return make_kernels<avx512_kernel>("avx512vpopcntdq");
+    if (__builtin_cpu_supports("avx2"))
+        return make_kernels<avx2_kernel>("avx2");
+    if (__builtin_cpu_supports("popcnt"))
+        return make_kernels<popcnt_kernel>("popcnt");
+    return make_kernels<default_kernel>("default");
+}
+
+#else
+
+static popcount_kernels select_kernels()
+{
+    return make_kernels<default_kernel>("default");
+}
+
+#endif
+
+static const popcount_kernels& kernels()
+{
+    static const popcount_kernels k = select_kernels();
+    return k;
+}
+
+size_t popcount(const uint64_t* words, size_t n_words)
+{
+    return kernels().none(words, words, n_words);
+}
+
+const char* popcount_isa()
+{
+    return kernels().isa;
+}
+
+size_t hamming_distance(const uint64_t* a, const uint64_t* b, size_t n_words)
+{
+    return kernels().xor_(a, b, n_words);
+}
+
+double tanimoto_distance(const uint64_t* a, const uint64_t* b, size_t n_words)
+{
+    // For bits, sum a_i^2 + sum b_i^2 - sum a_i b_i is |a or b|.
+    const popcount_kernels& k = kernels();
+    size_t both = k.and_(a, b, n_words), either = k.or_(a, b, n_words);
+    return either ? 1 - double(both) / either : 0;
+}
+
+} // ~namespace opencog
@@ -26,9 +26,12 @@
 #include <algorithm> // for std::max
 #include <cmath>
 #include <climits>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <limits>
 #include <numeric>
+#include <type_traits>
 #include <vector>
 
 #include <boost/range/numeric.hpp>
@@ -285,6 +288,88 @@ Float generalized_mean(const C& c, Float p = 1.0)
     return generalized_mean(c.begin(), c.end(), p);
 }
 
+/// The distances below, over arrays of n doubles or floats. These are
+/// compiled in the library, with vectorized loops, for several
+/// instruction sets where the toolchain allows it, the best one being
+/// picked at run time. The templates below call them for std::vector
+/// of double and float.
+double p_norm_distance(const double* a, const double* b, size_t n, double p);
+float p_norm_distance(const float* a, const float* b, size_t n, float p);
+double tanimoto_distance(const double* a, const double* b, size_t n);
+float tanimoto_distance(const float* a, const float* b, size_t n);
+double angular_distance(const double* a, const double* b, size_t n,
+                        bool pos_n_neg = true);
+float angular_distance(const float* a, const float* b, size_t n,
+                       bool pos_n_neg = true);
+
+/// Batches of distances, over points stored row by row, dim values
+/// each, in one contiguous array (as in a std::vector of n * dim
+/// values); they are faster than as many calls to the above, as the
+/// points are worked on in tiles that stay in cache.
+///
+/// p_norm_distances writes in out[i] the distance from the query q to
+/// point i of points, for i in [0, n).
+void p_norm_distances(const double* q, const double* points, size_t n,
+                      size_t dim, double p, double* out);
+void p_norm_distances(const float* q, const float* points, size_t n,
+                      size_t dim, float p, float* out);
+
+/// The pairwise_ functions write in out[i * ny + j] the distance
+/// between row i of x, for i in [0, nx), and row j of y, for j in
+/// [0, ny).
+void pairwise_p_norm_distances(const double* x, size_t nx, const double* y,
+                               size_t ny, size_t dim, double p, double* out);
+void pairwise_p_norm_distances(const float* x, size_t nx, const float* y,
+                               size_t ny, size_t dim, float p, float* out);
+
+/// Euclidean and angular distances take the matrix product route:
+/// they compute all the dot products x_i . y_j, as a matrix product,
+/// by blocks of 4 x 32 pairs held in registers, and derive the distances
+/// from them and the norms, as |x - y|^2 = |x|^2 + |y|^2 - 2 x.y. That
+/// is several times faster than pairwise_p_norm_distances for p = 2,
+/// but less exact for points very close to one another (with an error
+/// of the order of sqrt(epsilon) times their norm).
+void pairwise_euclidean_distances(const double* x, size_t nx, const double* y,
+                                  size_t ny, size_t dim, double* out);
+void pairwise_euclidean_distances(const float* x, size_t nx, const float* y,
+                                  size_t ny, size_t dim, float* out);
+void pairwise_angular_distances(const double* x, size_t nx, const double* y,
+                                size_t ny, size_t dim, bool pos_n_neg,
+                                double* out);
+void pairwise_angular_distances(const float* x, size_t nx, const float* y,
+                                size_t ny, size_t dim, bool pos_n_neg,
+                                float* out);
+
+/// The distances between binary vectors packed in n_words 64-bit
+/// words, by counting bits. The Hamming distance is the p-norm
+/// distance for p = 1 (and its square root that for p = 2).
+///
+/// These, and popcount(), use the bit count instructions of the CPU
+/// they run on (AVX-512 VPOPCNTDQ, else AVX2, else POPCNT), picked at
+/// the first call.
+size_t hamming_distance(const uint64_t* a, const uint64_t* b, size_t n_words);
+double tanimoto_distance(const uint64_t* a, const uint64_t* b, size_t n_words);
+
+/// The number of bits set in the n_words 64-bit words.
+size_t popcount(const uint64_t* words, size_t n_words);
+
+/// The instruction set used by the bit counts above: "avx512vpopcntdq",
+/// "avx2", "popcnt" or "default".
+const char* popcount_isa();
+
+namespace detail {
+
+// std::vector of double or float, for which the kernels above apply.
+template<typename Vec>
+struct is_real_vector : std::false_type {};
+
+template<typename T, typename A>
+struct is_real_vector<std::vector<T, A>>
+    : std::integral_constant<bool, std::is_same<T, double>::value
+                             or std::is_same<T, float>::value> {};
+
+} // ~namespace detail
+
 /// Compute the distance between two vectors, using the p-norm.  For
 /// p=2, this is the usual Eucliden distance, and for p=1, this is the
 /// Manhattan distance, and for p=0 or negative, this is the maximum
@@ -296,6 +381,11 @@ Float p_norm_distance(const Vec& a, const Vec& b, Float p=1.0)
                "Cannot compare unequal-sized vectors!  %d %d\n",
                a.size(), b.size());
 
+    if constexpr (detail::is_real_vector<Vec>::value) {
+        typedef typename Vec::value_type T;
+        return p_norm_distance(a.data(), b.data(), a.size(), T(p));
+    }
+
     typename Vec::const_iterator ia = a.begin(), ib = b.begin();
 
     Float sum = 0.0;
@@ -363,6 +453,9 @@ Float tanimoto_distance(const Vec& a, const Vec& b)
                "Cannot compare unequal-sized vectors!  %d %d\n",
                a.size(), b.size());
 
+    if constexpr (detail::is_real_vector<Vec>::value)
+        return tanimoto_distance(a.data(), b.data(), a.size());
+
     Float ab = boost::inner_product(a, b, Float(0)),
         aa = boost::inner_product(a, a, Float(0)),
         bb = boost::inner_product(b, b, Float(0)),
@@ -399,11 +492,14 @@ Float angular_distance(const Vec& a, const Vec& b, bool pos_n_neg = true)
                "Cannot compare unequal-sized vectors!  %d %d\n",
                a.size(), b.size());
 
-    // XXX FIXME writing out the explicit loop will almost
-    // surely be faster than calling boost. Why? Because a single
-    // loop allows the compiler to insert instructions into the
-    // pipeline bubbles; whereas three different loops will be more
-    // than three times slower!
+    // For other vectors than these, writing out the explicit loop
+    // would be faster than calling boost: a single loop allows the
+    // compiler to insert instructions into the pipeline bubbles;
+    // whereas three different loops will be more than three times
+    // slower!
+    if constexpr (detail::is_real_vector<Vec>::value)
+        return angular_distance(a.data(), b.data(), a.size(), pos_n_neg);
+
     Float ab = boost::inner_product(a, b, Float(0)),
         aa = boost::inner_product(a, a, Float(0)),
         bb = boost::inner_product(b, b, Float(0)),
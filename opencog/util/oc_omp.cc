@@ -20,11 +20,18 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <thread>
+
 #include "oc_omp.h"
 
 namespace opencog {
 
+// Without OpenMP, the number of threads last set, for the thread
+// pools; 0 until set.
+static unsigned configured_threads = 0;
+
 void setting_omp(unsigned num_threads, unsigned min_n) {
+    configured_threads = num_threads;
 #ifdef OC_OMP
     omp_set_dynamic(false);
     omp_set_num_threads(num_threads);
@@ -44,6 +51,15 @@ unsigned num_threads() {
 #endif
 }
 
+unsigned pool_threads() {
+#ifdef OC_OMP
+    return omp_get_max_threads();
+#else
+    if (configured_threads) return configured_threads;
+    return std::max(1U, std::thread::hardware_concurrency());
+#endif
+}
+
 std::pair<unsigned, unsigned> split_jobs(unsigned n_jobs) {
     unsigned n_jobs1 = n_jobs / 2;
     unsigned n_jobs2 = std::max(1U, n_jobs - n_jobs1);
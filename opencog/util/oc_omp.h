@@ -68,6 +68,12 @@ void setting_omp(unsigned num_threads, unsigned min_n = 50);
 //! returns the number of threads as configured by setting_omp
 unsigned num_threads();
 
+//! returns the number of workers of the thread pool of thread_pool.h.
+//! With OpenMP, that is num_threads(); without, it is still the number
+//! set by setting_omp (by default, the number of hardware threads),
+//! whereas num_threads() is 1.
+unsigned pool_threads();
+
 //! split the number of jobs in 2. For instance if n_jobs is 3, then it
 //! returns <1, 2>.
 /// This function is convenient for parallalizing
@@ -21,13 +21,6 @@
  */
 
 #include <stdlib.h>
-#include <string>
-#include <time.h>
-#ifdef WIN32_NOT_UNIX
-#include <winsock2.h>
-#else
-#include <sys/time.h>
-#endif
 
 #include <opencog/util/octime.h>
 #include <opencog/util/exceptions.h>
@@ -41,12 +34,12 @@ namespace opencog {
  * Time used as reference to set/get timestamps over the code
  * Used as a handy-dandy but crude profiling utility
  */
-static timeval referenceTime;
+static uint64_t referenceTime;
 static bool referenceTimeInitialized = false;
 
 void init_reference_time()
 {
-    gettimeofday(&referenceTime, NULL);
+    referenceTime = monotonic_nanos();
     referenceTimeInitialized = true;
 }
 
@@ -54,11 +47,7 @@ unsigned long get_elapsed_millis()
 {
     OC_ASSERT(referenceTimeInitialized,
             "utils - refenceTimeInitialized should have been initialized.");
-    timeval currentTime;
-    gettimeofday(&currentTime, NULL);
-    return (currentTime.tv_sec -referenceTime.tv_sec)*1000 + (currentTime.tv_usec - referenceTime.tv_usec) / 1000;
+    return (monotonic_nanos() - referenceTime) / 1000000;
 }
 
-
 };
-
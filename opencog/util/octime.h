@@ -23,6 +23,9 @@
 #ifndef OPENCOG_UTILS_TIME_H
 #define OPENCOG_UTILS_TIME_H
 
+#include <chrono>
+#include <cstdint>
+
 namespace opencog
 {
 /** \addtogroup grp_cogutil
@@ -36,10 +39,34 @@ void init_reference_time();
 /**
  * Reference time is initialized with initReferenceTime() function.
  * The initReferenceTime() function must be called before
- * first invocation of this function.
+ * first invocation of this function. The clock is monotonic: it does
+ * not jump when the system time is set.
  */
 unsigned long get_elapsed_millis();
 
+//! Nanoseconds on the monotonic clock, from an arbitrary origin
+/**
+ * A read of std::chrono::steady_clock, that is clock_gettime through
+ * the vDSO on Linux: a few tens of nanoseconds, and consistent across
+ * cores, unlike a raw TSC read.
+ */
+inline uint64_t monotonic_nanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//! An interval timer, in nanoseconds
+class stopwatch
+{
+    uint64_t _start;
+public:
+    stopwatch() : _start(monotonic_nanos()) {}
+    void restart() { _start = monotonic_nanos(); }
+    uint64_t elapsed_nanos() const { return monotonic_nanos() - _start; }
+    double elapsed_seconds() const { return elapsed_nanos() * 1e-9; }
+};
+
 /** @}*/
 } // namespace opencog
 
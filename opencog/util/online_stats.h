@@ -0,0 +1,428 @@
+/*
+ * opencog/util/online_stats.h
+ *
+ * Statistics computed in one pass, by accumulators that merge: mean
+ * and variance, generalized means, entropy and quantiles.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_ONLINE_STATS_H
+#define _OPENCOG_ONLINE_STATS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <opencog/util/oc_assert.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+/**
+ * \file online_stats.h
+ *
+ * Where entropy() and generalized_mean() in numeric.h, or the boost
+ * accumulators, need the whole sample in one place, these see each
+ * value once, and keep a few numbers (or, for entropy and quantiles,
+ * bounded tables). Accumulators of the same type and parameters
+ * merge into the accumulator of both samples, so that each thread
+ * may keep its own, without sharing anything, and the results be
+ * combined at the end; for instance with parallel_reduce() in
+ * thread_pool.h:
+ *
+ *     online_moments m = parallel_reduce(0, n, 4096, online_moments(),
+ *         [&](size_t lo, size_t hi) {
+ *             online_moments part;
+ *             for (size_t i = lo; i < hi; i++) part.add(x[i]);
+ *             return part;
+ *         },
+ *         [](online_moments a, const online_moments& b) {
+ *             a.merge(b);
+ *             return a;
+ *         });
+ */
+
+//! Count, mean, variance, min and max of a sample
+///
+/// Welford's update, which does not lose precision as the sum of
+/// squares does when the variance is small compared to the mean; the
+/// merge is that of Chan et al.
+class online_moments
+{
+public:
+    void add(double x)
+    {
+        _n++;
+        double d = x - _mean;
+        _mean += d / _n;
+        _m2 += d * (x - _mean);
+        _min = std::min(_min, x);
+        _max = std::max(_max, x);
+    }
+
+    template<typename It>
+    void add(It from, It to)
+    {
+        for (; from != to; ++from) add(*from);
+    }
+
+    void merge(const online_moments& other)
+    {
+        if (0 == other._n) return;
+        if (0 == _n) { *this = other; return; }
+        double n = _n + other._n, d = other._mean - _mean;
+        _mean += d * other._n / n;
+        _m2 += other._m2 + d * d * _n * other._n / n;
+        _n += other._n;
+        _min = std::min(_min, other._min);
+        _max = std::max(_max, other._max);
+    }
+
+    void clear() { *this = online_moments(); }
+
+    uint64_t count() const { return _n; }
+    double mean() const { return _n ? _mean : NAN; }
+    double sum() const { return _n * _mean; }
+
+    /// Variance of the sample (the mean square deviation)
+    double variance() const { return _n ? _m2 / _n : NAN; }
+    /// Unbiased estimate of the variance of the population
+    double sample_variance() const { return 1 < _n ? _m2 / (_n - 1) : NAN; }
+    double std_dev() const { return std::sqrt(variance()); }
+
+    /// +inf and -inf when empty
+    double min() const { return _min; }
+    double max() const { return _max; }
+
+private:
+    uint64_t _n = 0;
+    double _mean = 0;
+    double _m2 = 0;
+    double _min = std::numeric_limits<double>::infinity();
+    double _max = -std::numeric_limits<double>::infinity();
+};
+
+//! Generalized mean, (sum_i x_i^p / n)^(1/p), of positive values
+///
+/// For p = 0 it is the geometric mean, kept as the sum of the logs,
+/// so that it does not overflow as the product of the values does.
+class online_generalized_mean
+{
+public:
+    explicit online_generalized_mean(double p = 1.0) : _p(p) {}
+
+    void add(double x)
+    {
+        _n++;
+        _sum += 0 == _p ? std::log(x) : 1 == _p ? x : std::pow(x, _p);
+    }
+
+    template<typename It>
+    void add(It from, It to)
+    {
+        for (; from != to; ++from) add(*from);
+    }
+
+    void merge(const online_generalized_mean& other)
+    {
+        OC_ASSERT(_p == other._p,
+                  "online_generalized_mean::merge - different exponents.");
+        _n += other._n;
+        _sum += other._sum;
+    }
+
+    void clear() { _n = 0; _sum = 0; }
+
+    uint64_t count() const { return _n; }
+    double p() const { return _p; }
+
+    double mean() const
+    {
+        if (0 == _n) return NAN;
+        if (0 == _p) return std::exp(_sum / _n);
+        return std::pow(_sum / _n, 1.0 / _p);
+    }
+
+private:
+    double _p;
+    uint64_t _n = 0;
+    double _sum = 0;
+};
+
+//! Entropy, in bits, of the distribution of the values added
+///
+/// Keeps the count of each distinct value; the entropy is
+/// log2(N) - sum_i c_i log2(c_i) / N for counts c_i summing to N,
+/// the same as entropy() in numeric.h of the frequencies c_i / N.
+template<typename T, typename Hash = boost::hash<T>>
+class online_entropy
+{
+public:
+    typedef boost::unordered_map<T, uint64_t, Hash> count_map;
+
+    void add(const T& x, uint64_t n = 1)
+    {
+        _counts[x] += n;
+        _total += n;
+    }
+
+    void merge(const online_entropy& other)
+    {
+        for (const auto& v : other._counts) _counts[v.first] += v.second;
+        _total += other._total;
+    }
+
+    void clear() { _counts.clear(); _total = 0; }
+
+    uint64_t total_count() const { return _total; }
+    const count_map& counts() const { return _counts; }
+
+    double entropy() const
+    {
+        if (0 == _total) return 0;
+        double sum = 0;
+        for (const auto& v : _counts)
+            if (v.second) sum += v.second * std::log2(double(v.second));
+        return std::max(0.0, std::log2(double(_total)) - sum / _total);
+    }
+
+private:
+    count_map _counts;
+    uint64_t _total = 0;
+};
+
+//! Quantiles of a sample, to within a fraction of a percent, in
+//! bounded memory: a merging t-digest (Dunning and Ertl)
+///
+/// The values are summarized by at most about compression centroids
+/// (a mean and a weight each), smaller near the tails, so that the
+/// extreme quantiles are as accurate as the median: with the default
+/// compression of 100, quantiles are typically within 0.1% of rank
+/// (the 99.9th percentile is found between the 99.8th and the
+/// 100th). The min and max are exact.
+///
+/// Values are added to a buffer, merged into the centroids when it
+/// is full (or the digest is queried), which amortizes the sort. As
+/// the queries may merge the buffer, a digest shared between threads
+/// needs a lock even for them; better give each thread its own.
+class tdigest
+{
+public:
+    explicit tdigest(double compression = 100)
+        : _delta(compression)
+    {
+        OC_ASSERT(10 <= compression,
+                  "tdigest - compression must be at least 10.");
+        _buffer.reserve(buffer_size());
+    }
+
+    void add(double x, double w = 1)
+    {
+        if (not (0 < w)) return;
+        _buffer.push_back({x, w});
+        _count += w;
+        _min = std::min(_min, x);
+        _max = std::max(_max, x);
+        if (buffer_size() <= _buffer.size()) compress();
+    }
+
+    template<typename It>
+    void add(It from, It to)
+    {
+        for (; from != to; ++from) add(*from);
+    }
+
+    void merge(const tdigest& other)
+    {
+        for (const centroid& c : other._centroids) _buffer.push_back(c);
+        for (const centroid& c : other._buffer) _buffer.push_back(c);
+        _count += other._count;
+        _min = std::min(_min, other._min);
+        _max = std::max(_max, other._max);
+        compress();
+    }
+
+    void clear()
+    {
+        _centroids.clear();
+        _buffer.clear();
+        _count = 0;
+        _min = std::numeric_limits<double>::infinity();
+        _max = -std::numeric_limits<double>::infinity();
+    }
+
+    /// Total weight (number of values, when unweighted)
+    double count() const { return _count; }
+    double compression() const { return _delta; }
+    double min() const { return _min; }
+    double max() const { return _max; }
+
+    /// Number of centroids, once the buffer is merged
+    size_t size() const { compress(); return _centroids.size(); }
+
+    /// The value below which a fraction q of the weight lies, q in
+    /// [0, 1]; NaN when empty.
+    double quantile(double q) const
+    {
+        OC_ASSERT(0 <= q and q <= 1, "tdigest::quantile - q = %g", q);
+        compress();
+        if (_centroids.empty()) return NAN;
+        if (1 == _centroids.size()) return _centroids[0].mean;
+
+        // Each centroid holds half of its weight on either side of
+        // its mean; interpolate between the means, and between the
+        // outer ones and the min and max.
+        double target = q * _count;
+        const centroid& first = _centroids.front();
+        const centroid& last = _centroids.back();
+        if (target < first.weight / 2)
+            return _min + (first.mean - _min) * target / (first.weight / 2);
+        if (_count - last.weight / 2 < target)
+            return last.mean + (_max - last.mean)
+                * (target - (_count - last.weight / 2)) / (last.weight / 2);
+
+        double left = first.weight / 2;     // weight below the mean of i
+        for (size_t i = 0; i + 1 < _centroids.size(); i++)
+        {
+            const centroid& a = _centroids[i];
+            const centroid& b = _centroids[i + 1];
+            double gap = (a.weight + b.weight) / 2;
+            if (target <= left + gap)
+                return a.mean + (b.mean - a.mean) * (target - left) / gap;
+            left += gap;
+        }
+        return last.mean;
+    }
+
+    /// The fraction of the weight below x
+    double cdf(double x) const
+    {
+        compress();
+        if (_centroids.empty()) return NAN;
+        if (x < _min) return 0;
+        if (_max <= x) return 1;
+        if (1 == _centroids.size())
+            return _max == _min ? 0.5 : (x - _min) / (_max - _min);
+
+        const centroid& first = _centroids.front();
+        const centroid& last = _centroids.back();
+        if (x < first.mean)
+            return first.weight / 2 * (x - _min) / (first.mean - _min)
+                / _count;
+        if (last.mean <= x)
+            return (_count - last.weight / 2
+                    + last.weight / 2 * (x - last.mean) / (_max - last.mean))
+                / _count;
+
+        double left = first.weight / 2;
+        for (size_t i = 0; i + 1 < _centroids.size(); i++)
+        {
+            const centroid& a = _centroids[i];
+            const centroid& b = _centroids[i + 1];
+            double gap = (a.weight + b.weight) / 2;
+            if (x < b.mean)
+                return (left + gap * (x - a.mean) / (b.mean - a.mean))
+                    / _count;
+            left += gap;
+        }
+        return 1;
+    }
+
+private:
+    struct centroid
+    {
+        double mean;
+        double weight;
+        bool operator<(const centroid& other) const
+        { return mean < other.mean; }
+    };
+
+    size_t buffer_size() const { return size_t(5 * _delta); }
+
+    // The scale function k1: a centroid spans at most 1 unit of k,
+    // which is steep near q = 0 and q = 1, so that centroids there
+    // are small.
+    double k_of_q(double q) const
+    {
+        return _delta / (2 * M_PI) * std::asin(2 * q - 1);
+    }
+    double q_of_k(double k) const
+    {
+        if (_delta / 4 <= k) return 1;
+        return (std::sin(k * 2 * M_PI / _delta) + 1) / 2;
+    }
+
+    // Merge the buffer into the centroids, in one pass over both,
+    // sorted by mean. The passes go up and down in turn, so that the
+    // merges do not all drift the same way.
+    void compress() const
+    {
+        if (_buffer.empty()) return;
+        _buffer.insert(_buffer.end(), _centroids.begin(), _centroids.end());
+        std::sort(_buffer.begin(), _buffer.end());
+        _reverse = not _reverse;
+        if (_reverse) std::reverse(_buffer.begin(), _buffer.end());
+
+        _centroids.clear();
+        double total = 0;
+        for (const centroid& c : _buffer) total += c.weight;
+
+        centroid cur = _buffer[0];
+        double done = 0;
+        double limit = total * q_of_k(k_of_q(0) + 1);
+        for (size_t i = 1; i < _buffer.size(); i++)
+        {
+            const centroid& c = _buffer[i];
+            if (done + cur.weight + c.weight <= limit)
+            {
+                cur.weight += c.weight;
+                cur.mean += (c.mean - cur.mean) * c.weight / cur.weight;
+            }
+            else
+            {
+                done += cur.weight;
+                _centroids.push_back(cur);
+                limit = total * q_of_k(k_of_q(done / total) + 1);
+                cur = c;
+            }
+        }
+        _centroids.push_back(cur);
+        if (_reverse) std::reverse(_centroids.begin(), _centroids.end());
+        _buffer.clear();
+    }
+
+    double _delta;
+    mutable std::vector<centroid> _centroids;
+    mutable std::vector<centroid> _buffer;
+    mutable bool _reverse = false;
+    double _count = 0;
+    double _min = std::numeric_limits<double>::infinity();
+    double _max = -std::numeric_limits<double>::infinity();
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_ONLINE_STATS_H
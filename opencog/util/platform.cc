@@ -25,6 +25,7 @@
 
 #include "platform.h"
 #include <stdlib.h>
+#include <algorithm>
 
 namespace opencog {
 
@@ -223,3 +224,164 @@ uint64_t opencog::getFreeRAM()
     return getpagesize() * sysconf(_SC_AVPHYS_PAGES);
 }
 #endif // __APPLE__
+
+#ifdef __linux__
+#include <fstream>
+
+// Read a single number from a cgroup file. "max" means no limit.
+static bool read_cgroup_value(const std::string& path, uint64_t& val)
+{
+    std::ifstream in(path);
+    std::string word;
+    if (not (in >> word) or word == "max") return false;
+    val = strtoull(word.c_str(), NULL, 10);
+    return true;
+}
+
+// The directory of this process's cgroup v2, from the "0::" line.
+static std::string cgroup_v2_dir()
+{
+    std::ifstream in("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(in, line))
+        if (0 == line.compare(0, 3, "0::"))
+            return "/sys/fs/cgroup" + line.substr(3);
+    return "/sys/fs/cgroup";
+}
+
+bool opencog::getCgroupMemory(uint64_t& used, uint64_t& limit)
+{
+    // cgroup v2. Inside a container, /proc/self/cgroup usually says
+    // "0::/", and the container's own limits are at the root.
+    std::string dirs[] = { cgroup_v2_dir(), "/sys/fs/cgroup" };
+    for (const std::string& dir : dirs)
+        if (read_cgroup_value(dir + "/memory.max", limit) and
+            read_cgroup_value(dir + "/memory.current", used))
+            return true;
+
+    // cgroup v1. With no limit, the limit reads as a huge number.
+    const std::string v1 = "/sys/fs/cgroup/memory/";
+    if (read_cgroup_value(v1 + "memory.limit_in_bytes", limit) and
+        limit < getTotalRAM() and
+        read_cgroup_value(v1 + "memory.usage_in_bytes", used))
+        return true;
+    return false;
+}
+#else // __linux__
+bool opencog::getCgroupMemory(uint64_t& used, uint64_t& limit)
+{
+    return false;
+}
+#endif // __linux__
+
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#define HAVE_MALLINFO2 1
+#include <malloc.h>
+#endif
+
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+
+// Defined only if jemalloc is linked in.
+extern "C" int mallctl(const char*, void*, size_t*, void*, size_t)
+    __attribute__((weak));
+
+static void sample_allocator(opencog::memory_sample& ms)
+{
+    if (mallctl)
+    {
+        // The statistics are refreshed by writing to "epoch".
+        uint64_t epoch = 1;
+        size_t sz = sizeof(epoch);
+        mallctl("epoch", &epoch, &sz, &epoch, sz);
+        size_t allocated = 0, resident = 0;
+        sz = sizeof(size_t);
+        if (0 == mallctl("stats.allocated", &allocated, &sz, NULL, 0) and
+            0 == mallctl("stats.resident", &resident, &sz, NULL, 0))
+        {
+            ms.heap_allocated = allocated;
+            ms.heap_retained = resident;
+            ms.allocator = "jemalloc";
+            return;
+        }
+    }
+#ifdef HAVE_MALLINFO2
+    struct mallinfo2 mi = mallinfo2();
+    ms.heap_allocated = mi.uordblks + mi.hblkhd;
+    ms.heap_retained = mi.arena + mi.hblkhd;
+    ms.allocator = "glibc";
+#endif
+}
+
+#ifdef __linux__
+// The Rss lines of /proc/self/status, in kB.
+static void sample_rss(opencog::memory_sample& ms)
+{
+    std::ifstream in("/proc/self/status");
+    std::string key;
+    uint64_t kb;
+    while (in >> key)
+    {
+        uint64_t* field = nullptr;
+        if ("VmRSS:" == key) field = &ms.rss;
+        else if ("RssAnon:" == key) field = &ms.rss_anon;
+        else if ("RssFile:" == key) field = &ms.rss_file;
+        else if ("RssShmem:" == key) field = &ms.rss_shmem;
+        if (field and in >> kb) *field = kb * 1024;
+        in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+}
+#else
+static void sample_rss(opencog::memory_sample&) {}
+#endif
+
+opencog::memory_sample opencog::get_memory_sample(unsigned max_age_ms)
+{
+    static std::mutex mtx;
+    static memory_sample last;
+    static bool sampled = false;
+
+    using namespace std::chrono;
+    uint64_t now = duration_cast<milliseconds>(
+        steady_clock::now().time_since_epoch()).count();
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (sampled and now - last.taken_at_ms < max_age_ms) return last;
+
+    memory_sample ms;
+    sample_rss(ms);
+    if (not getCgroupMemory(ms.cgroup_used, ms.cgroup_limit))
+        ms.cgroup_used = ms.cgroup_limit = 0;
+    sample_allocator(ms);
+    ms.taken_at_ms = now;
+    last = ms;
+    sampled = true;
+    return ms;
+}
+
+std::string opencog::memory_sample::to_string() const
+{
+    auto mb = [](uint64_t b) { return double(b) / (1 << 20); };
+    std::stringstream ss;
+    ss.precision(1);
+    ss << std::fixed << "rss=" << mb(rss) << "MB (anon=" << mb(rss_anon)
+       << " file=" << mb(rss_file) << " shmem=" << mb(rss_shmem) << ")";
+    if (0 < cgroup_limit)
+        ss << " cgroup=" << mb(cgroup_used) << "/" << mb(cgroup_limit) << "MB";
+    if (*allocator)
+        ss << " heap=" << mb(heap_allocated) << "/" << mb(heap_retained)
+           << "MB (" << allocator << ")";
+    return ss.str();
+}
+
+double opencog::getMemoryPressure()
+{
+    uint64_t used, limit;
+    if (getCgroupMemory(used, limit) and 0 < limit)
+        return std::min(1.0, double(used) / limit);
+    return 1.0 - double(getFreeRAM()) / getTotalRAM();
+}
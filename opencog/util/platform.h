@@ -94,6 +94,43 @@ uint64_t getTotalRAM();
 //! Return the total number of free bytes avaiable in RAM (excluding OS caches)
 uint64_t getFreeRAM();
 
+//! Get the memory usage and limit of the cgroup (v2, else v1) that
+//! this process runs in, in bytes. Return false if there is no cgroup
+//! memory limit, e.g. when not running in a container.
+bool getCgroupMemory(uint64_t& used, uint64_t& limit);
+
+//! Return the fraction of the available memory that is in use, from
+//! 0.0 to 1.0. This is relative to the cgroup memory limit, if there
+//! is one, and to the physical RAM otherwise.
+double getMemoryPressure();
+
+//! A breakdown of the memory of this process, in bytes. Fields that
+//! cannot be had on this platform are 0.
+struct memory_sample
+{
+    uint64_t rss = 0;             //!< resident set size
+    uint64_t rss_anon = 0;        //!< resident heap, stacks, and the like
+    uint64_t rss_file = 0;        //!< resident code and mapped files
+    uint64_t rss_shmem = 0;       //!< resident shared memory
+    uint64_t cgroup_used = 0;     //!< by the whole cgroup
+    uint64_t cgroup_limit = 0;    //!< 0 if there is no cgroup limit
+    uint64_t heap_allocated = 0;  //!< handed out by malloc, not yet freed
+    uint64_t heap_retained = 0;   //!< held by malloc, whether in use or not
+    const char* allocator = "";   //!< "glibc" or "jemalloc", if known
+    uint64_t taken_at_ms = 0;     //!< monotonic time of the sample
+
+    std::string to_string() const;
+};
+
+//! Return a sample of the memory of this process.
+///
+/// Taking one reads /proc and the cgroup files, and asks the
+/// allocator: mallinfo2() for glibc malloc, mallctl() when jemalloc is
+/// linked in. So samples are cached: the last one is returned if it
+/// is less than max_age_ms old, and all threads share it. Pass 0 for
+/// a fresh one.
+memory_sample get_memory_sample(unsigned max_age_ms = 1000);
+
 //! Return the OS username
 const char* getUserName();
 
@@ -25,9 +25,20 @@
 #ifndef _OPENCOG_UTIL_POOL_H
 #define _OPENCOG_UTIL_POOL_H
 
-#include <queue>
-#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include <opencog/util/trace_event.h>
 
 namespace opencog {
 /** \addtogroup grp_cogutil
@@ -79,13 +90,14 @@ class pool
         /// Fetch a resource from the pool. Block if the pool is empty.
         /// If blocked, this will unblock when a resource is put into
         /// the pool.
-        Resource& borrow()
+        Resource borrow()
         {
             std::unique_lock<std::mutex> lock(mu);
             while (objs.empty()) {
+                OC_TRACE_SCOPE("pool::wait");
                 cond.wait(lock);
             }
-            Resource& rv = objs.front();
+            Resource rv = std::move(objs.front());
             objs.pop();
             return rv;
         }
@@ -99,6 +111,12 @@ class pool
             objs.push(obj);
             cond.notify_one();
         }
+        void give_back(Resource&& obj)
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            objs.push(std::move(obj));
+            cond.notify_one();
+        }
 
         size_t available()
         {
@@ -111,6 +129,320 @@ class pool
         std::queue<Resource> objs;
 };
 
+//! Counters of a resource_pool
+struct resource_pool_stats
+{
+    size_t created = 0;       ///< by the factory, in all
+    size_t destroyed = 0;     ///< by discard(), trim() or a full pool
+    size_t live = 0;          ///< created and not destroyed
+    size_t idle = 0;          ///< live and not handed out
+    size_t gets = 0;          ///< resources handed out
+    size_t cache_hits = 0;    ///< gets served by a per-thread cache
+    size_t waits = 0;         ///< gets that had to wait
+    size_t timeouts = 0;      ///< try_get() that gave up
+};
+
+//! Thread-safe pool of resources, created on demand by a factory.
+/// Unlike pool above, the resources are created as needed, up to
+/// max_size live ones, min_size of them at construction; get() only
+/// blocks when max_size are handed out.
+///
+/// get() returns a handle, which gives the resource back when it is
+/// destroyed. A resource that went bad (a dropped connection, say) is
+/// destroyed instead with handle::discard(), and replaced by the
+/// factory on some later get().
+///
+/// Each thread first looks in a cache of its own, a magazine of a few
+/// resources, and gives resources back to it; only when it is empty,
+/// or full, is the shared store, and its lock, used. When some thread
+/// is waiting, resources go to the shared store, and a waiter takes
+/// from the magazines of other threads before blocking, so that no
+/// resource sits idle in a cache while a thread starves.
+///
+/// The magazines are picked by a per-thread index, modulo their
+/// number; a magazine has a lock of its own, uncontended as long as
+/// there are no more threads than magazines.
+///
+/// The pool must outlive the handles.
+///
+///     resource_pool<connection> conns([]() { return connection(url); },
+///                                     2, 16);
+///     {
+///         auto c = conns.get();
+///         c->query(...);
+///     }   // back to the pool
+template<typename Resource>
+class resource_pool
+{
+    public:
+        typedef std::function<Resource()> factory;
+
+        //! A resource on loan; movable, not copyable
+        class handle
+        {
+            friend class resource_pool;
+
+            resource_pool* _pool;
+            std::optional<Resource> _res;
+
+            handle(resource_pool* p, Resource&& r)
+                : _pool(p), _res(std::move(r)) {}
+
+        public:
+            handle() : _pool(nullptr) {}
+            handle(handle&& h) : _pool(h._pool), _res(std::move(h._res))
+            { h._res.reset(); }
+            handle& operator=(handle&& h)
+            {
+                if (this != &h) {
+                    reset();
+                    _pool = h._pool;
+                    _res = std::move(h._res);
+                    h._res.reset();
+                }
+                return *this;
+            }
+            ~handle() { reset(); }
+
+            explicit operator bool() const { return _res.has_value(); }
+            Resource& operator*() { return *_res; }
+            Resource* operator->() { return &*_res; }
+            Resource& get() { return *_res; }
+
+            //! Give the resource back now
+            void reset()
+            {
+                if (_res) _pool->give_back(std::move(*_res));
+                _res.reset();
+            }
+
+            //! Destroy the resource rather than give it back
+            void discard()
+            {
+                if (not _res) return;
+                _res.reset();
+                _pool->forget();
+            }
+        };
+
+        /// Create min_size resources now, and at most max_size (0 for
+        /// no limit) live ones; each thread caches up to magazine_size
+        /// resources.
+        resource_pool(factory f, size_t min_size = 0, size_t max_size = 0,
+                      size_t magazine_size = 4)
+            : _factory(std::move(f)), _min_size(min_size),
+              _max_size(max_size), _magazine_size(magazine_size),
+              _magazines(std::max<size_t>(std::thread::hardware_concurrency(),
+                                          1) * 2),
+              _live(0), _waiting(0)
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            for (size_t i = 0; i < min_size; i++) {
+                _shared.push_back(_factory());
+                _live++;
+                _created++;
+            }
+        }
+
+        resource_pool(const resource_pool&) = delete;
+        resource_pool& operator=(const resource_pool&) = delete;
+
+        /// Fetch a resource, creating it if none is idle and fewer
+        /// than max_size are live; otherwise block until one is given
+        /// back. An exception of the factory is passed on.
+        handle get()
+        {
+            std::optional<handle> h = get_until(nullptr);
+            return std::move(*h);
+        }
+
+        /// Same as get(), but give up after timeout; then return an
+        /// empty optional.
+        template<class Rep, class Period>
+        std::optional<handle>
+        try_get(const std::chrono::duration<Rep, Period>& timeout)
+        {
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            return get_until(&deadline);
+        }
+
+        /// Destroy idle resources, those of the magazines too, down
+        /// to min_size live ones, or as near as the idle ones allow.
+        void trim()
+        {
+            std::vector<Resource> doomed;
+            drain_magazines();
+            std::lock_guard<std::mutex> lock(_mtx);
+            while (_min_size < _live and not _shared.empty()) {
+                doomed.push_back(std::move(_shared.back()));
+                _shared.pop_back();
+                _live--;
+                _destroyed++;
+            }
+        }
+
+        resource_pool_stats stats() const
+        {
+            resource_pool_stats st;
+            size_t cached = 0;
+            for (const magazine& m : _magazines) cached += m.count;
+            std::lock_guard<std::mutex> lock(_mtx);
+            st.created = _created;
+            st.destroyed = _destroyed;
+            st.live = _live;
+            st.idle = _shared.size() + cached;
+            st.gets = _gets + _cache_hits;
+            st.cache_hits = _cache_hits;
+            st.waits = _waits;
+            st.timeouts = _timeouts;
+            return st;
+        }
+
+    private:
+        typedef std::chrono::steady_clock::time_point time_point;
+
+        struct magazine
+        {
+            std::mutex mtx;
+            std::vector<Resource> res;
+            std::atomic<size_t> count{0};   // res.size(), for stats()
+        };
+
+        factory _factory;
+        const size_t _min_size;
+        const size_t _max_size;
+        const size_t _magazine_size;
+        std::vector<magazine> _magazines;
+
+        mutable std::mutex _mtx;
+        std::condition_variable _cond;
+        std::vector<Resource> _shared;
+        size_t _live;
+        std::atomic<size_t> _waiting;
+        size_t _created = 0, _destroyed = 0, _gets = 0, _waits = 0,
+            _timeouts = 0;
+        std::atomic<size_t> _cache_hits{0};
+
+        magazine& my_magazine()
+        {
+            static std::atomic<size_t> next_thread{0};
+            thread_local size_t index = next_thread++;
+            return _magazines[index % _magazines.size()];
+        }
+
+        bool pop(magazine& m, std::optional<Resource>& r)
+        {
+            std::lock_guard<std::mutex> lock(m.mtx);
+            if (m.res.empty()) return false;
+            r.emplace(std::move(m.res.back()));
+            m.res.pop_back();
+            m.count = m.res.size();
+            return true;
+        }
+
+        std::optional<handle> get_until(const time_point* deadline)
+        {
+            std::optional<Resource> r;
+            if (0 < _magazine_size and pop(my_magazine(), r)) {
+                _cache_hits++;
+                return handle(this, std::move(*r));
+            }
+
+            std::unique_lock<std::mutex> lock(_mtx);
+            bool waited = false, timed_out = false;
+            while (true) {
+                if (not _shared.empty()) {
+                    r.emplace(std::move(_shared.back()));
+                    _shared.pop_back();
+                    break;
+                }
+                if (0 == _max_size or _live < _max_size) {
+                    // Create outside of the lock, the slot reserved.
+                    _live++;
+                    _created++;
+                    lock.unlock();
+                    try {
+                        r.emplace(_factory());
+                    } catch (...) {
+                        forget();
+                        throw;
+                    }
+                    lock.lock();
+                    break;
+                }
+                if (timed_out) {
+                    _timeouts++;
+                    return std::nullopt;
+                }
+
+                // Idle resources may be in the magazines of others.
+                // Counted as waiting first, so that from now on
+                // resources are given back to the shared store, where
+                // they will be seen.
+                _waiting++;
+                lock.unlock();
+                for (magazine& m : _magazines)
+                    if (pop(m, r)) break;
+                lock.lock();
+                if (not r and _shared.empty()) {
+                    if (not waited) _waits++;
+                    waited = true;
+                    OC_TRACE_SCOPE("resource_pool::wait");
+                    if (deadline)
+                        timed_out = std::cv_status::timeout ==
+                            _cond.wait_until(lock, *deadline);
+                    else
+                        _cond.wait(lock);
+                }
+                _waiting--;
+                if (r) break;
+            }
+            _gets++;
+            return handle(this, std::move(*r));
+        }
+
+        void give_back(Resource&& r)
+        {
+            if (0 < _magazine_size) {
+                magazine& m = my_magazine();
+                std::lock_guard<std::mutex> lock(m.mtx);
+                // Checked under the lock of the magazine, which a
+                // waiter takes after counting itself.
+                if (0 == _waiting and m.res.size() < _magazine_size) {
+                    m.res.push_back(std::move(r));
+                    m.count = m.res.size();
+                    return;
+                }
+            }
+            std::lock_guard<std::mutex> lock(_mtx);
+            _shared.push_back(std::move(r));
+            _cond.notify_one();
+        }
+
+        // A live resource was destroyed.
+        void forget()
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _live--;
+            _destroyed++;
+            _cond.notify_one();
+        }
+
+        void drain_magazines()
+        {
+            for (magazine& m : _magazines) {
+                std::vector<Resource> res;
+                {
+                    std::lock_guard<std::mutex> lock(m.mtx);
+                    res.swap(m.res);
+                    m.count = 0;
+                }
+                std::lock_guard<std::mutex> lock(_mtx);
+                for (Resource& r : res) _shared.push_back(std::move(r));
+            }
+        }
+};
+
 
 /** @}*/
 } // ~namespace opencog
@@ -0,0 +1,91 @@
+/*
+ * opencog/util/profile.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencog/util/profile.h>
+
+namespace opencog {
+
+// The histograms are never removed, so that references to them stay
+// valid; map nodes do not move.
+static std::mutex profile_mtx;
+static std::map<std::string, std::unique_ptr<latency_histogram>>& profiles()
+{
+    static std::map<std::string, std::unique_ptr<latency_histogram>> p;
+    return p;
+}
+
+latency_histogram& profile_histogram(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(profile_mtx);
+    std::unique_ptr<latency_histogram>& h = profiles()[name];
+    if (not h) h.reset(new latency_histogram());
+    return *h;
+}
+
+std::string profile_report()
+{
+    std::vector<std::pair<std::string, const latency_histogram*>> hs;
+    {
+        std::lock_guard<std::mutex> lock(profile_mtx);
+        for (const auto& p : profiles())
+            if (0 < p.second->count())
+                hs.emplace_back(p.first, p.second.get());
+    }
+    std::stable_sort(hs.begin(), hs.end(), [](const auto& a, const auto& b) {
+        return a.second->sum() > b.second->sum();
+    });
+
+    std::string report;
+    char line[256];
+    snprintf(line, sizeof(line), "%-32s %10s %12s %10s %10s %10s %10s\n",
+             "name", "count", "total(us)", "mean(us)", "p50(us)",
+             "p99(us)", "max(us)");
+    report += line;
+    for (const auto& p : hs) {
+        const latency_histogram& h = *p.second;
+        snprintf(line, sizeof(line),
+                 "%-32s %10llu %12.1f %10.3f %10.3f %10.3f %10.3f\n",
+                 p.first.c_str(), (unsigned long long)h.count(),
+                 h.sum() / 1e3, h.mean() / 1e3, h.percentile(0.5) / 1e3,
+                 h.percentile(0.99) / 1e3, h.max() / 1e3);
+        report += line;
+    }
+    return report;
+}
+
+void log_profile_report(Logger::Level level)
+{
+    logger().log(level, "Profile:\n" + profile_report());
+}
+
+void reset_profile()
+{
+    std::lock_guard<std::mutex> lock(profile_mtx);
+    for (auto& p : profiles()) p.second->reset();
+}
+
+} // namespace opencog
@@ -0,0 +1,95 @@
+/*
+ * opencog/util/profile.h
+ *
+ * Named latency histograms, and scoped timers recording into them.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_PROFILE_H
+#define _OPENCOG_PROFILE_H
+
+#include <string>
+
+#include <opencog/util/Logger.h>
+#include <opencog/util/latency_histogram.h>
+#include <opencog/util/octime.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! The histogram of the samples of the given name, created on first
+//! call; it lives until the end of the process. Recording samples in
+//! it takes no lock, only getting it does: get it once per call site.
+latency_histogram& profile_histogram(const std::string& name);
+
+//! Records the time from its construction to its destruction in a
+//! histogram.
+class scoped_timer
+{
+    latency_histogram& _hist;
+    uint64_t _start;
+public:
+    explicit scoped_timer(latency_histogram& hist)
+        : _hist(hist), _start(monotonic_nanos()) {}
+    ~scoped_timer() { _hist.record(monotonic_nanos() - _start); }
+    scoped_timer(const scoped_timer&) = delete;
+    scoped_timer& operator=(const scoped_timer&) = delete;
+};
+
+//! One line per histogram of profile_histogram(), of the number of
+//! samples, their total, mean, median, p99 and max, in microseconds,
+//! the largest total first.
+std::string profile_report();
+
+//! Write profile_report() to the logger, at the given level.
+void log_profile_report(Logger::Level level = Logger::INFO);
+
+//! Clear all the histograms of profile_histogram().
+void reset_profile();
+
+/**
+ * Time the rest of the enclosing scope into profile_histogram(name),
+ * as in
+ *
+ *     void expensive() {
+ *         OC_PROFILE_SCOPE("expensive");
+ *         ...
+ *     }
+ *
+ * The histogram is looked up once, the first time through. Defining
+ * OC_NO_PROFILE compiles the timers out.
+ */
+#ifdef OC_NO_PROFILE
+#define OC_PROFILE_SCOPE(name)
+#else
+#define OC_PROFILE_CONCAT_(a, b) a##b
+#define OC_PROFILE_CONCAT(a, b) OC_PROFILE_CONCAT_(a, b)
+#define OC_PROFILE_SCOPE(name)                                          \
+    static ::opencog::latency_histogram&                                \
+        OC_PROFILE_CONCAT(oc_profile_hist_, __LINE__) =                 \
+            ::opencog::profile_histogram(name);                         \
+    ::opencog::scoped_timer OC_PROFILE_CONCAT(oc_profile_timer_, __LINE__) \
+        (OC_PROFILE_CONCAT(oc_profile_hist_, __LINE__))
+#endif
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_PROFILE_H
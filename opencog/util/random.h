@@ -24,7 +24,10 @@
 #ifndef _OPENCOG_RANDOM_H
 #define _OPENCOG_RANDOM_H
 
-#include <iomanip>
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <type_traits>
 
 #include <boost/numeric/conversion/cast.hpp>
 
@@ -32,6 +35,8 @@
 #include <opencog/util/RandGen.h>
 #include <opencog/util/mt19937ar.h>
 #include <opencog/util/numeric.h>
+#include <opencog/util/random_fill.h>
+#include <opencog/util/rng_engines.h>
 
 /**
  * \file random.h
@@ -44,42 +49,73 @@ namespace opencog {
  *  @{
  */
 
+namespace detail {
+
+// Iterator to the i-th element of c: in O(log n) for the order
+// statistics trees of indexed_set.h, by std::next otherwise (which is
+// O(1) for random access containers, O(n) for std::set and the like).
+template<typename C>
+auto nth_iterator(C& c, size_t i, int) -> decltype(c.find_by_order(i))
+{
+    return c.find_by_order(i);
+}
+
+template<typename C>
+auto nth_iterator(C& c, size_t i, long) -> decltype(c.begin())
+{
+    return std::next(c.begin(), i);
+}
+
+template<typename C>
+auto nth_iterator(C& c, size_t i) -> decltype(nth_iterator(c, i, 0))
+{
+    return nth_iterator(c, i, 0);
+}
+
+} // ~namespace detail
+
 //! Pick an element of container c randomly, with uniform
 //! distribution.  \warning it is assumed that c is non-empty
+///
+/// This takes O(n) on a std::set or std::map; use an indexed_set or
+/// indexed_map (see indexed_set.h), or a sorted vector, where it
+/// matters.
 template<typename C>
 const typename C::value_type& rand_element(const C& c, RandGen& rng=randGen())
 {
     OC_ASSERT(!c.empty());
-    return *std::next(c.begin(), rng.randint(c.size()));
+    return *detail::nth_iterator(c, rng.randint(c.size()));
 }
 
 //! Non-const version of above. Pick an element of container c
 //! randomly, with uniform distribution.  \warning it is assumed that
 //! c is non-empty
 template<typename C>
-typename C::value_type& rand_element(C& c, RandGen& rng=randGen())
+auto rand_element(C& c, RandGen& rng=randGen()) -> decltype(*c.begin())
 {
     OC_ASSERT(!c.empty());
-    return *std::next(c.begin(), rng.randint(c.size()));
+    return *detail::nth_iterator(c, rng.randint(c.size()));
 }
 
 //! Pick an element of container c randomly, with distribution d.
 //! \warning it is assumed that c is non-empty
-template<typename C, typename D>
+template<typename C, typename D,
+         typename std::enable_if<not is_fast_engine<D>::value, int>::type = 0>
 const typename C::value_type& rand_element(const C& c, D& d, RandGen& rng=randGen())
 {
     OC_ASSERT(!c.empty());
-    return *std::next(c.begin(), d(rng));
+    return *detail::nth_iterator(c, d(rng));
 }
 
 //! Non-const version of above. Pick an element of container c
 //! randomly, with uniform distribution.  \warning it is assumed that
 //! c is non-empty
-template<typename C, typename D>
-typename C::value_type& rand_element(C& c, D& d, RandGen& rng=randGen())
+template<typename C, typename D,
+         typename std::enable_if<not is_fast_engine<D>::value, int>::type = 0>
+auto rand_element(C& c, D& d, RandGen& rng=randGen()) -> decltype(*c.begin())
 {
     OC_ASSERT(!c.empty());
-    return *std::next(c.begin(), d(rng));
+    return *detail::nth_iterator(c, d(rng));
 }
 
 //! Pick an element of container c randomly, with uniform
@@ -89,7 +125,36 @@ template<typename C>
 typename C::value_type rand_element_erase(C& c, RandGen& rng=randGen())
 {
     OC_ASSERT(!c.empty());
-    auto it = std::next(c.begin(), rng.randint(c.size()));
+    auto it = detail::nth_iterator(c, rng.randint(c.size()));
+    typename C::value_type val = *it;
+    c.erase(it);
+    return val;
+}
+
+//! Same as rand_element(c), but using one of the engines of
+//! rng_engines.h; with no virtual call, the engine is inlined.
+template<typename C, typename Engine,
+         typename std::enable_if<is_fast_engine<Engine>::value, int>::type = 0>
+const typename C::value_type& rand_element(const C& c, Engine& eng)
+{
+    OC_ASSERT(!c.empty());
+    return *detail::nth_iterator(c, rand_below(eng, c.size()));
+}
+
+template<typename C, typename Engine,
+         typename std::enable_if<is_fast_engine<Engine>::value, int>::type = 0>
+auto rand_element(C& c, Engine& eng) -> decltype(*c.begin())
+{
+    OC_ASSERT(!c.empty());
+    return *detail::nth_iterator(c, rand_below(eng, c.size()));
+}
+
+template<typename C, typename Engine,
+         typename std::enable_if<is_fast_engine<Engine>::value, int>::type = 0>
+typename C::value_type rand_element_erase(C& c, Engine& eng)
+{
+    OC_ASSERT(!c.empty());
+    auto it = detail::nth_iterator(c, rand_below(eng, c.size()));
     typename C::value_type val = *it;
     c.erase(it);
     return val;
@@ -115,6 +180,24 @@ T gaussian_rand(T mean, T std_dev, RandGen& rng=randGen())
     return res;
 }
 
+//! Same as gaussian_rand(mean, std_dev), with one of the engines of
+//! rng_engines.h, and by the ziggurat method (see rand_normal()).
+template<typename T, typename Engine,
+         typename std::enable_if<is_fast_engine<Engine>::value, int>::type = 0>
+T gaussian_rand(T mean, T std_dev, Engine& eng)
+{
+    double val = mean + std_dev * rand_normal(eng);
+    T res;
+    try {
+        res = boost::numeric_cast<T>(val);
+    } catch(boost::numeric::positive_overflow&) {
+        res = std::numeric_limits<T>::max();
+    } catch(boost::numeric::negative_overflow&) {
+        res = std::numeric_limits<T>::min();
+    }
+    return res;
+}
+
 //! linear biased random bool, b in [0,1] when b tends to 1 the result
 //! tends to be true
 static inline bool biased_randbool(float b, RandGen& rng=randGen())
@@ -122,17 +205,89 @@ static inline bool biased_randbool(float b, RandGen& rng=randGen())
     return b > rng.randfloat();
 }
 
+template<typename Engine,
+         typename std::enable_if<is_fast_engine<Engine>::value, int>::type = 0>
+inline bool biased_randbool(float b, Engine& eng)
+{
+    return b > rand_unit_float(eng);
+}
+
+namespace detail {
+
+// Append x to s in the given base, as std::setbase would print it: 8
+// and 16 (in lower case) are honoured, anything else means 10.
+inline void append_int(std::string& s, int x, int base)
+{
+    if (base != 8 and base != 16) base = 10;
+    // Unlike decimal, std::ostream prints octal and hexadecimal
+    // negative numbers as unsigned.
+    unsigned u = x;
+    if (x < 0 and base == 10)
+    {
+        s += '-';
+        u = 0U - u;
+    }
+    char buf[16];
+    char* p = buf + sizeof(buf);
+    do
+    {
+        *--p = "0123456789abcdef"[u % base];
+        u /= base;
+    } while (u);
+    s.append(p, buf + sizeof(buf));
+}
+
+} // ~namespace detail
+
 //! Generate a random string of characters in the given base, using n
 //! random ints, and appending it to a given prefix.
 static inline std::string randstr(const std::string& prefix=std::string(),
                                   unsigned n=1, int base=16,
                                   RandGen& rng=randGen())
 {
-	std::stringstream ss;
-	ss << prefix << std::setbase(base);
-	dorepeat(n)
-		ss << rng.randint();
-	return ss.str();
+    std::string res;
+    res.reserve(prefix.size() + 11 * n);
+    res = prefix;
+    dorepeat(n)
+        detail::append_int(res, rng.randint(), base);
+    return res;
+}
+
+//! Write n random characters to out, from the 64 characters
+//! [0-9A-Za-z_-] (so safe in file names and URLs); no terminating
+//! null is written. With no allocation and 10 characters per number
+//! drawn, this is the one for making up names in a hot loop: 11
+//! characters give 66 bits, so are unique in practice among billions
+//! of names.
+template<typename Engine,
+         typename std::enable_if<is_fast_engine<Engine>::value, int>::type = 0>
+void rand_id(char* out, size_t n, Engine& eng)
+{
+    static const char digits[] =
+        "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz_-";
+    while (n)
+    {
+        uint64_t w = eng();
+        for (int k = 0; k < 10 and n; k++, n--, w >>= 6)
+            *out++ = digits[w & 63];
+    }
+}
+
+//! Same as above, returning a std::string (which stays in its
+//! internal buffer, with no allocation, up to 15 characters).
+template<typename Engine,
+         typename std::enable_if<is_fast_engine<Engine>::value, int>::type = 0>
+std::string rand_id(size_t n, Engine& eng)
+{
+    std::string res(n, '\0');
+    rand_id(&res[0], n, eng);
+    return res;
+}
+
+//! Same as above, using the engine of the calling thread.
+inline std::string rand_id(size_t n = 11)
+{
+    return rand_id(n, fastRandGen());
 }
 
 /** @}*/
@@ -0,0 +1,382 @@
+/*
+ * opencog/util/random_fill.h
+ *
+ * Filling whole arrays with random numbers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_RANDOM_FILL_H
+#define _OPENCOG_RANDOM_FILL_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include <opencog/util/oc_assert.h>
+#include <opencog/util/rng_engines.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+/**
+ * \file random_fill.h
+ *
+ * Drawing random numbers one call at a time, through randGen(), costs
+ * a virtual call and a distribution object per number. The functions
+ * here fill a whole array at once instead: first the raw 64-bit words,
+ * in bulk, then a second pass turning the words into the wanted
+ * numbers. Both passes are plain loops over arrays, with no branches
+ * and no calls, that the compiler vectorizes for whatever instruction
+ * set it targets (SSE2, AVX2, NEON...).
+ *
+ * They take any engine of rng_engines.h. With xoshiro256x4, below,
+ * the first pass is vectorized as well.
+ */
+
+//! Four independent xoshiro256** generators, stepped in lock-step.
+///
+/// The state is laid out lane by lane, so that one step of all four
+/// generators is a handful of vector instructions. Calling it one word
+/// at a time works, but the point of it is fill().
+class xoshiro256x4
+{
+public:
+    typedef uint64_t result_type;
+    static constexpr size_t lanes = 4;
+
+    explicit xoshiro256x4(uint64_t s = 0) { seed(s); }
+
+    void seed(uint64_t s)
+    {
+        splitmix64 sm(s);
+        for (size_t w = 0; w < 4; w++)
+            for (size_t l = 0; l < lanes; l++)
+                _s[w][l] = sm();
+        _pos = lanes;
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()()
+    {
+        if (lanes == _pos)
+        {
+            step(_buf);
+            _pos = 0;
+        }
+        return _buf[_pos++];
+    }
+
+    /// Write n random words to out.
+    void fill(uint64_t* out, size_t n)
+    {
+        // Use up what is left of the buffer first.
+        while (n and _pos < lanes)
+        {
+            *out++ = _buf[_pos++];
+            n--;
+        }
+        for (; lanes <= n; n -= lanes, out += lanes) step(out);
+        if (n)
+        {
+            step(_buf);
+            for (_pos = 0; _pos < n; _pos++) out[_pos] = _buf[_pos];
+        }
+    }
+
+private:
+    uint64_t _s[4][lanes];
+    uint64_t _buf[lanes];
+    size_t _pos;
+
+    void step(uint64_t* out)
+    {
+        for (size_t l = 0; l < lanes; l++)
+        {
+            uint64_t x = _s[1][l] * 5;
+            out[l] = ((x << 7) | (x >> 57)) * 9;
+            const uint64_t t = _s[1][l] << 17;
+            _s[2][l] ^= _s[0][l];
+            _s[3][l] ^= _s[1][l];
+            _s[1][l] ^= _s[2][l];
+            _s[0][l] ^= _s[3][l];
+            _s[2][l] ^= t;
+            _s[3][l] = (_s[3][l] << 45) | (_s[3][l] >> 19);
+        }
+    }
+};
+
+template<> struct is_fast_engine<xoshiro256x4> : std::true_type {};
+
+namespace detail {
+
+// Words are produced, and converted, in blocks of this many, so that
+// the block stays in L1.
+constexpr size_t fill_block = 256;
+
+template<typename Engine>
+inline void fill_words(Engine& eng, uint64_t* out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) out[i] = eng();
+}
+
+inline void fill_words(xoshiro256x4& eng, uint64_t* out, size_t n)
+{
+    eng.fill(out, n);
+}
+
+// Call convert(words, out, m) on successive blocks of at most
+// fill_block fresh words.
+template<typename Engine, typename T, typename Convert>
+void fill_blocks(Engine& eng, T* out, size_t n, Convert convert)
+{
+    uint64_t words[fill_block];
+    while (n)
+    {
+        size_t m = std::min(n, fill_block);
+        fill_words(eng, words, m);
+        convert(words, out, m);
+        out += m;
+        n -= m;
+    }
+}
+
+// Same, with blocks of fresh 32-bit halves of words.
+template<typename Engine, typename T, typename Convert>
+void fill_blocks32(Engine& eng, T* out, size_t n, Convert convert)
+{
+    uint64_t words[fill_block];
+    uint32_t halves[2 * fill_block];
+    while (n)
+    {
+        size_t m = std::min(n, 2 * fill_block);
+        size_t nw = (m + 1) / 2;
+        fill_words(eng, words, nw);
+        std::memcpy(halves, words, nw * sizeof(uint64_t));
+        convert(halves, out, m);
+        out += m;
+        n -= m;
+    }
+}
+
+// Doubles in [1, 2), built from the top 52 bits of the words.
+inline double unit_plus_one(uint64_t w)
+{
+    uint64_t bits = (w >> 12) | 0x3ff0000000000000ULL;
+    double d;
+    std::memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+} // ~namespace detail
+
+/// Fill out[0, n) with uniform doubles in [0, 1), to a resolution
+/// of 2^-52.
+template<typename Engine>
+void fill_uniform(double* out, size_t n, Engine& eng)
+{
+    detail::fill_blocks(eng, out, n, [](const uint64_t* w, double* o, size_t m) {
+        for (size_t i = 0; i < m; i++) o[i] = detail::unit_plus_one(w[i]) - 1.0;
+    });
+}
+
+/// Fill out[0, n) with uniform floats in [0, 1), to a resolution of
+/// 2^-24; each word gives two floats.
+template<typename Engine>
+void fill_uniform(float* out, size_t n, Engine& eng)
+{
+    detail::fill_blocks32(eng, out, n, [](const uint32_t* h, float* o, size_t m) {
+        for (size_t i = 0; i < m; i++) o[i] = float(int32_t(h[i] >> 8)) * 0x1p-24f;
+    });
+}
+
+/// Fill out[0, n) with uniform doubles in [lo, hi).
+template<typename Engine>
+void fill_uniform(double* out, size_t n, double lo, double hi, Engine& eng)
+{
+    const double width = hi - lo;
+    detail::fill_blocks(eng, out, n,
+                        [lo, width](const uint64_t* w, double* o, size_t m) {
+        for (size_t i = 0; i < m; i++)
+            o[i] = lo + (detail::unit_plus_one(w[i]) - 1.0) * width;
+    });
+}
+
+/// Fill out[0, n) with uniform integers in [0, bound), without bias;
+/// bound must be positive.
+///
+/// Each half word gives a number by a 32x32-bit multiply (Lemire's
+/// method). The few numbers that would be biased are spotted in a
+/// separate pass, and drawn again.
+template<typename Engine>
+void fill_randint(int* out, size_t n, int bound, Engine& eng)
+{
+    OC_ASSERT(0 < bound, "fill_randint - bound must be positive.");
+    const uint32_t b = bound;
+    const uint32_t threshold = uint32_t(-b) % b;
+    detail::fill_blocks32(eng, out, n,
+                          [&eng, b, threshold](const uint32_t* h, int* o, size_t m) {
+        uint32_t low[2 * detail::fill_block];
+        bool biased = false;
+        for (size_t i = 0; i < m; i++)
+        {
+            uint64_t x = uint64_t(h[i]) * b;
+            o[i] = int(x >> 32);
+            low[i] = uint32_t(x);
+            biased |= low[i] < threshold;
+        }
+        if (not biased) return;
+        for (size_t i = 0; i < m; i++)
+        {
+            while (low[i] < threshold)
+            {
+                uint64_t x = uint64_t(uint32_t(eng() >> 32)) * b;
+                o[i] = int(x >> 32);
+                low[i] = uint32_t(x);
+            }
+        }
+    });
+}
+
+/// Fill out[0, n) with independent booleans, each true with
+/// probability p (to a resolution of 2^-53).
+template<typename Engine>
+void fill_bernoulli(bool* out, size_t n, double p, Engine& eng)
+{
+    if (1.0 <= p)
+    {
+        std::fill(out, out + n, true);
+        return;
+    }
+    const uint64_t t = 0.0 < p ? uint64_t(p * 0x1p53) : 0;
+    detail::fill_blocks(eng, out, n, [t](const uint64_t* w, bool* o, size_t m) {
+        for (size_t i = 0; i < m; i++) o[i] = (w[i] >> 11) < t;
+    });
+}
+
+namespace detail {
+
+// Tables of the 128-layer ziggurat for the standard normal (Doornik's
+// ZIGNOR variant of Marsaglia and Tsang's method): layer i spans
+// [0, x[i]), and its fraction ratio[i] lies wholly under the density.
+struct normal_ziggurat
+{
+    static constexpr int layers = 128;
+    static constexpr double R = 3.442619855899;      // start of the tail
+    static constexpr double V = 9.91256303526217e-3; // area of a layer
+
+    double x[layers + 1];
+    double ratio[layers];
+
+    normal_ziggurat()
+    {
+        double f = std::exp(-0.5 * R * R);
+        x[0] = V / f;
+        x[1] = R;
+        x[layers] = 0;
+        for (int i = 2; i < layers; i++)
+        {
+            x[i] = std::sqrt(-2 * std::log(V / x[i - 1] + f));
+            f = std::exp(-0.5 * x[i] * x[i]);
+        }
+        for (int i = 0; i < layers; i++) ratio[i] = x[i + 1] / x[i];
+    }
+
+    static const normal_ziggurat& get()
+    {
+        static const normal_ziggurat zig;
+        return zig;
+    }
+};
+
+} // ~namespace detail
+
+/// A standard normal deviate, by the ziggurat method. About 98% of the
+/// draws cost one word from the engine, a table lookup and a multiply;
+/// the rest fall back to exact, slower, tests.
+template<typename Engine>
+double rand_normal(Engine& eng)
+{
+    typedef detail::normal_ziggurat zig_t;
+    const zig_t& zig = zig_t::get();
+    while (true)
+    {
+        // One word gives both the layer (low 7 bits) and a uniform
+        // u in [-1, 1) (top 53 bits).
+        uint64_t w = eng();
+        int i = w & (zig_t::layers - 1);
+        double u = 2 * ((w >> 11) * 0x1p-53) - 1;
+        if (std::abs(u) < zig.ratio[i]) return u * zig.x[i];
+
+        if (0 == i)
+        {
+            // The tail, beyond R; Marsaglia's method.
+            double x, y;
+            do
+            {
+                x = std::log(1 - rand_unit(eng)) / zig_t::R;
+                y = std::log(1 - rand_unit(eng));
+            } while (-2 * y < x * x);
+            return u < 0 ? x - zig_t::R : zig_t::R - x;
+        }
+
+        double x = u * zig.x[i];
+        double f0 = std::exp(-0.5 * (zig.x[i] * zig.x[i] - x * x));
+        double f1 = std::exp(-0.5 * (zig.x[i + 1] * zig.x[i + 1] - x * x));
+        if (f1 + rand_unit(eng) * (f0 - f1) < 1.0) return x;
+    }
+}
+
+/// Fill out[0, n) with normal deviates of the given mean and standard
+/// deviation.
+template<typename T, typename Engine>
+void fill_normal(T* out, size_t n, double mean, double sd, Engine& eng)
+{
+    for (size_t i = 0; i < n; i++) out[i] = T(mean + sd * rand_normal(eng));
+}
+
+/// Same as above, for any contiguous container (std::vector,
+/// std::array...) of double, float or int.
+template<typename Container, typename Engine>
+void fill_uniform(Container& c, Engine& eng)
+{
+    fill_uniform(c.data(), c.size(), eng);
+}
+
+template<typename Container, typename Engine>
+void fill_randint(Container& c, int bound, Engine& eng)
+{
+    fill_randint(c.data(), c.size(), bound, eng);
+}
+
+template<typename Container, typename Engine>
+void fill_normal(Container& c, double mean, double sd, Engine& eng)
+{
+    fill_normal(c.data(), c.size(), mean, sd, eng);
+}
+
+/** @}*/
+} // ~namespace opencog
+
+#endif // _OPENCOG_RANDOM_FILL_H
@@ -0,0 +1,441 @@
+/*
+ * opencog/util/rng_engines.h
+ *
+ * Small, fast, non-virtual pseudo-random engines.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_RNG_ENGINES_H
+#define _OPENCOG_RNG_ENGINES_H
+
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+/**
+ * \file rng_engines.h
+ *
+ * The engines below are alternatives to the RandGen returned by
+ * randGen(). RandGen is an abstract class, so each randint() or
+ * randdouble() is a virtual call, and its Mersenne Twister carries
+ * 2.5KB of state. These engines are plain classes, with a few words of
+ * state, and all of their members are inline; code templated on the
+ * engine type (see rand_below(), rand_unit() and the Engine overloads
+ * of rand_element() in random.h) compiles the generator right into the
+ * loop that uses it.
+ *
+ * All of them meet the standard UniformRandomBitGenerator requirements,
+ * producing 64-bit words, so they also work with the distributions of
+ * <random>. None of them is suitable for cryptography.
+ */
+
+//! SplitMix64; used to expand a single seed into a larger state.
+struct splitmix64
+{
+    typedef uint64_t result_type;
+
+    explicit splitmix64(uint64_t s = 0) : state(s) {}
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()()
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t state;
+};
+
+//! xoshiro256** (Blackman and Vigna): 256 bits of state, a period of
+//! 2^256 - 1, and a good general purpose default.
+class xoshiro256ss
+{
+public:
+    typedef uint64_t result_type;
+
+    explicit xoshiro256ss(uint64_t s = 0) { seed(s); }
+
+    void seed(uint64_t s)
+    {
+        splitmix64 sm(s);
+        for (uint64_t& w : _s) w = sm();
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()()
+    {
+        const uint64_t result = rotl(_s[1] * 5, 7) * 9;
+        const uint64_t t = _s[1] << 17;
+        _s[2] ^= _s[0];
+        _s[3] ^= _s[1];
+        _s[1] ^= _s[2];
+        _s[0] ^= _s[3];
+        _s[2] ^= t;
+        _s[3] = rotl(_s[3], 45);
+        return result;
+    }
+
+    /// Advance by 2^128 steps, as if calling operator() that many
+    /// times; 2^128 calls to jump() cut the period into that many
+    /// non-overlapping sequences, for parallel computations.
+    void jump()
+    {
+        static const uint64_t poly[] = {
+            0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+            0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+        jump(poly);
+    }
+
+    /// Advance by 2^192 steps.
+    void long_jump()
+    {
+        static const uint64_t poly[] = {
+            0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL,
+            0x77710069854ee241ULL, 0x39109bb02acbe635ULL };
+        jump(poly);
+    }
+
+    bool operator==(const xoshiro256ss& other) const
+    {
+        return _s[0] == other._s[0] and _s[1] == other._s[1]
+            and _s[2] == other._s[2] and _s[3] == other._s[3];
+    }
+    bool operator!=(const xoshiro256ss& other) const
+    { return not (*this == other); }
+
+private:
+    uint64_t _s[4];
+
+    static uint64_t rotl(uint64_t x, int k)
+    { return (x << k) | (x >> (64 - k)); }
+
+    void jump(const uint64_t* poly)
+    {
+        uint64_t t[4] = {0, 0, 0, 0};
+        for (int i = 0; i < 4; i++)
+            for (int b = 0; b < 64; b++)
+            {
+                if (poly[i] & (uint64_t(1) << b))
+                    for (int w = 0; w < 4; w++) t[w] ^= _s[w];
+                operator()();
+            }
+        for (int w = 0; w < 4; w++) _s[w] = t[w];
+    }
+};
+
+//! PCG64 (O'Neill), the XSL-RR output function over a 128-bit LCG.
+//! Distinct increments give distinct, non-overlapping sequences.
+class pcg64
+{
+public:
+    typedef uint64_t result_type;
+
+    explicit pcg64(uint64_t s = 0, uint64_t stream = 0) { seed(s, stream); }
+
+    void seed(uint64_t s, uint64_t stream = 0)
+    {
+        // The increment must be odd.
+        _inc = ((u128(stream) << 64 | 0x14057b7ef767814fULL) << 1) | 1;
+        _state = 0;
+        step();
+        _state += s;
+        step();
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()()
+    {
+        step();
+        uint64_t x = uint64_t(_state >> 64) ^ uint64_t(_state);
+        unsigned rot = unsigned(_state >> 122);
+        return (x >> rot) | (x << ((64 - rot) & 63));
+    }
+
+    bool operator==(const pcg64& other) const
+    { return _state == other._state and _inc == other._inc; }
+    bool operator!=(const pcg64& other) const
+    { return not (*this == other); }
+
+private:
+    typedef unsigned __int128 u128;
+    u128 _state;
+    u128 _inc;
+
+    void step()
+    {
+        static const u128 mult =
+            (u128(0x2360ed051fc65da4ULL) << 64) | 0x4385df649fccf645ULL;
+        _state = _state * mult + _inc;
+    }
+};
+
+//! wyrand (Wang Yi): a single word of state, and the fastest of the
+//! three; its period is 2^64.
+class wyrand
+{
+public:
+    typedef uint64_t result_type;
+
+    explicit wyrand(uint64_t s = 0) : _s(s) {}
+
+    void seed(uint64_t s) { _s = s; }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()()
+    {
+        _s += 0xa0761d6478bd642fULL;
+        unsigned __int128 m =
+            (unsigned __int128)_s * (_s ^ 0xe7037ed1a0b428dbULL);
+        return uint64_t(m >> 64) ^ uint64_t(m);
+    }
+
+    bool operator==(const wyrand& other) const { return _s == other._s; }
+    bool operator!=(const wyrand& other) const { return _s != other._s; }
+
+private:
+    uint64_t _s;
+};
+
+//! Philox4x32-10 (Salmon et al.), a counter-based generator.
+///
+/// The n-th output is a pure function of the key and of n: ten rounds
+/// of a keyed bijection applied to the counter n. So any position can
+/// be reached in O(1) (see discard()), and each key, or each value of
+/// the high half of the counter, gives an independent stream. Here the
+/// key is the seed, and the high 64 bits of the counter are the stream
+/// number, so philox4x32(seed, i) is the i-th stream of that seed.
+class philox4x32
+{
+public:
+    typedef uint64_t result_type;
+    typedef uint32_t block[4];
+
+    explicit philox4x32(uint64_t s = 0, uint64_t stream = 0) { seed(s, stream); }
+
+    void seed(uint64_t s, uint64_t stream = 0)
+    {
+        _key[0] = uint32_t(s);
+        _key[1] = uint32_t(s >> 32);
+        _ctr[0] = _ctr[1] = 0;
+        _ctr[2] = uint32_t(stream);
+        _ctr[3] = uint32_t(stream >> 32);
+        _pos = 2;
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()()
+    {
+        if (2 == _pos)
+        {
+            generate(_ctr, _key, _out);
+            if (0 == ++_ctr[0]) ++_ctr[1];
+            _pos = 0;
+        }
+        result_type r = uint64_t(_out[2 * _pos]) | uint64_t(_out[2 * _pos + 1]) << 32;
+        _pos++;
+        return r;
+    }
+
+    /// Skip n outputs, in constant time.
+    void discard(uint64_t n)
+    {
+        uint64_t at = position() + n;
+        uint64_t b = at / 2;
+        _ctr[0] = uint32_t(b);
+        _ctr[1] = uint32_t(b >> 32);
+        _pos = 2;
+        if (at % 2)
+        {
+            generate(_ctr, _key, _out);
+            if (0 == ++_ctr[0]) ++_ctr[1];
+            _pos = 1;
+        }
+    }
+
+    /// Number of outputs drawn so far from this stream.
+    uint64_t position() const
+    {
+        uint64_t b = uint64_t(_ctr[0]) | uint64_t(_ctr[1]) << 32;
+        return 2 * b - (2 - _pos);
+    }
+
+    /// The raw bijection: encrypt one counter block with a key.
+    static void generate(const block ctr, const uint32_t key[2], block out)
+    {
+        uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+        uint32_t k0 = key[0], k1 = key[1];
+        for (int r = 0; r < 10; r++)
+        {
+            uint64_t p0 = uint64_t(0xd2511f53U) * c0;
+            uint64_t p1 = uint64_t(0xcd9e8d57U) * c2;
+            uint32_t n0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+            uint32_t n2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+            c1 = uint32_t(p1);
+            c3 = uint32_t(p0);
+            c0 = n0;
+            c2 = n2;
+            k0 += 0x9e3779b9U;
+            k1 += 0xbb67ae85U;
+        }
+        out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+    }
+
+    bool operator==(const philox4x32& other) const
+    {
+        return _key[0] == other._key[0] and _key[1] == other._key[1]
+            and _ctr[2] == other._ctr[2] and _ctr[3] == other._ctr[3]
+            and position() == other.position();
+    }
+    bool operator!=(const philox4x32& other) const
+    { return not (*this == other); }
+
+private:
+    uint32_t _key[2];
+    block _ctr;         // of the next block to generate
+    block _out;
+    unsigned _pos;      // 64-bit words of _out used up
+};
+
+//! True for the engines that the Engine overloads of rand_element()
+//! and friends accept. Specialize it for other 64-bit engines.
+template<typename Engine>
+struct is_fast_engine : std::false_type {};
+
+template<> struct is_fast_engine<xoshiro256ss> : std::true_type {};
+template<> struct is_fast_engine<pcg64> : std::true_type {};
+template<> struct is_fast_engine<wyrand> : std::true_type {};
+template<> struct is_fast_engine<philox4x32> : std::true_type {};
+
+//! Random integer in [0, n), without bias (Lemire's multiply-and-
+//! reject method; it almost never needs a division). Returns 0 if n
+//! is 0.
+template<typename Engine>
+inline uint64_t rand_below(Engine& eng, uint64_t n)
+{
+    unsigned __int128 m = (unsigned __int128)eng() * n;
+    uint64_t low = uint64_t(m);
+    if (low < n)
+    {
+        uint64_t threshold = -n % n;
+        while (low < threshold)
+        {
+            m = (unsigned __int128)eng() * n;
+            low = uint64_t(m);
+        }
+    }
+    return uint64_t(m >> 64);
+}
+
+//! Random double in [0, 1), from the top 53 bits of one word.
+template<typename Engine>
+inline double rand_unit(Engine& eng)
+{
+    return (eng() >> 11) * 0x1p-53;
+}
+
+//! Random float in [0, 1), from the top 24 bits of one word.
+template<typename Engine>
+inline float rand_unit_float(Engine& eng)
+{
+    return (eng() >> 40) * 0x1p-24f;
+}
+
+//! Random boolean, from the top bit of one word.
+template<typename Engine>
+inline bool rand_coin(Engine& eng)
+{
+    return eng() >> 63;
+}
+
+namespace detail {
+
+inline philox4x32 make_task_engine(uint64_t seed, uint64_t task, philox4x32*)
+{
+    return philox4x32(seed, task);
+}
+
+inline pcg64 make_task_engine(uint64_t seed, uint64_t task, pcg64*)
+{
+    return pcg64(seed, task);
+}
+
+inline xoshiro256ss make_task_engine(uint64_t seed, uint64_t task, xoshiro256ss*)
+{
+    xoshiro256ss eng(seed);
+    for (uint64_t i = 0; i < task; i++) eng.jump();
+    return eng;
+}
+
+} // ~namespace detail
+
+/**
+ * The engine for task number task of a parallel computation seeded
+ * with seed. Engines of different tasks give independent streams;
+ * handing each task (each loop index, each chunk...) its own engine,
+ * rather than each thread, makes the result of a parallel run the
+ * same whatever the number of threads, and the order they run in.
+ *
+ * Example:
+ *
+ *     #pragma omp parallel for
+ *     for (long i = 0; i < n; i++) {
+ *         philox4x32 eng = task_engine(seed, i);
+ *         out[i] = simulate(eng);
+ *     }
+ *
+ * With philox4x32 (the default) and pcg64 this is O(1); the task is
+ * the stream number. With xoshiro256ss it is task calls to jump(), so
+ * only suited to a few hundred tasks. wyrand has no streams.
+ */
+template<typename Engine = philox4x32>
+Engine task_engine(uint64_t seed, uint64_t task)
+{
+    return detail::make_task_engine(seed, task, (Engine*)nullptr);
+}
+
+/**
+ * The engine of the calling thread, analogous to randGen(). Each
+ * thread gets its own, seeded with 0; call seed() to change that.
+ */
+inline xoshiro256ss& fastRandGen()
+{
+    static thread_local xoshiro256ss instance(0);
+    return instance;
+}
+
+/** @}*/
+} // ~namespace opencog
+
+#endif // _OPENCOG_RNG_ENGINES_H
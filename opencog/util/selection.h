@@ -23,12 +23,17 @@
 #ifndef _OPENCOG_SELECTION_H
 #define _OPENCOG_SELECTION_H
 
+#include <opencog/util/alias_sampler.h>
 #include <opencog/util/functional.h>
 #include <opencog/util/numeric.h>
+#include <algorithm>
 #include <iterator>
+#include <vector>
 #include <opencog/util/dorepeat.h>
+#include <opencog/util/oc_omp.h>
 #include <opencog/util/RandGen.h>
 #include <opencog/util/mt19937ar.h>
+#include <opencog/util/rng_engines.h>
 
 namespace opencog
 {
@@ -36,6 +41,135 @@ namespace opencog
  *  @{
  */
 
+namespace detail {
+
+// The batched selections below are cut into chunks of this many
+// winners (and the prefix sums into blocks of this many scores), each
+// with its own engine: the results then depend on the seed only, not on
+// the number of threads.
+const size_t select_chunk = 4096;
+
+// Run f(engine, begin, end) on [0, n) cut into chunks, in parallel.
+template<typename F>
+void for_each_select_chunk(size_t n, uint64_t seed, F f)
+{
+    long n_chunks = (n + select_chunk - 1) / select_chunk;
+#ifdef OC_OMP
+    #pragma omp parallel for schedule(static) num_threads(num_threads())
+#endif
+    for (long c = 0; c < n_chunks; c++)
+    {
+        philox4x32 eng = task_engine(seed, c);
+        size_t begin = c * select_chunk;
+        f(eng, begin, std::min(n, begin + select_chunk));
+    }
+}
+
+} // ~namespace detail
+
+/**
+ * Plays n_select tournaments of t_size elements of [from, to), drawn
+ * with replacement, and writes the winners (the largest element of
+ * each tournament) to dst[0, n_select). Same as tournament_selection,
+ * but the tournaments are played in parallel, with the threads set by
+ * setting_omp(); In and Out must be random access. The result only
+ * depends on seed (see task_engine()).
+ */
+template<typename In, typename Out>
+void tournament_select_n(In from, In to, Out dst, size_t n_select,
+                         unsigned int t_size, uint64_t seed)
+{
+    OC_ASSERT(t_size > 0);
+    size_t d = std::distance(from, to);
+    OC_ASSERT(d > 0, "tournament_select_n - no elements.");
+    detail::for_each_select_chunk(n_select, seed,
+        [&](philox4x32& eng, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                In res = from + rand_below(eng, d);
+                for (unsigned int t = 1; t < t_size; t++)
+                {
+                    In tmp = from + rand_below(eng, d);
+                    if (*res < *tmp)
+                        res = tmp;
+                }
+                dst[i] = *res;
+            }
+        });
+}
+
+/**
+ * Writes to dst[0, n_select) elements of [from, to), each drawn with a
+ * probability proportional to its score, the element converted to
+ * double; like roulette_selection, but in parallel, with the threads
+ * set by setting_omp(). In and Out must be random access.
+ *
+ * The cumulative scores are computed once, by blocks in parallel, and
+ * each draw is then a binary search in them: O(n + n_select log n)
+ * work in all, spread over the threads. The result only depends on
+ * seed (see task_engine()).
+ */
+template<typename In, typename Out>
+void roulette_select_n(In from, In to, Out dst, size_t n_select,
+                       uint64_t seed)
+{
+    size_t n = std::distance(from, to);
+    OC_ASSERT(n > 0, "roulette_select_n - no elements.");
+
+    // Prefix sums: each block sums its own scores, then the blocks are
+    // offset by the sums of the blocks before them.
+    std::vector<double> cum(n);
+    long n_blocks = (n + detail::select_chunk - 1) / detail::select_chunk;
+    std::vector<double> offset(n_blocks + 1, 0.0);
+    bool negative = false;
+#ifdef OC_OMP
+    #pragma omp parallel for schedule(static) num_threads(num_threads()) \
+        reduction(||:negative)
+#endif
+    for (long b = 0; b < n_blocks; b++)
+    {
+        size_t begin = b * detail::select_chunk;
+        size_t end = std::min(n, begin + detail::select_chunk);
+        double sum = 0;
+        for (size_t i = begin; i < end; i++)
+        {
+            double w = *(from + i);
+            negative = negative || w < 0;
+            cum[i] = (sum += w);
+        }
+        offset[b + 1] = sum;
+    }
+    OC_ASSERT(not negative, "roulette_select_n - negative score.");
+    std::partial_sum(offset.begin(), offset.end(), offset.begin());
+#ifdef OC_OMP
+    #pragma omp parallel for schedule(static) num_threads(num_threads())
+#endif
+    for (long b = 1; b < n_blocks; b++)
+    {
+        size_t begin = b * detail::select_chunk;
+        size_t end = std::min(n, begin + detail::select_chunk);
+        for (size_t i = begin; i < end; i++) cum[i] += offset[b];
+    }
+
+    const double total = cum.back();
+    OC_ASSERT(0 < total, "roulette_select_n - all scores are zero.");
+    // The first index reaching the total; never one of zero score.
+    const size_t last = std::lower_bound(cum.begin(), cum.end(), total)
+        - cum.begin();
+    detail::for_each_select_chunk(n_select, seed,
+        [&](philox4x32& eng, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                // upper_bound skips the zero scores, whose cumulative
+                // score equals that of the element before them.
+                size_t j = std::upper_bound(cum.begin(), cum.end(),
+                                            rand_unit(eng) * total)
+                    - cum.begin();
+                dst[i] = *(from + std::min(j, last));
+            }
+        });
+}
+
 struct tournament_selection
 {
     tournament_selection(unsigned int t_size_, RandGen& _rng = randGen())
@@ -72,6 +206,49 @@ struct tournament_selection
             *dst++ = *res;
         }
     }
+
+    /// Same as above, in parallel (see tournament_select_n()); dst
+    /// must be random access, and is written in [dst, dst + n_select).
+    /// Takes one number from rng, as the seed of the parallel streams.
+    template<typename In, typename Out>
+    void select_n(In from, In to, Out dst, size_t n_select) const
+    {
+        tournament_select_n(from, to, dst, n_select, t_size, rng());
+    }
+};
+
+struct roulette_selection
+{
+    roulette_selection(RandGen& _rng = randGen()) : rng(_rng) {}
+
+    RandGen& rng;
+
+    /**
+     * Selects randomly n_select elements in [from, to), each with a
+     * probability proportional to its score: the element itself, which
+     * must convert to double. It is the same as calling roulette_select
+     * n_select times, but the distribution is put in an alias table
+     * first, so that it takes O(distance(from, to) + n_select) rather
+     * than O(distance(from, to) * n_select).
+     *
+     * The winners are appended to dst.
+     */
+    template<typename In, typename Out>
+    void operator()(In from, In to, Out dst, unsigned int n_select) const
+    {
+        alias_sampler pick(from, to);
+        dorepeat (n_select)
+            *dst++ = *(from + pick(rng));
+    }
+
+    /// Same as above, in parallel (see roulette_select_n()); dst must
+    /// be random access, and is written in [dst, dst + n_select).
+    /// Takes one number from rng, as the seed of the parallel streams.
+    template<typename In, typename Out>
+    void select_n(In from, In to, Out dst, size_t n_select) const
+    {
+        roulette_select_n(from, to, dst, n_select, rng());
+    }
 };
 
 /**
@@ -0,0 +1,99 @@
+/*
+ * opencog/util/serial.h
+ *
+ * Building blocks of the binary encodings.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SERIAL_H
+#define _OPENCOG_SERIAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <streambuf>
+#include <string>
+
+#include <opencog/util/exceptions.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! Varints and raw bytes to and from a stream buffer, as used by
+//! tree_serialize.h and sketches.h; a truncated or corrupt stream
+//! throws an InconsistenceException.
+namespace serial {
+
+inline void put_varint(std::streambuf& sb, uint64_t v)
+{
+    while (0x80 <= v)
+    {
+        sb.sputc(char((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    sb.sputc(char(v));
+}
+
+inline uint64_t get_varint(std::streambuf& sb)
+{
+    uint64_t v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        int c = sb.sbumpc();
+        if (std::char_traits<char>::eof() == c)
+            throw InconsistenceException(TRACE_INFO,
+                "serial - unexpected end of stream.");
+        v |= uint64_t(c & 0x7f) << shift;
+        if (0 == (c & 0x80)) return v;
+    }
+    throw InconsistenceException(TRACE_INFO, "serial - bad varint.");
+}
+
+inline void get_bytes(std::streambuf& sb, char* p, size_t n)
+{
+    if (std::streamsize(n) != sb.sgetn(p, n))
+        throw InconsistenceException(TRACE_INFO,
+            "serial - unexpected end of stream.");
+}
+
+//! The most that a count from the stream may make a reader allocate
+//! ahead of the data: sizes are not trusted, and anything longer is
+//! read in chunks of that many bytes, or elements.
+const size_t chunk = 1 << 16;
+
+//! n bytes, read chunk by chunk, so that a corrupt length throws at
+//! the end of the stream rather than first allocating all of it.
+inline void get_string(std::streambuf& sb, std::string& s, uint64_t n)
+{
+    s.clear();
+    while (s.size() < n)
+    {
+        size_t have = s.size();
+        size_t len = (n - have < chunk) ? size_t(n - have) : chunk;
+        s.resize(have + len);
+        get_bytes(sb, &s[have], len);
+    }
+}
+
+} // ~namespace serial
+
+/** @}*/
+} // ~namespace opencog
+
+#endif // _OPENCOG_SERIAL_H
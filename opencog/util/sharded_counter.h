@@ -0,0 +1,176 @@
+/*
+ * opencog/util/sharded_counter.h
+ *
+ * A Counter that many threads can count into at once.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SHARDED_COUNTER_H
+#define _OPENCOG_SHARDED_COUNTER_H
+
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <opencog/util/Counter.h>
+#include <opencog/util/oc_omp.h>
+
+namespace opencog {
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! A Counter split in one shard per thread, for counting in parallel.
+///
+/// Each thread counts into its own shard, a plain Counter, with no
+/// lock and no shared cache line: add() (or local()) never contends
+/// with other threads. merge() then sums up all shards into a single
+/// Counter; it must not run concurrently with counting.
+///
+/// A thread gets its shard the first time it counts, under a lock,
+/// then finds it again in a thread-local cache of the last counter
+/// it used; switching between counters takes the lock again. Any kind of
+/// thread works: OpenMP teams, std::thread, thread pools.
+///
+/// Example:
+///
+///     sharded_counter<std::string, unsigned> words;
+///     #pragma omp parallel for
+///     for (long i = 0; i < n; i++)
+///         words.add(text[i]);
+///     Counter<std::string, unsigned> histogram = words.merge();
+///
+/// See also parallel_count(), below, which does all of that.
+template<typename T, typename CT, typename CMP = std::less<T>>
+class sharded_counter
+{
+public:
+    typedef Counter<T, CT, CMP> counter_type;
+
+    sharded_counter() : _id(next_id()) {}
+
+    sharded_counter(const sharded_counter&) = delete;
+    sharded_counter& operator=(const sharded_counter&) = delete;
+
+    //! The shard of the calling thread
+    counter_type& local()
+    {
+        // The cache holds the last counter used by the thread only, so
+        // that it does not grow with the counters that come and go.
+        // It is keyed by id rather than by address, as a new counter
+        // could be built where a deleted one was.
+        static thread_local std::pair<uint64_t, Shard*> cache(0, nullptr);
+        if (cache.second and cache.first == _id)
+            return cache.second->counter;
+
+        std::thread::id self = std::this_thread::get_id();
+        std::lock_guard<std::mutex> lock(_mtx);
+        Shard* sh = nullptr;
+        for (const auto& p : _shards)
+            if (p->owner == self) sh = p.get();
+        if (not sh) {
+            _shards.emplace_back(new Shard(self));
+            sh = _shards.back().get();
+        }
+        cache = std::make_pair(_id, sh);
+        return sh->counter;
+    }
+
+    //! Count key n more times, in the shard of the calling thread
+    void add(const T& key, CT n = 1)
+    {
+        local()[key] += n;
+    }
+
+    //! Number of shards, that is, of threads that counted so far
+    size_t shards() const
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        return _shards.size();
+    }
+
+    //! The sum of all shards
+    counter_type merge() const
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        counter_type res;
+        for (const auto& sh : _shards)
+            res += sh->counter;
+        return res;
+    }
+
+    //! Reset all shards to empty (keeping them assigned to their
+    //! threads)
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        for (auto& sh : _shards)
+            sh->counter.clear();
+    }
+
+private:
+    struct alignas(64) Shard
+    {
+        explicit Shard(std::thread::id t) : owner(t) {}
+        std::thread::id owner;
+        counter_type counter;
+    };
+
+    const uint64_t _id;
+    mutable std::mutex _mtx;
+    std::vector<std::unique_ptr<Shard>> _shards;
+
+    static uint64_t next_id()
+    {
+        static std::atomic<uint64_t> id(0);
+        return id++;
+    }
+};
+
+//! Count the elements of [from, to), a random access range, in
+//! parallel, with the threads set by setting_omp(); returns the same
+//! Counter as Counter<value_type, CT>(from, to) would.
+template<typename CT = unsigned, typename It>
+Counter<typename std::iterator_traits<It>::value_type, CT>
+parallel_count(It from, It to)
+{
+    typedef typename std::iterator_traits<It>::value_type T;
+    sharded_counter<T, CT> sc;
+    long n = std::distance(from, to);
+#ifdef OC_OMP
+    #pragma omp parallel num_threads(num_threads())
+#endif
+    {
+        Counter<T, CT>& c = sc.local();
+#ifdef OC_OMP
+        #pragma omp for schedule(static)
+#endif
+        for (long i = 0; i < n; i++)
+            c[from[i]] += 1;
+    }
+    return sc.merge();
+}
+
+/** @}*/
+} // ~namespace opencog
+
+#endif // _OPENCOG_SHARDED_COUNTER_H
@@ -2,8 +2,14 @@
 #define __COGUTIL_SIGSLOT_H__
 
 #include <functional>
+#include <future>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <tuple>
+
+#include <opencog/util/concurrent_queue.h>
 
 // A signal-slot class, to replace boost::signals2, which is painfully
 // over-weight, complex and slow. (Try it -- launch gdb, get into the
@@ -40,6 +46,24 @@
 //     siggy.connect(glub);
 //     siggy.emit(42, {68,69,70});
 // }
+//
+// emit() takes no lock: the slots are kept in a copy-on-write map,
+// which connect() and disconnect() replace, and which emit() walks
+// a snapshot of. So a slow slot holds up neither the other emitters
+// nor connect() and disconnect(). The flip side is that a slot
+// disconnected while an emit() is under way may still be called by
+// that emit(), once.
+//
+// In async mode, emit() does not call the slots: it queues the call,
+// with a copy of the arguments, for a worker thread, and returns at
+// once. The calls are made in the order of the emits. flush() waits
+// until all queued calls are done. Exceptions thrown by slots on
+// the worker are discarded.
+//
+//     SigSlot<int> siggy(true);  // async
+//     siggy.connect(slow_logger);
+//     siggy.emit(42);            // returns before slow_logger does
+//     siggy.flush();
 
 template <typename... ARGS>
 class SigSlot
@@ -48,23 +72,102 @@ class SigSlot
 		typedef std::function<void(ARGS...)> slot_type;
 
 	private:
+		// Serializes the writers; emit() does not take it.
 		mutable std::mutex _mtx;
 		// HACK ALERT -- use std::map, not std::set here, for only
 		// one reason: so that we get a natural operator-less, which
 		// is needed for the insert() to work.
+		typedef std::map<int, std::function<void(ARGS...)>> slot_map;
 
-		mutable std::map<int, std::function<void(ARGS...)>> _slots;
+		// Never modified once published; replaced whole, with
+		// std::atomic_store, by the writers.
+		std::shared_ptr<const slot_map> _slots;
 		mutable int _slot_id;
 
+		// The async mode: calls queued for the worker.
+		typedef std::function<void()> call_type;
+		concurrent_queue<call_type> _calls;
+		std::thread _worker;
+
+		std::shared_ptr<const slot_map> snapshot() const
+		{
+			return std::atomic_load(&_slots);
+		}
+
+		// Replace the slots by a copy changed by fn; the caller
+		// holds _mtx.
+		template <typename FN>
+		void update(FN&& fn)
+		{
+			std::shared_ptr<slot_map> slots =
+				std::make_shared<slot_map>(*_slots);
+			fn(*slots);
+			std::atomic_store(&_slots,
+				std::shared_ptr<const slot_map>(std::move(slots)));
+		}
+
+		void work()
+		{
+			try {
+				call_type call;
+				while (true) {
+					_calls.pop(call);
+					try { call(); } catch (...) {}
+				}
+			}
+			catch (typename concurrent_queue<call_type>::Canceled&) {}
+		}
+
 	public:
-		SigSlot() : _slot_id(0) {}
+		explicit SigSlot(bool async = false)
+			: _slots(std::make_shared<const slot_map>()), _slot_id(0)
+		{
+			set_async(async);
+		}
+
+		~SigSlot()
+		{
+			set_async(false);
+		}
+
+		SigSlot(const SigSlot&) = delete;
+		SigSlot& operator=(const SigSlot&) = delete;
+
+		// Switch the async mode on or off. Switching it off waits
+		// for the calls queued so far. Not to be called concurrently
+		// with emit().
+		void set_async(bool async)
+		{
+			if (async == is_async()) return;
+			if (async) {
+				_calls.open();
+				_worker = std::thread(&SigSlot::work, this);
+			} else {
+				flush();
+				_calls.close();
+				_worker.join();
+			}
+		}
+
+		bool is_async() const { return _worker.joinable(); }
+
+		// Wait until all calls queued by emit() so far are done.
+		void flush()
+		{
+			if (not is_async()) return;
+			std::promise<void> done;
+			std::future<void> f = done.get_future();
+			_calls.push([&done]() { done.set_value(); });
+			f.wait();
+		}
 
 		// Connect using std::function.
 		int connect(std::function<void(ARGS...)> const& fn)
 		{
 			std::lock_guard<std::mutex> lck(_mtx);
 			_slot_id++;
-			_slots.insert(std::make_pair(_slot_id, fn));
+			update([&](slot_map& slots) {
+				slots.insert(std::make_pair(_slot_id, fn)); });
 			return _slot_id;
 		}
 
@@ -89,7 +192,8 @@ class SigSlot
 		{
 			std::lock_guard<std::mutex> lck(_mtx);
 			_slot_id++;
-			_slots.insert({_slot_id, std::bind(fn, ag ...)});
+			update([&](slot_map& slots) {
+				slots.insert({_slot_id, std::bind(fn, ag ...)}); });
 			return _slot_id;
 		}
 #endif
@@ -97,20 +201,28 @@ class SigSlot
 		void disconnect(int id)
 		{
 			std::lock_guard<std::mutex> lck(_mtx);
-			_slots.erase(id);
+			update([&](slot_map& slots) { slots.erase(id); });
 		}
 
 		void disconnect_all()
 		{
 			std::lock_guard<std::mutex> lck(_mtx);
-			_slots.clear();
+			std::atomic_store(&_slots, std::make_shared<const slot_map>());
 		}
 
-		// Call everything that's connected.
+		// Call everything that's connected; in async mode, queue
+		// the calls instead.
 		void emit(ARGS... p)
 		{
-			std::lock_guard<std::mutex> lck(_mtx);
-			for(auto it : _slots) it.second(p...);
+			std::shared_ptr<const slot_map> slots = snapshot();
+			if (slots->empty()) return;
+			if (not is_async()) {
+				for (const auto& it : *slots) it.second(p...);
+				return;
+			}
+			_calls.push([slots, args = std::make_tuple(p...)]() mutable {
+				for (const auto& it : *slots) std::apply(it.second, args);
+			});
 		}
 };
 
@@ -0,0 +1,462 @@
+/*
+ * opencog/util/sketches.h
+ *
+ * Approximate counting, in bounded memory: HyperLogLog, Count-Min and
+ * MinHash sketches.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SKETCHES_H
+#define _OPENCOG_SKETCHES_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/util/oc_assert.h>
+#include <opencog/util/serial.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+/**
+ * \file sketches.h
+ *
+ * Where a Counter, or the sets given to jaccard_index(), would hold
+ * every distinct element, these sketches hold a fixed number of words,
+ * and answer within a known error:
+ *
+ * - hyperloglog: number of distinct elements,
+ * - count_min_sketch: number of occurences of an element (never less
+ *   than the true count),
+ * - minhash: Jaccard index of two sets, in O(k) per comparison.
+ *
+ * Sketches of the same type, parameters and seed merge into the sketch
+ * of the union of their streams, so that streams may be sketched apart
+ * (on other threads, or other machines) then aggregated. write() and
+ * read() give them a compact binary form for that.
+ *
+ * Elements are hashed with Hash (boost::hash by default), then mixed
+ * with the seed, so that poor hashes such as that of integers (the
+ * identity) do well. Only sketches built with the same Hash and seed
+ * may be merged or compared.
+ */
+
+namespace detail {
+
+// The finalizer of splitmix64: a bijection in which each bit of the
+// output depends on all bits of the input.
+inline uint64_t sketch_mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+inline void put_magic(std::ostream& out, uint32_t magic)
+{
+    out.rdbuf()->sputn(reinterpret_cast<const char*>(&magic), sizeof(magic));
+}
+
+inline void get_magic(std::streambuf& sb, uint32_t magic, const char* what)
+{
+    uint32_t m;
+    serial::get_bytes(sb, reinterpret_cast<char*>(&m), sizeof(m));
+    if (magic != m)
+        throw InconsistenceException(TRACE_INFO,
+            "%s::read - not a %s stream.", what, what);
+}
+
+} // ~namespace detail
+
+//! Count of distinct elements, to within about 1.04 / sqrt(2^precision)
+///
+/// Takes 2^precision bytes; the default precision of 12 gives 4KB and
+/// a standard error of 1.6%. Adding an element is a hash and a max,
+/// and the estimate is a pass over the registers.
+template<typename T, typename Hash = boost::hash<T>>
+class hyperloglog
+{
+public:
+    static constexpr uint32_t MAGIC = 0x3148434f;   // "OCH1"
+
+    /// precision must be in [4, 18]
+    explicit hyperloglog(unsigned precision = 12, uint64_t seed = 0,
+                         const Hash& hash = Hash())
+        : _p(precision), _seed(seed), _hash(hash)
+    {
+        OC_ASSERT(4 <= precision and precision <= 18,
+                  "hyperloglog - precision must be in [4, 18].");
+        _regs.assign(size_t(1) << _p, 0);
+    }
+
+    void add(const T& x)
+    {
+        uint64_t h = detail::sketch_mix(uint64_t(_hash(x)) ^ _seed);
+        // The top bits give the register, the rank of the first 1 in
+        // the others the value.
+        size_t j = h >> (64 - _p);
+        uint64_t rest = (h << _p) | (uint64_t(1) << (_p - 1));
+        uint8_t rank = __builtin_clzll(rest) + 1;
+        if (_regs[j] < rank) _regs[j] = rank;
+    }
+
+    template<typename It>
+    void add(It from, It to)
+    {
+        for (; from != to; ++from) add(*from);
+    }
+
+    /// Estimated number of distinct elements added
+    double estimate() const
+    {
+        const double m = _regs.size();
+        double sum = 0;
+        size_t zeros = 0;
+        for (uint8_t r : _regs)
+        {
+            sum += std::ldexp(1.0, -int(r));
+            zeros += 0 == r;
+        }
+        double alpha = 16 == m ? 0.673 : 32 == m ? 0.697 : 64 == m ? 0.709
+            : 0.7213 / (1 + 1.079 / m);
+        double e = alpha * m * m / sum;
+        // Small counts are better estimated by linear counting.
+        if (e <= 2.5 * m and 0 < zeros)
+            return m * std::log(m / zeros);
+        return e;
+    }
+
+    /// Become the sketch of the union of both streams
+    void merge(const hyperloglog& other)
+    {
+        OC_ASSERT(_p == other._p and _seed == other._seed,
+                  "hyperloglog::merge - different precisions or seeds.");
+        for (size_t j = 0; j < _regs.size(); j++)
+            _regs[j] = std::max(_regs[j], other._regs[j]);
+    }
+
+    void clear() { std::fill(_regs.begin(), _regs.end(), 0); }
+
+    unsigned precision() const { return _p; }
+    uint64_t seed() const { return _seed; }
+
+    bool operator==(const hyperloglog& other) const
+    {
+        return _p == other._p and _seed == other._seed
+            and _regs == other._regs;
+    }
+
+    void write(std::ostream& out) const
+    {
+        std::streambuf& sb = *out.rdbuf();
+        detail::put_magic(out, MAGIC);
+        serial::put_varint(sb, _p);
+        serial::put_varint(sb, _seed);
+        sb.sputn(reinterpret_cast<const char*>(_regs.data()), _regs.size());
+    }
+
+    static hyperloglog read(std::istream& in, const Hash& hash = Hash())
+    {
+        std::streambuf& sb = *in.rdbuf();
+        detail::get_magic(sb, MAGIC, "hyperloglog");
+        unsigned p = serial::get_varint(sb);
+        if (p < 4 or 18 < p)
+            throw InconsistenceException(TRACE_INFO,
+                "hyperloglog::read - bad precision %u.", p);
+        hyperloglog res(p, serial::get_varint(sb), hash);
+        serial::get_bytes(sb, reinterpret_cast<char*>(res._regs.data()),
+                          res._regs.size());
+        return res;
+    }
+
+private:
+    unsigned _p;
+    uint64_t _seed;
+    Hash _hash;
+    std::vector<uint8_t> _regs;
+};
+
+//! Counts of elements, overestimated by at most epsilon times the
+//! total count, with probability 1 - delta
+///
+/// That takes depth = ceil(ln(1 / delta)) rows of width = ceil(e /
+/// epsilon) counters; count() is the least of the counters the element
+/// maps to, one per row.
+template<typename T, typename Hash = boost::hash<T>>
+class count_min_sketch
+{
+public:
+    static constexpr uint32_t MAGIC = 0x3143434f;   // "OCC1"
+
+    count_min_sketch(size_t width, size_t depth, uint64_t seed = 0,
+                     const Hash& hash = Hash())
+        : _width(width), _depth(depth), _seed(seed), _total(0), _hash(hash),
+          _counts(width * depth, 0)
+    {
+        OC_ASSERT(0 < width and 0 < depth,
+                  "count_min_sketch - width and depth must be positive.");
+    }
+
+    /// Sketch counting within epsilon * total_count(), with
+    /// probability 1 - delta
+    static count_min_sketch with_error(double epsilon, double delta,
+                                       uint64_t seed = 0,
+                                       const Hash& hash = Hash())
+    {
+        OC_ASSERT(0 < epsilon and 0 < delta and delta < 1,
+                  "count_min_sketch - epsilon and delta must be in (0, 1).");
+        return count_min_sketch(std::ceil(std::exp(1.0) / epsilon),
+                                std::ceil(std::log(1 / delta)), seed, hash);
+    }
+
+    void add(const T& x, uint64_t n = 1)
+    {
+        uint64_t h1, h2;
+        hashes(x, h1, h2);
+        for (size_t i = 0; i < _depth; i++)
+            _counts[i * _width + column(h1 + i * h2)] += n;
+        _total += n;
+    }
+
+    template<typename It>
+    void add(It from, It to)
+    {
+        for (; from != to; ++from) add(*from);
+    }
+
+    /// Estimated count of x, never less than the true one
+    uint64_t count(const T& x) const
+    {
+        uint64_t h1, h2;
+        hashes(x, h1, h2);
+        uint64_t res = std::numeric_limits<uint64_t>::max();
+        for (size_t i = 0; i < _depth; i++)
+            res = std::min(res, _counts[i * _width + column(h1 + i * h2)]);
+        return res;
+    }
+
+    /// Sum of all counts added
+    uint64_t total_count() const { return _total; }
+
+    /// Become the sketch of the union of both streams
+    void merge(const count_min_sketch& other)
+    {
+        OC_ASSERT(_width == other._width and _depth == other._depth
+                  and _seed == other._seed,
+                  "count_min_sketch::merge - different sizes or seeds.");
+        for (size_t i = 0; i < _counts.size(); i++)
+            _counts[i] += other._counts[i];
+        _total += other._total;
+    }
+
+    void clear()
+    {
+        std::fill(_counts.begin(), _counts.end(), 0);
+        _total = 0;
+    }
+
+    size_t width() const { return _width; }
+    size_t depth() const { return _depth; }
+    uint64_t seed() const { return _seed; }
+
+    bool operator==(const count_min_sketch& other) const
+    {
+        return _width == other._width and _depth == other._depth
+            and _seed == other._seed and _counts == other._counts;
+    }
+
+    /// Counters are written as varints, so that a sparse sketch takes
+    /// about a byte per counter.
+    void write(std::ostream& out) const
+    {
+        std::streambuf& sb = *out.rdbuf();
+        detail::put_magic(out, MAGIC);
+        serial::put_varint(sb, _width);
+        serial::put_varint(sb, _depth);
+        serial::put_varint(sb, _seed);
+        serial::put_varint(sb, _total);
+        for (uint64_t c : _counts) serial::put_varint(sb, c);
+    }
+
+    static count_min_sketch read(std::istream& in, const Hash& hash = Hash())
+    {
+        std::streambuf& sb = *in.rdbuf();
+        detail::get_magic(sb, MAGIC, "count_min_sketch");
+        size_t width = serial::get_varint(sb);
+        size_t depth = serial::get_varint(sb);
+        if (0 == width or 0 == depth or (1 << 30) / width < depth)
+            throw InconsistenceException(TRACE_INFO,
+                "count_min_sketch::read - bad size.");
+        count_min_sketch res(width, depth, serial::get_varint(sb), hash);
+        res._total = serial::get_varint(sb);
+        for (uint64_t& c : res._counts) c = serial::get_varint(sb);
+        return res;
+    }
+
+private:
+    size_t _width, _depth;
+    uint64_t _seed, _total;
+    Hash _hash;
+    std::vector<uint64_t> _counts;
+
+    // The rows use h1 + i * h2, as good as independent hashes
+    // (Kirsch and Mitzenmacher), for the cost of one.
+    void hashes(const T& x, uint64_t& h1, uint64_t& h2) const
+    {
+        h1 = detail::sketch_mix(uint64_t(_hash(x)) ^ _seed);
+        h2 = detail::sketch_mix(h1) | 1;
+    }
+
+    size_t column(uint64_t h) const
+    {
+        return size_t(((unsigned __int128)h * _width) >> 64);
+    }
+};
+
+//! Signature of a set, whose Jaccard index with another signature
+//! estimates that of the sets, to within about 1 / sqrt(k)
+///
+/// Each of the k slots holds the least value of an independent hash
+/// over the elements added; two sets agree on a slot with probability
+/// their Jaccard index. The signature of a union is the slot-wise min.
+template<typename T, typename Hash = boost::hash<T>>
+class minhash
+{
+public:
+    static constexpr uint32_t MAGIC = 0x314d434f;   // "OCM1"
+
+    explicit minhash(size_t k = 128, uint64_t seed = 0,
+                     const Hash& hash = Hash())
+        : _seed(seed), _hash(hash),
+          _mins(k, std::numeric_limits<uint64_t>::max())
+    {
+        OC_ASSERT(0 < k, "minhash - k must be positive.");
+        _salts.reserve(k);
+        uint64_t s = seed;
+        for (size_t i = 0; i < k; i++)
+            _salts.push_back(detail::sketch_mix(s += 0x9e3779b97f4a7c15ULL));
+    }
+
+    void add(const T& x)
+    {
+        uint64_t h = detail::sketch_mix(uint64_t(_hash(x)) ^ _seed);
+        const size_t k = _mins.size();
+        for (size_t i = 0; i < k; i++)
+            _mins[i] = std::min(_mins[i], detail::sketch_mix(h ^ _salts[i]));
+    }
+
+    template<typename It>
+    void add(It from, It to)
+    {
+        for (; from != to; ++from) add(*from);
+    }
+
+    /// Estimated Jaccard index of the sets of both signatures
+    float similarity(const minhash& other) const
+    {
+        OC_ASSERT(compatible(other),
+                  "minhash::similarity - different sizes or seeds.");
+        size_t same = 0;
+        for (size_t i = 0; i < _mins.size(); i++)
+            same += _mins[i] == other._mins[i];
+        return float(same) / _mins.size();
+    }
+
+    /// Become the signature of the union of both sets
+    void merge(const minhash& other)
+    {
+        OC_ASSERT(compatible(other),
+                  "minhash::merge - different sizes or seeds.");
+        for (size_t i = 0; i < _mins.size(); i++)
+            _mins[i] = std::min(_mins[i], other._mins[i]);
+    }
+
+    void clear()
+    {
+        std::fill(_mins.begin(), _mins.end(),
+                  std::numeric_limits<uint64_t>::max());
+    }
+
+    size_t size() const { return _mins.size(); }
+    uint64_t seed() const { return _seed; }
+    const std::vector<uint64_t>& signature() const { return _mins; }
+
+    bool operator==(const minhash& other) const
+    {
+        return _seed == other._seed and _mins == other._mins;
+    }
+
+    /// The slots are written raw, in the host byte order.
+    void write(std::ostream& out) const
+    {
+        std::streambuf& sb = *out.rdbuf();
+        detail::put_magic(out, MAGIC);
+        serial::put_varint(sb, _mins.size());
+        serial::put_varint(sb, _seed);
+        sb.sputn(reinterpret_cast<const char*>(_mins.data()),
+                 _mins.size() * sizeof(uint64_t));
+    }
+
+    static minhash read(std::istream& in, const Hash& hash = Hash())
+    {
+        std::streambuf& sb = *in.rdbuf();
+        detail::get_magic(sb, MAGIC, "minhash");
+        size_t k = serial::get_varint(sb);
+        if (0 == k or (1 << 24) < k)
+            throw InconsistenceException(TRACE_INFO,
+                "minhash::read - bad size.");
+        minhash res(k, serial::get_varint(sb), hash);
+        serial::get_bytes(sb, reinterpret_cast<char*>(res._mins.data()),
+                          k * sizeof(uint64_t));
+        return res;
+    }
+
+private:
+    uint64_t _seed;
+    Hash _hash;
+    std::vector<uint64_t> _mins;
+    std::vector<uint64_t> _salts;
+
+    bool compatible(const minhash& other) const
+    {
+        return _mins.size() == other._mins.size() and _seed == other._seed;
+    }
+};
+
+//! Approximate jaccard_index (see jaccard_index.h) of the sets of two
+//! MinHash signatures.
+template<typename T, typename Hash>
+float jaccard_index(const minhash<T, Hash>& s1, const minhash<T, Hash>& s2)
+{
+    return s1.similarity(s2);
+}
+
+/** @}*/
+} // ~namespace opencog
+
+#endif // _OPENCOG_SKETCHES_H
@@ -0,0 +1,144 @@
+/*
+ * opencog/util/subtree_index.h
+ *
+ * An index of the subtrees of a collection of trees.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SUBTREE_INDEX_H
+#define _OPENCOG_SUBTREE_INDEX_H
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+
+#include <opencog/util/interned_tree.h>
+#include <opencog/util/tree.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! Answers "which trees contain this subtree?" over a fixed corpus.
+///
+/// Every tree added is interned (see tree_interner), so each distinct
+/// subtree of the corpus gets an id, found by its structural hash and
+/// then checked label by label. For each id, the index keeps the
+/// sorted list of the trees in which that subtree occurs.
+///
+/// A query interns nothing: it looks the pattern up bottom-up, in
+/// time proportional to the size of the pattern (giving up as soon as
+/// some part of it occurs nowhere in the corpus), and then returns the
+/// list. The size of the corpus does not come into it. Likewise, two
+/// trees of the corpus are equal exactly when their root ids are, so
+/// equal() takes constant time.
+///
+/// Trees are numbered from zero, in the order they were added. The
+/// index keeps no reference to them.
+template<typename T, typename Hash = boost::hash<T>>
+class subtree_index
+{
+public:
+    typedef tree_interner<T, Hash> interner;
+    typedef typename interner::id_type id_type;
+    typedef std::vector<size_t> tree_ids;
+
+    subtree_index(const Hash& h = Hash()) : _interner(h) {}
+
+    /// Add a tree (or forest) to the corpus; return its number.
+    template<typename Alloc>
+    size_t add(const tree<T, Alloc>& tr)
+    {
+        size_t tid = _roots.size();
+        _roots.emplace_back();
+        for (auto sib = tr.begin(); sib != tr.end(); sib = tr.next_sibling(sib))
+            _roots.back().push_back(_interner.intern(sib));
+
+        // Post this tree in the list of every distinct subtree it has:
+        // a walk over the shared, interned, form visits each only once.
+        if (_postings.size() < _interner.size())
+            _postings.resize(_interner.size());
+        std::vector<id_type> todo(_roots.back());
+        while (not todo.empty())
+        {
+            id_type id = todo.back();
+            todo.pop_back();
+            tree_ids& post = _postings[id];
+            if (not post.empty() and post.back() == tid) continue;
+            post.push_back(tid);
+            const auto& kids = _interner.children(id);
+            todo.insert(todo.end(), kids.begin(), kids.end());
+        }
+        return tid;
+    }
+
+    /// The trees containing the subtree of the pattern at it, in
+    /// increasing order.
+    template<typename It>
+    const tree_ids& containing(const It& it) const
+    {
+        id_type id;
+        if (not _interner.find(it, id)) return _none;
+        return _postings[id];
+    }
+
+    /// The trees containing the pattern, which must have a single root.
+    template<typename Alloc>
+    const tree_ids& containing(const tree<T, Alloc>& pattern) const
+    {
+        if (pattern.empty()) return _none;
+        return containing(pattern.begin());
+    }
+
+    /// Does tree tid contain the pattern?
+    template<typename Pattern>
+    bool contains(size_t tid, const Pattern& pattern) const
+    {
+        const tree_ids& post = containing(pattern);
+        return std::binary_search(post.begin(), post.end(), tid);
+    }
+
+    /// Are trees a and b of the corpus equal?
+    bool equal(size_t a, size_t b) const { return _roots[a] == _roots[b]; }
+
+    /// Number of trees in the corpus.
+    size_t size() const { return _roots.size(); }
+
+    /// Number of distinct subtrees in the corpus.
+    size_t distinct_subtrees() const { return _interner.size(); }
+
+    void clear()
+    {
+        _interner.clear();
+        _roots.clear();
+        _postings.clear();
+    }
+
+private:
+    interner _interner;
+    std::vector<std::vector<id_type>> _roots;     // per tree
+    std::vector<tree_ids> _postings;              // per subtree id
+    tree_ids _none;
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_SUBTREE_INDEX_H
@@ -0,0 +1,144 @@
+/*
+ * opencog/util/thread_pool.h
+ *
+ * A shared pool of worker threads, and parallel loops over it.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_THREAD_POOL_H
+#define _OPENCOG_THREAD_POOL_H
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <opencog/util/oc_omp.h>
+#include <opencog/util/work_stealing_scheduler.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! The shared work_stealing_scheduler, of pool_threads() workers.
+///
+/// Unlike the parallel algorithms of OMP_ALGO, it does not need
+/// OpenMP nor the GNU parallel mode, so it works with any compiler.
+/// It is started on first use; after setting_omp() changes the number
+/// of threads, the next call starts a new pool of the new size. The
+/// old one lives on until the last of its users lets go of it.
+inline std::shared_ptr<work_stealing_scheduler> thread_pool()
+{
+    static std::mutex mtx;
+    static std::shared_ptr<work_stealing_scheduler> pool;
+    std::lock_guard<std::mutex> lock(mtx);
+    unsigned n = pool_threads();
+    if (not pool or pool->num_threads() != n)
+        pool = std::make_shared<work_stealing_scheduler>(n);
+    return pool;
+}
+
+//! Call f(i) for every i in [begin, end), in parallel, in chunks of
+/// grain consecutive indexes.
+///
+/// It returns once all calls are done; if any threw, the first
+/// exception is re-thrown then. When called from a task running on
+/// the same scheduler (a nested loop), or when the scheduler has a
+/// single worker, the whole loop runs serially, on the calling thread.
+template<typename F>
+void parallel_for(size_t begin, size_t end, size_t grain, F f,
+                  work_stealing_scheduler& sched)
+{
+    if (end <= begin) return;
+    grain = std::max<size_t>(grain, 1);
+    size_t nchunks = (end - begin + grain - 1) / grain;
+    auto chunk = [&](size_t c) {
+        size_t lo = begin + c * grain, hi = std::min(end, lo + grain);
+        for (size_t i = lo; i < hi; i++) f(i);
+    };
+
+    if (1 == nchunks or 0 <= sched.current_worker()
+        or 1 == sched.num_threads())
+    {
+        for (size_t c = 0; c < nchunks; c++) chunk(c);
+        return;
+    }
+
+    task_latch latch;
+    latch.pending = nchunks;
+    auto run = [&chunk, &latch](size_t c) {
+        std::exception_ptr err;
+        try { chunk(c); }
+        catch (...) { err = std::current_exception(); }
+        latch.done(err);
+    };
+    for (size_t c = 1; c < nchunks; c++)
+        sched.submit([&run, c]() { run(c); });
+    run(0);
+    latch.wait();
+}
+
+//! Same as above, over the shared thread_pool()
+template<typename F>
+void parallel_for(size_t begin, size_t end, size_t grain, F f)
+{
+    std::shared_ptr<work_stealing_scheduler> pool = thread_pool();
+    parallel_for(begin, end, grain, f, *pool);
+}
+
+//! Reduce [begin, end) in parallel: the range is cut in chunks of
+/// grain consecutive indexes, f(lo, hi) gives the T of chunk
+/// [lo, hi), and the results of the chunks are combined, in order,
+/// by reduce(T, T), starting from identity.
+///
+/// The chunks and the order of the combination do not depend on the
+/// number of threads, so neither does the result, even for floating
+/// point sums. Nesting and exceptions are as for parallel_for().
+template<typename T, typename F, typename R>
+T parallel_reduce(size_t begin, size_t end, size_t grain, T identity,
+                  F f, R reduce, work_stealing_scheduler& sched)
+{
+    if (end <= begin) return identity;
+    grain = std::max<size_t>(grain, 1);
+    size_t nchunks = (end - begin + grain - 1) / grain;
+    std::vector<T> partial(nchunks, identity);
+    parallel_for(0, nchunks, 1, [&](size_t c) {
+        size_t lo = begin + c * grain;
+        partial[c] = f(lo, std::min(end, lo + grain));
+    }, sched);
+
+    T res = identity;
+    for (const T& p : partial) res = reduce(res, p);
+    return res;
+}
+
+//! Same as above, over the shared thread_pool()
+template<typename T, typename F, typename R>
+T parallel_reduce(size_t begin, size_t end, size_t grain, T identity,
+                  F f, R reduce)
+{
+    std::shared_ptr<work_stealing_scheduler> pool = thread_pool();
+    return parallel_reduce(begin, end, grain, identity, f, reduce, *pool);
+}
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_THREAD_POOL_H
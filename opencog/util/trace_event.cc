@@ -0,0 +1,265 @@
+/*
+ * opencog/util/trace_event.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <opencog/util/trace_event.h>
+
+using namespace opencog;
+
+std::atomic<bool> opencog::detail::trace_on(false);
+
+namespace {
+
+struct event
+{
+    const char* name;
+    uint64_t nsec;
+    int64_t value;
+    char phase;
+};
+
+// The events of one thread. Only the thread appends, and publishes
+// the count with a release store; the dump reads up to the count.
+// The buffer is allocated on the first event, and outlives the
+// thread, so that its events can be dumped after it exits.
+struct thread_events
+{
+    std::unique_ptr<event[]> events;
+    size_t capacity = 0;
+    std::atomic<size_t> count{0};
+    std::atomic<size_t> dropped{0};
+    std::atomic<uint64_t> session{0};   // of the events
+    long tid;
+    std::string name;         // under the registry lock
+};
+
+std::mutex registry_mtx;
+std::vector<std::shared_ptr<thread_events>> registry;
+std::atomic<uint64_t> session(0);
+size_t capacity = 1 << 16;
+uint64_t start_nsec = 0;
+
+uint64_t now_nsec()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+long thread_id()
+{
+#ifdef __linux__
+    return syscall(SYS_gettid);
+#else
+    static std::atomic<long> next(1);
+    return next++;
+#endif
+}
+
+thread_events& my_events()
+{
+    thread_local std::shared_ptr<thread_events> te;
+    if (not te)
+    {
+        te = std::make_shared<thread_events>();
+        te->tid = thread_id();
+        std::lock_guard<std::mutex> lock(registry_mtx);
+        // Forget the threads that are gone and left nothing to dump.
+        uint64_t s = session.load();
+        registry.erase(std::remove_if(registry.begin(), registry.end(),
+            [s](const std::shared_ptr<thread_events>& t) {
+                return 1 == t.use_count() and
+                    (t->session.load() != s or 0 == t->count.load());
+            }), registry.end());
+        registry.push_back(te);
+    }
+    return *te;
+}
+
+void record(char phase, const char* name, int64_t value)
+{
+    thread_events& te = my_events();
+    uint64_t s = session.load(std::memory_order_acquire);
+    if (te.session.load(std::memory_order_relaxed) != s)
+    {
+        if (not te.events)
+        {
+            std::lock_guard<std::mutex> lock(registry_mtx);
+            te.capacity = capacity;
+            te.events.reset(new event[capacity]);
+        }
+        te.count.store(0, std::memory_order_relaxed);
+        te.dropped.store(0, std::memory_order_relaxed);
+        te.session.store(s, std::memory_order_release);
+    }
+    size_t n = te.count.load(std::memory_order_relaxed);
+    if (te.capacity <= n)
+    {
+        te.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    te.events[n] = {name, now_nsec(), value, phase};
+    te.count.store(n + 1, std::memory_order_release);
+}
+
+void write_string(std::ostream& out, const char* s)
+{
+    out << '"';
+    for (; *s; s++)
+    {
+        if ('"' == *s or '\\' == *s) out << '\\' << *s;
+        else if (0 <= *s and *s < 0x20)
+        {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", *s);
+            out << buf;
+        }
+        else out << *s;
+    }
+    out << '"';
+}
+
+template<typename F>
+void for_each_thread(F f)
+{
+    std::lock_guard<std::mutex> lock(registry_mtx);
+    uint64_t s = session.load();
+    for (const auto& te : registry)
+        if (te->session.load(std::memory_order_acquire) == s) f(*te);
+}
+
+} // ~namespace
+
+void opencog::trace_start(size_t events_per_thread)
+{
+    std::lock_guard<std::mutex> lock(registry_mtx);
+    capacity = events_per_thread;
+    start_nsec = now_nsec();
+    session++;
+    detail::trace_on = true;
+}
+
+void opencog::trace_stop()
+{
+    detail::trace_on = false;
+}
+
+void opencog::trace_begin(const char* name)
+{
+    if (trace_enabled()) record('B', name, 0);
+}
+
+void opencog::trace_end(const char* name)
+{
+    // Even if stopped since the beginning, so that the span is closed.
+    thread_events& te = my_events();
+    if (te.session.load(std::memory_order_relaxed)
+        == session.load(std::memory_order_relaxed))
+        record('E', name, 0);
+}
+
+void opencog::trace_instant(const char* name)
+{
+    if (trace_enabled()) record('i', name, 0);
+}
+
+void opencog::trace_counter(const char* name, int64_t value)
+{
+    if (trace_enabled()) record('C', name, value);
+}
+
+void opencog::trace_thread_name(const std::string& name)
+{
+    thread_events& te = my_events();
+    std::lock_guard<std::mutex> lock(registry_mtx);
+    te.name = name;
+}
+
+void opencog::trace_write_json(std::ostream& out)
+{
+    long pid = getpid();
+    bool first = true;
+    auto sep = [&]() { out << (first ? "\n" : ",\n"); first = false; };
+
+    out << "{\"traceEvents\":[";
+    for_each_thread([&](const thread_events& te) {
+        if (not te.name.empty())
+        {
+            sep();
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+                << ",\"tid\":" << te.tid << ",\"args\":{\"name\":";
+            write_string(out, te.name.c_str());
+            out << "}}";
+        }
+        size_t n = te.count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < n; i++)
+        {
+            const event& e = te.events[i];
+            char ts[32];
+            // Microseconds since trace_start(), to the nanosecond
+            snprintf(ts, sizeof(ts), "%.3f",
+                     (int64_t(e.nsec - start_nsec)) / 1000.0);
+            sep();
+            out << "{\"name\":";
+            write_string(out, e.name);
+            out << ",\"ph\":\"" << e.phase << "\",\"ts\":" << ts
+                << ",\"pid\":" << pid << ",\"tid\":" << te.tid;
+            if ('C' == e.phase)
+                out << ",\"args\":{\"value\":" << e.value << "}";
+            else if ('i' == e.phase)
+                out << ",\"s\":\"t\"";
+            out << "}";
+        }
+    });
+    out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+bool opencog::trace_dump(const std::string& filename)
+{
+    std::ofstream out(filename);
+    if (not out) return false;
+    trace_write_json(out);
+    return bool(out);
+}
+
+size_t opencog::trace_event_count()
+{
+    size_t n = 0;
+    for_each_thread([&n](const thread_events& te) { n += te.count.load(); });
+    return n;
+}
+
+size_t opencog::trace_dropped_count()
+{
+    size_t n = 0;
+    for_each_thread([&n](const thread_events& te) { n += te.dropped.load(); });
+    return n;
+}
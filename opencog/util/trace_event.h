@@ -0,0 +1,134 @@
+/*
+ * opencog/util/trace_event.h
+ *
+ * Trace events, for a timeline of the threads, in the Chrome trace
+ * format.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_TRACE_EVENT_H
+#define _OPENCOG_TRACE_EVENT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! Trace events: spans, instants and counters, on a timeline per
+//! thread.
+/**
+ * Between trace_start() and trace_stop(), each event is appended to a
+ * buffer of the calling thread, without lock nor allocation; once a
+ * buffer is full, further events of that thread are dropped, and
+ * counted. Outside of that, an event costs a relaxed atomic load.
+ *
+ * trace_write_json() writes the events in the Chrome trace event
+ * format, which chrome://tracing and the Perfetto UI
+ * (ui.perfetto.dev) both open.
+ *
+ * Event names must be string literals, or otherwise outlive the
+ * trace: only the pointer is recorded.
+ *
+ *     trace_start();
+ *     {
+ *         OC_TRACE_SCOPE("load");
+ *         ...
+ *     }
+ *     trace_stop();
+ *     trace_dump("trace.json");
+ *
+ * The writer threads of Logger, async_buffer and async_caller, and
+ * the waits of concurrent_queue and resource_pool, have spans of
+ * their own.
+ */
+
+//! Start recording, clearing the events of any previous trace. Each
+//! thread records up to events_per_thread events (fixed by the first
+//! trace that the thread is part of).
+void trace_start(size_t events_per_thread = 1 << 16);
+
+//! Stop recording; the events are kept until the next trace_start().
+void trace_stop();
+
+namespace detail { extern std::atomic<bool> trace_on; }
+
+//! Whether events are being recorded
+inline bool trace_enabled()
+{
+    return detail::trace_on.load(std::memory_order_relaxed);
+}
+
+//! Record the beginning or the end of a span on the calling thread.
+//! Spans nest, and must end in reverse order of beginning.
+void trace_begin(const char* name);
+void trace_end(const char* name);
+
+//! Record an event without duration
+void trace_instant(const char* name);
+
+//! Record the value of a counter, drawn as a graph over time
+void trace_counter(const char* name, int64_t value);
+
+//! Name the calling thread in the trace, as in "Logger writer"
+void trace_thread_name(const std::string& name);
+
+//! Write the events of the last trace, in Chrome trace JSON. To be
+//! called after trace_stop(), before the next trace_start().
+void trace_write_json(std::ostream&);
+
+//! Same as above, to a file; return false if it cannot be written
+bool trace_dump(const std::string& filename);
+
+//! The number of events recorded, and dropped for lack of room, in
+//! the last trace, over all threads
+size_t trace_event_count();
+size_t trace_dropped_count();
+
+//! A span from construction to destruction, if tracing is on at
+//! construction.
+class trace_scope
+{
+    const char* _name;
+public:
+    explicit trace_scope(const char* name)
+        : _name(trace_enabled() ? name : nullptr)
+    {
+        if (_name) trace_begin(_name);
+    }
+    ~trace_scope() { if (_name) trace_end(_name); }
+    trace_scope(const trace_scope&) = delete;
+    trace_scope& operator=(const trace_scope&) = delete;
+};
+
+#define OC_TRACE_CONCAT_(a, b) a##b
+#define OC_TRACE_CONCAT(a, b) OC_TRACE_CONCAT_(a, b)
+
+//! A trace span over the rest of the enclosing scope
+#define OC_TRACE_SCOPE(name) \
+    ::opencog::trace_scope OC_TRACE_CONCAT(oc_trace_scope_, __LINE__)(name)
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_TRACE_EVENT_H
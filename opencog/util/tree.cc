@@ -1,77 +1,73 @@
 #include "tree.h"
-#include <boost/spirit/include/classic_core.hpp>
+#include "tree_builder.h"
 
-namespace {
-using namespace boost::spirit::classic;
-using std::string;
-using namespace opencog;
-
-tree<string> tr;
-tree<string>::iterator at = tr.begin();
-
-void begin_internal(const char* from, const char* to)
-{
-    at = tr.empty()
-        ? tr.insert(at,string(from, to-1))
-        : tr.append_child(at,string(from, to-1));
-}
-
-void end_internal(const char)
-{
-    at = tr.parent(at);
-}
+#include <cctype>
+#include <cstring>
 
-void add_leaf(const char* from, const char* to)
-{
-    if (tr.empty())
-        at = tr.insert(at, string(from, to));
-    else
-        tr.append_child(at, string(from, to));
-}
+using namespace opencog;
 
-struct TreeGrammar : public grammar<TreeGrammar>
+void opencog::parse_preorder(const std::string& str,
+                             preorder_seq<std::string>& seq)
 {
-    std::vector<string> v;
+    const char* p = str.c_str();
+    const char* end = p + str.size();
+
+    auto skip_space = [&]() { while (p < end and isspace((unsigned char) *p)) p++; };
+    auto is_label_char = [](char c)
+        { return c != '(' and c != ')' and not isspace((unsigned char) c); };
+    auto fail = [&](const char* what) {
+        throw InconsistenceException(TRACE_INFO,
+            "tree - %s at offset %u of '%s'.", what,
+            (unsigned) (p - str.c_str()), str.c_str());
+    };
 
-    template<typename ScannerT>
-    struct definition
+    // Indexes into seq of the nodes whose children are being parsed.
+    std::vector<size_t> open;
+    while (true)
     {
-        definition(const TreeGrammar&)
+        skip_space();
+        if (p == end) break;
+
+        if (*p == ')')
         {
-            term =
-                lexeme_d[// or a message M with the syntax message:"M"
-                         // added this to parse correctly has_said perceptions
-                         // XXX THIS IS A HACK -- FIXME
-                         ( str_p("message:") >> ch_p('"')
-                           >> *(anychar_p - ch_p('"')) >> ch_p('"'))
-                         | (+( anychar_p - ch_p('(') - ch_p(')') - space_p))]
-                [&add_leaf];
-            beg =
-                lexeme_d[(+( anychar_p - ch_p('(') - ch_p(')') - space_p)) >> '('];
-            expr =
-                (beg[&begin_internal] >> +expr >> ch_p(')')[&end_internal]) |
-                term;
-            //expr=term | (term >> '(' >> +expr >> ')');
+            if (open.empty()) fail("unbalanced close paren");
+            open.pop_back();
+            p++;
+            continue;
         }
-        rule<ScannerT> expr, beg, term;
-
-        const rule<ScannerT>& start() const { return expr; }
-    };
-};
 
-tree<std::string> parse_string_tree(const std::string& str)
-{
-    TreeGrammar tg;
-    tr.clear();
-    at = tr.begin();
-    parse(str.c_str(), tg, space_p);
-
-    tree<std::string> tmp(tr);
-    tr.clear();
-    return tmp;
+        // Added to parse has_said perceptions, where the message M may
+        // hold spaces: message:"M" is a single leaf.
+        const char* from = p;
+        static const char msg[] = "message:\"";
+        size_t msglen = sizeof(msg) - 1;
+        const char* close = nullptr;
+        if (size_t(end - p) > msglen and 0 == strncmp(p, msg, msglen))
+            close = (const char*) memchr(p + msglen, '"', end - p - msglen);
+        if (close)
+            p = close + 1;
+        else
+            while (p < end and is_label_char(*p)) p++;
+        if (p == from) fail("expected a label");
+
+        if (not open.empty()) seq[open.back()].second++;
+        seq.emplace_back(std::string(from, p), 0);
+
+        // An open paren, possibly after some white space, starts the
+        // list of children.
+        const char* lbl_end = p;
+        skip_space();
+        if (p < end and *p == '(' and not close)
+        {
+            open.push_back(seq.size() - 1);
+            p++;
+        }
+        else
+            p = lbl_end;
+    }
+    if (not open.empty()) fail("missing close paren");
 }
 
-} // ~namespace
 
 namespace std {
 
@@ -97,38 +93,10 @@ std::istream& operator>>(std::istream& in,opencog::tree<std::string>& t)
         throw InconsistenceException(TRACE_INFO, "tree - %s.",
                                      stream.str().c_str());
     }
-    // I can't figure out how to fix the parser, so I hack around it
-    // here: we must ignore whitespace after a function name, but before
-    // a parenthesis. XXX If you know how to fix the parser, please do.
-    // Example: "and  ($1 $2)" should parse as "and($1 $2)", but the
-    // former fails to parse correctly for some reason unclear to me.
-    int sz = str.length();
-    int i=0, j = 0;
-    while (i<sz and (str[i] == ' ' or str[i] == '\t')) i++;
-    while (i<sz) {
-       int ix = i;
-       // Skip all whitespace that preceeds an open paren.
-       while (str[ix] == ' ' or str[ix] == '\t') ix++;
-       if (str[ix] == '(') {
-          i = ix;
-
-          // If there is nothing but whitespace until the close paren,
-          // then drop both the open and the close parens.  The operator
-          // is effectively child-less in this situation.  If we don't
-          // do this, then the parser goes bonkers and decides that the
-          // operator is a child of itself.  For example, "+()" parses
-          // to become "+(+)" which is incorrect. (Yes, some operators
-          // can be zero-ary).
-          ix++;
-          while (str[ix] == ' ' or str[ix] == '\t') ix++;
-          if (str[ix] == ')') i = ++ix;
-       }
-       str[j] = str[i];
-       i++; j++;
-    }
-    str[j] = 0x0; // null terminate
-
-    t = parse_string_tree(str);
+    // parse_preorder() takes care of white space before an open
+    // paren, as in "and  ($1 $2)", and of child-less operators, as in
+    // "+()".
+    t = opencog::parse_tree(str);
     return in;
 }
 
@@ -76,6 +76,7 @@
 
 #include <opencog/util/oc_assert.h>
 #include <opencog/util/exceptions.h>
+#include <opencog/util/memory_accounting.h>
 // #define tree_assert assert
 #define tree_assert OC_ASSERT
 
@@ -107,6 +108,14 @@ void destructor(T1* p)
     p->~T1();
 }
 
+// The bytes of the nodes kept for re-use, by all trees (see
+// recycle_nodes()). Never destroyed, as trees may outlive it.
+inline memory_account& spare_node_bytes()
+{
+    static memory_account* acct = new memory_account("tree spare nodes");
+    return *acct;
+}
+
 }
 
 /// A node in the tree, combining links to other nodes as well as the actual data.
@@ -147,8 +156,11 @@ public:
     explicit tree(const std::initializer_list<tree<T, tree_node_allocator>>&);
     /// Copy a tree
     tree(const tree<T, tree_node_allocator>&);
+    /// Move a tree; constant time, leaves the other tree empty.
+    tree(tree<T, tree_node_allocator>&&);
     ~tree();
     tree<T, tree_node_allocator>& operator=(const tree<T, tree_node_allocator>&);
+    tree<T, tree_node_allocator>& operator=(tree<T, tree_node_allocator>&&);
 
     /// Base class for iterators, only pointers stored, no traversal logic.
 #ifdef __SGI_STL_PORT
@@ -416,6 +428,10 @@ public:
     /// Append the nodes in the from-to range (plus their children) as last/first children of position.
     template<typename iter> iter append_children(iter position, sibling_iterator from, sibling_iterator to);
     template<typename iter> iter prepend_children(iter position, sibling_iterator from, sibling_iterator to);
+    /// Move the roots (plus their children) of other, which must not be
+    /// empty, to be the last children of position; returns the first
+    /// of them. Constant time: the nodes are spliced in, not copied.
+    template<typename iter> iter append_child(iter position, tree&& other);
 
     /// Short-hand to insert topmost node in otherwise empty tree.
     pre_order_iterator set_head(const T& x);
@@ -427,6 +443,10 @@ public:
     template<typename iter> iter insert_subtree(iter position, const iterator_base& subtree);
     /// Insert node (with children) pointed to by subtree as next sibling of node pointed to by position.
     template<typename iter> iter insert_subtree_after(iter position, const iterator_base& subtree);
+    /// Move the roots (plus their children) of other, which must not be
+    /// empty, to be the previous siblings of position; returns the
+    /// first of them. Constant time.
+    template<typename iter> iter insert_subtree(iter position, tree&& other);
     /// Insert node as next sibling of node pointed to by position.
     template<typename iter> iter insert_after(iter position, const T& x);
     /// Insert node above position (below parent if it exists); returns new node
@@ -436,6 +456,9 @@ public:
     template<typename iter> iter replace(iter position, const T& x);
     /// Replace node at 'position' with subtree starting at 'from' (do not erase subtree at 'from'); see above.
     template<typename iter> iter replace(iter position, const iterator_base& from);
+    /// Replace the subtree at 'position' with the roots (plus their children) of other, which
+    /// must not be empty, moving them rather than copying; returns the first of them.
+    template<typename iter> iter replace(iter position, tree&& other);
     /// Replace string of siblings (plus their children) with copy of a new string (with children); see above
     sibling_iterator replace(sibling_iterator orig_begin, sibling_iterator orig_end,
                              sibling_iterator new_begin,  sibling_iterator new_end);
@@ -491,6 +514,16 @@ public:
     /// Exchange two nodes (plus subtrees)
     void     swap(iterator, iterator);
 
+    /// Keep the nodes of erased subtrees for re-use (true), or give
+    /// them back to the allocator at once (false, the default).
+    void     recycle_nodes(bool);
+    /// Make sure there are at least n spare nodes; turns recycling on.
+    void     reserve(size_t n);
+    /// Number of nodes kept for re-use.
+    size_t   spare_nodes() const { return nspare_; }
+    /// Give all spare nodes back to the allocator.
+    void     release_spare_nodes();
+
     /// Count the total number of nodes.
     int      size() const;
     /// Count the total number of nodes of the subtree 'it'
@@ -549,8 +582,14 @@ public:
     tree_node *head, *feet;    // head/feet are always dummy; if an iterator points to them it is invalid
 private:
     tree_node_allocator alloc_;
+    tree_node *spare_;         // recycled nodes, linked by next_sibling
+    size_t nspare_;
+    bool recycle_;
     void head_initialise_();
     void copy_(const tree<T, tree_node_allocator>& other);
+    tree_node* get_node_();
+    void put_node_(tree_node*);
+    tree_node* splice_(tree& other, tree_node* parent, tree_node* next);
 
     /// Comparator class for two nodes of a tree (used for sorting and searching).
     template<class StrictWeakOrdering>
@@ -702,6 +741,7 @@ template <class T, class tree_node_allocator>
 tree<T, tree_node_allocator>::~tree()
 {
     clear();
+    release_spare_nodes();
     alloc_.deallocate(head,1);
     alloc_.deallocate(feet,1);
 }
@@ -709,6 +749,10 @@ tree<T, tree_node_allocator>::~tree()
 template <class T, class tree_node_allocator>
 void tree<T, tree_node_allocator>::head_initialise_()
 {
+    spare_=0;
+    nspare_=0;
+    recycle_=false;
+
     head = alloc_.allocate(1,0); // MSVC does not have default second argument
     feet = alloc_.allocate(1,0);
 
@@ -740,6 +784,155 @@ tree<T, tree_node_allocator>::tree(const tree<T, tree_node_allocator>& other)
     copy_(other);
 }
 
+template <class T, class tree_node_allocator>
+tree<T, tree_node_allocator>::tree(tree<T, tree_node_allocator>&& other)
+    : alloc_(other.alloc_)
+{
+    // The other tree keeps a fresh head and feet, so that it is still
+    // a valid, empty, tree.
+    head_initialise_();
+    std::swap(head, other.head);
+    std::swap(feet, other.feet);
+}
+
+template <class T, class tree_node_allocator>
+tree<T, tree_node_allocator>& tree<T, tree_node_allocator>::operator=(tree<T, tree_node_allocator>&& other)
+{
+    if (this==&other)
+        return *this;
+    if (alloc_==other.alloc_) {
+        std::swap(head, other.head);
+        std::swap(feet, other.feet);
+        other.clear();
+    }
+    else
+        copy_(other);
+    return *this;
+}
+
+template <class T, class tree_node_allocator>
+typename tree<T, tree_node_allocator>::tree_node* tree<T, tree_node_allocator>::get_node_()
+{
+    if (spare_) {
+        tree_node* n=spare_;
+        spare_=n->next_sibling;
+        --nspare_;
+        kp::spare_node_bytes().sub(sizeof(tree_node));
+        return n;
+    }
+    return alloc_.allocate(1,0);
+}
+
+template <class T, class tree_node_allocator>
+void tree<T, tree_node_allocator>::put_node_(tree_node* n)
+{
+    if (recycle_) {
+        n->next_sibling=spare_;
+        spare_=n;
+        ++nspare_;
+        kp::spare_node_bytes().add(sizeof(tree_node));
+    }
+    else
+        alloc_.deallocate(n,1);
+}
+
+template <class T, class tree_node_allocator>
+void tree<T, tree_node_allocator>::recycle_nodes(bool on)
+{
+    recycle_=on;
+}
+
+template <class T, class tree_node_allocator>
+void tree<T, tree_node_allocator>::reserve(size_t n)
+{
+    recycle_=true;
+    while (nspare_<n)
+        put_node_(alloc_.allocate(1,0));
+}
+
+template <class T, class tree_node_allocator>
+void tree<T, tree_node_allocator>::release_spare_nodes()
+{
+    while (spare_) {
+        tree_node* n=spare_;
+        spare_=n->next_sibling;
+        alloc_.deallocate(n,1);
+    }
+    kp::spare_node_bytes().sub(nspare_*sizeof(tree_node));
+    nspare_=0;
+}
+
+// Unlink all the roots of other, and link them in as children of
+// parent, just before next (or as the last children, if next is 0).
+// For the top level, parent is 0, and next is never 0.
+template <class T, class tree_node_allocator>
+typename tree<T, tree_node_allocator>::tree_node*
+tree<T, tree_node_allocator>::splice_(tree& other, tree_node* parent, tree_node* next)
+{
+    tree_assert(!other.empty());
+    tree_node* first=other.head->next_sibling;
+    tree_node* last=other.feet->prev_sibling;
+    other.head->next_sibling=other.feet;
+    other.feet->prev_sibling=other.head;
+
+    for (tree_node* n=first; ; n=n->next_sibling) {
+        n->parent=parent;
+        if (n==last) break;
+    }
+    tree_node* prev = next ? next->prev_sibling : parent->last_child;
+    first->prev_sibling=prev;
+    last->next_sibling=next;
+    if (prev) prev->next_sibling=first;
+    else      parent->first_child=first;
+    if (next) next->prev_sibling=last;
+    else      parent->last_child=last;
+    return first;
+}
+
+template <class T, class tree_node_allocator>
+template <class iter>
+iter tree<T, tree_node_allocator>::append_child(iter position, tree&& other)
+{
+    tree_assert(position.node!=head && position.node!=feet);
+    if (alloc_==other.alloc_)
+        return iter(splice_(other, position.node, 0));
+
+    // Nodes cannot move between allocators; copy them instead.
+    iter first;
+    for (sibling_iterator sib=other.begin(); sib!=other.end(); ++sib) {
+        iter it=append_child(position, iter(sib.node));
+        if (first.node==0) first=it;
+    }
+    other.clear();
+    return first;
+}
+
+template <class T, class tree_node_allocator>
+template <class iter>
+iter tree<T, tree_node_allocator>::insert_subtree(iter position, tree&& other)
+{
+    tree_assert(position.node!=head);
+    if (alloc_==other.alloc_)
+        return iter(splice_(other, position.node->parent, position.node));
+
+    iter first;
+    for (sibling_iterator sib=other.begin(); sib!=other.end(); ++sib) {
+        iter it=insert_subtree(position, sib);
+        if (first.node==0) first=it;
+    }
+    other.clear();
+    return first;
+}
+
+template <class T, class tree_node_allocator>
+template <class iter>
+iter tree<T, tree_node_allocator>::replace(iter position, tree&& other)
+{
+    iter first=insert_subtree(position, std::move(other));
+    erase(position);
+    return first;
+}
+
 template <class T, class tree_node_allocator>
 void tree<T, tree_node_allocator>::copy_(const tree<T, tree_node_allocator>& other)
 {
@@ -772,15 +965,27 @@ void tree<T, tree_node_allocator>::clear()
 template<class T, class tree_node_allocator>
 void tree<T, tree_node_allocator>::erase_children(const iterator_base& it)
 {
+    // Iterative, so that very deep trees do not overflow the stack:
+    // go down to a leaf, free it, and move on to its next sibling; once
+    // the last child of a node is gone, that node is a leaf itself.
     tree_node *cur=it.node->first_child;
-    tree_node *prev=0;
-
     while(cur!=0) {
-        prev=cur;
-        cur=cur->next_sibling;
-        erase_children(pre_order_iterator(prev));
-        kp::destructor(&prev->data);
-        alloc_.deallocate(prev,1);
+        if(cur->first_child!=0) {
+            cur=cur->first_child;
+            continue;
+        }
+        tree_node *next=cur->next_sibling;
+        tree_node *parent=cur->parent;
+        kp::destructor(&cur->data);
+        put_node_(cur);
+        if(next!=0)
+            cur=next;
+        else if(parent==it.node)
+            break;
+        else {
+            parent->first_child=0;
+            cur=parent;
+        }
     }
     it.node->first_child=0;
     it.node->last_child=0;
@@ -810,7 +1015,7 @@ iter tree<T, tree_node_allocator>::erase(iter it)
     }
 
     kp::destructor(&cur->data);
-    alloc_.deallocate(cur,1);
+    put_node_(cur);
     return ret;
 }
 
@@ -1006,7 +1211,7 @@ iter tree<T, tree_node_allocator>::append_child(iter position)
     tree_assert(position.node!=head);
     tree_assert(position.node);
 
-    tree_node *tmp=alloc_.allocate(1,0);
+    tree_node *tmp=get_node_();
     kp::constructor(&tmp->data);
     tmp->first_child=0;
     tmp->last_child=0;
@@ -1031,7 +1236,7 @@ iter tree<T, tree_node_allocator>::prepend_child(iter position)
     tree_assert(position.node!=head);
     tree_assert(position.node);
 
-    tree_node *tmp=alloc_.allocate(1,0);
+    tree_node *tmp=get_node_();
     kp::constructor(&tmp->data);
     tmp->first_child=0;
     tmp->last_child=0;
@@ -1077,7 +1282,7 @@ iter tree<T, tree_node_allocator>::append_child(iter position, const T& x)
     tree_assert(position.node!=head);
     tree_assert(position.node);
 
-    tree_node* tmp = alloc_.allocate(1,0);
+    tree_node* tmp = get_node_();
     kp::constructor(&tmp->data, x);
     tmp->first_child=0;
     tmp->last_child=0;
@@ -1102,7 +1307,7 @@ iter tree<T, tree_node_allocator>::prepend_child(iter position, const T& x)
     tree_assert(position.node!=head);
     tree_assert(position.node);
 
-    tree_node* tmp = alloc_.allocate(1,0);
+    tree_node* tmp = get_node_();
     kp::constructor(&tmp->data, x);
     tmp->first_child=0;
     tmp->last_child=0;
@@ -1223,7 +1428,7 @@ iter tree<T, tree_node_allocator>::insert(iter position, const T& x)
         position.node=feet; // Backward compatibility: when calling insert on a null node,
         // insert before the feet.
     }
-    tree_node* tmp = alloc_.allocate(1,0);
+    tree_node* tmp = get_node_();
     kp::constructor(&tmp->data, x);
     tmp->first_child=0;
     tmp->last_child=0;
@@ -1245,7 +1450,7 @@ iter tree<T, tree_node_allocator>::insert(iter position, const T& x)
 template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::sibling_iterator tree<T, tree_node_allocator>::insert(sibling_iterator position, const T& x)
 {
-    tree_node* tmp = alloc_.allocate(1,0);
+    tree_node* tmp = get_node_();
     kp::constructor(&tmp->data, x);
     tmp->first_child=0;
     tmp->last_child=0;
@@ -1275,7 +1480,7 @@ template <class T, class tree_node_allocator>
 template <class iter>
 iter tree<T, tree_node_allocator>::insert_after(iter position, const T& x)
 {
-    tree_node* tmp = alloc_.allocate(1,0);
+    tree_node* tmp = get_node_();
     kp::constructor(&tmp->data, x);
     tmp->first_child=0;
     tmp->last_child=0;
@@ -1300,7 +1505,7 @@ template <class iter>
 iter tree<T, tree_node_allocator>::insert_above(iter position, const T& x) {
     tree_node *dst=position.node;
 
-    tree_node* tmp = alloc_.allocate(1,0);
+    tree_node* tmp = get_node_();
     kp::constructor(&tmp->data, x);
 
     tmp->first_child=dst;
@@ -1381,7 +1586,7 @@ iter tree<T, tree_node_allocator>::replace(iter position, const iterator_base& f
 
     // replace the node at position with head of the replacement tree at from
     erase_children(position);
-    tree_node* tmp = alloc_.allocate(1,0);
+    tree_node* tmp = get_node_();
     kp::constructor(&tmp->data, (*from));
     tmp->first_child=0;
     tmp->last_child=0;
@@ -1401,7 +1606,7 @@ iter tree<T, tree_node_allocator>::replace(iter position, const iterator_base& f
     tmp->next_sibling=current_to->next_sibling;
     tmp->parent=current_to->parent;
     kp::destructor(&current_to->data);
-    alloc_.deallocate(current_to,1);
+    put_node_(current_to);
     current_to=tmp;
 
     // only at this stage can we fix 'last'
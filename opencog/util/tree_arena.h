@@ -0,0 +1,254 @@
+/*
+ * opencog/util/tree_arena.h
+ *
+ * Arena allocation of tree nodes.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_TREE_ARENA_H
+#define _OPENCOG_TREE_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <opencog/util/tree.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! A bump allocator of fixed-size nodes, with a free list.
+///
+/// Nodes are carved, in order, out of large chunks, so that the nodes
+/// of a tree built in one go sit next to each other in memory. Freed
+/// nodes go onto a free list, and are handed out again before any new
+/// space is used. reset() makes all of the space available again at
+/// once, in O(number of chunks), keeping the chunks for re-use.
+///
+/// An arena is not thread safe; use one per thread (see
+/// arena_allocator::thread_arena()).
+class tree_arena
+{
+public:
+    tree_arena(size_t node_size, size_t node_align = alignof(std::max_align_t),
+               size_t chunk_nodes = 1024)
+        : _node_size(round_up(std::max(node_size, sizeof(void*)), node_align)),
+          _chunk_nodes(chunk_nodes), _chunk(0), _next(nullptr), _end(nullptr),
+          _free(nullptr), _live(0)
+    {}
+
+    ~tree_arena() { release(); }
+
+    void* allocate()
+    {
+        _live++;
+        if (_free)
+        {
+            void* p = _free;
+            _free = *static_cast<void**>(_free);
+            return p;
+        }
+        if (_next == _end) next_chunk();
+        void* p = _next;
+        _next += _node_size;
+        return p;
+    }
+
+    void deallocate(void* p)
+    {
+        _live--;
+        *static_cast<void**>(p) = _free;
+        _free = p;
+    }
+
+    /// Forget about every node handed out so far. Only call this once
+    /// all of the trees using this arena have been destroyed (or if
+    /// they are never going to be touched again, and hold data with
+    /// trivial destructors).
+    void reset()
+    {
+        _chunk = 0;
+        _next = _end = nullptr;
+        _free = nullptr;
+        _live = 0;
+    }
+
+    /// Like reset(), but also give the memory back to the system.
+    void release()
+    {
+        for (auto& c : _chunks) ::operator delete(c.first);
+        _chunks.clear();
+        reset();
+    }
+
+    /// Make sure that the next n nodes (not counting those on the free
+    /// list) can be handed out from one contiguous run of memory.
+    void reserve(size_t n)
+    {
+        if (n <= size_t(_end - _next) / _node_size) return;
+        if (_chunk == _chunks.size() or _chunks[_chunk].second < n)
+            _chunks.insert(_chunks.begin() + _chunk, {static_cast<char*>(
+                ::operator new(std::max(n, _chunk_nodes) * _node_size)),
+                std::max(n, _chunk_nodes)});
+        next_chunk();
+    }
+
+    /// Number of nodes currently handed out.
+    size_t live() const { return _live; }
+
+    /// Number of bytes obtained from the system.
+    size_t capacity() const
+    {
+        size_t nodes = 0;
+        for (auto& c : _chunks) nodes += c.second;
+        return nodes * _node_size;
+    }
+
+    size_t node_size() const { return _node_size; }
+
+private:
+    size_t _node_size;
+    size_t _chunk_nodes;
+    std::vector<std::pair<char*, size_t>> _chunks;   // memory, nodes
+    size_t _chunk;          // next chunk in _chunks to bump through
+    char* _next;
+    char* _end;
+    void* _free;
+    size_t _live;
+
+    tree_arena(const tree_arena&) = delete;
+    tree_arena& operator=(const tree_arena&) = delete;
+
+    static size_t round_up(size_t n, size_t align)
+    { return (n + align - 1) / align * align; }
+
+    void next_chunk()
+    {
+        // Re-use the chunks kept by reset(), before asking for more.
+        if (_chunk == _chunks.size())
+            _chunks.emplace_back(static_cast<char*>(
+                ::operator new(_chunk_nodes * _node_size)), _chunk_nodes);
+        _next = _chunks[_chunk].first;
+        _end = _next + _chunks[_chunk].second * _node_size;
+        _chunk++;
+    }
+};
+
+//! An allocator that takes nodes from a tree_arena; plug it into the
+//! second template parameter of tree, or use arena_tree<T>.
+///
+/// Each allocator remembers the arena that was current, for the
+/// calling thread, when it was constructed; that is the thread's own
+/// arena, unless an arena_scope says otherwise. A tree thus always
+/// gives its nodes back to the arena they came from. Since arenas are
+/// not thread safe, a tree must only be modified or destroyed by the
+/// thread that owns its arena, and must not outlive that arena.
+template<class Node>
+class arena_allocator
+{
+public:
+    typedef Node value_type;
+    typedef Node* pointer;
+    typedef const Node* const_pointer;
+    typedef Node& reference;
+    typedef const Node& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    template<class U> struct rebind { typedef arena_allocator<U> other; };
+
+    arena_allocator() : _arena(current()) {}
+    arena_allocator(tree_arena& a) : _arena(&a) {}
+    template<class U>
+    arena_allocator(const arena_allocator<U>& other) : _arena(other.arena()) {}
+
+    Node* allocate(size_t n, const void* = 0)
+    {
+        if (1 == n and sizeof(Node) <= _arena->node_size())
+            return static_cast<Node*>(_arena->allocate());
+        return static_cast<Node*>(::operator new(n * sizeof(Node)));
+    }
+
+    void deallocate(Node* p, size_t n)
+    {
+        if (1 == n and sizeof(Node) <= _arena->node_size())
+            _arena->deallocate(p);
+        else
+            ::operator delete(p);
+    }
+
+    tree_arena* arena() const { return _arena; }
+
+    /// The calling thread's own arena, for this type of node.
+    static tree_arena& thread_arena()
+    {
+        static thread_local tree_arena arena(sizeof(Node), alignof(Node));
+        return arena;
+    }
+
+    /// The arena that newly constructed allocators will use.
+    static tree_arena*& current()
+    {
+        static thread_local tree_arena* cur = nullptr;
+        if (nullptr == cur) cur = &thread_arena();
+        return cur;
+    }
+
+    bool operator==(const arena_allocator& other) const
+    { return _arena == other._arena; }
+    bool operator!=(const arena_allocator& other) const
+    { return _arena != other._arena; }
+
+private:
+    tree_arena* _arena;
+};
+
+//! Make all trees created, in this thread, during the lifetime of the
+//! scope, take their nodes from the given arena. For example, to
+//! build a batch of trees, and then free them all at once:
+///
+///     tree_arena arena(sizeof(tree_node_<int>));
+///     {
+///         arena_scope<int> scope(arena);
+///         std::vector<arena_tree<int>> batch = build_them();
+///         ... use them, then let them go ...
+///     }
+///     arena.reset();   // the next batch re-uses the same memory
+///
+template<class T>
+class arena_scope
+{
+    typedef arena_allocator<tree_node_<T>> allocator;
+    tree_arena* _saved;
+public:
+    arena_scope(tree_arena& arena) : _saved(allocator::current())
+    { allocator::current() = &arena; }
+    ~arena_scope() { allocator::current() = _saved; }
+};
+
+/// A tree whose nodes come from an arena.
+template<class T>
+using arena_tree = tree<T, arena_allocator<tree_node_<T>>>;
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_TREE_ARENA_H
@@ -0,0 +1,122 @@
+/*
+ * opencog/util/tree_builder.h
+ *
+ * Building trees in bulk, from pre-order or from strings.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_TREE_BUILDER_H
+#define _OPENCOG_TREE_BUILDER_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/util/tree.h>
+#include <opencog/util/tree_arena.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+/// A tree (or forest) in pre-order: each node's label, and its arity.
+/// For example, the tree and(a or(b c)) is
+///     {{"and", 2}, {"a", 0}, {"or", 2}, {"b", 0}, {"c", 0}}
+template<typename T>
+using preorder_seq = std::vector<std::pair<T, unsigned>>;
+
+namespace detail {
+
+// Room for the nodes, plus the head and the feet of the tree.
+template<typename Alloc>
+void reserve_nodes(const Alloc&, size_t) {}
+
+template<typename Node>
+void reserve_nodes(const arena_allocator<Node>&, size_t n)
+{
+    arena_allocator<Node>::current()->reserve(n + 2);
+}
+
+} // ~namespace detail
+
+//! Build a tree from its pre-order form, in one pass.
+///
+/// The nodes are linked as they come: each one is appended to the
+/// innermost node still waiting for children. For an arena_tree, room
+/// for all of the nodes is reserved up front, so that they sit in one
+/// contiguous run. Each call only touches its own arguments, so any
+/// number of threads can build trees at the same time.
+///
+/// Throws InconsistenceException if the arities do not add up.
+template<typename T, typename Alloc = std::allocator<tree_node_<T>>>
+tree<T, Alloc> build_tree(const preorder_seq<T>& seq)
+{
+    typedef tree<T, Alloc> tree_type;
+    typedef typename tree_type::pre_order_iterator tree_it;
+
+    detail::reserve_nodes(Alloc(), seq.size());
+    tree_type tr;
+
+    // Parents still waiting for children, and how many.
+    std::vector<std::pair<tree_it, unsigned>> open;
+    for (const auto& node : seq)
+    {
+        tree_it it;
+        if (open.empty())
+            it = tr.insert(tr.end(), node.first);
+        else
+        {
+            it = tr.append_child(open.back().first, node.first);
+            if (0 == --open.back().second) open.pop_back();
+        }
+        if (0 < node.second) open.emplace_back(it, node.second);
+    }
+    if (not open.empty())
+        throw InconsistenceException(TRACE_INFO,
+            "build_tree - %u node(s) are missing children.",
+            (unsigned) open.size());
+    return tr;
+}
+
+/// Parse a tree, or a forest, written as in "and(a or(b c)) d", into
+/// its pre-order form, appending to seq. Labels are runs of anything
+/// but parentheses and white space; white space may separate a label
+/// from its open parenthesis, and "f()" is a node with no children. A
+/// leaf may also be written as message:"text", where the text may hold
+/// spaces. Does not use any global state; safe to call from many
+/// threads at once.
+///
+/// Throws InconsistenceException on a syntax error.
+void parse_preorder(const std::string& str, preorder_seq<std::string>& seq);
+
+/// Parse a tree, or a forest, with parse_preorder(), then build it
+/// with build_tree().
+template<typename Alloc = std::allocator<tree_node_<std::string>>>
+tree<std::string, Alloc> parse_tree(const std::string& str)
+{
+    preorder_seq<std::string> seq;
+    parse_preorder(str, seq);
+    return build_tree<std::string, Alloc>(seq);
+}
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_TREE_BUILDER_H
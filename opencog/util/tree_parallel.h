@@ -0,0 +1,337 @@
+/*
+ * opencog/util/tree_parallel.h
+ *
+ * Parallel traversal and reduction of trees.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_TREE_PARALLEL_H
+#define _OPENCOG_TREE_PARALLEL_H
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+#include <boost/optional.hpp>
+
+#include <opencog/util/tree.h>
+#include <opencog/util/work_stealing_scheduler.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+/// The scheduler used by the tree algorithms below, when none is
+/// given; one worker per hardware thread, started on first use.
+inline work_stealing_scheduler& default_tree_scheduler()
+{
+    static work_stealing_scheduler sched;
+    return sched;
+}
+
+namespace detail {
+
+// How a subtree is split into work. The subtree is first sized, in one
+// sequential pass. A node with more than grain nodes below it is big;
+// big nodes are handled by the calling thread. The children of a big
+// node are cut, at sibling boundaries, into units: either a big child
+// (which is split in turn), or a run of consecutive small children
+// holding at least grain nodes in all. Each run is a task, walked
+// serially. The plan lists the big nodes and the runs in pre-order,
+// with the number of items directly below each big node, so that
+// results can be put back together in order.
+template<typename T>
+struct tree_plan
+{
+    typedef tree_node_<T> node;
+
+    struct item
+    {
+        const node* big;             // null for a run of small siblings
+        const node* first;           // the run is [first, last)
+        const node* last;
+        unsigned nitems;             // items directly below a big node
+    };
+    std::vector<item> items;
+    size_t nruns = 0;
+
+    tree_plan(const node* top, size_t grain)
+    {
+        // Post-order sizing pass, keeping the sizes of the children of
+        // the big nodes only; kids holds, for each open node, the sizes
+        // of its children finished so far.
+        boost::unordered_map<const node*, size_t> sizes;
+        std::vector<std::pair<const node*, size_t>> kids;
+        std::vector<std::pair<const node*, size_t>> todo{{top, 0}};
+        bool top_big = false;
+        while (not todo.empty())
+        {
+            const node* n = todo.back().first;
+            if (0 == todo.back().second)
+            {
+                todo.back().second = kids.size() + 1;
+                for (const node* c = n->last_child; c; c = c->prev_sibling)
+                    todo.emplace_back(c, 0);
+                continue;
+            }
+            size_t mark = todo.back().second - 1;
+            todo.pop_back();
+            size_t size = 1;
+            for (size_t i = mark; i < kids.size(); i++) size += kids[i].second;
+            if (grain < size)
+            {
+                for (size_t i = mark; i < kids.size(); i++)
+                    sizes.insert(kids[i]);
+                if (n == top) top_big = true;
+            }
+            kids.resize(mark);
+            kids.emplace_back(n, size);
+        }
+
+        if (not top_big)
+        {
+            items.push_back({nullptr, top, top->next_sibling, 0});
+            nruns = 1;
+            return;
+        }
+
+        build_big(top, sizes, grain);
+    }
+
+private:
+    void build_big(const node* n, boost::unordered_map<const node*, size_t>& sizes,
+                   size_t grain)
+    {
+        // Iterative: each frame is a big node, and the remaining
+        // children to be cut.
+        struct frame { const node* child; size_t self; const node* first; size_t acc; };
+        std::vector<frame> stack;
+        auto open = [&](const node* b) {
+            stack.push_back({b->first_child, items.size(), nullptr, 0});
+            items.push_back({b, nullptr, nullptr, 0});
+        };
+        open(n);
+        while (not stack.empty())
+        {
+            frame& f = stack.back();
+            auto flush = [&](frame& fr, const node* last) {
+                if (not fr.first) return;
+                items.push_back({nullptr, fr.first, last, 0});
+                items[fr.self].nitems++;
+                nruns++;
+                fr.first = nullptr;
+                fr.acc = 0;
+            };
+            if (not f.child)
+            {
+                flush(f, nullptr);
+                stack.pop_back();
+                continue;
+            }
+            const node* c = f.child;
+            f.child = c->next_sibling;
+            size_t sz = sizes[c];
+            if (grain < sz)
+            {
+                flush(f, c);
+                items[f.self].nitems++;
+                open(c);          // invalidates f
+                continue;
+            }
+            if (not f.first) f.first = c;
+            f.acc += sz;
+            if (grain <= f.acc) flush(f, c->next_sibling);
+        }
+    }
+};
+
+} // ~namespace detail
+
+//! Call f(it) on every node of the subtree at top, in parallel.
+///
+/// The subtree is cut at sibling boundaries into pieces of at least
+/// grain nodes, and the pieces are run as tasks on the scheduler; so
+/// subtrees smaller than grain are always walked serially, by a single
+/// thread. The order in which f sees the nodes is unspecified, and f
+/// must be safe to call from many threads at once. The tree must not
+/// be modified in the meantime. If f throws, the first exception is
+/// re-thrown, once all of the pieces have finished.
+///
+/// When called from a task running on the same scheduler, the whole
+/// subtree is walked serially, by the calling thread.
+template<typename It, typename F>
+void parallel_for_each_subtree(It top, F f, size_t grain = 1024,
+                               work_stealing_scheduler& sched = default_tree_scheduler())
+{
+    typedef typename It::value_type T;
+    typedef tree_node_<T> node;
+
+    auto walk = [&f](const node* first, const node* last) {
+        for (const node* s = first; s != last; s = s->next_sibling)
+        {
+            std::vector<const node*> todo{s};
+            while (not todo.empty())
+            {
+                const node* n = todo.back();
+                todo.pop_back();
+                f(It(const_cast<node*>(n)));
+                for (const node* c = n->last_child; c; c = c->prev_sibling)
+                    todo.push_back(c);
+            }
+        }
+    };
+
+    if (0 <= sched.current_worker() or 1 == sched.num_threads())
+    {
+        walk(top.node, top.node->next_sibling);
+        return;
+    }
+
+    detail::tree_plan<T> plan(top.node, grain);
+    task_latch latch;
+    latch.pending = plan.nruns + 1;
+    for (const auto& item : plan.items)
+    {
+        if (item.big) continue;
+        sched.submit([&walk, &latch, item]() {
+            std::exception_ptr err;
+            try { walk(item.first, item.last); }
+            catch (...) { err = std::current_exception(); }
+            latch.done(err);
+        });
+    }
+
+    // The big nodes themselves are few; do them here.
+    std::exception_ptr err;
+    try
+    {
+        for (const auto& item : plan.items)
+            if (item.big) f(It(const_cast<node*>(item.big)));
+    }
+    catch (...) { err = std::current_exception(); }
+    latch.done(err);
+    latch.wait();
+}
+
+//! Reduce the subtree at top, in parallel.
+///
+/// The result is that of the serial recursion
+///
+///     reduce(n) = combine(...combine(combine(map(n), reduce(c1)), reduce(c2))..., reduce(ck))
+///
+/// over the children c1...ck of n, in order. combine must be
+/// associative (but need not be commutative); the work is then split
+/// as for parallel_for_each_subtree(), and the pieces are put back
+/// together in order. map and combine must be safe to call from many
+/// threads at once.
+template<typename It, typename Map, typename Combine>
+auto parallel_reduce(It top, Map map, Combine combine, size_t grain = 1024,
+                     work_stealing_scheduler& sched = default_tree_scheduler())
+    -> decltype(map(top))
+{
+    typedef typename It::value_type T;
+    typedef tree_node_<T> node;
+    typedef decltype(map(top)) R;
+
+    // Serial reduction of the subtree at s, without recursion.
+    auto fold_one = [&map, &combine](const node* s) {
+        std::vector<std::pair<const node*, R>> stack;
+        stack.emplace_back(s, map(It(const_cast<node*>(s))));
+        std::vector<const node*> next{s->first_child};
+        while (true)
+        {
+            const node* c = next.back();
+            if (c)
+            {
+                next.back() = c->next_sibling;
+                stack.emplace_back(c, map(It(const_cast<node*>(c))));
+                next.push_back(c->first_child);
+                continue;
+            }
+            next.pop_back();
+            R r = std::move(stack.back().second);
+            stack.pop_back();
+            if (stack.empty()) return r;
+            stack.back().second = combine(std::move(stack.back().second),
+                                          std::move(r));
+        }
+    };
+
+    // Serial reduction of a non-empty run of siblings, seeded from the
+    // first one.
+    auto fold = [&fold_one, &combine](const node* first, const node* last) {
+        R acc = fold_one(first);
+        for (const node* s = first->next_sibling; s != last; s = s->next_sibling)
+            acc = combine(std::move(acc), fold_one(s));
+        return acc;
+    };
+
+    if (0 <= sched.current_worker() or 1 == sched.num_threads())
+        return fold(top.node, top.node->next_sibling);
+
+    detail::tree_plan<T> plan(top.node, grain);
+    std::vector<boost::optional<R>> results(plan.items.size());
+    task_latch latch;
+    latch.pending = plan.nruns + 1;
+    for (size_t i = 0; i < plan.items.size(); i++)
+    {
+        if (plan.items[i].big) continue;
+        sched.submit([&fold, &latch, &plan, &results, i]() {
+            std::exception_ptr err;
+            try { results[i] = fold(plan.items[i].first, plan.items[i].last); }
+            catch (...) { err = std::current_exception(); }
+            latch.done(err);
+        });
+    }
+    std::exception_ptr err;
+    try
+    {
+        for (size_t i = 0; i < plan.items.size(); i++)
+            if (plan.items[i].big)
+                results[i] = map(It(const_cast<node*>(plan.items[i].big)));
+    }
+    catch (...) { err = std::current_exception(); }
+    latch.done(err);
+    latch.wait();
+
+    // Put the pieces back together, bottom-up: walking the plan
+    // backwards, the results of the items below each big node are
+    // on the stack, first one on top.
+    std::vector<R> stack;
+    for (size_t i = plan.items.size(); 0 < i--; )
+    {
+        const auto& item = plan.items[i];
+        R r = std::move(*results[i]);
+        for (unsigned k = 0; k < item.nitems; k++)
+        {
+            r = combine(std::move(r), std::move(stack.back()));
+            stack.pop_back();
+        }
+        stack.push_back(std::move(r));
+    }
+    return std::move(stack.back());
+}
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_TREE_PARALLEL_H
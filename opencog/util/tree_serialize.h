@@ -0,0 +1,268 @@
+/*
+ * opencog/util/tree_serialize.h
+ *
+ * A compact binary encoding for trees.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_TREE_SERIALIZE_H
+#define _OPENCOG_TREE_SERIALIZE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/util/serial.h>
+#include <opencog/util/tree.h>
+#include <opencog/util/tree_builder.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! How to write and read node data; specialize this for other types.
+///
+/// write() must append the encoding of the value to the stream buffer,
+/// and read() must decode exactly what write() wrote. The functions in
+/// the serial namespace may be used to build on. Provided here are
+/// integers (as zig-zag varints), floating point numbers (raw, in the
+/// host byte order) and strings (length-prefixed).
+template<typename T, typename Enable = void>
+struct tree_serial_traits;
+
+template<typename T>
+struct tree_serial_traits<T, typename std::enable_if<std::is_integral<T>::value>::type>
+{
+    static void write(std::streambuf& sb, T v)
+    {
+        int64_t s = int64_t(v);
+        serial::put_varint(sb, (uint64_t(s) << 1) ^ uint64_t(s >> 63));
+    }
+    static T read(std::streambuf& sb)
+    {
+        uint64_t u = serial::get_varint(sb);
+        return T(int64_t(u >> 1) ^ -int64_t(u & 1));
+    }
+};
+
+template<typename T>
+struct tree_serial_traits<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+    static void write(std::streambuf& sb, T v)
+    {
+        sb.sputn(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+    static T read(std::streambuf& sb)
+    {
+        T v;
+        serial::get_bytes(sb, reinterpret_cast<char*>(&v), sizeof(T));
+        return v;
+    }
+};
+
+template<>
+struct tree_serial_traits<std::string>
+{
+    static void write(std::streambuf& sb, const std::string& s)
+    {
+        serial::put_varint(sb, s.size());
+        sb.sputn(s.data(), s.size());
+    }
+    static std::string read(std::streambuf& sb)
+    {
+        std::string s;
+        serial::get_string(sb, s, serial::get_varint(sb));
+        return s;
+    }
+};
+
+//! Writes trees to a stream, in a compact binary encoding.
+///
+/// The stream starts with a four byte magic number. Then each tree is
+/// its number of nodes, followed by its nodes in pre-order; each node
+/// is its arity, then its label. All numbers are varints. The writer
+/// keeps a dictionary of the labels written so far: a label is written
+/// in full (by the traits) only the first time it is seen, and as its
+/// dictionary index after that. So a stream has to be read from the
+/// start, by a single tree_reader.
+///
+/// Example:
+///
+///     std::ofstream out("trees.bin", std::ios::binary);
+///     tree_writer<std::string> w(out);
+///     w.write_batch(trees.begin(), trees.end());
+///
+///     std::ifstream in("trees.bin", std::ios::binary);
+///     tree_reader<std::string> r(in);
+///     std::vector<tree<std::string>> back;
+///     r.read_batch(back);
+///
+template<typename T, typename Traits = tree_serial_traits<T>,
+         typename Hash = boost::hash<T>>
+class tree_writer
+{
+public:
+    static constexpr uint32_t MAGIC = 0x3154434f;   // "OCT1"
+
+    tree_writer(std::ostream& out) : _out(out), _sb(*out.rdbuf())
+    {
+        _sb.sputn(reinterpret_cast<const char*>(&MAGIC), sizeof(MAGIC));
+    }
+
+    template<typename Alloc>
+    void write(const tree<T, Alloc>& tr)
+    {
+        serial::put_varint(_sb, tr.size());
+        for (auto it = tr.begin(); it != tr.end(); ++it)
+        {
+            serial::put_varint(_sb, it.number_of_children());
+            auto dit = _dict.find(*it);
+            if (dit != _dict.end())
+                serial::put_varint(_sb, dit->second + 1);
+            else
+            {
+                serial::put_varint(_sb, 0);
+                Traits::write(_sb, *it);
+                _dict.emplace(*it, _dict.size());
+            }
+        }
+    }
+
+    /// Write every tree in the range, preceded by their number. Such
+    /// a batch must be read back with read_batch().
+    template<typename It>
+    void write_batch(It first, It last)
+    {
+        serial::put_varint(_sb, std::distance(first, last));
+        for (; first != last; ++first) write(*first);
+    }
+
+    void flush() { _out.flush(); }
+
+    /// Number of distinct labels written so far.
+    size_t dictionary_size() const { return _dict.size(); }
+
+private:
+    std::ostream& _out;
+    std::streambuf& _sb;
+    boost::unordered_map<T, uint32_t, Hash> _dict;
+};
+
+//! Reads back the trees written by a tree_writer.
+///
+/// Each tree is linked in a single pass, as it is decoded. The node
+/// count comes first, so that an arena_tree can reserve its nodes up
+/// front: reading into an arena tree makes at most one allocation (of
+/// up to serial::chunk nodes, as the count is not trusted), and none
+/// at all if the arena has room to spare.
+template<typename T, typename Traits = tree_serial_traits<T>>
+class tree_reader
+{
+public:
+    tree_reader(std::istream& in) : _sb(*in.rdbuf())
+    {
+        uint32_t magic;
+        serial::get_bytes(_sb, reinterpret_cast<char*>(&magic), sizeof(magic));
+        if (tree_writer<T, Traits>::MAGIC != magic)
+            throw InconsistenceException(TRACE_INFO,
+                "tree_reader - not a tree stream.");
+    }
+
+    /// Read the next tree into tr, replacing whatever it held.
+    template<typename Alloc>
+    void read(tree<T, Alloc>& tr)
+    {
+        typedef typename tree<T, Alloc>::pre_order_iterator tree_it;
+
+        size_t n = serial::get_varint(_sb);
+        tr.clear();
+        detail::reserve_nodes(Alloc(), std::min(n, serial::chunk));
+        _open.clear();
+        for (size_t i = 0; i < n; i++)
+        {
+            unsigned arity = serial::get_varint(_sb);
+            const T& label = get_label();
+            tree_it it;
+            if (_open.empty())
+                it = tr.insert(tr.end(), label);
+            else
+            {
+                it = tr.append_child(tree_it(_open.back().first), label);
+                if (0 == --_open.back().second) _open.pop_back();
+            }
+            if (0 < arity) _open.emplace_back(it.node, arity);
+        }
+        if (not _open.empty())
+            throw InconsistenceException(TRACE_INFO,
+                "tree_reader - truncated tree.");
+    }
+
+    /// Read a batch of trees, written by write_batch(), appending them
+    /// to the vector.
+    template<typename Tree>
+    void read_batch(std::vector<Tree>& trees)
+    {
+        size_t n = serial::get_varint(_sb);
+        trees.reserve(trees.size() + std::min(n, serial::chunk));
+        for (size_t i = 0; i < n; i++)
+        {
+            trees.emplace_back();
+            read(trees.back());
+        }
+    }
+
+    /// Return false at the end of the stream.
+    bool good() const
+    {
+        return std::char_traits<char>::eof() != _sb.sgetc();
+    }
+
+private:
+    std::streambuf& _sb;
+    std::vector<T> _dict;
+    std::vector<std::pair<tree_node_<T>*, unsigned>> _open;
+
+    const T& get_label()
+    {
+        uint64_t ref = serial::get_varint(_sb);
+        if (0 == ref)
+        {
+            _dict.push_back(Traits::read(_sb));
+            return _dict.back();
+        }
+        if (_dict.size() < ref)
+            throw InconsistenceException(TRACE_INFO,
+                "tree_reader - bad label reference %u.", (unsigned) ref);
+        return _dict[ref - 1];
+    }
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_TREE_SERIALIZE_H
@@ -0,0 +1,135 @@
+/*
+ * opencog/util/weighted_selector.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "weighted_selector.h"
+#include "oc_assert.h"
+
+namespace opencog
+{
+
+weighted_selector::weighted_selector(const std::vector<double>& weights)
+    : _weights(weights), _updates(0)
+{
+    for (double w : _weights)
+        OC_ASSERT(0 <= w, "weighted_selector - negative weight.");
+    rebuild();
+}
+
+double weighted_selector::total() const
+{
+    double sum = 0;
+    for (size_t k = _weights.size(); k; k -= k & -k)
+        sum += _tree[k];
+    return sum;
+}
+
+void weighted_selector::set(size_t i, double w)
+{
+    OC_ASSERT(0 <= w, "weighted_selector - negative weight.");
+    double delta = w - _weights[i];
+    _weights[i] = w;
+    add(i, delta);
+}
+
+size_t weighted_selector::insert(double w)
+{
+    OC_ASSERT(0 <= w, "weighted_selector - negative weight.");
+    if (not _free.empty())
+    {
+        size_t i = _free.back();
+        _free.pop_back();
+        set(i, w);
+        return i;
+    }
+
+    // The new node k covers (k - lowbit(k), k]; all but its own weight
+    // are already in the tree.
+    size_t k = _weights.size() + 1;
+    double node = w;
+    for (size_t j = k - 1, stop = k - (k & -k); j > stop; j -= j & -j)
+        node += _tree[j];
+    _weights.push_back(w);
+    if (_tree.empty()) _tree.push_back(0);
+    _tree.push_back(node);
+    return k - 1;
+}
+
+void weighted_selector::erase(size_t i)
+{
+    set(i, 0);
+    _free.push_back(i);
+}
+
+size_t weighted_selector::select(double u, RandGen& rng) const
+{
+    double t = total();
+    OC_ASSERT(0 < t, "weighted_selector - all weights are zero.");
+    size_t i;
+    while (not find(u * t, i))
+        u = rng.randdouble_one_excluded();
+    return i;
+}
+
+bool weighted_selector::find(double x, size_t& i) const
+{
+    size_t n = _weights.size();
+    OC_ASSERT(0 < n, "weighted_selector - selector is empty.");
+    size_t step = 1;
+    while (step * 2 <= n) step *= 2;
+
+    // Find the largest pos such that the sum of the first pos weights
+    // is <= x; the answer is the next index.
+    size_t pos = 0;
+    for (; step; step /= 2)
+    {
+        if (pos + step <= n and _tree[pos + step] <= x)
+        {
+            pos += step;
+            x -= _tree[pos];
+        }
+    }
+    if (n <= pos) pos = n - 1;
+    i = pos;
+    return 0 < _weights[pos];
+}
+
+void weighted_selector::add(size_t i, double delta)
+{
+    for (size_t k = i + 1; k < _tree.size(); k += k & -k)
+        _tree[k] += delta;
+
+    // Each update adds a little rounding error to the partial sums;
+    // start afresh now and then, at an amortised O(1) cost.
+    if (_weights.size() < ++_updates) rebuild();
+}
+
+void weighted_selector::rebuild()
+{
+    size_t n = _weights.size();
+    _tree.assign(n + 1, 0);
+    for (size_t k = 1; k <= n; k++)
+    {
+        _tree[k] += _weights[k - 1];
+        size_t parent = k + (k & -k);
+        if (parent <= n) _tree[parent] += _tree[k];
+    }
+    _updates = 0;
+}
+
+} //~namespace opencog
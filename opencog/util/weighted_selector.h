@@ -0,0 +1,122 @@
+/*
+ * opencog/util/weighted_selector.h
+ *
+ * Weighted random selection, with weights that change between draws.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_WEIGHTED_SELECTOR_H
+#define _OPENCOG_WEIGHTED_SELECTOR_H
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#include <opencog/util/mt19937ar.h>
+#include <opencog/util/oc_assert.h>
+#include <opencog/util/RandGen.h>
+#include <opencog/util/rng_engines.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+/**
+ * Selects indices with probability proportional to their weights, like
+ * roulette_select() or alias_sampler, but the weights may change at
+ * any time: a draw, or changing, adding or removing a weight, each
+ * take O(log n). Where alias_sampler must be rebuilt, in O(n), after
+ * every change, this is the one to use when a few weights change
+ * between draws.
+ *
+ * The weights are kept in a Fenwick (binary indexed) tree of partial
+ * sums; a draw picks a point in [0, total) and descends the tree to
+ * the index whose range holds it.
+ *
+ * Indices are stable. erase() only sets a weight to zero, and frees
+ * its index for reuse by insert(); an index of weight zero is never
+ * selected. Unlike lazy_selector, the same index can be drawn any
+ * number of times.
+ */
+class weighted_selector
+{
+public:
+    weighted_selector() : _updates(0) {}
+    weighted_selector(const std::vector<double>& weights);
+
+    //! number of indices, including erased ones
+    size_t size() const { return _weights.size(); }
+
+    //! sum of all weights
+    double total() const;
+
+    double weight(size_t i) const { return _weights[i]; }
+
+    //! change the weight of index i
+    void set(size_t i, double w);
+
+    //! add an index with weight w, reusing an erased index if any;
+    //! returns the index
+    size_t insert(double w);
+
+    //! set the weight of index i to zero, and free i for reuse; i
+    //! must not be erased again until insert() has returned it
+    void erase(size_t i);
+
+    //! select an index, with probability proportional to its weight.
+    //! The total weight must be positive.
+    size_t operator()(RandGen& rng = randGen()) const
+    {
+        return select(rng.randdouble_one_excluded(), rng);
+    }
+
+    //! same, with one of the engines of rng_engines.h
+    template<typename Engine,
+             typename std::enable_if<is_fast_engine<Engine>::value, int>::type = 0>
+    size_t operator()(Engine& eng) const
+    {
+        double t = total();
+        OC_ASSERT(0 < t, "weighted_selector - all weights are zero.");
+        size_t i;
+        while (not find(rand_unit(eng) * t, i)) {}
+        return i;
+    }
+
+private:
+    std::vector<double> _weights;
+    std::vector<double> _tree;      // 1-based Fenwick tree
+    std::vector<size_t> _free;      // erased indices
+    size_t _updates;                // since the last rebuild
+
+    size_t select(double u, RandGen& rng) const;
+
+    //! the index whose range of [0, total) holds x; false if rounding
+    //! made it land on a zero weight
+    bool find(double x, size_t& i) const;
+
+    void add(size_t i, double delta);
+
+    //! recompute the tree from the weights, to clear rounding errors
+    void rebuild();
+};
+
+/** @}*/
+} //~namespace opencog
+
+#endif // _OPENCOG_WEIGHTED_SELECTOR_H
@@ -0,0 +1,175 @@
+/*
+ * opencog/util/work_stealing_deque.h
+ *
+ * A lock-free work-stealing deque, after Chase and Lev, "Dynamic
+ * Circular Work-Stealing Deque" (SPAA 2005), using the C11 memory
+ * orderings of Le, Pop, Cohen and Zappa Nardelli, "Correct and
+ * Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OC_WORK_STEALING_DEQUE_H
+#define _OC_WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! A deque with one owner, and any number of thieves.
+///
+/// Unlike concurrent_stack, this is not a general multi-producer,
+/// multi-consumer container. Exactly one thread, the owner, may call
+/// push() and pop(); these work at the bottom end of the deque, in
+/// LIFO order, and touch no shared cache lines unless the deque is
+/// nearly empty. Any other thread may call steal(), which takes the
+/// oldest element from the top end. So the owner keeps working on its
+/// most recent (cache-hot) work, while idle threads take the oldest
+/// (and, for divide-and-conquer work, the largest) pieces.
+///
+/// None of the methods block, and none take a lock. The ring grows as
+/// needed; old rings are kept until the deque is destroyed, since a
+/// thief might still be reading from one.
+///
+/// The Element must be trivially copyable, as thieves read slots that
+/// the owner might be overwriting. Use pointers (or indexes) for
+/// anything larger; see work_stealing_scheduler for an example.
+
+template<typename Element>
+class work_stealing_deque
+{
+    static_assert(std::is_trivially_copyable<Element>::value,
+                  "work_stealing_deque elements must be trivially copyable");
+
+private:
+    struct Ring
+    {
+        int64_t mask;
+        std::unique_ptr<std::atomic<Element>[]> slots;
+
+        Ring(int64_t size)
+            : mask(size - 1), slots(new std::atomic<Element>[size]) {}
+        int64_t size() const { return mask + 1; }
+        Element get(int64_t i) const
+        { return slots[i & mask].load(std::memory_order_relaxed); }
+        void put(int64_t i, Element e)
+        { slots[i & mask].store(e, std::memory_order_relaxed); }
+    };
+
+    alignas(64) std::atomic<int64_t> _top;
+    alignas(64) std::atomic<int64_t> _bottom;
+    std::atomic<Ring*> _ring;
+    std::vector<std::unique_ptr<Ring>> _rings;   // owner only
+
+    work_stealing_deque(const work_stealing_deque&) = delete;
+    work_stealing_deque& operator=(const work_stealing_deque&) = delete;
+
+    Ring* grow(Ring* old, int64_t bottom, int64_t top)
+    {
+        Ring* ring = new Ring(2 * old->size());
+        for (int64_t i = top; i < bottom; i++)
+            ring->put(i, old->get(i));
+        _rings.emplace_back(ring);
+        _ring.store(ring, std::memory_order_release);
+        return ring;
+    }
+
+public:
+    /// The initial capacity is rounded up to a power of two.
+    work_stealing_deque(size_t capacity = 256)
+        : _top(0), _bottom(0)
+    {
+        int64_t size = 2;
+        while (size < (int64_t) capacity) size <<= 1;
+        _rings.emplace_back(new Ring(size));
+        _ring = _rings.back().get();
+    }
+
+    /// Push an element onto the bottom. Owner only.
+    void push(Element e)
+    {
+        int64_t b = _bottom.load(std::memory_order_relaxed);
+        int64_t t = _top.load(std::memory_order_acquire);
+        Ring* ring = _ring.load(std::memory_order_relaxed);
+        if (ring->size() - 1 < b - t) ring = grow(ring, b, t);
+        ring->put(b, e);
+        std::atomic_thread_fence(std::memory_order_release);
+        _bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    /// Pop the most recently pushed element off the bottom. Return
+    /// false if the deque is empty. Owner only.
+    bool pop(Element& e)
+    {
+        int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+        Ring* ring = _ring.load(std::memory_order_relaxed);
+        _bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = _top.load(std::memory_order_relaxed);
+
+        if (b < t)
+        {
+            _bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        e = ring->get(b);
+        if (t < b) return true;
+
+        // The last element; race the thieves for it.
+        bool won = _top.compare_exchange_strong(t, t + 1,
+                       std::memory_order_seq_cst, std::memory_order_relaxed);
+        _bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    /// Take the oldest element off the top. Return false if the deque
+    /// is empty, or if another thread got there first. Any thread.
+    bool steal(Element& e)
+    {
+        int64_t t = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = _bottom.load(std::memory_order_acquire);
+        if (b <= t) return false;
+
+        Ring* ring = _ring.load(std::memory_order_acquire);
+        e = ring->get(t);
+        return _top.compare_exchange_strong(t, t + 1,
+                   std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    /// Return true if the deque is empty at this instant in time.
+    bool is_empty() const { return 0 == size(); }
+
+    /// Return the size of the deque at this instant in time.
+    size_t size() const
+    {
+        int64_t b = _bottom.load(std::memory_order_relaxed);
+        int64_t t = _top.load(std::memory_order_relaxed);
+        return (t < b) ? b - t : 0;
+    }
+
+    static bool is_lock_free() noexcept { return true; }
+};
+/** @}*/
+
+#endif // _OC_WORK_STEALING_DEQUE_H
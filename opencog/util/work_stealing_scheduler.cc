@@ -0,0 +1,206 @@
+/*
+ * opencog/util/work_stealing_scheduler.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/util/work_stealing_scheduler.h>
+#include <opencog/util/affinity.h>
+#include <opencog/util/exceptions.h>
+
+using namespace opencog;
+
+// The scheduler and worker that the current thread belongs to.
+static thread_local const work_stealing_scheduler* current_sched = nullptr;
+static thread_local unsigned current_index = 0;
+
+// Number of failed rounds of looking for work, before sleeping.
+#define IDLE_SPINS 16
+
+work_stealing_scheduler::work_stealing_scheduler(unsigned nthreads)
+    : _inject_size(0), _queued(0), _outstanding(0), _sleepers(0),
+      _stopping(false), _steal_count(0)
+{
+    if (0 == nthreads) nthreads = std::thread::hardware_concurrency();
+    if (0 == nthreads) nthreads = 1;
+
+    for (unsigned i = 0; i < nthreads; i++)
+    {
+        _workers.emplace_back(new Worker);
+        _workers.back()->seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+    }
+    for (unsigned i = 0; i < nthreads; i++)
+        _workers[i]->thread = std::thread(&work_stealing_scheduler::worker_loop, this, i);
+}
+
+work_stealing_scheduler::~work_stealing_scheduler()
+{
+    {
+        std::unique_lock<std::mutex> lock(_idle_mutex);
+        while (0 < _outstanding) _done_cond.wait(lock);
+        _stopping = true;
+    }
+    _idle_cond.notify_all();
+    for (auto& w : _workers) w->thread.join();
+}
+
+int work_stealing_scheduler::current_worker() const
+{
+    return (this == current_sched) ? (int) current_index : -1;
+}
+
+unsigned work_stealing_scheduler::pin_workers()
+{
+    const cpu_topology& topo = get_cpu_topology();
+    unsigned pinned = 0;
+    for (unsigned i = 0; i < _workers.size(); i++)
+        if (pin_thread_to_node(_workers[i]->thread, topo.node_for(i)))
+            pinned++;
+    return pinned;
+}
+
+void work_stealing_scheduler::submit(Task task)
+{
+    Task* t = new Task(std::move(task));
+    _outstanding++;
+
+    if (this == current_sched)
+        _workers[current_index]->deque.push(t);
+    else
+    {
+        std::lock_guard<std::mutex> lock(_inject_mutex);
+        _inject.push_back(t);
+        _inject_size++;
+    }
+
+    // Only pay for a wakeup if some worker is actually asleep.
+    _queued++;
+    if (0 < _sleepers)
+    {
+        std::lock_guard<std::mutex> lock(_idle_mutex);
+        _idle_cond.notify_one();
+    }
+}
+
+void work_stealing_scheduler::wait_idle()
+{
+    if (this == current_sched)
+        throw RuntimeException(TRACE_INFO,
+            "Cannot wait for the work_stealing_scheduler from within a task!");
+
+    std::unique_lock<std::mutex> lock(_idle_mutex);
+    while (0 < _outstanding) _done_cond.wait(lock);
+
+    if (_error)
+    {
+        std::exception_ptr err = _error;
+        _error = nullptr;
+        std::rethrow_exception(err);
+    }
+}
+
+/// Find something to do: first from our own deque, then from the
+/// injection queue, then by stealing from the others.
+bool work_stealing_scheduler::find_task(unsigned self, Task*& t)
+{
+    Worker& me = *_workers[self];
+    if (me.deque.pop(t)) return true;
+
+    if (0 < _inject_size)
+    {
+        std::lock_guard<std::mutex> lock(_inject_mutex);
+        if (not _inject.empty())
+        {
+            t = _inject.front();
+            _inject.pop_front();
+            _inject_size--;
+            return true;
+        }
+    }
+
+    // Start at a random victim, so that thieves spread out.
+    size_t n = _workers.size();
+    me.seed ^= me.seed << 13;
+    me.seed ^= me.seed >> 7;
+    me.seed ^= me.seed << 17;
+    size_t start = me.seed % n;
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t victim = (start + i) % n;
+        if (victim == self) continue;
+        if (_workers[victim]->deque.steal(t))
+        {
+            _steal_count++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void work_stealing_scheduler::run_task(Task* t)
+{
+    _queued--;
+    try
+    {
+        (*t)();
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(_idle_mutex);
+        if (not _error) _error = std::current_exception();
+    }
+    delete t;
+
+    if (0 == --_outstanding)
+    {
+        std::lock_guard<std::mutex> lock(_idle_mutex);
+        _done_cond.notify_all();
+    }
+}
+
+void work_stealing_scheduler::worker_loop(unsigned self)
+{
+    current_sched = this;
+    current_index = self;
+
+    unsigned idle = 0;
+    while (true)
+    {
+        Task* t;
+        if (find_task(self, t))
+        {
+            run_task(t);
+            idle = 0;
+            continue;
+        }
+
+        // A steal can fail just because some other thief won the
+        // race; so look a few times, before going to sleep.
+        if (++idle < IDLE_SPINS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        idle = 0;
+
+        std::unique_lock<std::mutex> lock(_idle_mutex);
+        _sleepers++;
+        while (_queued <= 0 and not _stopping)
+            _idle_cond.wait(lock);
+        _sleepers--;
+        if (_stopping and _queued <= 0) return;
+    }
+}
@@ -0,0 +1,186 @@
+/*
+ * opencog/util/work_stealing_scheduler.h
+ *
+ * A small task scheduler, built on work_stealing_deque.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_WORK_STEALING_SCHEDULER_H
+#define _OPENCOG_WORK_STEALING_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <opencog/util/work_stealing_deque.h>
+
+namespace opencog
+{
+/** \addtogroup grp_cogutil
+ *  @{
+ */
+
+//! Runs tasks on a fixed set of worker threads, balancing the load
+/// by work-stealing.
+///
+/// Each worker owns a work_stealing_deque. Tasks submitted by a task
+/// (that is, from a worker thread) go onto the bottom of that worker's
+/// own deque, and the worker runs them next, in LIFO order, without
+/// contending with anyone. Tasks submitted from any other thread go
+/// onto a shared injection queue. A worker that runs out of work takes
+/// from the injection queue, and failing that, steals the oldest task
+/// of some other, randomly chosen, worker. Workers that find nothing
+/// at all go to sleep, and are woken when more work is submitted.
+///
+/// Example, a parallel sum over a large array:
+///
+///     work_stealing_scheduler sched;
+///     std::function<void(size_t, size_t)> sum = [&](size_t lo, size_t hi) {
+///         if (hi - lo < 1000) { total += std::accumulate(...); return; }
+///         size_t mid = (lo + hi) / 2;
+///         sched.submit([=, &sum]() { sum(lo, mid); });
+///         sum(mid, hi);
+///     };
+///     sched.submit([&]() { sum(0, n); });
+///     sched.wait_idle();
+///
+class work_stealing_scheduler
+{
+public:
+    typedef std::function<void()> Task;
+
+    /// Start nthreads workers. Zero means one per hardware thread.
+    work_stealing_scheduler(unsigned nthreads = 0);
+
+    /// Waits for all submitted tasks to finish, then stops the workers.
+    ~work_stealing_scheduler();
+
+    /// Run the task on one of the workers, at some later time. Any
+    /// thread may submit, including the tasks themselves.
+    void submit(Task);
+
+    /// Same as submit(), but return a future holding the result of
+    /// f, or the exception it threw (which then does not reach
+    /// wait_idle()). Do not wait on the future from within a task of
+    /// this scheduler, unless the task it waits for is known to run
+    /// without it.
+    template<typename F>
+    std::future<typename std::result_of<F()>::type> async(F f)
+    {
+        typedef typename std::result_of<F()>::type R;
+        auto job = std::make_shared<std::packaged_task<R()>>(std::move(f));
+        std::future<R> res = job->get_future();
+        submit([job]() { (*job)(); });
+        return res;
+    }
+
+    /// Block until every submitted task, including any tasks that
+    /// those submitted, has finished. If any task threw an exception,
+    /// the first such exception is re-thrown here. Must not be called
+    /// from within a task.
+    void wait_idle();
+
+    unsigned num_threads() const { return _workers.size(); }
+
+    /// Spread the workers over the NUMA nodes, worker i on node
+    /// get_cpu_topology().node_for(i), and keep them there. Return
+    /// the number of workers that could be pinned.
+    unsigned pin_workers();
+
+    /// The index of the worker running the calling thread, or -1 if
+    /// the calling thread is not one of this scheduler's workers.
+    int current_worker() const;
+
+    /// Number of tasks that were run by a worker other than the one
+    /// they were submitted to.
+    unsigned long get_steal_count() const { return _steal_count; }
+
+private:
+    struct Worker
+    {
+        work_stealing_deque<Task*> deque;
+        std::thread thread;
+        uint64_t seed;
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+
+    std::mutex _inject_mutex;
+    std::deque<Task*> _inject;
+    std::atomic<size_t> _inject_size;
+
+    // Submitted but not yet taken; submitted but not yet finished.
+    std::atomic<long> _queued;
+    std::atomic<long> _outstanding;
+
+    std::mutex _idle_mutex;
+    std::condition_variable _idle_cond;
+    std::condition_variable _done_cond;
+    std::atomic<unsigned> _sleepers;
+    bool _stopping;
+    std::exception_ptr _error;
+
+    std::atomic<unsigned long> _steal_count;
+
+    work_stealing_scheduler(const work_stealing_scheduler&) = delete;
+    work_stealing_scheduler& operator=(const work_stealing_scheduler&) = delete;
+
+    bool find_task(unsigned self, Task*&);
+    void run_task(Task*);
+    void worker_loop(unsigned self);
+};
+
+//! Waits for the tasks of one parallel call, and keeps the first
+/// exception thrown by any of them.
+///
+/// Set pending to the number of tasks; each calls done() when it
+/// finishes, and wait() returns when all have, re-throwing the first
+/// exception, if any. Unlike wait_idle(), it ignores the other tasks
+/// of the scheduler.
+struct task_latch
+{
+    std::mutex mtx;
+    std::condition_variable cond;
+    size_t pending = 0;
+    std::exception_ptr error;
+
+    void done(std::exception_ptr err)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (err and not error) error = err;
+        if (0 == --pending) cond.notify_all();
+    }
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (0 < pending) cond.wait(lock);
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_WORK_STEALING_SCHEDULER_H
@@ -24,7 +24,12 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <random>
+#include <stdexcept>
+#include <vector>
+
+#include <opencog/util/rng_engines.h>
 
 namespace opencog {
 /** \addtogroup grp_cogutil
@@ -89,7 +94,8 @@ class zipf_distribution
 		}
 		void reset() {}
 
-		IntType operator()(std::mt19937& rng)
+		template<class URBG>
+		IntType operator()(URBG& rng)
 		{
 			while (true)
 			{
@@ -232,7 +238,8 @@ class zipf_table_distribution
 		{}
 		void reset() {}
 
-		IntType operator()(std::mt19937& rng)
+		template<class URBG>
+		IntType operator()(URBG& rng)
 		{
 			return _dist(rng);
 		}
@@ -266,6 +273,130 @@ class zipf_table_distribution
 		}
 };
 
+/**
+ * Same API as above, without the q-deformation, and tuned for speed
+ * with huge N: no table, constant memory, and O(1) expected time per
+ * draw for any N and any s > 0.
+ *
+ * This is the rejection-inversion sampler of Hörmann and Derflinger,
+ * as above, but formulated as in the Apache Commons RNG
+ * RejectionInversionZipfSampler: H, h and H^{-1} are written with
+ * log, exp, log1p and expm1 (no std::pow), and their constants are
+ * computed once, at construction. Most draws are accepted by the
+ * cheap squeeze test `k - x <= cut`, costing one log1p and one exp.
+ * It takes any uniform random bit generator, including the engines of
+ * rng_engines.h, and N up to 2^63.
+ *
+ * Example usage: a skewed workload over ten billion keys.
+ *
+ *    xoshiro256ss eng(42);
+ *    zipf_rejection_distribution<uint64_t> zipf(10000000000ULL, 0.99);
+ *    uint64_t key = zipf(eng);
+ */
+template<class IntType = uint64_t, class RealType = double>
+class zipf_rejection_distribution
+{
+	public:
+		typedef IntType result_type;
+
+		static_assert(std::numeric_limits<IntType>::is_integer, "");
+		static_assert(!std::numeric_limits<RealType>::is_integer, "");
+
+		/// zipf_rejection_distribution(N, s)
+		/// Zipf distribution for `N` items, in the range `[1,N]` inclusive.
+		/// The distribution follows the power-law 1/n^s with exponent `s`.
+		zipf_rejection_distribution(const IntType n, const RealType s=1.0)
+			: _n(n), _s(s)
+		{
+			if (n < 1)
+				throw std::runtime_error("Range error: Parameter N must be at least 1!");
+			if (not (0 < s))
+				throw std::runtime_error("Range error: Parameter s must be positive!");
+			_H_x1 = H(1.5) - 1.0;
+			_H_n = H(RealType(n) + 0.5);
+			_cut = 2.0 - H_inv(H(2.5) - h(2.0));
+		}
+		void reset() {}
+
+		template<class URBG>
+		IntType operator()(URBG& rng)
+		{
+			while (true)
+			{
+				// u is uniform between H(x_1) and H(n + 1/2)
+				const RealType u = _H_n + unit(rng) * (_H_x1 - _H_n);
+				const RealType x = H_inv(u);
+				IntType k = IntType(x + 0.5);
+				if (k < 1) k = 1;
+				else if (k > _n) k = _n;
+				if (k - x <= _cut or u >= H(k + 0.5) - h(k))
+					return k;
+			}
+		}
+
+		/// Returns the parameter the distribution was constructed with.
+		RealType s() const { return _s; }
+		/// Returns the minimum value potentially generated by the distribution.
+		result_type min() const { return 1; }
+		/// Returns the maximum value potentially generated by the distribution.
+		result_type max() const { return _n; }
+
+	private:
+		IntType    _n;     ///< Number of elements
+		RealType   _s;     ///< Exponent
+		RealType   _H_x1;  ///< H(3/2) - h(1)
+		RealType   _H_n;   ///< H(n + 1/2)
+		RealType   _cut;   ///< squeeze for the acceptance test
+
+		template<class URBG>
+		static RealType unit(URBG& rng)
+		{
+			return std::generate_canonical<RealType,
+				std::numeric_limits<RealType>::digits>(rng);
+		}
+		static RealType unit(xoshiro256ss& rng) { return rand_unit(rng); }
+		static RealType unit(pcg64& rng) { return rand_unit(rng); }
+		static RealType unit(wyrand& rng) { return rand_unit(rng); }
+		static RealType unit(philox4x32& rng) { return rand_unit(rng); }
+
+		/** log(1 + x) / x, also near 0 */
+		static RealType log1pxbx(const RealType x)
+		{
+			if (std::abs(x) > 1e-8)
+				return std::log1p(x) / x;
+			return 1.0 - x * (0.5 - x * (1/3.0 - 0.25 * x));
+		}
+
+		/** (exp(x) - 1) / x, also near 0 */
+		static RealType expxm1bx(const RealType x)
+		{
+			if (std::abs(x) > 1e-8)
+				return std::expm1(x) / x;
+			return 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+		}
+
+		/** The hat function h(x) = 1/x^s */
+		RealType h(const RealType x) const
+		{
+			return std::exp(-_s * std::log(x));
+		}
+
+		/** H(x) = (x^(1-s) - 1) / (1-s), or log(x) if s == 1 */
+		RealType H(const RealType x) const
+		{
+			const RealType log_x = std::log(x);
+			return expxm1bx((1.0 - _s) * log_x) * log_x;
+		}
+
+		/** The inverse function of H(x). */
+		RealType H_inv(const RealType y) const
+		{
+			RealType t = y * (1.0 - _s);
+			if (t < -1.0) t = -1.0;
+			return std::exp(log1pxbx(t) * y);
+		}
+};
+
 /** @}*/
 } // ~namespace opencog
 
@@ -0,0 +1,140 @@
+/*
+ * tests/benchmark/algorithm_bench.cc
+ *
+ * Benchmarks for the set algorithms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <vector>
+
+#include <opencog/util/algorithm.h>
+#include <opencog/util/comprehension.h>
+#include <opencog/util/rng_engines.h>
+
+#include "bench.h"
+
+using namespace opencog;
+
+namespace {
+
+// About n unique integers below 4n, sorted
+std::vector<unsigned> random_set(size_t n, uint64_t seed)
+{
+    splitmix64 eng(seed);
+    std::vector<unsigned> v(n);
+    for (unsigned& x : v) x = eng() % (4 * n);
+    std::sort(v.begin(), v.end());
+    v.erase(std::unique(v.begin(), v.end()), v.end());
+    return v;
+}
+
+// Items are input elements.
+void bm_set_intersection_std_set(bench::state& st)
+{
+    std::vector<unsigned> a = random_set(st.arg(), 1), b = random_set(st.arg(), 2);
+    std::set<unsigned> sa(a.begin(), a.end()), sb(b.begin(), b.end());
+    while (st.next())
+        bench::do_not_optimize(set_intersection(sa, sb).size());
+    st.set_items(st.iterations() * (a.size() + b.size()));
+}
+
+void bm_set_intersection_std_vector(bench::state& st)
+{
+    std::vector<unsigned> a = random_set(st.arg(), 1), b = random_set(st.arg(), 2);
+    std::vector<unsigned> res;
+    while (st.next())
+    {
+        res.clear();
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                              std::back_inserter(res));
+        bench::do_not_optimize(res.data());
+    }
+    st.set_items(st.iterations() * (a.size() + b.size()));
+}
+
+// On the threads set by setting_omp()
+void bm_set_intersection_vector(bench::state& st)
+{
+    std::vector<unsigned> a = random_set(st.arg(), 1), b = random_set(st.arg(), 2);
+    while (st.next())
+        bench::do_not_optimize(set_intersection(a, b).data());
+    st.set_items(st.iterations() * (a.size() + b.size()));
+}
+
+void bm_set_union_vector(bench::state& st)
+{
+    std::vector<unsigned> a = random_set(st.arg(), 1), b = random_set(st.arg(), 2);
+    while (st.next())
+        bench::do_not_optimize(set_union(a, b).data());
+    st.set_items(st.iterations() * (a.size() + b.size()));
+}
+
+// Map, filter, map: items are input elements.
+void bm_comp_chained(bench::state& st)
+{
+    std::vector<unsigned> a = random_set(st.arg(), 1);
+    while (st.next())
+    {
+        auto sq = vector_comp(a, [](unsigned x) { return uint64_t(x) * x; });
+        auto odd = vector_comp(sq, [](uint64_t x) { return x + 1; },
+                               [](uint64_t x) { return x % 2; });
+        bench::do_not_optimize(odd.data());
+    }
+    st.set_items(st.iterations() * a.size());
+}
+
+void bm_comp_view(bench::state& st)
+{
+    std::vector<unsigned> a = random_set(st.arg(), 1);
+    auto view = comp_view(a)
+        | comp_map([](unsigned x) { return uint64_t(x) * x; })
+        | comp_filter([](uint64_t x) { return x % 2; })
+        | comp_map([](uint64_t x) { return x + 1; });
+    while (st.next())
+        bench::do_not_optimize(view.to_vector().data());
+    st.set_items(st.iterations() * a.size());
+}
+
+// On the threads set by setting_omp()
+void bm_comp_view_parallel(bench::state& st)
+{
+    std::vector<unsigned> a = random_set(st.arg(), 1);
+    auto view = comp_view(a)
+        | comp_map([](unsigned x) { return uint64_t(x) * x; })
+        | comp_filter([](uint64_t x) { return x % 2; })
+        | comp_map([](uint64_t x) { return x + 1; });
+    while (st.next())
+        bench::do_not_optimize(view.parallel_collect().data());
+    st.set_items(st.iterations() * a.size());
+}
+
+bool registered =
+    bench::add("comp_chained", bm_comp_chained, 1 << 18) and
+    bench::add("comp_view", bm_comp_view, 1 << 18) and
+    bench::add("comp_view_parallel", bm_comp_view_parallel, 1 << 18) and
+    bench::add("set_intersection_std_set", bm_set_intersection_std_set,
+               1 << 18) and
+    bench::add("set_intersection_std_vector", bm_set_intersection_std_vector,
+               1 << 18) and
+    bench::add("set_intersection_vector", bm_set_intersection_vector,
+               1 << 18) and
+    bench::add("set_union_vector", bm_set_union_vector, 1 << 18);
+
+} // ~namespace
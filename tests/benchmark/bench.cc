@@ -0,0 +1,144 @@
+/*
+ * tests/benchmark/bench.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "bench.h"
+
+namespace {
+
+struct entry
+{
+    std::string name;
+    bench::function f;
+    long arg;
+};
+
+std::vector<entry>& registry()
+{
+    static std::vector<entry> r;
+    return r;
+}
+
+void usage(const char* prog)
+{
+    printf("Usage: %s [--filter=SUBSTRING] [--format=console|csv|json]\n"
+           "          [--min-time=SECONDS] [--list]\n", prog);
+}
+
+} // ~namespace
+
+bool bench::add(const std::string& name, function f, long arg)
+{
+    std::string full = name;
+    if (arg) full += "/" + std::to_string(arg);
+    registry().push_back({full, f, arg});
+    return true;
+}
+
+int bench::run(int argc, char* argv[])
+{
+    std::string filter, format = "console";
+    double min_time = 0.2;
+    bool list = false;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* a = argv[i];
+        if (0 == strncmp(a, "--filter=", 9)) filter = a + 9;
+        else if (0 == strncmp(a, "--format=", 9)) format = a + 9;
+        else if (0 == strncmp(a, "--min-time=", 11)) min_time = atof(a + 11);
+        else if (0 == strcmp(a, "--list")) list = true;
+        else { usage(argv[0]); return strcmp(a, "--help") ? 1 : 0; }
+    }
+    if (format != "console" and format != "csv" and format != "json")
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (format == "csv")
+        printf("name,iterations,ns_per_op,items_per_second,counters\n");
+    if (format == "json") printf("{\n  \"benchmarks\": [");
+    if (format == "console")
+        printf("%-48s %12s %14s %14s\n", "Benchmark", "Iterations", "ns/op", "items/s");
+
+    bool first = true;
+    for (const entry& e : registry())
+    {
+        if (e.name.find(filter) == std::string::npos) continue;
+        if (list) { if (format == "console") printf("%s\n", e.name.c_str()); continue; }
+
+        // Grow the iteration count until the loop runs for long enough.
+        size_t n = 1;
+        state st(n, e.arg);
+        while (true)
+        {
+            st = state(n, e.arg);
+            e.f(st);
+            double secs = st.seconds();
+            if (min_time <= secs or 1000000000 <= n) break;
+            double grow = (secs <= 0) ? 10 : 1.4 * min_time / secs;
+            n = std::max(n + 1, size_t(n * std::min(10.0, std::max(2.0, grow))));
+        }
+
+        double ns = 1e9 * st.seconds() / st.iterations();
+        double rate = st.items() ? st.items() / st.seconds() : 0;
+        if (format == "console")
+        {
+            printf("%-48s %12zu %14.1f %14.4g", e.name.c_str(), st.iterations(), ns, rate);
+            for (const auto& c : st.counters())
+                printf("  %s=%.4g", c.first.c_str(), c.second);
+            printf("\n");
+        }
+        else if (format == "csv")
+        {
+            printf("%s,%zu,%.1f,%.6g,", e.name.c_str(), st.iterations(), ns, rate);
+            const char* sep = "";
+            for (const auto& c : st.counters())
+            {
+                printf("%s%s=%.6g", sep, c.first.c_str(), c.second);
+                sep = ";";
+            }
+            printf("\n");
+        }
+        else
+        {
+            printf("%s\n    {\"name\": \"%s\", \"iterations\": %zu, "
+                   "\"real_time\": %.1f, \"time_unit\": \"ns\", "
+                   "\"items_per_second\": %.6g",
+                   first ? "" : ",", e.name.c_str(), st.iterations(), ns, rate);
+            for (const auto& c : st.counters())
+                printf(", \"%s\": %.6g", c.first.c_str(), c.second);
+            printf("}");
+        }
+        first = false;
+        fflush(stdout);
+    }
+    if (format == "json") printf("\n  ]\n}\n");
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    return bench::run(argc, argv);
+}
@@ -0,0 +1,118 @@
+/*
+ * tests/benchmark/bench.h
+ *
+ * A minimal microbenchmark harness, in the style of Google Benchmark.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_BENCH_H
+#define _OPENCOG_BENCH_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench
+{
+
+//! Handed to each benchmark; drives its timed loop.
+///
+/// A benchmark does any setup first, then runs the code to be measured
+/// in a loop, as in
+///
+///     void bm_copy(bench::state& st) {
+///         tree<int> tr = make_tree(st.arg());
+///         while (st.next()) {
+///             tree<int> cp(tr);
+///             bench::do_not_optimize(cp);
+///         }
+///         st.set_items(st.iterations() * tr.size());
+///     }
+///
+/// Only the loop is timed. The harness calls the benchmark again, with
+/// more iterations, until the loop runs for long enough.
+class state
+{
+public:
+    state(size_t iterations, long arg)
+        : _iterations(iterations), _left(iterations), _arg(arg), _items(0) {}
+
+    /// Return true while there are iterations left to run.
+    bool next()
+    {
+        if (_left == _iterations) _start = clock::now();
+        if (0 < _left--) return true;
+        _stop = clock::now();
+        return false;
+    }
+
+    size_t iterations() const { return _iterations; }
+
+    /// The argument that the benchmark was registered with.
+    long arg() const { return _arg; }
+
+    /// Report the number of items processed, for an items/sec rate.
+    void set_items(size_t n) { _items = n; }
+    size_t items() const { return _items; }
+
+    double seconds() const
+    { return std::chrono::duration<double>(_stop - _start).count(); }
+
+    /// Report another figure, such as a latency percentile; it is
+    /// printed after the rate, as name=value.
+    void set_counter(const std::string& name, double value)
+    {
+        for (auto& c : _counters)
+            if (c.first == name) { c.second = value; return; }
+        _counters.emplace_back(name, value);
+    }
+    const std::vector<std::pair<std::string, double>>& counters() const
+    { return _counters; }
+
+private:
+    typedef std::chrono::steady_clock clock;
+    size_t _iterations;
+    size_t _left;
+    long _arg;
+    size_t _items;
+    std::vector<std::pair<std::string, double>> _counters;
+    clock::time_point _start, _stop;
+};
+
+typedef std::function<void(state&)> function;
+
+/// Register a benchmark; the argument is passed on through state::arg,
+/// and shows in the name as "name/arg". Returns true, so that it can be
+/// used to initialise a static.
+bool add(const std::string& name, function f, long arg = 0);
+
+/// Run the registered benchmarks, as selected by the command line.
+int run(int argc, char* argv[]);
+
+/// Keep the compiler from optimising away the computation of v.
+template<typename T>
+inline void do_not_optimize(const T& v)
+{
+    asm volatile("" : : "g"(&v) : "memory");
+}
+
+} // namespace bench
+
+#endif // _OPENCOG_BENCH_H
@@ -0,0 +1,285 @@
+/*
+ * tests/benchmark/cache_bench.cc
+ *
+ * Benchmarks for the caches of lru_cache.h, replaying key traces:
+ * synthetic Zipf streams, and recorded ones.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <opencog/util/hashing.h>
+#include <opencog/util/Logger.h>
+#include <opencog/util/lru_cache.h>
+#include <opencog/util/platform.h>
+#include <opencog/util/rng_engines.h>
+#include <opencog/util/zipf.h>
+
+#include "bench.h"
+
+using namespace opencog;
+
+// Each benchmark replays a whole trace per iteration, into a new cache,
+// so that the hit ratio is that of a cold start, and reports, on top
+// of the rate of lookups:
+//  - hit%: the hits, out of all lookups;
+//  - ns/lookup;
+//  - B/entry: the heap grown by the cache, over its number of entries
+//    at the end of the first replay;
+// and for the thread safe caches, the first two with the trace split
+// over 1 to 8 threads, sharing one cache. adaptive_cache wraps a
+// sharded_lru_cache; inf_cache, unlimited, gives the best hit ratio
+// possible on each trace.
+//
+// The traces are Zipf streams of exponents 0.8 and 1.1, and one of
+// exponent 1 interrupted by scans of keys that are used only once.
+// To replay a recorded trace, set COGUTIL_CACHE_TRACE to a file of
+// keys, one per line (any text; equal lines are equal keys). The
+// caches are then run at sizes holding 1% and 10% of its distinct
+// keys, with names such as "cache/arc_cache/trace/1%". The sizes of
+// the synthetic traces are 1k and 8k entries, out of 128k keys.
+
+namespace {
+
+const size_t LOOKUPS = 1 << 18;
+const size_t KEYS = 1 << 17;
+
+typedef std::vector<uint64_t> trace;
+
+// What is cached; cheap, so that the ns/lookup are those of the cache.
+struct compute
+{
+    typedef uint64_t argument_type;
+    typedef uint64_t result_type;
+    uint64_t operator()(const uint64_t& x) const { return hash_u64(x); }
+};
+
+trace zipf_trace(double s, uint64_t seed)
+{
+    zipf_distribution<uint64_t> zipf(KEYS, s);
+    xoshiro256ss eng(seed);
+    trace t(LOOKUPS);
+    for (uint64_t& k : t) k = zipf(eng);
+    return t;
+}
+
+// Every 16k lookups, a scan of 4k keys that are never seen again.
+trace scan_trace()
+{
+    trace t = zipf_trace(1.0, 3);
+    uint64_t fresh = KEYS + 1;
+    for (size_t i = 1 << 14; i + (1 << 12) <= t.size(); i += 1 << 14)
+        for (size_t j = 0; j < (1 << 12); j++) t[i + j] = fresh++;
+    return t;
+}
+
+// The lines of the file, numbered in order of first appearance; so
+// that the keys hash alike, whatever the file holds.
+bool load_trace(const char* path, trace& t, size_t& distinct)
+{
+    std::ifstream in(path);
+    if (not in) return false;
+    std::unordered_map<std::string, uint64_t> ids;
+    std::string line;
+    while (std::getline(in, line))
+        t.push_back(ids.emplace(line, ids.size()).first->second);
+    distinct = ids.size();
+    return not t.empty();
+}
+
+// A cache of about n entries, of the given type; the caches that
+// need other arguments are specialised below.
+template<typename Cache>
+struct policy
+{
+    Cache cache;
+    explicit policy(size_t n) : cache(n) {}
+    uint64_t operator()(uint64_t x) const { return cache(x); }
+    const inf_cache_base& base() const { return cache; }
+};
+
+// The budget is in bytes; give it room for n of the default entries.
+template<>
+struct policy<budget_lru_cache<compute>>
+{
+    budget_lru_cache<compute> cache;
+    explicit policy(size_t n)
+        : cache(n * entry_sizeof<uint64_t, uint64_t>()(0, 0)) {}
+    uint64_t operator()(uint64_t x) const { return cache(x); }
+    const inf_cache_base& base() const { return cache; }
+};
+
+// Unlimited; the upper bound on the hit ratio of the others.
+template<>
+struct policy<inf_cache<compute>>
+{
+    inf_cache<compute> cache;
+    explicit policy(size_t) {}
+    uint64_t operator()(uint64_t x) const { return cache(x); }
+    const inf_cache_base& base() const { return cache; }
+};
+
+template<>
+struct policy<adaptive_cache<sharded_lru_cache<compute>>>
+{
+    sharded_lru_cache<compute> inner;
+    adaptive_cache<sharded_lru_cache<compute>> cache;
+    explicit policy(size_t n) : inner(n), cache(inner) {}
+    uint64_t operator()(uint64_t x) const { return cache(x); }
+    const inf_cache_base& base() const { return inner; }
+};
+
+void report(bench::state& st, const trace& t, const inf_cache_base& c)
+{
+    size_t lookups = st.iterations() * t.size();
+    cache_stats cs = c.get_stats();
+    st.set_items(lookups);
+    st.set_counter("hit%", 100.0 * cs.hits / (cs.hits + cs.misses));
+    st.set_counter("ns/lookup", 1e9 * st.seconds() / lookups);
+}
+
+template<typename Policy>
+void bm_replay(bench::state& st, const trace* t, size_t n)
+{
+    std::unique_ptr<Policy> p;
+    double bytes_per_entry = 0;
+    while (st.next())
+    {
+        bool first = not p;
+        p.reset();
+        uint64_t heap = get_memory_sample(0).heap_allocated;
+        p.reset(new Policy(n));
+        uint64_t sum = 0;
+        for (uint64_t k : *t) sum += (*p)(k);
+        bench::do_not_optimize(sum);
+        if (first)
+        {
+            size_t entries = p->base().get_stats().size;
+            uint64_t grown = get_memory_sample(0).heap_allocated - heap;
+            if (entries) bytes_per_entry = double(grown) / entries;
+        }
+    }
+    report(st, *t, p->base());
+    st.set_counter("B/entry", bytes_per_entry);
+}
+
+// The trace split over the threads, round robin, into one cache.
+template<typename Policy>
+void bm_shared(bench::state& st, const trace* t, size_t n, unsigned threads)
+{
+    std::unique_ptr<Policy> p;
+    while (st.next())
+    {
+        p.reset(new Policy(n));
+        std::vector<std::thread> ths;
+        for (unsigned i = 0; i < threads; i++)
+            ths.emplace_back([&, i] {
+                uint64_t sum = 0;
+                for (size_t j = i; j < t->size(); j += threads)
+                    sum += (*p)((*t)[j]);
+                bench::do_not_optimize(sum);
+            });
+        for (std::thread& th : ths) th.join();
+    }
+    report(st, *t, p->base());
+}
+
+struct workload
+{
+    std::string name;
+    trace keys;
+    size_t sizes[2];
+    std::string size_names[2];
+};
+
+std::vector<workload>& workloads()
+{
+    static std::vector<workload> w;
+    return w;
+}
+
+// Unlimited caches are run once per trace, rather than at each size.
+template<typename Cache>
+void add_policy(const std::string& name, bool thread_safe,
+                bool limited = true)
+{
+    for (const workload& w : workloads())
+        for (int i = 0; i < (limited ? 2 : 1); i++)
+        {
+            const trace* t = &w.keys;
+            size_t n = w.sizes[i];
+            std::string bm = "cache/" + name + "/" + w.name + "/"
+                + (limited ? w.size_names[i] : "all");
+            bench::add(bm, [=](bench::state& st) {
+                bm_replay<policy<Cache>>(st, t, n); });
+            if (not thread_safe) continue;
+            for (unsigned th : {1, 2, 4, 8})
+                bench::add(bm + "/t" + std::to_string(th),
+                           [=](bench::state& st) {
+                               bm_shared<policy<Cache>>(st, t, n, th); });
+        }
+}
+
+bool add_all()
+{
+    // The caches log their creation and their hits, at INFO.
+    logger().set_level(Logger::WARN);
+
+    std::vector<workload>& w = workloads();
+    w.push_back({"zipf0.8", zipf_trace(0.8, 1), {1 << 10, 1 << 13}, {"1k", "8k"}});
+    w.push_back({"zipf1.1", zipf_trace(1.1, 2), {1 << 10, 1 << 13}, {"1k", "8k"}});
+    w.push_back({"zipf+scan", scan_trace(), {1 << 10, 1 << 13}, {"1k", "8k"}});
+
+    if (const char* path = getenv("COGUTIL_CACHE_TRACE"))
+    {
+        trace t;
+        size_t distinct = 0;
+        if (load_trace(path, t, distinct))
+        {
+            size_t small = std::max<size_t>(1, distinct / 100);
+            size_t large = std::max<size_t>(1, distinct / 10);
+            w.push_back({"trace", std::move(t), {small, large}, {"1%", "10%"}});
+        }
+        else
+            fprintf(stderr, "Cannot read the trace in %s; skipping it\n", path);
+    }
+
+    add_policy<lru_cache<compute>>("lru_cache", false);
+    add_policy<slab_lru_cache<compute>>("slab_lru_cache", false);
+    add_policy<budget_lru_cache<compute>>("budget_lru_cache", false);
+    add_policy<clock_cache<compute>>("clock_cache", false);
+    add_policy<arc_cache<compute>>("arc_cache", false);
+    add_policy<prr_cache<compute>>("prr_cache", false);
+    add_policy<lru_cache_threaded<compute>>("lru_cache_threaded", true);
+    add_policy<prr_cache_threaded<compute>>("prr_cache_threaded", true);
+    add_policy<sharded_lru_cache<compute>>("sharded_lru_cache", true);
+    add_policy<adaptive_cache<sharded_lru_cache<compute>>>(
+        "adaptive_cache", true);
+    add_policy<inf_cache<compute>>("inf_cache", true, false);
+    return true;
+}
+
+bool registered = add_all();
+
+} // ~namespace
@@ -0,0 +1,137 @@
+/*
+ * tests/benchmark/cluster_bench.cc
+ *
+ * Benchmarks for the C clustering library.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cstdlib>
+#include <vector>
+
+extern "C" {
+#include <opencog/util/cluster.h>
+}
+
+#include <opencog/util/random_fill.h>
+#include <opencog/util/rng_engines.h>
+
+#include "bench.h"
+
+using namespace opencog;
+
+namespace {
+
+const int ncols = 16;
+
+// arg rows of ncols normal deviates, in 8 blobs.
+struct dataset
+{
+    std::vector<double> values;
+    std::vector<int> ones;
+    std::vector<double*> data;
+    std::vector<int*> mask;
+    std::vector<double> weight;
+
+    dataset(int nrows)
+        : values(nrows * ncols), ones(nrows * ncols, 1), weight(ncols, 1.0)
+    {
+        xoshiro256ss eng(1);
+        fill_normal(values, 0, 1, eng);
+        for (int i = 0; i < nrows; i++)
+        {
+            values[i * ncols + i % ncols] += 5 * (i % 8);
+            data.push_back(&values[i * ncols]);
+            mask.push_back(&ones[i * ncols]);
+        }
+    }
+};
+
+// Items are distances.
+void bm_distancematrix(bench::state& st)
+{
+    const int n = st.arg();
+    dataset ds(n);
+    while (st.next())
+    {
+        double** m = distancematrix(n, ncols, ds.data.data(), ds.mask.data(),
+                                    ds.weight.data(), 'e', 0);
+        for (int i = 1; i < n; i++) free(m[i]);
+        free(m);
+    }
+    st.set_items(st.iterations() * n * (n - 1) / 2);
+}
+
+// Same, from the row-major buffer, with no mask.
+void bm_distancematrix_rowmajor(bench::state& st)
+{
+    const int n = st.arg();
+    dataset ds(n);
+    while (st.next())
+    {
+        double** m = distancematrix_rowmajor(n, ncols, ds.values.data(), NULL,
+                                             ncols, ds.weight.data(), 'e', 0);
+        for (int i = 1; i < n; i++) free(m[i]);
+        free(m);
+    }
+    st.set_items(st.iterations() * n * (n - 1) / 2);
+}
+
+// Items are rows, times passes.
+void bm_kcluster(bench::state& st)
+{
+    const int n = st.arg(), npass = 8;
+    dataset ds(n);
+    std::vector<int> clusterid(n);
+    while (st.next())
+    {
+        double error;
+        int ifound;
+        kcluster(8, n, ncols, ds.data.data(), ds.mask.data(),
+                 ds.weight.data(), 0, npass, 'a', 'e', clusterid.data(),
+                 &error, &ifound);
+        bench::do_not_optimize(error);
+    }
+    st.set_items(st.iterations() * n * npass);
+}
+
+// Items are rows, times iterations over batches of 1024.
+void bm_kcluster_minibatch(bench::state& st)
+{
+    const int n = st.arg(), niter = 100;
+    dataset ds(n);
+    std::vector<int> clusterid(n);
+    std::vector<double> centers(8 * ncols);
+    std::vector<double*> cdata;
+    for (int k = 0; k < 8; k++) cdata.push_back(&centers[k * ncols]);
+    while (st.next())
+    {
+        double error;
+        kcluster_minibatch(8, n, ncols, ds.data.data(), NULL,
+                           ds.weight.data(), 1024, niter, 'e',
+                           clusterid.data(), cdata.data(), &error);
+        bench::do_not_optimize(error);
+    }
+    st.set_items(st.iterations() * n);
+}
+
+bool registered =
+    bench::add("distancematrix", bm_distancematrix, 2000) and
+    bench::add("distancematrix_rowmajor", bm_distancematrix_rowmajor, 2000) and
+    bench::add("kcluster", bm_kcluster, 10000) and
+    bench::add("kcluster_minibatch", bm_kcluster_minibatch, 100000);
+
+} // ~namespace
@@ -0,0 +1,357 @@
+/*
+ * tests/benchmark/concurrent_bench.cc
+ *
+ * Benchmarks for the concurrent containers, the pools, and the
+ * asynchronous writers, under contention.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <opencog/util/async_buffer.h>
+#include <opencog/util/async_method_caller.h>
+#include <opencog/util/concurrent_bounded_queue.h>
+#include <opencog/util/concurrent_queue.h>
+#include <opencog/util/concurrent_set.h>
+#include <opencog/util/concurrent_stack.h>
+#include <opencog/util/latency_histogram.h>
+#include <opencog/util/pool.h>
+
+#include "bench.h"
+
+using namespace opencog;
+
+// Each benchmark moves N items per iteration, through P producer and
+// C consumer threads (started anew each iteration), and reports, on
+// top of the rate of items:
+//  - p50_us and p99_us: the time from push to pop (or the wait for a
+//    resource, for the pools), of one item in 16;
+//  - waits/item: the voluntary context switches of the process, per
+//    item. A thread that blocks on a contended lock or an empty queue
+//    sleeps on a futex, which is one switch; so this counts the waits
+//    without needing perf counters. For the time spent in them, run
+//    under "perf trace -s" or "perf lock".
+
+namespace {
+
+const size_t N = 1 << 16;
+
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+long context_switches()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_nvcsw;
+}
+
+struct probe
+{
+    latency_histogram latency;
+    long switches = context_switches();
+
+    void record(size_t seq, uint64_t since)
+    {
+        if (0 == (seq & 15)) latency.record(now_ns() - since);
+    }
+
+    void report(bench::state& st, size_t per_iteration = N)
+    {
+        size_t items = st.iterations() * per_iteration;
+        st.set_items(items);
+        if (latency.count())
+        {
+            st.set_counter("p50_us", latency.percentile(0.5) / 1000);
+            st.set_counter("p99_us", latency.percentile(0.99) / 1000);
+        }
+        st.set_counter("waits/item",
+                       double(context_switches() - switches) / items);
+    }
+};
+
+// An element of S bytes, stamped with its sequence number and the
+// time it was pushed.
+template<size_t S>
+struct payload
+{
+    uint64_t seq = 0;
+    uint64_t stamp = 0;
+    char pad[S - 2 * sizeof(uint64_t)] = {};
+};
+
+std::string config(size_t size, unsigned producers, unsigned consumers)
+{
+    std::string s = size ? std::to_string(size) + "B/" : "";
+    return s + "p" + std::to_string(producers) + "c" + std::to_string(consumers);
+}
+
+// concurrent_queue, concurrent_stack and concurrent_bounded_queue; the
+// last consumer to pop cancels the container, which wakes the others.
+template<typename Queue, size_t S>
+void bm_queue(bench::state& st, unsigned producers, unsigned consumers)
+{
+    probe pr;
+    while (st.next())
+    {
+        Queue q;
+        std::atomic<size_t> left(N);
+        std::vector<std::thread> threads;
+        for (unsigned c = 0; c < consumers; c++)
+            threads.emplace_back([&] {
+                payload<S> x;
+                try {
+                    while (true)
+                    {
+                        q.pop(x);
+                        pr.record(x.seq, x.stamp);
+                        if (1 == left.fetch_sub(1)) q.cancel();
+                    }
+                }
+                catch (const typename Queue::Canceled&) {}
+            });
+        for (unsigned p = 0; p < producers; p++)
+            threads.emplace_back([&, p] {
+                payload<S> x;
+                for (size_t i = p; i < N; i += producers)
+                {
+                    x.seq = i;
+                    x.stamp = now_ns();
+                    q.push(x);
+                }
+            });
+        for (std::thread& t : threads) t.join();
+    }
+    pr.report(st);
+}
+
+// Distinct keys, so that none are merged.
+void bm_set(bench::state& st, unsigned producers, unsigned consumers)
+{
+    probe pr;
+    while (st.next())
+    {
+        concurrent_set<uint64_t> s;
+        std::atomic<size_t> left(N);
+        std::vector<std::thread> threads;
+        for (unsigned c = 0; c < consumers; c++)
+            threads.emplace_back([&] {
+                uint64_t x;
+                try {
+                    while (true)
+                    {
+                        s.get(x);
+                        if (1 == left.fetch_sub(1)) s.cancel();
+                    }
+                }
+                catch (const concurrent_set<uint64_t>::Canceled&) {}
+            });
+        for (unsigned p = 0; p < producers; p++)
+            threads.emplace_back([&, p] {
+                for (size_t i = p; i < N; i += producers) s.insert(i);
+            });
+        for (std::thread& t : threads) t.join();
+    }
+    pr.report(st);
+}
+
+// Threads borrowing and giving back one of a few resources; the
+// latency is the wait for it.
+void bm_pool(bench::state& st, unsigned threads, unsigned resources)
+{
+    probe pr;
+    while (st.next())
+    {
+        pool<int> p;
+        for (unsigned r = 0; r < resources; r++) p.give_back(r);
+        std::vector<std::thread> ths;
+        for (unsigned t = 0; t < threads; t++)
+            ths.emplace_back([&, t] {
+                for (size_t i = t; i < N; i += threads)
+                {
+                    uint64_t start = now_ns();
+                    int r = p.borrow();
+                    pr.record(i, start);
+                    p.give_back(r);
+                }
+            });
+        for (std::thread& t : ths) t.join();
+    }
+    pr.report(st);
+}
+
+void bm_resource_pool(bench::state& st, unsigned threads, unsigned resources)
+{
+    probe pr;
+    while (st.next())
+    {
+        int next = 0;
+        resource_pool<int> p([&next] { return next++; }, resources, resources);
+        std::vector<std::thread> ths;
+        for (unsigned t = 0; t < threads; t++)
+            ths.emplace_back([&, t] {
+                for (size_t i = t; i < N; i += threads)
+                {
+                    uint64_t start = now_ns();
+                    resource_pool<int>::handle h = p.get();
+                    pr.record(i, start);
+                }
+            });
+        for (std::thread& t : ths) t.join();
+    }
+    pr.report(st);
+}
+
+template<typename Element>
+struct sink
+{
+    std::atomic<size_t> written{0};
+    void write(const Element&) { written++; }
+};
+
+// Producers enqueue, then wait for the writers with barrier(). The
+// latencies are those of the telemetry of the writer: enqueue to
+// written.
+template<size_t S>
+void bm_async_caller(bench::state& st, unsigned producers, unsigned writers,
+                     size_t high, size_t low)
+{
+    typedef payload<S> elt;
+    sink<elt> w;
+    async_caller<sink<elt>, elt> ac(&w, &sink<elt>::write, writers);
+    ac.set_watermarks(high, low);
+    probe pr;
+    while (st.next())
+    {
+        std::vector<std::thread> threads;
+        for (unsigned p = 0; p < producers; p++)
+            threads.emplace_back([&, p] {
+                elt x;
+                for (size_t i = p; i < N; i += producers)
+                {
+                    x.seq = i;
+                    ac.enqueue(x);
+                }
+            });
+        for (std::thread& t : threads) t.join();
+        ac.barrier();
+    }
+    pr.report(st);
+    async_telemetry tm = ac.get_telemetry();
+    st.set_counter("p50_us", tm.p50_usec);
+    st.set_counter("p99_us", tm.p99_usec);
+    st.set_counter("busy", tm.busy_ratio);
+}
+
+// Each iteration inserts new keys, so that none are merged.
+void bm_async_buffer(bench::state& st, unsigned producers, unsigned writers,
+                     size_t high, size_t low)
+{
+    sink<uint64_t> w;
+    async_buffer<sink<uint64_t>, uint64_t> ab(&w, &sink<uint64_t>::write,
+                                              writers);
+    ab.set_watermarks(high, low);
+    probe pr;
+    uint64_t base = 0;
+    while (st.next())
+    {
+        std::vector<std::thread> threads;
+        for (unsigned p = 0; p < producers; p++)
+            threads.emplace_back([&, p] {
+                for (size_t i = p; i < N; i += producers) ab.insert(base + i);
+            });
+        for (std::thread& t : threads) t.join();
+        ab.barrier();
+        base += N;
+    }
+    pr.report(st);
+    async_telemetry tm = ab.get_telemetry();
+    st.set_counter("p50_us", tm.p50_usec);
+    st.set_counter("p99_us", tm.p99_usec);
+    st.set_counter("busy", tm.busy_ratio);
+}
+
+const unsigned pc[][2] = { {1, 1}, {4, 1}, {1, 4}, {4, 4} };
+
+// Default watermarks, and ones high enough that producers never block.
+const size_t watermarks[][2] = { {DEFAULT_HIGH_WATER_MARK,
+                                  DEFAULT_LOW_WATER_MARK},
+                                 {100000, 10000} };
+
+template<size_t S>
+bool add_queues()
+{
+    for (const auto& c : pc)
+    {
+        unsigned prod = c[0], cons = c[1];
+        std::string cfg = config(S, prod, cons);
+        bench::add("concurrent_queue/" + cfg, [=](bench::state& st) {
+            bm_queue<concurrent_queue<payload<S>>, S>(st, prod, cons); });
+        bench::add("concurrent_stack/" + cfg, [=](bench::state& st) {
+            bm_queue<concurrent_stack<payload<S>>, S>(st, prod, cons); });
+        bench::add("concurrent_bounded_queue/" + cfg, [=](bench::state& st) {
+            bm_queue<concurrent_bounded_queue<payload<S>>, S>(st, prod, cons); });
+    }
+    return true;
+}
+
+bool add_all()
+{
+    add_queues<16>();
+    add_queues<256>();
+    for (const auto& c : pc)
+    {
+        unsigned prod = c[0], cons = c[1];
+        bench::add("concurrent_set/" + config(0, prod, cons),
+                   [=](bench::state& st) { bm_set(st, prod, cons); });
+    }
+    for (unsigned t : {1, 4, 16})
+        for (unsigned r : {1, 4})
+        {
+            std::string cfg = "t" + std::to_string(t) + "r" + std::to_string(r);
+            bench::add("pool/" + cfg,
+                       [=](bench::state& st) { bm_pool(st, t, r); });
+            bench::add("resource_pool/" + cfg,
+                       [=](bench::state& st) { bm_resource_pool(st, t, r); });
+        }
+    for (const auto& c : pc)
+        for (const auto& wm : watermarks)
+        {
+            unsigned prod = c[0], writers = c[1];
+            size_t hi = wm[0], lo = wm[1];
+            std::string cfg = "p" + std::to_string(prod)
+                + "w" + std::to_string(writers) + "/hwm" + std::to_string(hi);
+            bench::add("async_caller/64B/" + cfg, [=](bench::state& st) {
+                bm_async_caller<64>(st, prod, writers, hi, lo); });
+            bench::add("async_buffer/" + cfg, [=](bench::state& st) {
+                bm_async_buffer(st, prod, writers, hi, lo); });
+        }
+    return true;
+}
+
+bool registered = add_all();
+
+} // ~namespace
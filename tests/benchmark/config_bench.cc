@@ -0,0 +1,62 @@
+/*
+ * tests/benchmark/config_bench.cc
+ *
+ * Benchmarks for the reads of Config parameters.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string>
+
+#include <opencog/util/Config.h>
+
+#include "bench.h"
+
+using namespace opencog;
+
+namespace {
+
+// A config of arg parameters, read in a key among them
+Config& make_config(long n)
+{
+    static Config cfg;
+    cfg.reset();
+    for (long i = 0; i < n; i++)
+        cfg.set("PARAM_" + std::to_string(i), std::to_string(i));
+    return cfg;
+}
+
+void bm_config_get_int(bench::state& st)
+{
+    Config& cfg = make_config(st.arg());
+    const std::string key = "PARAM_" + std::to_string(st.arg() / 2);
+    while (st.next())
+        bench::do_not_optimize(cfg.get_int(key));
+}
+
+void bm_config_param_int(bench::state& st)
+{
+    Config& cfg = make_config(st.arg());
+    config_param<int> p("PARAM_" + std::to_string(st.arg() / 2), 0, cfg);
+    while (st.next())
+        bench::do_not_optimize(p());
+}
+
+bool registered =
+    bench::add("config_get_int", bm_config_get_int, 64) and
+    bench::add("config_param_int", bm_config_param_int, 64);
+
+} // ~namespace
@@ -0,0 +1,136 @@
+/*
+ * tests/benchmark/counter_bench.cc
+ *
+ * Benchmarks for Counter, flat_counter, sharded_counter and the
+ * sketches.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <vector>
+
+#include <opencog/util/Counter.h>
+#include <opencog/util/flat_counter.h>
+#include <opencog/util/random_fill.h>
+#include <opencog/util/rng_engines.h>
+#include <opencog/util/sharded_counter.h>
+#include <opencog/util/sketches.h>
+
+#include "bench.h"
+
+using namespace opencog;
+
+namespace {
+
+const size_t N = 100000;
+
+// N values out of arg distinct keys.
+std::vector<int> make_values(long n_keys)
+{
+    std::vector<int> v(N);
+    xoshiro256ss eng(1);
+    fill_randint(v, n_keys, eng);
+    return v;
+}
+
+void bm_counter_count(bench::state& st)
+{
+    std::vector<int> v = make_values(st.arg());
+    while (st.next())
+    {
+        Counter<int, unsigned> c(v);
+        bench::do_not_optimize(c);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+void bm_flat_counter_count(bench::state& st)
+{
+    std::vector<int> v = make_values(st.arg());
+    while (st.next())
+    {
+        flat_counter<int, unsigned> c(v);
+        bench::do_not_optimize(c);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+void bm_parallel_count(bench::state& st)
+{
+    std::vector<int> v = make_values(st.arg());
+    while (st.next())
+    {
+        Counter<int, unsigned> c = parallel_count(v.begin(), v.end());
+        bench::do_not_optimize(c);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+// Items are elements added.
+template<typename Sketch>
+void bm_sketch_add(bench::state& st)
+{
+    std::vector<int> v = make_values(N);
+    while (st.next())
+    {
+        Sketch sk;
+        sk.add(v.begin(), v.end());
+        bench::do_not_optimize(sk);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+// Items are keys merged.
+template<typename C>
+void bm_add(bench::state& st)
+{
+    std::vector<int> v = make_values(st.arg());
+    C a(v.begin(), v.begin() + N / 2), b(v.begin() + N / 2, v.end());
+    while (st.next())
+    {
+        C c = a + b;
+        bench::do_not_optimize(c);
+    }
+    st.set_items(st.iterations() * (a.size() + b.size()));
+}
+
+template<typename C>
+void bm_total_count(bench::state& st)
+{
+    std::vector<int> v = make_values(st.arg());
+    C c(v);
+    while (st.next())
+    {
+        unsigned t = c.total_count();
+        bench::do_not_optimize(t);
+    }
+    st.set_items(st.iterations() * c.size());
+}
+
+bool registered =
+    bench::add("counter_count", bm_counter_count, 1000) and
+    bench::add("flat_counter_count", bm_flat_counter_count, 1000) and
+    bench::add("parallel_count", bm_parallel_count, 1000) and
+    bench::add("hyperloglog_add", bm_sketch_add<hyperloglog<int>>, 0) and
+    bench::add("minhash_add", bm_sketch_add<minhash<int>>, 0) and
+    bench::add("counter_add", bm_add<Counter<int, unsigned>>, 1000) and
+    bench::add("flat_counter_add", bm_add<flat_counter<int, unsigned>>, 1000) and
+    bench::add("counter_total_count",
+               bm_total_count<Counter<int, unsigned>>, 1000) and
+    bench::add("flat_counter_total_count",
+               bm_total_count<flat_counter<int, unsigned>>, 1000);
+
+} // ~namespace
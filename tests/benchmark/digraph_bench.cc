@@ -0,0 +1,89 @@
+/*
+ * tests/benchmark/digraph_bench.cc
+ *
+ * Benchmarks for the digraphs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include <opencog/util/digraph.h>
+#include <opencog/util/rng_engines.h>
+
+#include "bench.h"
+
+using namespace opencog;
+
+namespace {
+
+// A random dag of n nodes and about 8 arcs per node
+digraph random_dag(unsigned n)
+{
+    splitmix64 eng(1);
+    digraph g(n);
+    for (unsigned i = 0; i < 8 * n; i++) {
+        unsigned a = eng() % n, b = eng() % n;
+        if (a != b) g.insert(std::min(a, b), std::max(a, b));
+    }
+    return g;
+}
+
+// Items are nodes.
+void bm_digraph_topological_sort(bench::state& st)
+{
+    digraph g = random_dag(st.arg());
+    std::vector<unsigned> order;
+    while (st.next())
+    {
+        order.clear();
+        randomized_topological_sort(g, std::back_inserter(order));
+        bench::do_not_optimize(order.data());
+    }
+    st.set_items(st.iterations() * g.n_nodes());
+}
+
+void bm_csr_digraph_topological_sort(bench::state& st)
+{
+    csr_digraph g(random_dag(st.arg()));
+    std::vector<unsigned> order;
+    while (st.next())
+    {
+        order.clear();
+        g.topological_sort(std::back_inserter(order));
+        bench::do_not_optimize(order.data());
+    }
+    st.set_items(st.iterations() * g.n_nodes());
+}
+
+// On the threads set by setting_omp()
+void bm_csr_digraph_bfs(bench::state& st)
+{
+    csr_digraph g(random_dag(st.arg()));
+    while (st.next())
+        bench::do_not_optimize(g.bfs(0).data());
+    st.set_items(st.iterations() * g.n_nodes());
+}
+
+bool registered =
+    bench::add("digraph_topological_sort", bm_digraph_topological_sort,
+               100000) and
+    bench::add("csr_digraph_topological_sort",
+               bm_csr_digraph_topological_sort, 100000) and
+    bench::add("csr_digraph_bfs", bm_csr_digraph_bfs, 100000);
+
+} // ~namespace
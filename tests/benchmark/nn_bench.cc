@@ -0,0 +1,161 @@
+/*
+ * tests/benchmark/nn_bench.cc
+ *
+ * Benchmarks for the nearest neighbor searches.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include <opencog/util/Cover_Tree.h>
+#include <opencog/util/hnsw.h>
+#include <opencog/util/random_fill.h>
+#include <opencog/util/rng_engines.h>
+
+#include "bench.h"
+
+using namespace opencog;
+
+namespace {
+
+const int dim = 8;
+
+struct point
+{
+    std::array<double, dim> x;
+    double distance(const point& p) const
+    {
+        double s = 0;
+        for (int i = 0; i < dim; i++)
+            s += (x[i] - p.x[i]) * (x[i] - p.x[i]);
+        return std::sqrt(s);
+    }
+    bool operator==(const point& p) const { return x == p.x; }
+};
+
+// n points uniform in the unit cube
+std::vector<point> points(int n, uint64_t seed)
+{
+    xoshiro256ss eng(seed);
+    std::vector<double> v(n * dim);
+    fill_uniform(v.data(), v.size(), eng);
+    std::vector<point> ps(n);
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < dim; j++)
+            ps[i].x[j] = v[i * dim + j];
+    return ps;
+}
+
+const int nqueries = 256, k = 10;
+
+// Items are points.
+void bm_cover_tree_build(bench::state& st)
+{
+    std::vector<point> ps = points(st.arg(), 1);
+    while (st.next())
+    {
+        CoverTree<point> tree(std::sqrt(dim), ps);
+        bench::do_not_optimize(tree.get_root());
+    }
+    st.set_items(st.iterations() * ps.size());
+}
+
+void bm_cover_tree_insert(bench::state& st)
+{
+    std::vector<point> ps = points(st.arg(), 1);
+    while (st.next())
+    {
+        CoverTree<point> tree(std::sqrt(dim));
+        for (const point& p : ps) tree.insert(p);
+        bench::do_not_optimize(tree.get_root());
+    }
+    st.set_items(st.iterations() * ps.size());
+}
+
+// Items are queries.
+void bm_cover_tree_knn(bench::state& st)
+{
+    CoverTree<point> tree(std::sqrt(dim), points(st.arg(), 1));
+    std::vector<point> qs = points(nqueries, 2);
+    while (st.next())
+        for (const point& q : qs)
+            bench::do_not_optimize(tree.k_nearest_neighbors(q, k));
+    st.set_items(st.iterations() * nqueries);
+}
+
+void bm_frozen_cover_tree_knn(bench::state& st)
+{
+    CoverTree<point> tree(std::sqrt(dim), points(st.arg(), 1));
+    FrozenCoverTree<point> frozen(tree);
+    std::vector<point> qs = points(nqueries, 2);
+    while (st.next())
+        for (const point& q : qs)
+            bench::do_not_optimize(frozen.k_nearest_neighbors(q, k));
+    st.set_items(st.iterations() * nqueries);
+}
+
+// Into flat arrays, on the threads set by setting_omp()
+void bm_frozen_cover_tree_knn_batch(bench::state& st)
+{
+    CoverTree<point> tree(std::sqrt(dim), points(st.arg(), 1));
+    FrozenCoverTree<point> frozen(tree);
+    std::vector<point> qs = points(nqueries, 2);
+    std::vector<const point*> out(nqueries * k);
+    while (st.next())
+    {
+        frozen.k_nearest_neighbors_batch(qs.data(), nqueries, k, out.data());
+        bench::do_not_optimize(out.data());
+    }
+    st.set_items(st.iterations() * nqueries);
+}
+
+// Approximate, with the default ef
+void bm_hnsw_build(bench::state& st)
+{
+    std::vector<point> ps = points(st.arg(), 1);
+    while (st.next())
+    {
+        hnsw_index<point> index(ps);
+        bench::do_not_optimize(index.size());
+    }
+    st.set_items(st.iterations() * ps.size());
+}
+
+void bm_hnsw_knn(bench::state& st)
+{
+    std::vector<point> ps = points(st.arg(), 1);
+    hnsw_index<point> index(ps);
+    std::vector<point> qs = points(nqueries, 2);
+    while (st.next())
+        for (const point& q : qs)
+            bench::do_not_optimize(index.search(q, k));
+    st.set_items(st.iterations() * nqueries);
+}
+
+bool registered =
+    bench::add("cover_tree_build", bm_cover_tree_build, 20000) and
+    bench::add("cover_tree_insert", bm_cover_tree_insert, 20000) and
+    bench::add("cover_tree_knn", bm_cover_tree_knn, 20000) and
+    bench::add("frozen_cover_tree_knn", bm_frozen_cover_tree_knn, 20000) and
+    bench::add("frozen_cover_tree_knn_batch", bm_frozen_cover_tree_knn_batch,
+               20000) and
+    bench::add("hnsw_build", bm_hnsw_build, 20000) and
+    bench::add("hnsw_knn", bm_hnsw_knn, 20000);
+
+} // ~namespace
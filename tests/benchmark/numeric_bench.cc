@@ -0,0 +1,178 @@
+/*
+ * tests/benchmark/numeric_bench.cc
+ *
+ * Benchmarks for the distances of numeric.h.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cmath>
+#include <vector>
+
+#include <opencog/util/numeric.h>
+#include <opencog/util/random_fill.h>
+#include <opencog/util/rng_engines.h>
+
+#include "bench.h"
+
+using namespace opencog;
+
+namespace {
+
+template<typename T>
+std::vector<T> make_vector(size_t n, uint64_t seed)
+{
+    std::vector<double> d(n);
+    xoshiro256ss eng(seed);
+    fill_uniform(d, eng);
+    return std::vector<T>(d.begin(), d.end());
+}
+
+// The loop p_norm_distance used to run, for comparison.
+template<typename T>
+T scalar_euclidean(const std::vector<T>& a, const std::vector<T>& b)
+{
+    T sum = 0;
+    for (size_t i = 0; i < a.size(); i++) sum += sq(a[i] - b[i]);
+    return std::sqrt(sum);
+}
+
+template<typename T>
+void bm_euclidean_scalar(bench::state& st)
+{
+    std::vector<T> a = make_vector<T>(st.arg(), 1), b = make_vector<T>(st.arg(), 2);
+    while (st.next())
+    {
+        T d = scalar_euclidean(a, b);
+        bench::do_not_optimize(d);
+    }
+    st.set_items(st.iterations() * a.size());
+}
+
+template<typename T>
+void bm_p_norm_distance(bench::state& st, T p)
+{
+    std::vector<T> a = make_vector<T>(st.arg(), 1), b = make_vector<T>(st.arg(), 2);
+    while (st.next())
+    {
+        T d = p_norm_distance(a, b, p);
+        bench::do_not_optimize(d);
+    }
+    st.set_items(st.iterations() * a.size());
+}
+
+template<typename T>
+void bm_angular_distance(bench::state& st)
+{
+    std::vector<T> a = make_vector<T>(st.arg(), 1), b = make_vector<T>(st.arg(), 2);
+    while (st.next())
+    {
+        T d = angular_distance<std::vector<T>, T>(a, b);
+        bench::do_not_optimize(d);
+    }
+    st.set_items(st.iterations() * a.size());
+}
+
+// Items are bits.
+void bm_binary_tanimoto(bench::state& st)
+{
+    std::vector<uint64_t> a(st.arg() / 64), b(st.arg() / 64);
+    xoshiro256ss eng(1);
+    for (auto& w : a) w = eng();
+    for (auto& w : b) w = eng();
+    while (st.next())
+    {
+        double d = tanimoto_distance(a.data(), b.data(), a.size());
+        bench::do_not_optimize(d);
+    }
+    st.set_items(st.iterations() * st.arg());
+}
+
+// Items are bits.
+void bm_popcount(bench::state& st)
+{
+    std::vector<uint64_t> a(st.arg() / 64);
+    xoshiro256ss eng(1);
+    for (auto& w : a) w = eng();
+    while (st.next())
+    {
+        size_t n = popcount(a.data(), a.size());
+        bench::do_not_optimize(n);
+    }
+    st.set_items(st.iterations() * st.arg());
+}
+
+// A 512 x 512 matrix of distances between points of arg dimensions;
+// items are pairs.
+const size_t n_points = 512;
+
+template<void (*F)(const std::vector<float>&, size_t, std::vector<float>&)>
+void bm_pairwise(bench::state& st)
+{
+    size_t dim = st.arg();
+    std::vector<float> x = make_vector<float>(n_points * dim, 1),
+        out(n_points * n_points);
+    while (st.next())
+    {
+        F(x, dim, out);
+        bench::do_not_optimize(out);
+    }
+    st.set_items(st.iterations() * n_points * n_points);
+}
+
+void pairs_one_by_one(const std::vector<float>& x, size_t dim,
+                      std::vector<float>& out)
+{
+    for (size_t i = 0; i < n_points; i++)
+        for (size_t j = 0; j < n_points; j++)
+            out[i * n_points + j] =
+                p_norm_distance(&x[i * dim], &x[j * dim], dim, 2.0f);
+}
+
+void pairs_tiled(const std::vector<float>& x, size_t dim,
+                 std::vector<float>& out)
+{
+    pairwise_p_norm_distances(x.data(), n_points, x.data(), n_points, dim,
+                              2.0f, out.data());
+}
+
+void pairs_gemm(const std::vector<float>& x, size_t dim,
+                std::vector<float>& out)
+{
+    pairwise_euclidean_distances(x.data(), n_points, x.data(), n_points, dim,
+                                 out.data());
+}
+
+bool registered =
+    bench::add("euclidean_scalar/double", bm_euclidean_scalar<double>, 1024) and
+    bench::add("euclidean_scalar/float", bm_euclidean_scalar<float>, 1024) and
+    bench::add("p_norm_distance/2/double",
+               [](bench::state& st) { bm_p_norm_distance<double>(st, 2); }, 1024) and
+    bench::add("p_norm_distance/2/float",
+               [](bench::state& st) { bm_p_norm_distance<float>(st, 2); }, 1024) and
+    bench::add("p_norm_distance/1/float",
+               [](bench::state& st) { bm_p_norm_distance<float>(st, 1); }, 1024) and
+    bench::add("angular_distance/float", bm_angular_distance<float>, 1024) and
+    bench::add("tanimoto_distance/bits", bm_binary_tanimoto, 4096) and
+    bench::add("tanimoto_distance/bits", bm_binary_tanimoto, 65536) and
+    bench::add("popcount/bits", bm_popcount, 65536) and
+    bench::add("pairwise/one_by_one", bm_pairwise<pairs_one_by_one>, 64) and
+    bench::add("pairwise/one_by_one", bm_pairwise<pairs_one_by_one>, 512) and
+    bench::add("pairwise/p_norm", bm_pairwise<pairs_tiled>, 64) and
+    bench::add("pairwise/euclidean", bm_pairwise<pairs_gemm>, 64) and
+    bench::add("pairwise/euclidean", bm_pairwise<pairs_gemm>, 512);
+
+} // ~namespace
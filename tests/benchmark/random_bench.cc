@@ -0,0 +1,283 @@
+/*
+ * tests/benchmark/random_bench.cc
+ *
+ * Benchmarks for the random generators.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <opencog/util/alias_sampler.h>
+#include <opencog/util/indexed_set.h>
+#include <opencog/util/mt19937ar.h>
+#include <opencog/util/random.h>
+#include <opencog/util/random_fill.h>
+#include <opencog/util/rng_engines.h>
+
+#include "bench.h"
+
+using namespace opencog;
+
+namespace {
+
+const size_t N = 4096;
+
+// Through the virtual RandGen interface.
+void bm_randgen_randint(bench::state& st)
+{
+    RandGen& rng = randGen();
+    while (st.next())
+    {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < N; i++) sum += rng.randint(1000);
+        bench::do_not_optimize(sum);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+void bm_randgen_randdouble(bench::state& st)
+{
+    RandGen& rng = randGen();
+    while (st.next())
+    {
+        double sum = 0;
+        for (size_t i = 0; i < N; i++) sum += rng.randdouble();
+        bench::do_not_optimize(sum);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+template<typename Engine>
+void bm_engine_below(bench::state& st)
+{
+    Engine eng(1);
+    while (st.next())
+    {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < N; i++) sum += rand_below(eng, 1000);
+        bench::do_not_optimize(sum);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+template<typename Engine>
+void bm_engine_unit(bench::state& st)
+{
+    Engine eng(1);
+    while (st.next())
+    {
+        double sum = 0;
+        for (size_t i = 0; i < N; i++) sum += rand_unit(eng);
+        bench::do_not_optimize(sum);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+void bm_rand_element_randgen(bench::state& st)
+{
+    std::vector<int> v(st.arg(), 1);
+    RandGen& rng = randGen();
+    while (st.next())
+    {
+        long sum = 0;
+        for (size_t i = 0; i < N; i++) sum += rand_element(v, rng);
+        bench::do_not_optimize(sum);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+void bm_rand_element_engine(bench::state& st)
+{
+    std::vector<int> v(st.arg(), 1);
+    xoshiro256ss eng(1);
+    while (st.next())
+    {
+        long sum = 0;
+        for (size_t i = 0; i < N; i++) sum += rand_element(v, eng);
+        bench::do_not_optimize(sum);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+void bm_randgen_floats(bench::state& st)
+{
+    std::vector<float> v(N);
+    RandGen& rng = randGen();
+    while (st.next())
+    {
+        for (float& x : v) x = rng.randfloat();
+        bench::do_not_optimize(v);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+template<typename Engine>
+void bm_fill_uniform(bench::state& st)
+{
+    std::vector<float> v(N);
+    Engine eng(1);
+    while (st.next())
+    {
+        fill_uniform(v, eng);
+        bench::do_not_optimize(v);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+template<typename Engine>
+void bm_fill_randint(bench::state& st)
+{
+    std::vector<int> v(N);
+    Engine eng(1);
+    while (st.next())
+    {
+        fill_randint(v, 1000, eng);
+        bench::do_not_optimize(v);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+std::vector<double> make_weights(size_t n)
+{
+    std::vector<double> w(n);
+    xoshiro256ss eng(3);
+    fill_uniform(w, eng);
+    return w;
+}
+
+void bm_rand_discrete(bench::state& st)
+{
+    std::vector<double> w = make_weights(st.arg());
+    RandGen& rng = randGen();
+    while (st.next())
+    {
+        size_t sum = 0;
+        for (size_t i = 0; i < 256; i++) sum += rng.rand_discrete(w);
+        bench::do_not_optimize(sum);
+    }
+    st.set_items(st.iterations() * 256);
+}
+
+void bm_alias_sampler(bench::state& st)
+{
+    std::vector<double> w = make_weights(st.arg());
+    alias_sampler pick(w);
+    xoshiro256ss eng(1);
+    while (st.next())
+    {
+        size_t sum = 0;
+        for (size_t i = 0; i < 256; i++) sum += pick(eng);
+        bench::do_not_optimize(sum);
+    }
+    st.set_items(st.iterations() * 256);
+}
+
+void bm_gaussian_randgen(bench::state& st)
+{
+    std::vector<double> v(N);
+    RandGen& rng = randGen();
+    while (st.next())
+    {
+        for (double& x : v) x = gaussian_rand(0.0, 1.0, rng);
+        bench::do_not_optimize(v);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+template<typename Engine>
+void bm_fill_normal(bench::state& st)
+{
+    std::vector<double> v(N);
+    Engine eng(1);
+    while (st.next())
+    {
+        fill_normal(v, 0.0, 1.0, eng);
+        bench::do_not_optimize(v);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+template<typename Set>
+void bm_rand_element_set(bench::state& st)
+{
+    Set s;
+    for (long i = 0; i < st.arg(); i++) s.insert(i);
+    xoshiro256ss eng(1);
+    while (st.next())
+    {
+        long sum = 0;
+        for (size_t i = 0; i < 256; i++) sum += rand_element(s, eng);
+        bench::do_not_optimize(sum);
+    }
+    st.set_items(st.iterations() * 256);
+}
+
+void bm_randstr(bench::state& st)
+{
+    RandGen& rng = randGen();
+    while (st.next())
+    {
+        std::string s = randstr("node", 2, 16, rng);
+        bench::do_not_optimize(s);
+    }
+    st.set_items(st.iterations());
+}
+
+void bm_rand_id(bench::state& st)
+{
+    xoshiro256ss eng(1);
+    char buf[11];
+    while (st.next())
+    {
+        rand_id(buf, sizeof(buf), eng);
+        bench::do_not_optimize(buf);
+    }
+    st.set_items(st.iterations());
+}
+
+bool registered =
+    bench::add("randgen_randint", bm_randgen_randint) and
+    bench::add("randgen_randdouble", bm_randgen_randdouble) and
+    bench::add("rand_below/xoshiro256ss", bm_engine_below<xoshiro256ss>) and
+    bench::add("rand_below/pcg64", bm_engine_below<pcg64>) and
+    bench::add("rand_below/wyrand", bm_engine_below<wyrand>) and
+    bench::add("rand_unit/xoshiro256ss", bm_engine_unit<xoshiro256ss>) and
+    bench::add("rand_unit/pcg64", bm_engine_unit<pcg64>) and
+    bench::add("rand_unit/wyrand", bm_engine_unit<wyrand>) and
+    bench::add("rand_element/randgen", bm_rand_element_randgen, 1000) and
+    bench::add("rand_element/xoshiro256ss", bm_rand_element_engine, 1000) and
+    bench::add("randgen_floats", bm_randgen_floats) and
+    bench::add("fill_uniform/xoshiro256ss", bm_fill_uniform<xoshiro256ss>) and
+    bench::add("fill_uniform/xoshiro256x4", bm_fill_uniform<xoshiro256x4>) and
+    bench::add("fill_uniform/wyrand", bm_fill_uniform<wyrand>) and
+    bench::add("fill_randint/xoshiro256x4", bm_fill_randint<xoshiro256x4>) and
+    bench::add("fill_randint/wyrand", bm_fill_randint<wyrand>) and
+    bench::add("rand_discrete", bm_rand_discrete, 1000) and
+    bench::add("alias_sampler", bm_alias_sampler, 1000) and
+    bench::add("gaussian_rand/randgen", bm_gaussian_randgen) and
+    bench::add("fill_normal/xoshiro256ss", bm_fill_normal<xoshiro256ss>) and
+    bench::add("fill_normal/wyrand", bm_fill_normal<wyrand>) and
+    bench::add("rand_element/std::set",
+               bm_rand_element_set<std::set<long>>, 100000) and
+    bench::add("rand_element/indexed_set",
+               bm_rand_element_set<indexed_set<long>>, 100000) and
+    bench::add("randstr", bm_randstr) and
+    bench::add("rand_id", bm_rand_id);
+
+} // ~namespace
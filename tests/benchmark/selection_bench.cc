@@ -0,0 +1,101 @@
+/*
+ * tests/benchmark/selection_bench.cc
+ *
+ * Benchmarks for the selection of winners in a population.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <iterator>
+#include <vector>
+
+#include <opencog/util/mt19937ar.h>
+#include <opencog/util/random_fill.h>
+#include <opencog/util/rng_engines.h>
+#include <opencog/util/selection.h>
+
+#include "bench.h"
+
+using namespace opencog;
+
+namespace {
+
+// Each iteration draws as many winners as there are in the population.
+std::vector<double> make_population(size_t n)
+{
+    std::vector<double> pop(n);
+    xoshiro256ss eng(3);
+    fill_uniform(pop, eng);
+    return pop;
+}
+
+void bm_tournament_selection(bench::state& st)
+{
+    std::vector<double> pop = make_population(st.arg()), winners;
+    tournament_selection select(4);
+    while (st.next())
+    {
+        winners.clear();
+        select(pop.begin(), pop.end(), std::back_inserter(winners), pop.size());
+        bench::do_not_optimize(winners);
+    }
+    st.set_items(st.iterations() * pop.size());
+}
+
+void bm_tournament_select_n(bench::state& st)
+{
+    std::vector<double> pop = make_population(st.arg()), winners(pop.size());
+    tournament_selection select(4);
+    while (st.next())
+    {
+        select.select_n(pop.begin(), pop.end(), winners.begin(), pop.size());
+        bench::do_not_optimize(winners);
+    }
+    st.set_items(st.iterations() * pop.size());
+}
+
+void bm_roulette_selection(bench::state& st)
+{
+    std::vector<double> pop = make_population(st.arg()), winners;
+    roulette_selection select;
+    while (st.next())
+    {
+        winners.clear();
+        select(pop.begin(), pop.end(), std::back_inserter(winners), pop.size());
+        bench::do_not_optimize(winners);
+    }
+    st.set_items(st.iterations() * pop.size());
+}
+
+void bm_roulette_select_n(bench::state& st)
+{
+    std::vector<double> pop = make_population(st.arg()), winners(pop.size());
+    roulette_selection select;
+    while (st.next())
+    {
+        select.select_n(pop.begin(), pop.end(), winners.begin(), pop.size());
+        bench::do_not_optimize(winners);
+    }
+    st.set_items(st.iterations() * pop.size());
+}
+
+bool registered =
+    bench::add("tournament_selection", bm_tournament_selection, 1000000) and
+    bench::add("tournament_select_n", bm_tournament_select_n, 1000000) and
+    bench::add("roulette_selection", bm_roulette_selection, 1000000) and
+    bench::add("roulette_select_n", bm_roulette_select_n, 1000000);
+
+} // ~namespace
@@ -0,0 +1,109 @@
+/*
+ * tests/benchmark/stats_bench.cc
+ *
+ * Benchmarks for the statistical tests.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include <opencog/util/Counter.h>
+#include <opencog/util/MannWhitneyU.h>
+#include <opencog/util/online_stats.h>
+#include <opencog/util/random_fill.h>
+#include <opencog/util/rng_engines.h>
+
+#include "bench.h"
+
+using namespace opencog;
+
+namespace {
+
+// Sorted sample of n numbers in [0, 1000).
+std::vector<double> make_sample(size_t n, uint64_t seed)
+{
+    std::vector<double> v(n);
+    xoshiro256ss eng(seed);
+    fill_uniform(v.data(), n, 0.0, 1000.0, eng);
+    std::sort(v.begin(), v.end());
+    return v;
+}
+
+// Items are elements of both samples.
+void bm_mann_whitney_counter(bench::state& st)
+{
+    std::vector<double> x1 = make_sample(st.arg(), 1),
+        x2 = make_sample(st.arg(), 2);
+    Counter<double, double> c1(x1), c2(x2);
+    while (st.next())
+    {
+        double z = standardizedMannWhitneyU(c1, c2);
+        bench::do_not_optimize(z);
+    }
+    st.set_items(st.iterations() * 2 * st.arg());
+}
+
+void bm_mann_whitney_sorted(bench::state& st)
+{
+    std::vector<double> x1 = make_sample(st.arg(), 1),
+        x2 = make_sample(st.arg(), 2);
+    while (st.next())
+    {
+        double z = standardizedMannWhitneyU(x1.data(), x1.size(),
+                                            x2.data(), x2.size());
+        bench::do_not_optimize(z);
+    }
+    st.set_items(st.iterations() * 2 * st.arg());
+}
+
+// The 99th percentile of arg numbers, unsorted; items are numbers.
+void bm_quantile_sort(bench::state& st)
+{
+    std::vector<double> x(st.arg());
+    xoshiro256ss eng(1);
+    fill_uniform(x.data(), x.size(), 0.0, 1000.0, eng);
+    while (st.next())
+    {
+        std::vector<double> v(x);
+        std::sort(v.begin(), v.end());
+        bench::do_not_optimize(v[v.size() * 99 / 100]);
+    }
+    st.set_items(st.iterations() * st.arg());
+}
+
+void bm_quantile_tdigest(bench::state& st)
+{
+    std::vector<double> x(st.arg());
+    xoshiro256ss eng(1);
+    fill_uniform(x.data(), x.size(), 0.0, 1000.0, eng);
+    while (st.next())
+    {
+        tdigest d;
+        d.add(x.begin(), x.end());
+        bench::do_not_optimize(d.quantile(0.99));
+    }
+    st.set_items(st.iterations() * st.arg());
+}
+
+bool registered =
+    bench::add("mann_whitney_u/counter", bm_mann_whitney_counter, 10000) and
+    bench::add("mann_whitney_u/sorted", bm_mann_whitney_sorted, 10000) and
+    bench::add("quantile/sort", bm_quantile_sort, 1000000) and
+    bench::add("quantile/tdigest", bm_quantile_tdigest, 1000000);
+
+} // ~namespace
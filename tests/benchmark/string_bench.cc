@@ -0,0 +1,203 @@
+/*
+ * tests/benchmark/string_bench.cc
+ *
+ * Benchmarks for the string utilities.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+#include <opencog/util/StringTokenizer.h>
+#include <opencog/util/hashing.h>
+#include <opencog/util/iostreamContainer.h>
+#include <opencog/util/misc.h>
+#include <opencog/util/rng_engines.h>
+
+#include "bench.h"
+
+using namespace opencog;
+
+namespace {
+
+// 100000 words of 1 to 12 letters, separated by spaces and commas.
+// Items are tokens.
+const size_t N = 100000;
+const std::string delims = " ,\n";
+
+std::string make_text()
+{
+    xoshiro256ss eng(1);
+    std::string s;
+    for (size_t i = 0; i < N; i++)
+    {
+        s.append(1 + eng() % 12, 'a' + eng() % 26);
+        s += eng() % 8 ? " " : ", ";
+    }
+    return s;
+}
+
+void bm_tokenize(bench::state& st)
+{
+    std::string s = make_text();
+    while (st.next())
+    {
+        std::vector<std::string> toks;
+        tokenize(s, std::back_inserter(toks), delims);
+        bench::do_not_optimize(toks.data());
+    }
+    st.set_items(st.iterations() * N);
+}
+
+void bm_alt_string_tokenizer(bench::state& st)
+{
+    std::string s = make_text();
+    while (st.next())
+    {
+        AltStringTokenizer toks(s, delims);
+        bench::do_not_optimize(toks.data());
+    }
+    st.set_items(st.iterations() * N);
+}
+
+void bm_string_view_tokenizer(bench::state& st)
+{
+    std::string s = make_text();
+    while (st.next())
+    {
+        size_t len = 0;
+        for (std::string_view tok : string_view_tokenizer(s, delims))
+            len += tok.size();
+        bench::do_not_optimize(len);
+    }
+    st.set_items(st.iterations() * N);
+}
+
+// N doubles of all magnitudes; items are numbers.
+std::vector<double> make_doubles()
+{
+    xoshiro256ss eng(1);
+    std::vector<double> v(N);
+    for (double& x : v) x = double(eng() >> 11) / (1 + eng() % 100000);
+    return v;
+}
+
+void bm_ostream_operator(bench::state& st)
+{
+    std::vector<double> v = make_doubles();
+    while (st.next())
+    {
+        std::ostringstream ss;
+        for (double x : v) ss << x << ' ';
+        bench::do_not_optimize(ss.str().size());
+    }
+    st.set_items(st.iterations() * N);
+}
+
+void bm_ostream_container(bench::state& st)
+{
+    std::vector<double> v = make_doubles();
+    while (st.next())
+    {
+        std::ostringstream ss;
+        ostream_container(ss, v);
+        bench::do_not_optimize(ss.str().size());
+    }
+    st.set_items(st.iterations() * N);
+}
+
+void bm_istream_container(bench::state& st)
+{
+    std::ostringstream os;
+    ostream_container(os, make_doubles());
+    const std::string text = os.str();
+    while (st.next())
+    {
+        std::istringstream ss(text);
+        std::vector<double> v;
+        istream_container(ss, std::back_inserter(v));
+        bench::do_not_optimize(v.data());
+    }
+    st.set_items(st.iterations() * N);
+}
+
+void bm_container_binary(bench::state& st)
+{
+    std::vector<double> v = make_doubles();
+    while (st.next())
+    {
+        std::stringstream ss;
+        ostream_container_binary(ss, v);
+        std::vector<double> w;
+        istream_container_binary(ss, w);
+        bench::do_not_optimize(w.data());
+    }
+    st.set_items(st.iterations() * N);
+}
+
+// Lookups of the N words of the text in a map of them; items are
+// lookups.
+template<typename Hash>
+void bm_string_map(bench::state& st)
+{
+    std::vector<std::string> words;
+    tokenize(make_text(), std::back_inserter(words), delims);
+    boost::unordered_map<std::string, size_t, Hash> m;
+    for (size_t i = 0; i < words.size(); i++) m.emplace(words[i], i);
+    while (st.next())
+    {
+        size_t sum = 0;
+        for (const std::string& w : words) sum += m.find(w)->second;
+        bench::do_not_optimize(sum);
+    }
+    st.set_items(st.iterations() * words.size());
+}
+
+// Hashes of arg bytes; items are bytes.
+template<typename Hash>
+void bm_string_hash(bench::state& st)
+{
+    std::string s(st.arg(), 'x');
+    Hash hash;
+    while (st.next())
+    {
+        size_t h = hash(s);
+        bench::do_not_optimize(h);
+        s[0]++;
+    }
+    st.set_items(st.iterations() * st.arg());
+}
+
+bool registered =
+    bench::add("tokenize", bm_tokenize) and
+    bench::add("alt_string_tokenizer", bm_alt_string_tokenizer) and
+    bench::add("string_view_tokenizer", bm_string_view_tokenizer) and
+    bench::add("ostream_operator", bm_ostream_operator) and
+    bench::add("ostream_container", bm_ostream_container) and
+    bench::add("istream_container", bm_istream_container) and
+    bench::add("container_binary", bm_container_binary) and
+    bench::add("string_map/boost_hash", bm_string_map<boost::hash<std::string>>) and
+    bench::add("string_map/fast_hash", bm_string_map<fast_hash<std::string>>) and
+    bench::add("string_hash/boost_hash", bm_string_hash<boost::hash<std::string>>, 256) and
+    bench::add("string_hash/fast_hash", bm_string_hash<fast_hash<std::string>>, 256);
+
+} // ~namespace
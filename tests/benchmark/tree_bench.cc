@@ -0,0 +1,267 @@
+/*
+ * tests/benchmark/tree_bench.cc
+ *
+ * Benchmarks for tree.h, and the alternative tree layouts.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencog/util/flat_tree.h>
+#include <opencog/util/hashing.h>
+#include <opencog/util/tree.h>
+#include <opencog/util/tree_arena.h>
+#include <opencog/util/tree_builder.h>
+#include <opencog/util/tree_serialize.h>
+
+#include "bench.h"
+
+using namespace opencog;
+
+namespace {
+
+enum shape { BUSHY, DEEP, RANDOM };
+const char* shape_names[] = { "bushy", "deep", "random" };
+
+// The pre-order form of a tree of n nodes, of the given shape:
+// bushy trees have eight children per node, filled breadth first;
+// deep trees are a long spine, with one leaf hanging off each spine
+// node; random trees attach each node to a random earlier node.
+preorder_seq<int> make_seq(shape sh, size_t n)
+{
+    std::vector<size_t> parent(n, 0);
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 1; i < n; i++)
+    {
+        if (BUSHY == sh) parent[i] = (i - 1) / 8;
+        else if (DEEP == sh) parent[i] = (i % 2) ? (i - 1) : (i - 2);
+        else
+        {
+            seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+            parent[i] = seed % i;
+        }
+    }
+
+    // Children lists, then a pre-order walk.
+    std::vector<std::vector<size_t>> kids(n);
+    for (size_t i = 1; i < n; i++) kids[parent[i]].push_back(i);
+    preorder_seq<int> seq;
+    seq.reserve(n);
+    std::vector<size_t> todo{0};
+    while (not todo.empty())
+    {
+        size_t i = todo.back();
+        todo.pop_back();
+        seq.emplace_back(int(i % 1000), kids[i].size());
+        todo.insert(todo.end(), kids[i].rbegin(), kids[i].rend());
+    }
+    return seq;
+}
+
+template<typename Alloc = std::allocator<tree_node_<int>>>
+tree<int, Alloc> make_tree(shape sh, size_t n)
+{
+    return build_tree<int, Alloc>(make_seq(sh, n));
+}
+
+tree<std::string> to_string_tree(const tree<int>& tr)
+{
+    tree<std::string> st;
+    tree_convert(tr, st);
+    return st;
+}
+
+// Append, node by node, the way most code builds trees.
+void bm_build(bench::state& st, shape sh)
+{
+    preorder_seq<int> seq = make_seq(sh, st.arg());
+    while (st.next())
+    {
+        tree<int> tr;
+        std::vector<std::pair<tree<int>::iterator, unsigned>> open;
+        for (const auto& node : seq)
+        {
+            tree<int>::iterator it = open.empty()
+                ? tr.insert(tr.end(), node.first)
+                : tr.append_child(open.back().first, node.first);
+            if (not open.empty() and 0 == --open.back().second) open.pop_back();
+            if (node.second) open.emplace_back(it, node.second);
+        }
+        bench::do_not_optimize(tr);
+    }
+    st.set_items(st.iterations() * seq.size());
+}
+
+void bm_build_tree(bench::state& st, shape sh)
+{
+    preorder_seq<int> seq = make_seq(sh, st.arg());
+    while (st.next())
+    {
+        tree<int> tr = build_tree(seq);
+        bench::do_not_optimize(tr);
+    }
+    st.set_items(st.iterations() * seq.size());
+}
+
+void bm_build_arena(bench::state& st, shape sh)
+{
+    preorder_seq<int> seq = make_seq(sh, st.arg());
+    tree_arena arena(sizeof(tree_node_<int>));
+    arena_scope<int> scope(arena);
+    while (st.next())
+    {
+        {
+            arena_tree<int> tr = build_tree<int, arena_allocator<tree_node_<int>>>(seq);
+            bench::do_not_optimize(tr);
+        }
+        arena.reset();
+    }
+    st.set_items(st.iterations() * seq.size());
+}
+
+void bm_copy(bench::state& st, shape sh)
+{
+    tree<int> tr = make_tree(sh, st.arg());
+    while (st.next())
+    {
+        tree<int> cp(tr);
+        bench::do_not_optimize(cp);
+    }
+    st.set_items(st.iterations() * tr.size());
+}
+
+void bm_pre_order(bench::state& st, shape sh)
+{
+    tree<int> tr = make_tree(sh, st.arg());
+    while (st.next())
+    {
+        long sum = 0;
+        for (auto it = tr.begin(); it != tr.end(); ++it) sum += *it;
+        bench::do_not_optimize(sum);
+    }
+    st.set_items(st.iterations() * tr.size());
+}
+
+void bm_post_order(bench::state& st, shape sh)
+{
+    tree<int> tr = make_tree(sh, st.arg());
+    while (st.next())
+    {
+        long sum = 0;
+        for (auto it = tr.begin_post(); it != tr.end_post(); ++it) sum += *it;
+        bench::do_not_optimize(sum);
+    }
+    st.set_items(st.iterations() * tr.size());
+}
+
+void bm_flat_pre_order(bench::state& st, shape sh)
+{
+    flat_tree<int> ft(make_tree(sh, st.arg()));
+    while (st.next())
+    {
+        long sum = 0;
+        for (int x : ft) sum += x;
+        bench::do_not_optimize(sum);
+    }
+    st.set_items(st.iterations() * ft.size());
+}
+
+void bm_hash_value(bench::state& st, shape sh)
+{
+    tree<int> tr = make_tree(sh, st.arg());
+    while (st.next())
+    {
+        size_t h = hash_value(tr);
+        bench::do_not_optimize(h);
+    }
+    st.set_items(st.iterations() * tr.size());
+}
+
+void bm_print(bench::state& st, shape sh)
+{
+    tree<std::string> tr = to_string_tree(make_tree(sh, st.arg()));
+    while (st.next())
+    {
+        std::stringstream ss;
+        ss << tr;
+        bench::do_not_optimize(ss);
+    }
+    st.set_items(st.iterations() * tr.size());
+}
+
+void bm_parse(bench::state& st, shape sh)
+{
+    std::stringstream ss;
+    ss << to_string_tree(make_tree(sh, st.arg()));
+    std::string str = ss.str();
+    while (st.next())
+    {
+        tree<std::string> tr = parse_tree(str);
+        bench::do_not_optimize(tr);
+    }
+    st.set_items(st.iterations() * st.arg());
+}
+
+void bm_serialize(bench::state& st, shape sh)
+{
+    tree<int> tr = make_tree(sh, st.arg());
+    while (st.next())
+    {
+        std::stringstream ss;
+        tree_writer<int>(ss).write(tr);
+        tree_reader<int> r(ss);
+        tree<int> back;
+        r.read(back);
+        bench::do_not_optimize(back);
+    }
+    st.set_items(st.iterations() * tr.size());
+}
+
+bool register_all()
+{
+    struct { const char* name; void (*f)(bench::state&, shape); } benches[] = {
+        {"tree_build", bm_build},
+        {"tree_build_tree", bm_build_tree},
+        {"tree_build_arena", bm_build_arena},
+        {"tree_copy", bm_copy},
+        {"tree_pre_order", bm_pre_order},
+        {"tree_post_order", bm_post_order},
+        {"flat_tree_pre_order", bm_flat_pre_order},
+        {"tree_hash_value", bm_hash_value},
+        {"tree_print", bm_print},
+        {"tree_parse", bm_parse},
+        {"tree_serialize", bm_serialize},
+    };
+    for (const auto& b : benches)
+        for (shape sh : {BUSHY, DEEP, RANDOM})
+            for (long n : {64, 4096, 262144})
+            {
+                // Deep trees are printed and parsed recursively.
+                if (DEEP == sh and 4096 < n and
+                    (b.f == bm_print or b.f == bm_parse)) continue;
+                auto f = b.f;
+                bench::add(std::string(b.name) + "/" + shape_names[sh],
+                           [f, sh](bench::state& st) { f(st, sh); }, n);
+            }
+    return true;
+}
+
+bool registered = register_all();
+
+} // ~namespace
@@ -0,0 +1,70 @@
+/*
+ * tests/benchmark/zipf_bench.cc
+ *
+ * Benchmarks for the Zipf distributions of zipf.h.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <random>
+
+#include <opencog/util/rng_engines.h>
+#include <opencog/util/zipf.h>
+
+#include "bench.h"
+
+using namespace opencog;
+
+namespace {
+
+const size_t DRAWS = 1024;
+
+// The argument is N; s is 1, the usual worst case for the rejection
+// samplers.
+template<typename Dist, typename Engine>
+void bm_zipf(bench::state& st)
+{
+    Dist zipf(st.arg(), 1.0);
+    Engine eng(1);
+    while (st.next())
+    {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < DRAWS; i++) sum += zipf(eng);
+        bench::do_not_optimize(sum);
+    }
+    st.set_items(st.iterations() * DRAWS);
+}
+
+typedef zipf_distribution<uint64_t> zipf;
+typedef zipf_table_distribution<uint64_t> zipf_table;
+typedef zipf_rejection_distribution<uint64_t> zipf_rejection;
+
+bool register_all()
+{
+    for (long n : {30L, 1000L, 1000000L})
+        bench::add("zipf_table/mt19937", bm_zipf<zipf_table, std::mt19937>, n);
+    for (long n : {30L, 1000L, 1000000L, 10000000000L})
+    {
+        bench::add("zipf/mt19937", bm_zipf<zipf, std::mt19937>, n);
+        bench::add("zipf_rejection/mt19937", bm_zipf<zipf_rejection, std::mt19937>, n);
+        bench::add("zipf_rejection/xoshiro256ss", bm_zipf<zipf_rejection, xoshiro256ss>, n);
+    }
+    return true;
+}
+
+bool registered = register_all();
+
+} // ~namespace